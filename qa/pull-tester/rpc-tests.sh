@@ -47,9 +47,12 @@ testScripts=(
     'mempool_nu_activation.py'
     'mempool_tx_expiry.py'
     'httpbasics.py'
+    'rpcstats.py'
+    'prometheus.py'
     'zapwallettxes.py'
     'proxy_test.py'
     'merkle_blocks.py'
+    'compactblocks.py'
     'fundrawtransaction.py'
     'signrawtransactions.py'
     'signrawtransaction_offline.py'
@@ -58,8 +61,11 @@ testScripts=(
     'nodehandling.py'
     'reindex.py'
     'addressindex.py'
+    'addressbalanceindex.py'
+    'addressindexpaging.py'
     'timestampindex.py'
     'spentindex.py'
+    'coinsupplyindex.py'
     'decodescript.py'
     'blockchain.py'
     'disablewallet.py'
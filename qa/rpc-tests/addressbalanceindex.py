@@ -0,0 +1,107 @@
+#!/usr/bin/env python2
+# Copyright (c) 2023 The Elosys developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that -addressbalanceindex answers getaddressbalance like the full
+# address index does, across reorgs and after a background build.
+#
+# Node 1 runs with the balance index from the start, node 2 with the address
+# index only until it is restarted with the balance index enabled.
+#
+
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes, \
+    initialize_chain_clean, start_node, stop_node
+
+
+class AddressBalanceIndexTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 3)
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug", "-relaypriority=0"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug", "-addressindex", "-addressbalanceindex"]))
+        self.nodes.append(start_node(2, self.options.tmpdir, ["-debug", "-addressindex"]))
+        connect_nodes(self.nodes[0], 1)
+        connect_nodes(self.nodes[0], 2)
+        self.is_network_split = False
+        self.sync_all()
+
+    def check_balances(self, addresses):
+        for address in addresses:
+            indexed = self.nodes[1].getaddressbalance(address)
+            summed = self.nodes[2].getaddressbalance(address)
+            assert_equal(indexed, summed)
+
+    def run_test(self):
+        print "Mining blocks..."
+        self.nodes[0].generate(105)
+        self.sync_all()
+
+        addresses = [self.nodes[0].getnewaddress() for i in range(4)]
+
+        # Unknown addresses have an empty history in both modes
+        assert_equal(self.nodes[1].getaddressbalance(addresses[0]),
+                     {"balance": 0, "received": 0, "txcount": 0})
+        self.check_balances(addresses)
+
+        print "Testing credits and debits..."
+        for i, amount in enumerate([10, 15, 20]):
+            self.nodes[0].sendtoaddress(addresses[i % 2], amount)
+            self.nodes[0].generate(1)
+        self.sync_all()
+        self.check_balances(addresses)
+        balance = self.nodes[1].getaddressbalance(addresses[0])
+        assert_equal(balance["balance"], 30 * 100000000)
+        assert_equal(balance["received"], 30 * 100000000)
+        assert_equal(balance["txcount"], 2)
+
+        # Spend everything of the first address, most of it comes back as change
+        unspent = [u for u in self.nodes[0].listunspent() if u["address"] == addresses[0]]
+        inputs = [{"txid": u["txid"], "vout": u["vout"]} for u in unspent]
+        outputs = {addresses[2]: 5, addresses[0]: 24.9999}
+        rawtx = self.nodes[0].createrawtransaction(inputs, outputs)
+        signed = self.nodes[0].signrawtransaction(rawtx)
+        self.nodes[0].sendrawtransaction(signed["hex"], True)
+        self.nodes[0].generate(1)
+        self.sync_all()
+        self.check_balances(addresses)
+        balance = self.nodes[1].getaddressbalance(addresses[0])
+        assert_equal(balance["balance"], 249999 * 10000)
+        assert_equal(balance["txcount"], 3)
+
+        print "Testing reorg..."
+        tip = self.nodes[0].getbestblockhash()
+        for node in self.nodes:
+            node.invalidateblock(tip)
+        self.check_balances(addresses)
+        assert_equal(self.nodes[1].getaddressbalance(addresses[0])["txcount"], 2)
+        for node in self.nodes:
+            node.reconsiderblock(tip)
+        self.sync_all()
+        self.check_balances(addresses)
+
+        print "Testing background build..."
+        expected = [self.nodes[2].getaddressbalance(address) for address in addresses]
+        stop_node(self.nodes[2], 2)
+        self.nodes[2] = start_node(2, self.options.tmpdir, ["-debug", "-addressindex", "-addressbalanceindex"])
+        connect_nodes(self.nodes[0], 2)
+        # Blocks connected while the build runs are picked up as well
+        self.nodes[0].sendtoaddress(addresses[3], 7)
+        self.nodes[0].generate(1)
+        self.sync_all()
+        time.sleep(1)
+        self.check_balances(addresses)
+        assert_equal(self.nodes[2].getaddressbalance(addresses[1]), expected[1])
+        assert_equal(self.nodes[2].getaddressbalance(addresses[3])["balance"], 7 * 100000000)
+
+
+if __name__ == '__main__':
+    AddressBalanceIndexTest().main()
@@ -0,0 +1,98 @@
+#!/usr/bin/env python2
+# Copyright (c) 2023 The Elosys developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that walking getaddresstxids, getaddressdeltas and getaddressutxos
+# page by page with "limit" and "cursor" returns the unpaged results.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, connect_nodes, \
+    initialize_chain_clean, start_node
+
+
+class AddressIndexPagingTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug", "-relaypriority=0"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug", "-addressindex"]))
+        connect_nodes(self.nodes[0], 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def walk(self, method, query, key, limit, reverse=False):
+        """Collect all pages of a paged query"""
+        items = []
+        request = dict(query, limit=limit, reverse=reverse)
+        while True:
+            page = getattr(self.nodes[1], method)(request)
+            assert len(page[key]) <= limit
+            items += page[key]
+            if "next" not in page:
+                return items
+            assert_equal(len(page[key]), limit)
+            request = dict(query, limit=limit, cursor=page["next"])
+
+    def run_test(self):
+        print "Mining blocks..."
+        self.nodes[0].generate(105)
+        self.sync_all()
+
+        addresses = [self.nodes[0].getnewaddress() for i in range(2)]
+        for i in range(7):
+            self.nodes[0].sendtoaddress(addresses[i % 2], 1 + i)
+            if i % 3 == 2:
+                self.nodes[0].generate(1)
+        self.nodes[0].generate(1)
+        self.sync_all()
+
+        single = {"addresses": [addresses[0]]}
+        both = {"addresses": addresses}
+
+        print "Testing getaddressdeltas paging..."
+        deltas = self.nodes[1].getaddressdeltas(both)
+        for limit in [1, 2, 3, 100]:
+            assert_equal(self.walk("getaddressdeltas", both, "deltas", limit), deltas)
+        # Reversed pages walk each address from its newest record down
+        reverse = self.walk("getaddressdeltas", single, "deltas", 2, True)
+        assert_equal(reverse, list(reversed(self.nodes[1].getaddressdeltas(single))))
+
+        print "Testing getaddresstxids paging..."
+        txids = self.nodes[1].getaddresstxids(single)
+        for limit in [1, 2, 100]:
+            assert_equal(self.walk("getaddresstxids", single, "txids", limit), txids)
+        paged = self.walk("getaddresstxids", both, "txids", 2)
+        assert_equal(sorted(paged), sorted(self.nodes[1].getaddresstxids(both)))
+
+        print "Testing getaddressutxos paging..."
+        utxos = self.nodes[1].getaddressutxos(both)
+        key = lambda u: (u["address"], u["txid"], u["outputIndex"])
+        for limit in [1, 4]:
+            paged = self.walk("getaddressutxos", both, "utxos", limit)
+            assert_equal(sorted(paged, key=key), sorted(utxos, key=key))
+
+        print "Testing invalid cursors..."
+        page = self.nodes[1].getaddressdeltas(dict(both, limit=1))
+        for method, query in [("getaddressutxos", both), ("getaddressdeltas", {"addresses": [addresses[1]]})]:
+            try:
+                getattr(self.nodes[1], method)(dict(query, cursor=page["next"]))
+                assert False, "cursor was accepted by %s" % method
+            except JSONRPCException as e:
+                assert "ursor" in e.error["message"]
+        try:
+            self.nodes[1].getaddressdeltas(dict(both, limit=0))
+            assert False, "zero limit was accepted"
+        except JSONRPCException as e:
+            assert "Limit" in e.error["message"]
+
+
+if __name__ == '__main__':
+    AddressIndexPagingTest().main()
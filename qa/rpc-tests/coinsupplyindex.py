@@ -0,0 +1,71 @@
+#!/usr/bin/env python2
+# Copyright (c) 2023 The Elosys developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that -coinsupplyindex answers coinsupply like the block by block sum
+# does, at every height and across reorgs.
+#
+# Node 1 runs with the coin supply index, node 0 sums the blocks.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes, \
+    initialize_chain_clean, start_node
+
+
+class CoinSupplyIndexTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug", "-coinsupplyindex"]))
+        connect_nodes(self.nodes[0], 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def check_supply(self, heights):
+        for height in heights:
+            summed = self.nodes[0].coinsupply(str(height))
+            indexed = self.nodes[1].coinsupply(str(height))
+            assert_equal(indexed["result"], "success")
+            assert "notarypay" not in summed
+            assert "burned" in indexed
+            for key in ["height", "supply", "zfunds", "sprout", "total"]:
+                assert_equal(indexed[key], summed[key])
+
+    def run_test(self):
+        print "Mining blocks..."
+        self.nodes[0].generate(105)
+        self.sync_all()
+        self.check_supply([1, 2, 50, 100, 105])
+        assert_equal(self.nodes[1].coinsupply()["height"], 105)
+
+        print "Testing spends..."
+        address = self.nodes[1].getnewaddress()
+        for amount in [10, 15]:
+            self.nodes[0].sendtoaddress(address, amount)
+            self.nodes[0].generate(1)
+        self.sync_all()
+        self.check_supply([105, 106, 107])
+
+        print "Testing reorg..."
+        tip = self.nodes[1].getbestblockhash()
+        supply = self.nodes[1].coinsupply()
+        self.nodes[0].invalidateblock(tip)
+        self.nodes[1].invalidateblock(tip)
+        assert_equal(self.nodes[1].coinsupply()["height"], 106)
+        self.check_supply([106])
+        self.nodes[0].reconsiderblock(tip)
+        self.nodes[1].reconsiderblock(tip)
+        assert_equal(self.nodes[1].coinsupply(), supply)
+        self.check_supply([107])
+
+
+if __name__ == '__main__':
+    CoinSupplyIndexTest().main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python2
+# Copyright (c) 2023 The Elosys developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test compact block relay and compare block propagation time with and
+# without it between two regtest nodes sharing a full mempool.
+#
+# Nodes 0/1 exchange compact blocks, nodes 2/3 run with -compactblocks=0.
+#
+
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_greater_than, \
+    connect_nodes, start_nodes, sync_blocks, sync_mempools
+
+NUM_TXS = 200
+NUM_ROUNDS = 3
+
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def setup_network(self, split=False):
+        args_cmpct = ["-debug=cmpctblock", "-debug=net", "-compactblocks=1"]
+        args_full = ["-debug=net", "-compactblocks=0"]
+        self.nodes = start_nodes(4, self.options.tmpdir,
+                                 [args_cmpct, args_cmpct, args_full, args_full])
+        connect_nodes(self.nodes[0], 1)
+        connect_nodes(self.nodes[2], 3)
+        self.is_network_split = True
+        self.sync_all()
+
+    def fill_mempool(self, sender, receiver):
+        address = receiver.getnewaddress()
+        for i in range(NUM_TXS):
+            sender.sendtoaddress(address, 0.01)
+
+    def propagation_time(self, miner, receiver):
+        """Mine a block on a full mempool and time until the receiver has it"""
+        self.fill_mempool(miner, receiver)
+        sync_mempools([miner, receiver])
+        assert_equal(len(receiver.getrawmempool()), NUM_TXS)
+
+        start = time.time()
+        blockhash = miner.generate(1)[0]
+        while receiver.getbestblockhash() != blockhash:
+            assert time.time() - start < 60, "block did not propagate"
+            time.sleep(0.005)
+        elapsed = time.time() - start
+
+        assert_equal(len(receiver.getblock(blockhash)["tx"]), NUM_TXS + 1)
+        assert_equal(len(receiver.getrawmempool()), 0)
+        return elapsed
+
+    def run_test(self):
+        # Both sides of each pair agree on the negotiated mode
+        for peer in self.nodes[0].getpeerinfo() + self.nodes[1].getpeerinfo():
+            assert_equal(peer["cmpctblocks"], True)
+        for peer in self.nodes[2].getpeerinfo() + self.nodes[3].getpeerinfo():
+            assert_equal(peer["cmpctblocks"], False)
+
+        cmpct_times = []
+        full_times = []
+        for i in range(NUM_ROUNDS):
+            cmpct_times.append(self.propagation_time(self.nodes[0], self.nodes[1]))
+            full_times.append(self.propagation_time(self.nodes[2], self.nodes[3]))
+        print "Propagation with compact blocks: %s" % ", ".join("%.3fs" % t for t in cmpct_times)
+        print "Propagation with full blocks:    %s" % ", ".join("%.3fs" % t for t in full_times)
+
+        # Once node 0 delivered a new tip, node 1 asks it to push blocks directly
+        assert_equal(self.nodes[1].getpeerinfo()[0]["cmpctblocks_hb"], False)
+        assert_equal(self.nodes[0].getpeerinfo()[0]["cmpctblocks_hb"], True)
+
+        # A block mined by the receiving side propagates the other way too
+        self.nodes[1].generate(1)
+        sync_blocks(self.nodes[:2])
+        assert_greater_than(self.nodes[0].getblockcount(), 200 + NUM_ROUNDS)
+
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
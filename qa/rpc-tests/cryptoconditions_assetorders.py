@@ -0,0 +1,104 @@
+#!/usr/bin/env python2
+# Copyright (c) 2023 The Elosys developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that -assetorderindex keeps the token orderbook sorted by price through
+# mempool, connected and disconnected blocks, and pages it with tokenorderbook.
+#
+
+from test_framework.test_framework import CryptoconditionsTestFramework
+from test_framework.util import assert_equal, assert_raises
+from cryptoconditions import assert_success
+
+
+class CryptoconditionsAssetOrdersTest(CryptoconditionsTestFramework):
+
+    def __init__(self):
+        CryptoconditionsTestFramework.__init__(self)
+        self.extra_cc_args = ['-assetorderindex=1']
+
+    def book(self, rpc, tokenid, side, *args):
+        return [order['txid'] for order in rpc.tokenorderbook(tokenid, side, *args)['orders']]
+
+    def run_assetorders_tests(self):
+        rpc = self.nodes[0]
+
+        result = rpc.tokencreate("BOOK", "10", "orderbook index test")
+        assert_success(result)
+        tokenid = self.send_and_mine(result['hex'], rpc)
+
+        assert_raises(Exception, rpc.tokenorderbook, tokenid, "both")
+        assert_equal(rpc.tokenorderbook(tokenid, "ask"), {'tokenid': tokenid, 'side': 'ask', 'orders': [], 'next': None})
+
+        # asks come cheapest first
+        asks = {}
+        for price in ["3", "1", "2"]:
+            result = rpc.tokenask("100", tokenid, price)
+            assert_success(result)
+            asks[price] = self.send_and_mine(result['hex'], rpc)
+        assert_equal(self.book(rpc, tokenid, "ask"), [asks["1"], asks["2"], asks["3"]])
+
+        # bids come dearest first
+        bids = {}
+        for price in ["0.1", "0.3", "0.2"]:
+            result = rpc.tokenbid("100", tokenid, price)
+            assert_success(result)
+            bids[price] = self.send_and_mine(result['hex'], rpc)
+        assert_equal(self.book(rpc, tokenid, "bid"), [bids["0.3"], bids["0.2"], bids["0.1"]])
+
+        # tokenorders lists the same orders, bids first
+        assert_equal([order['txid'] for order in rpc.tokenorders(tokenid)],
+                     [bids["0.3"], bids["0.2"], bids["0.1"], asks["1"], asks["2"], asks["3"]])
+
+        # paging with the cursor
+        page = rpc.tokenorderbook(tokenid, "ask", 2)
+        assert_equal([order['txid'] for order in page['orders']], [asks["1"], asks["2"]])
+        page = rpc.tokenorderbook(tokenid, "ask", 2, page['next'])
+        assert_equal([order['txid'] for order in page['orders']], [asks["3"]])
+        assert_equal(page['next'], None)
+
+        # a mempool ask shows up unless the mempool is left out
+        result = rpc.tokenask("100", tokenid, "1.5")
+        assert_success(result)
+        pendingid = rpc.sendrawtransaction(result['hex'])
+        book = rpc.tokenorderbook(tokenid, "ask")['orders']
+        assert_equal([order['txid'] for order in book], [asks["1"], pendingid, asks["2"], asks["3"]])
+        assert_equal(book[1]['height'], -1)
+        assert_equal(self.book(rpc, tokenid, "ask", 100, "", False), [asks["1"], asks["2"], asks["3"]])
+        rpc.generate(1)
+        self.sync_all()
+        assert_equal(self.book(rpc, tokenid, "ask"), [asks["1"], pendingid, asks["2"], asks["3"]])
+        assert_equal(self.nodes[1].tokenorderbook(tokenid, "ask"), rpc.tokenorderbook(tokenid, "ask"))
+
+        # a cancel closes the order, disconnecting it reopens the order
+        result = rpc.tokencancelask(tokenid, asks["1"])
+        assert_success(result)
+        self.send_and_mine(result['hex'], rpc)
+        assert_equal(self.book(rpc, tokenid, "ask"), [pendingid, asks["2"], asks["3"]])
+        tip = rpc.getbestblockhash()
+        rpc.invalidateblock(tip)
+        assert_equal(self.book(rpc, tokenid, "ask", 100, "", False), [asks["1"], pendingid, asks["2"], asks["3"]])
+        # the cancel is back in the mempool
+        assert_equal(self.book(rpc, tokenid, "ask"), [pendingid, asks["2"], asks["3"]])
+        rpc.reconsiderblock(tip)
+        assert_equal(rpc.getbestblockhash(), tip)
+        assert_equal(self.book(rpc, tokenid, "ask", 100, "", False), [pendingid, asks["2"], asks["3"]])
+
+    def run_test(self):
+        print("Mining blocks...")
+        rpc = self.nodes[0]
+        rpc1 = self.nodes[1]
+        # utxos from block 1 become mature in block 101
+        if not self.options.noshutdown:
+            rpc.generate(101)
+        self.sync_all()
+        print("Importing privkeys")
+        rpc.importprivkey(self.privkey)
+        rpc1.importprivkey(self.privkey1)
+        self.run_assetorders_tests()
+
+
+if __name__ == '__main__':
+    CryptoconditionsAssetOrdersTest().main()
@@ -0,0 +1,91 @@
+#!/usr/bin/env python2
+# Copyright (c) 2023 The Elosys developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that -tokenindex follows token transfers through connected and
+# disconnected blocks, and that tokenbalance agrees with tokenutxos.
+#
+
+from test_framework.test_framework import CryptoconditionsTestFramework
+from test_framework.util import assert_equal
+from cryptoconditions import assert_success
+
+
+class CryptoconditionsTokenIndexTest(CryptoconditionsTestFramework):
+
+    def __init__(self):
+        CryptoconditionsTestFramework.__init__(self)
+        self.extra_cc_args = ['-tokenindex=1']
+
+    def token_sum(self, rpc, tokenid, pubkey=None):
+        utxos = rpc.tokenutxos(tokenid, pubkey) if pubkey else rpc.tokenutxos(tokenid)
+        return sum(utxo['satoshis'] for utxo in utxos)
+
+    def run_tokenindex_tests(self):
+        rpc = self.nodes[0]
+        supply = 1000000000
+
+        # an unknown token has no outputs
+        assert_equal(rpc.tokenutxos(self.pubkey), [])
+
+        result = rpc.tokencreate("INDEXED", "10", "token index test")
+        assert_success(result)
+        tokenid = self.send_and_mine(result['hex'], rpc)
+        createheight = rpc.getblockcount()
+
+        utxos = rpc.tokenutxos(tokenid, self.pubkey)
+        assert_equal(self.token_sum(rpc, tokenid, self.pubkey), supply)
+        for utxo in utxos:
+            assert_equal(utxo['txid'], tokenid)
+            assert_equal(utxo['height'], createheight)
+        assert_equal(rpc.tokenbalance(tokenid, self.pubkey)['balance'], supply)
+
+        # the transfer spends the create outputs and adds the recipient
+        result = rpc.tokentransfer(tokenid, self.pubkey1, "100")
+        assert_success(result)
+        transferid = self.send_and_mine(result['hex'], rpc)
+        self.sync_all()
+
+        recipient = rpc.tokenutxos(tokenid, self.pubkey1)
+        assert_equal(len(recipient), 1)
+        assert_equal(recipient[0]['txid'], transferid)
+        assert_equal(recipient[0]['satoshis'], 100)
+        assert_equal(self.token_sum(rpc, tokenid, self.pubkey), supply - 100)
+        assert_equal(self.token_sum(rpc, tokenid), supply)
+        assert_equal(rpc.tokenbalance(tokenid, self.pubkey)['balance'], supply - 100)
+        assert_equal(self.nodes[1].tokenbalance(tokenid, self.pubkey1)['balance'], 100)
+        assert_equal(self.nodes[1].tokenutxos(tokenid), rpc.tokenutxos(tokenid))
+
+        # disconnecting the transfer restores the spent outputs with their height
+        tip = rpc.getbestblockhash()
+        rpc.invalidateblock(tip)
+        assert_equal(rpc.tokenutxos(tokenid, self.pubkey1), [])
+        assert_equal(self.token_sum(rpc, tokenid, self.pubkey), supply)
+        for utxo in rpc.tokenutxos(tokenid):
+            assert_equal(utxo['txid'], tokenid)
+            assert_equal(utxo['height'], createheight)
+        assert_equal(rpc.tokenbalance(tokenid, self.pubkey)['balance'], supply)
+
+        rpc.reconsiderblock(tip)
+        assert_equal(rpc.getbestblockhash(), tip)
+        assert_equal(self.token_sum(rpc, tokenid, self.pubkey1), 100)
+        assert_equal(self.token_sum(rpc, tokenid), supply)
+
+    def run_test(self):
+        print("Mining blocks...")
+        rpc = self.nodes[0]
+        rpc1 = self.nodes[1]
+        # utxos from block 1 become mature in block 101
+        if not self.options.noshutdown:
+            rpc.generate(101)
+        self.sync_all()
+        print("Importing privkeys")
+        rpc.importprivkey(self.privkey)
+        rpc1.importprivkey(self.privkey1)
+        self.run_tokenindex_tests()
+
+
+if __name__ == '__main__':
+    CryptoconditionsTokenIndexTest().main()
@@ -0,0 +1,66 @@
+#!/usr/bin/env python2
+# Copyright (c) 2023 The Elosys developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that -prometheusport serves the node metrics, including the block
+# connection phases and the mempool gauges.
+#
+
+import os
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, start_nodes
+
+try:
+    import http.client as httplib
+except ImportError:
+    import httplib
+
+
+def prometheus_port(n):
+    return 13000 + n + os.getpid() % 999
+
+
+class PrometheusTest(BitcoinTestFramework):
+
+    def setup_network(self, split=False):
+        self.nodes = start_nodes(1, self.options.tmpdir, [["-prometheusport=%d" % prometheus_port(0)]])
+        self.is_network_split = False
+
+    def scrape(self):
+        conn = httplib.HTTPConnection("127.0.0.1", prometheus_port(0))
+        conn.request("GET", "/metrics")
+        response = conn.getresponse()
+        assert_equal(response.status, 200)
+        body = response.read().decode("utf-8")
+        conn.close()
+        return body
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(2)
+        node.sendtoaddress(node.getnewaddress(), 1)
+
+        # The exporter publishes asynchronously
+        for i in range(10):
+            body = self.scrape()
+            if "elosys_mempool_transactions" in body:
+                break
+            time.sleep(1)
+
+        for name in ["elosys_block_read_seconds", "elosys_block_connect_seconds",
+                     "elosys_block_flush_seconds", "elosys_chain_height",
+                     "elosys_mempool_transactions", "elosys_mempool_bytes",
+                     "elosys_leveldb_reads", "elosys_coins_cache_lookups"]:
+            assert name in body, "%s missing from the metrics" % name
+
+        for line in body.splitlines():
+            if line.startswith("elosys_mempool_transactions "):
+                assert_equal(float(line.split()[1]), 1)
+
+
+if __name__ == '__main__':
+    PrometheusTest().main()
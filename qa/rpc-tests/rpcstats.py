@@ -0,0 +1,50 @@
+#!/usr/bin/env python2
+# Copyright (c) 2023 The Elosys developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the per-method counters and latency quantiles of getrpcstats.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, start_nodes
+
+
+class RPCStatsTest(BitcoinTestFramework):
+
+    def setup_network(self, split=False):
+        self.nodes = start_nodes(1, self.options.tmpdir)
+        self.is_network_split = False
+
+    def run_test(self):
+        node = self.nodes[0]
+        before = node.getrpcstats()["methods"].get("getblockcount", {"calls": 0})["calls"]
+        for i in range(10):
+            node.getblockcount()
+        for i in range(3):
+            try:
+                node.getblockhash(-1)
+                assert False, "getblockhash accepted a negative height"
+            except JSONRPCException:
+                pass
+
+        stats = node.getrpcstats()
+        methods = stats["methods"]
+        assert_equal(methods["getblockcount"]["calls"] - before, 10)
+        assert_equal(methods["getblockcount"]["errors"], 0)
+        assert_equal(methods["getblockhash"]["calls"], 3)
+        assert_equal(methods["getblockhash"]["errors"], 3)
+
+        entry = methods["getblockcount"]
+        assert 0 <= entry["p50_ms"] <= entry["p90_ms"] <= entry["p99_ms"] <= entry["max_ms"]
+        assert entry["total_ms"] >= entry["max_ms"]
+
+        # The getrpcstats call itself is executing while the stats are taken
+        inflight = [call["method"] for call in stats["inflight"]]
+        assert "getrpcstats" in inflight
+
+
+if __name__ == '__main__':
+    RPCStatsTest().main()
@@ -186,6 +186,8 @@ class CryptoconditionsTestFramework(BitcoinTestFramework):
 
     def __init__(self):
         self.num_nodes = 2
+        # appended to the arguments of both nodes
+        self.extra_cc_args = []
 
     def setup_chain(self):
         print("Initializing CC test directory "+self.options.tmpdir)
@@ -218,7 +220,7 @@ class CryptoconditionsTestFramework(BitcoinTestFramework):
                     '--daemon',
                     '-rpcuser=rt',
                     '-rpcpassword=rt'
-                    ],
+                    ] + self.extra_cc_args,
                     ['-ac_name=REGTEST',
                     '-conf='+self.options.tmpdir+'/node1/REGTEST.conf',
                     '-port=64365',
@@ -235,7 +237,7 @@ class CryptoconditionsTestFramework(BitcoinTestFramework):
                     '-addnode=127.0.0.1:64367',
                     '--daemon',
                     '-rpcuser=rt',
-                    '-rpcpassword=rt']]
+                    '-rpcpassword=rt'] + self.extra_cc_args]
         )
         self.is_network_split = split
         self.rpc              = self.nodes[0]
@@ -0,0 +1,139 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ASSETORDERINDEX_H
+#define BITCOIN_ASSETORDERINDEX_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+/** Order prices in the key are the price of one token in 1/ASSET_ORDER_PRICE_SCALE satoshis */
+static const uint64_t ASSET_ORDER_PRICE_SCALE = 10000;
+
+static const unsigned char ASSET_ORDER_BID = 'b';
+static const unsigned char ASSET_ORDER_ASK = 's';
+
+/**
+ * An open assets order in the orderbook index. Keys sort by token, side and
+ * unit price, so one side of a token's book is a key range in price order:
+ * asks are read forwards, bids backwards.
+ */
+struct CAssetOrderKey {
+    uint256 tokenid;
+    unsigned char side;
+    uint64_t unitPrice;
+    uint256 txhash;
+    unsigned int index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 77;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        tokenid.Serialize(s);
+        ser_writedata8(s, side);
+        // Prices and output indexes are stored big-endian for key sorting in LevelDB
+        ser_writedata32be(s, unitPrice >> 32);
+        ser_writedata32be(s, unitPrice & 0xffffffff);
+        txhash.Serialize(s);
+        ser_writedata32be(s, index);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        tokenid.Unserialize(s);
+        side = ser_readdata8(s);
+        unitPrice = (uint64_t)ser_readdata32be(s) << 32;
+        unitPrice |= ser_readdata32be(s);
+        txhash.Unserialize(s);
+        index = ser_readdata32be(s);
+    }
+
+    CAssetOrderKey(uint256 tokenidIn, unsigned char sideIn, uint64_t price, uint256 txid, unsigned int indexValue) {
+        tokenid = tokenidIn;
+        side = sideIn;
+        unitPrice = price;
+        txhash = txid;
+        index = indexValue;
+    }
+
+    CAssetOrderKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        tokenid.SetNull();
+        side = 0;
+        unitPrice = 0;
+        txhash.SetNull();
+        index = 0;
+    }
+
+    /** The same order as the serialized keys */
+    friend bool operator<(const CAssetOrderKey& a, const CAssetOrderKey& b) {
+        if (a.tokenid != b.tokenid)
+            return a.tokenid < b.tokenid;
+        if (a.side != b.side)
+            return a.side < b.side;
+        if (a.unitPrice != b.unitPrice)
+            return a.unitPrice < b.unitPrice;
+        if (a.txhash != b.txhash)
+            return a.txhash < b.txhash;
+        return a.index < b.index;
+    }
+};
+
+/** What tokenorders shows of an order, decoded from the order transaction */
+struct CAssetOrderValue {
+    unsigned char funcid;
+    //! Additional eval code of the tokens address holding an ask, 0 for fungible tokens
+    unsigned char evalcode2;
+    //! Value of the order output, coins for bids and tokens for asks
+    CAmount amount;
+    //! Value of the first output of the order transaction
+    CAmount amount0;
+    //! Opret price: tokens required by a bid, coins (or other tokens) required by an ask
+    int64_t price;
+    uint256 assetid2;
+    std::vector<unsigned char> origpubkey;
+    //! -1 for orders in the mempool
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(funcid);
+        READWRITE(evalcode2);
+        READWRITE(amount);
+        READWRITE(amount0);
+        READWRITE(price);
+        READWRITE(assetid2);
+        READWRITE(origpubkey);
+        READWRITE(blockHeight);
+    }
+
+    CAssetOrderValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        funcid = 0;
+        evalcode2 = 0;
+        amount = -1;
+        amount0 = 0;
+        price = 0;
+        assetid2.SetNull();
+        origpubkey.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const {
+        return (amount == -1);
+    }
+};
+
+#endif // BITCOIN_ASSETORDERINDEX_H
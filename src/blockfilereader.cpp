@@ -0,0 +1,156 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilereader.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+class CBlockFileReader::CMappedFile
+{
+public:
+    explicit CMappedFile(const boost::filesystem::path& path)
+    {
+        boost::interprocess::file_mapping mapping(path.string().c_str(), boost::interprocess::read_only);
+        region = boost::interprocess::mapped_region(mapping, boost::interprocess::read_only);
+    }
+
+    const unsigned char* data() const { return (const unsigned char*)region.get_address(); }
+    size_t size() const { return region.get_size(); }
+
+private:
+    boost::interprocess::mapped_region region;
+};
+
+CBlockFileReader::CBlockFileReader(int nMaxMappedFilesIn) : nMaxMappedFiles(std::max(nMaxMappedFilesIn, 0))
+{
+}
+
+CBlockFileReader::~CBlockFileReader()
+{
+}
+
+void CBlockFileReader::SetMaxMappedFiles(int nMaxMappedFilesIn)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    nMaxMappedFiles = std::max(nMaxMappedFilesIn, 0);
+    EvictExcess();
+}
+
+int CBlockFileReader::GetMaxMappedFiles() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return nMaxMappedFiles;
+}
+
+void CBlockFileReader::Invalidate(int nFile)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    MappedFileMap::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        lruFiles.erase(it->second.second);
+        mapFiles.erase(it);
+    }
+}
+
+void CBlockFileReader::EvictExcess()
+{
+    // Readers still holding a mapping keep it alive until they are done
+    while (lruFiles.size() > (size_t)nMaxMappedFiles) {
+        mapFiles.erase(lruFiles.back());
+        lruFiles.pop_back();
+    }
+}
+
+std::shared_ptr<const CBlockFileReader::CMappedFile> CBlockFileReader::GetMapping(int nFile, size_t nMinSize)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (nMaxMappedFiles == 0)
+        return nullptr;
+
+    MappedFileMap::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        lruFiles.splice(lruFiles.begin(), lruFiles, it->second.second);
+        if (it->second.first->size() >= nMinSize)
+            return it->second.first;
+        // The file grew since it was mapped
+        lruFiles.erase(it->second.second);
+        mapFiles.erase(it);
+    }
+
+    std::shared_ptr<const CMappedFile> mapped;
+    try {
+        mapped = std::make_shared<const CMappedFile>(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+    } catch (const std::exception& e) {
+        LogPrint("db", "%s: cannot map block file %d: %s\n", __func__, nFile, e.what());
+        return nullptr;
+    }
+    lruFiles.push_front(nFile);
+    mapFiles[nFile] = std::make_pair(mapped, lruFiles.begin());
+    EvictExcess();
+
+    if (mapped->size() < nMinSize)
+        return nullptr;
+    return mapped;
+}
+
+bool CBlockFileReader::ReadBlock(const CDiskBlockPos& pos, CBlock& block)
+{
+    block.SetNull();
+
+    // Blocks are stored as message start, length and the serialized block;
+    // pos points at the block itself
+    const size_t nPos = pos.nPos;
+    if (nPos >= 8) {
+        std::shared_ptr<const CMappedFile> mapped = GetMapping(pos.nFile, nPos);
+        if (mapped) {
+            uint32_t nSize = ReadLE32(mapped->data() + nPos - 4);
+            if (nPos + nSize > mapped->size())
+                mapped = GetMapping(pos.nFile, nPos + nSize);
+            if (mapped) {
+                try {
+                    CBufferReader reader(SER_DISK, CLIENT_VERSION, mapped->data() + nPos, nSize);
+                    reader >> block;
+                    return true;
+                } catch (const std::exception& e) {
+                    return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+                }
+            }
+        }
+    }
+
+    return ReadBlockFromFile(pos, block);
+}
+
+bool CBlockFileReader::ReadBlockFromFile(const CDiskBlockPos& pos, CBlock& block)
+{
+    // Open history file to read
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+    // Read block
+    try {
+        filein >> block;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+CBlockFileReader& GetBlockFileReader()
+{
+    static CBlockFileReader reader;
+    return reader;
+}
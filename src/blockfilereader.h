@@ -0,0 +1,72 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEREADER_H
+#define BITCOIN_BLOCKFILEREADER_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+class CBlock;
+struct CDiskBlockPos;
+
+/** Default for -mappedblockfiles, the number of blk?????.dat files kept mapped */
+static const int DEFAULT_MAPPED_BLOCK_FILES = 8;
+
+/**
+ * Reads blocks from the blk?????.dat files.
+ *
+ * The most recently used files are kept memory mapped read-only and blocks are
+ * deserialized straight out of the mapping, which saves the open/seek/close and
+ * the buffered copy of every read. Files are mapped at the size they have when
+ * first used; a read past the end of a mapping (the file grew since) remaps it.
+ * Files that are truncated or deleted must be dropped with Invalidate first.
+ *
+ * With no mapped files allowed, or when a file cannot be mapped, blocks are read
+ * through stdio as before.
+ */
+class CBlockFileReader
+{
+public:
+    explicit CBlockFileReader(int nMaxMappedFilesIn = DEFAULT_MAPPED_BLOCK_FILES);
+    ~CBlockFileReader();
+
+    /**
+     * Deserialize the block stored at pos. Nothing is checked beyond the
+     * deserialization itself.
+     * @returns false (and logs) if the block cannot be read
+     */
+    bool ReadBlock(const CDiskBlockPos& pos, CBlock& block);
+
+    /** Unmap a file, must be called before it is truncated or removed */
+    void Invalidate(int nFile);
+
+    /** Change the number of mapped files, 0 disables mapping */
+    void SetMaxMappedFiles(int nMaxMappedFilesIn);
+    int GetMaxMappedFiles() const;
+
+private:
+    class CMappedFile;
+    typedef std::list<int> LRUList;
+    typedef std::map<int, std::pair<std::shared_ptr<const CMappedFile>, LRUList::iterator> > MappedFileMap;
+
+    mutable std::mutex cs;
+    int nMaxMappedFiles;
+    //! Most recently used file numbers at the front
+    LRUList lruFiles;
+    MappedFileMap mapFiles;
+
+    /** The mapping of nFile if it covers at least nMinSize bytes, remapping as needed */
+    std::shared_ptr<const CMappedFile> GetMapping(int nFile, size_t nMinSize);
+    void EvictExcess();
+
+    bool ReadBlockFromFile(const CDiskBlockPos& pos, CBlock& block);
+};
+
+/** The reader used by ReadBlockFromDisk */
+CBlockFileReader& GetBlockFileReader();
+
+#endif // BITCOIN_BLOCKFILEREADER_H
@@ -0,0 +1,334 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexsnapshot.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace {
+
+const unsigned char SNAPSHOT_MAGIC[4] = {'b', 'i', 'd', 'x'};
+const uint32_t SNAPSHOT_VERSION = 1;
+
+//! magic, version, snapshot id, record count, SHA256 of the records
+const size_t SNAPSHOT_HEADER_SIZE = 4 + 4 + 32 + 8 + 32;
+const size_t SNAPSHOT_RECORD_SIZE = 268;
+const uint32_t SNAPSHOT_NO_PARENT = 0xffffffff;
+
+const uint32_t RECORD_HAVE_BRANCH_ID = 1;
+const uint32_t RECORD_HAVE_SPROUT_VALUE = 2;
+
+//! Records buffered per fwrite while writing a snapshot
+const size_t SNAPSHOT_WRITE_BATCH = 4096;
+
+boost::filesystem::path GetSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index.snapshot";
+}
+
+unsigned char* WriteHash(unsigned char* ptr, const uint256& hash)
+{
+    memcpy(ptr, hash.begin(), 32);
+    return ptr + 32;
+}
+
+const unsigned char* ReadHash(const unsigned char* ptr, uint256& hash)
+{
+    memcpy(hash.begin(), ptr, 32);
+    return ptr + 32;
+}
+
+void EncodeRecord(unsigned char* ptr, const CBlockIndex* pindex, uint32_t nPrev)
+{
+    uint32_t nFlags = 0;
+    if (pindex->nCachedBranchId)
+        nFlags |= RECORD_HAVE_BRANCH_ID;
+    if (pindex->nSproutValue)
+        nFlags |= RECORD_HAVE_SPROUT_VALUE;
+
+    ptr = WriteHash(ptr, pindex->GetBlockHash());
+    WriteLE32(ptr, nPrev); ptr += 4;
+    WriteLE32(ptr, (uint32_t)pindex->nHeight); ptr += 4;
+    WriteLE32(ptr, (uint32_t)pindex->nFile); ptr += 4;
+    WriteLE32(ptr, pindex->nDataPos); ptr += 4;
+    WriteLE32(ptr, pindex->nUndoPos); ptr += 4;
+    WriteLE32(ptr, pindex->nTx); ptr += 4;
+    WriteLE32(ptr, pindex->nStatus); ptr += 4;
+    WriteLE32(ptr, pindex->nCachedBranchId ? *pindex->nCachedBranchId : 0); ptr += 4;
+    WriteLE32(ptr, (uint32_t)pindex->nVersion); ptr += 4;
+    WriteLE32(ptr, pindex->nTime); ptr += 4;
+    WriteLE32(ptr, pindex->nBits); ptr += 4;
+    WriteLE32(ptr, nFlags); ptr += 4;
+    WriteLE32(ptr, (uint32_t)(int32_t)pindex->segid); ptr += 4;
+    WriteLE64(ptr, (uint64_t)(pindex->nSproutValue ? *pindex->nSproutValue : 0)); ptr += 8;
+    WriteLE64(ptr, (uint64_t)pindex->nSaplingValue); ptr += 8;
+    WriteLE64(ptr, (uint64_t)pindex->nNotaryPay); ptr += 8;
+    ptr = WriteHash(ptr, pindex->hashSproutAnchor);
+    ptr = WriteHash(ptr, pindex->hashMerkleRoot);
+    ptr = WriteHash(ptr, pindex->hashFinalSaplingRoot);
+    ptr = WriteHash(ptr, pindex->nNonce);
+    ptr = WriteHash(ptr, ArithToUint256(pindex->nChainWork));
+}
+
+void DecodeRecord(const unsigned char* ptr, CBlockIndex* pindex, uint32_t& nPrev)
+{
+    // The block hash was read by the caller to key mapBlockIndex
+    ptr += 32;
+    nPrev = ReadLE32(ptr); ptr += 4;
+    pindex->nHeight = (int)ReadLE32(ptr); ptr += 4;
+    pindex->nFile = (int)ReadLE32(ptr); ptr += 4;
+    pindex->nDataPos = ReadLE32(ptr); ptr += 4;
+    pindex->nUndoPos = ReadLE32(ptr); ptr += 4;
+    pindex->nTx = ReadLE32(ptr); ptr += 4;
+    pindex->nStatus = ReadLE32(ptr); ptr += 4;
+    uint32_t nBranchId = ReadLE32(ptr); ptr += 4;
+    pindex->nVersion = (int)ReadLE32(ptr); ptr += 4;
+    pindex->nTime = ReadLE32(ptr); ptr += 4;
+    pindex->nBits = ReadLE32(ptr); ptr += 4;
+    uint32_t nFlags = ReadLE32(ptr); ptr += 4;
+    pindex->segid = (int8_t)(int32_t)ReadLE32(ptr); ptr += 4;
+    CAmount nSproutValue = (CAmount)ReadLE64(ptr); ptr += 8;
+    pindex->nSaplingValue = (CAmount)ReadLE64(ptr); ptr += 8;
+    pindex->nNotaryPay = (int64_t)ReadLE64(ptr); ptr += 8;
+    ptr = ReadHash(ptr, pindex->hashSproutAnchor);
+    ptr = ReadHash(ptr, pindex->hashMerkleRoot);
+    ptr = ReadHash(ptr, pindex->hashFinalSaplingRoot);
+    ptr = ReadHash(ptr, pindex->nNonce);
+    uint256 chainWork;
+    ptr = ReadHash(ptr, chainWork);
+    pindex->nChainWork = UintToArith256(chainWork);
+
+    if (nFlags & RECORD_HAVE_BRANCH_ID)
+        pindex->nCachedBranchId = nBranchId;
+    if (nFlags & RECORD_HAVE_SPROUT_VALUE)
+        pindex->nSproutValue = nSproutValue;
+}
+
+/** Drop a partially loaded index so the leveldb walk starts from scratch */
+void UnloadBlockIndexEntries(std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight)
+{
+    for (const auto& item : mapBlockIndex)
+        delete item.second;
+    mapBlockIndex.clear();
+    vSortedByHeight.clear();
+}
+
+bool CompareByHeight(const std::pair<int, CBlockIndex*>& a, const std::pair<int, CBlockIndex*>& b)
+{
+    return a.first < b.first;
+}
+
+} // anon namespace
+
+bool WriteBlockIndexSnapshot()
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMillis();
+
+    // Height order puts every parent before its children
+    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
+    vSortedByHeight.reserve(mapBlockIndex.size());
+    for (const auto& item : mapBlockIndex)
+        vSortedByHeight.push_back(std::make_pair(item.second->nHeight, item.second));
+    std::stable_sort(vSortedByHeight.begin(), vSortedByHeight.end(), CompareByHeight);
+
+    boost::unordered_map<const CBlockIndex*, uint32_t> mapOrdinal;
+    mapOrdinal.reserve(vSortedByHeight.size());
+
+    boost::filesystem::path path = GetSnapshotPath();
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".new";
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file)
+        return error("%s: failed to open %s", __func__, pathTmp.string());
+
+    uint256 id = GetRandHash();
+    uint64_t nCount = vSortedByHeight.size();
+    unsigned char header[SNAPSHOT_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+
+    // The header is rewritten with the checksum once all records are out
+    bool fOk = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    CSHA256 hasher;
+    std::vector<unsigned char> vBuffer;
+    vBuffer.reserve(SNAPSHOT_WRITE_BATCH * SNAPSHOT_RECORD_SIZE);
+    for (uint32_t i = 0; fOk && i < nCount; i++) {
+        const CBlockIndex* pindex = vSortedByHeight[i].second;
+        uint32_t nPrev = SNAPSHOT_NO_PARENT;
+        if (pindex->pprev) {
+            boost::unordered_map<const CBlockIndex*, uint32_t>::const_iterator it = mapOrdinal.find(pindex->pprev);
+            if (it == mapOrdinal.end()) {
+                fclose(file);
+                return error("%s: parent of %s is not below it", __func__, pindex->GetBlockHash().ToString());
+            }
+            nPrev = it->second;
+        }
+        mapOrdinal[pindex] = i;
+
+        size_t nOffset = vBuffer.size();
+        vBuffer.resize(nOffset + SNAPSHOT_RECORD_SIZE);
+        EncodeRecord(&vBuffer[nOffset], pindex, nPrev);
+        if (vBuffer.size() == SNAPSHOT_WRITE_BATCH * SNAPSHOT_RECORD_SIZE || i + 1 == nCount) {
+            hasher.Write(&vBuffer[0], vBuffer.size());
+            fOk = fwrite(&vBuffer[0], 1, vBuffer.size(), file) == vBuffer.size();
+            vBuffer.clear();
+        }
+    }
+
+    uint256 checksum;
+    hasher.Finalize(checksum.begin());
+    unsigned char* ptr = header;
+    memcpy(ptr, SNAPSHOT_MAGIC, 4); ptr += 4;
+    WriteLE32(ptr, SNAPSHOT_VERSION); ptr += 4;
+    ptr = WriteHash(ptr, id);
+    WriteLE64(ptr, nCount); ptr += 8;
+    WriteHash(ptr, checksum);
+    fOk = fOk && fseek(file, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    if (fOk) {
+        fflush(file);
+        FileCommit(file);
+    }
+    fclose(file);
+    if (!fOk)
+        return error("%s: failed to write %s", __func__, pathTmp.string());
+
+    // A crash between the rename and the id update leaves a mismatching id,
+    // which only costs the next start a leveldb walk.
+    if (!RenameOver(pathTmp, path))
+        return error("%s: failed to rename %s", __func__, pathTmp.string());
+    if (!pblocktree->WriteBlockIndexSnapshotId(id))
+        return error("%s: failed to store the snapshot id", __func__);
+
+    LogPrintf("Wrote block index snapshot with %u entries in %dms\n", nCount, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool LoadBlockIndexSnapshot(std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight)
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMillis();
+
+    uint256 id;
+    if (!pblocktree->ReadBlockIndexSnapshotId(id)) {
+        LogPrintf("%s: no current block index snapshot\n", __func__);
+        return false;
+    }
+    boost::filesystem::path path = GetSnapshotPath();
+    if (!boost::filesystem::exists(path)) {
+        LogPrintf("%s: %s is missing\n", __func__, path.string());
+        return false;
+    }
+    std::vector<uint256> vJournal;
+    if (!pblocktree->ReadBlockIndexJournal(vJournal))
+        return false;
+
+    uint64_t nCount = 0;
+    try {
+        boost::interprocess::file_mapping mapping(path.string().c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+        const unsigned char* data = (const unsigned char*)region.get_address();
+        size_t nSize = region.get_size();
+
+        if (nSize < SNAPSHOT_HEADER_SIZE || memcmp(data, SNAPSHOT_MAGIC, 4) != 0)
+            return error("%s: %s is not a block index snapshot", __func__, path.string());
+        const unsigned char* ptr = data + 4;
+        uint32_t nVersion = ReadLE32(ptr); ptr += 4;
+        if (nVersion != SNAPSHOT_VERSION)
+            return error("%s: unsupported snapshot version %u", __func__, nVersion);
+        uint256 fileId, checksum;
+        ptr = ReadHash(ptr, fileId);
+        nCount = ReadLE64(ptr); ptr += 8;
+        ReadHash(ptr, checksum);
+        if (fileId != id) {
+            LogPrintf("%s: snapshot is stale\n", __func__);
+            return false;
+        }
+        if (nCount >= SNAPSHOT_NO_PARENT || nSize != SNAPSHOT_HEADER_SIZE + nCount * SNAPSHOT_RECORD_SIZE)
+            return error("%s: snapshot size mismatch", __func__);
+
+        const unsigned char* records = data + SNAPSHOT_HEADER_SIZE;
+        uint256 actual;
+        CSHA256().Write(records, nCount * SNAPSHOT_RECORD_SIZE).Finalize(actual.begin());
+        if (actual != checksum)
+            return error("%s: snapshot checksum mismatch", __func__);
+
+        std::vector<CBlockIndex*> vIndex(nCount);
+        vSortedByHeight.reserve(nCount + vJournal.size());
+        mapBlockIndex.reserve(nCount + vJournal.size());
+        for (uint32_t i = 0; i < nCount; i++) {
+            const unsigned char* record = records + i * SNAPSHOT_RECORD_SIZE;
+            uint256 hash;
+            ReadHash(record, hash);
+
+            CBlockIndex* pindexNew = new CBlockIndex();
+            std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(std::make_pair(hash, pindexNew));
+            if (!ret.second) {
+                delete pindexNew;
+                UnloadBlockIndexEntries(vSortedByHeight);
+                return error("%s: duplicate entry %s", __func__, hash.ToString());
+            }
+            pindexNew->phashBlock = &ret.first->first;
+            vIndex[i] = pindexNew;
+
+            uint32_t nPrev;
+            DecodeRecord(record, pindexNew, nPrev);
+            if (nPrev != SNAPSHOT_NO_PARENT) {
+                if (nPrev >= i) {
+                    UnloadBlockIndexEntries(vSortedByHeight);
+                    return error("%s: entry %s links forward", __func__, hash.ToString());
+                }
+                pindexNew->pprev = vIndex[nPrev];
+            }
+            vSortedByHeight.push_back(std::make_pair(pindexNew->nHeight, pindexNew));
+        }
+    } catch (const boost::interprocess::interprocess_exception& e) {
+        UnloadBlockIndexEntries(vSortedByHeight);
+        return error("%s: failed to map %s: %s", __func__, path.string(), e.what());
+    }
+
+    // Entries written after the snapshot come from leveldb on top of it
+    std::vector<CBlockIndex*> vInserted;
+    if (!pblocktree->LoadBlockIndexEntries(vJournal, vInserted)) {
+        UnloadBlockIndexEntries(vSortedByHeight);
+        return false;
+    }
+    if (!vInserted.empty()) {
+        std::vector<std::pair<int, CBlockIndex*> > vNew;
+        vNew.reserve(vInserted.size());
+        for (CBlockIndex* pindex : vInserted)
+            vNew.push_back(std::make_pair(pindex->nHeight, pindex));
+        std::stable_sort(vNew.begin(), vNew.end(), CompareByHeight);
+        size_t nMid = vSortedByHeight.size();
+        vSortedByHeight.insert(vSortedByHeight.end(), vNew.begin(), vNew.end());
+        std::inplace_merge(vSortedByHeight.begin(), vSortedByHeight.begin() + nMid, vSortedByHeight.end(), CompareByHeight);
+    }
+
+    // A placeholder parent that received its header since the snapshot moves in height
+    // and invalidates the precomputed chain work below it; let leveldb rebuild everything.
+    for (const auto& item : vSortedByHeight) {
+        if (item.first != item.second->nHeight) {
+            UnloadBlockIndexEntries(vSortedByHeight);
+            LogPrintf("%s: snapshot superseded by the journal\n", __func__);
+            return false;
+        }
+    }
+
+    LogPrintf("%s: loaded %u entries from the snapshot and %u journaled entries in %dms\n",
+              __func__, nCount, vJournal.size(), GetTimeMillis() - nStart);
+    return true;
+}
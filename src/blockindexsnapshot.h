@@ -0,0 +1,45 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKINDEXSNAPSHOT_H
+#define BITCOIN_BLOCKINDEXSNAPSHOT_H
+
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * Flat snapshot of the block index (blocks/index.snapshot) so startup does not
+ * have to walk and deserialize every record in the block tree database.
+ *
+ * The file holds a header (magic, version, snapshot id, record count and the
+ * SHA256 of the records) followed by fixed-size records in height order. Parent
+ * links are stored as record ordinals and chain work is precomputed, so the
+ * records can be loaded from a memory mapping in a single pass without sorting.
+ *
+ * The block tree database stores the id of the current snapshot and journals
+ * the hash of every index entry written after it. At startup the snapshot is
+ * used only if its id matches; the journaled entries are then read from
+ * leveldb on top of it. Anything else falls back to the full leveldb walk.
+ */
+
+/** Default for -blockindexsnapshot */
+static const bool DEFAULT_BLOCKINDEX_SNAPSHOT = true;
+
+/**
+ * Write the in-memory block index to a new snapshot and make it current.
+ * Every entry must already be written to the block tree database. cs_main must be held.
+ * @returns true on success
+ */
+bool WriteBlockIndexSnapshot();
+
+/**
+ * Populate mapBlockIndex from the current snapshot plus the journal.
+ * @param vSortedByHeight receives every loaded entry ordered by height
+ * @returns false if there is no usable snapshot, mapBlockIndex is left empty then
+ */
+bool LoadBlockIndexSnapshot(std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight);
+
+#endif // BITCOIN_BLOCKINDEXSNAPSHOT_H
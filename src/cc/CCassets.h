@@ -24,6 +24,7 @@
 #define CC_ASSETS_H
 
 #include "CCinclude.h"
+#include "assetorderindex.h"
 
 // CCcustom
 bool AssetsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
@@ -42,11 +43,15 @@ bool SetSwapFillamounts(int64_t &paid,int64_t &remaining_price,int64_t orig_nVal
 int64_t AssetValidateBuyvin(struct CCcontract_info *cp,Eval* eval,int64_t &tmpprice,std::vector<uint8_t> &tmporigpubkey,char *CCaddr,char *origaddr,const CTransaction &tx,uint256 refassetid);
 int64_t AssetValidateSellvin(struct CCcontract_info *cp,Eval* eval,int64_t &tmpprice,std::vector<uint8_t> &tmporigpubkey,char *CCaddr,char *origaddr,const CTransaction &tx,uint256 assetid);
 bool AssetCalcAmounts(struct CCcontract_info *cpAssets, int64_t &inputs, int64_t &outputs, Eval* eval, const CTransaction &tx, uint256 assetid);
+uint64_t AssetOrderUnitPrice(unsigned char side, int64_t amount, int64_t price);
+bool GetAssetOrderOutputs(const CTransaction &tx, int32_t height, std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &orders);
 
 // CCassetstx
 //int64_t GetAssetBalance(CPubKey pk,uint256 tokenid); // --> GetTokenBalance()
 int64_t AddAssetInputs(struct CCcontract_info *cp, CMutableTransaction &mtx, CPubKey pk, uint256 assetid, int64_t total, int32_t maxinputs);
 
+UniValue AssetOrderToJSON(struct CCcontract_info *cpAssets, struct CCcontract_info *cpTokens, uint256 txid, int32_t vout,
+                          uint256 assetid, const CAssetOrderValue &order);
 UniValue AssetOrders(uint256 tokenid, CPubKey pubkey, uint8_t additionalEvalCode);
 //UniValue AssetInfo(uint256 tokenid);
 //UniValue AssetList();
@@ -648,3 +648,75 @@ bool AssetCalcAmounts(struct CCcontract_info *cpAssets, int64_t &inputs, int64_t
 		it's now done in Tokens  */
 	return(true);
 }
+
+// price of one token in 1/ASSET_ORDER_PRICE_SCALE satoshis, from the order amount and its opret price
+uint64_t AssetOrderUnitPrice(unsigned char side, int64_t amount, int64_t price)
+{
+    arith_uint256 unitPrice;
+    if (amount <= 0 || price <= 0)
+        return(0);
+    if (side == ASSET_ORDER_BID)    // amount coins for price tokens
+        unitPrice = arith_uint256(amount) * arith_uint256(ASSET_ORDER_PRICE_SCALE) / arith_uint256(price);
+    else                            // amount tokens for price coins
+        unitPrice = arith_uint256(price) * arith_uint256(ASSET_ORDER_PRICE_SCALE) / arith_uint256(amount);
+    if (unitPrice > arith_uint256(std::numeric_limits<uint64_t>::max()))
+        return(std::numeric_limits<uint64_t>::max());
+    return(unitPrice.GetLow64());
+}
+
+// the open orders a transaction creates: its outputs on the assets global addresses that tokenorders lists,
+// bids on the coins address and asks on the tokens addresses
+bool GetAssetOrderOutputs(const CTransaction &tx, int32_t height, std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &orders)
+{
+    struct CCcontract_info *cpAssets, assetsC;
+    CAssetOrderValue order; uint256 assetid; uint8_t evalCode; unsigned char side;
+    vscript_t vopret, vopretNonfungible; bool fNonfungibleChecked = false;
+    char bidaddr[64], askaddr[64], nonfungibleaddr[64], destaddr[64];
+
+    // every transaction of a block comes here, rule out the others before decoding
+    if (tx.vout.size() < 2 || !GetOpReturnData(tx.vout.back().scriptPubKey, vopret) || vopret.size() < 2 || vopret[0] != EVAL_TOKENS)
+        return(false);
+    if ((order.funcid = DecodeAssetTokenOpRet(tx.vout.back().scriptPubKey, evalCode, assetid, order.assetid2, order.price, order.origpubkey)) == 0 || assetid == zeroid)
+        return(false);
+
+    cpAssets = CCinit(&assetsC, EVAL_ASSETS);
+    CPubKey assetsPk = GetUnspendable(cpAssets, NULL);
+    GetCCaddress(cpAssets, bidaddr, assetsPk);
+    GetTokensCCaddress(cpAssets, askaddr, assetsPk);
+    nonfungibleaddr[0] = 0;
+    order.amount0 = tx.vout[0].nValue;
+    order.blockHeight = height;
+
+    for (int32_t v = 0; v < (int32_t)tx.vout.size() - 1; v++)
+    {
+        if (tx.vout[v].nValue <= 0 || !tx.vout[v].scriptPubKey.IsPayToCryptoCondition())
+            continue;
+        Getscriptaddress(destaddr, tx.vout[v].scriptPubKey);
+        order.evalcode2 = 0;
+        if (strcmp(destaddr, bidaddr) == 0)
+            side = ASSET_ORDER_BID;
+        else if (strcmp(destaddr, askaddr) == 0)
+            side = ASSET_ORDER_ASK;
+        else
+        {
+            // asks of non-fungible tokens are on a tokens address with the token's eval code too
+            if (!fNonfungibleChecked)
+            {
+                fNonfungibleChecked = true;
+                GetNonfungibleData(assetid, vopretNonfungible);
+                if (vopretNonfungible.size() > 0)
+                {
+                    cpAssets->additionalTokensEvalcode2 = vopretNonfungible.begin()[0];
+                    GetTokensCCaddress(cpAssets, nonfungibleaddr, assetsPk);
+                }
+            }
+            if (nonfungibleaddr[0] == 0 || strcmp(destaddr, nonfungibleaddr) != 0)
+                continue;
+            side = ASSET_ORDER_ASK;
+            order.evalcode2 = vopretNonfungible.begin()[0];
+        }
+        order.amount = tx.vout[v].nValue;
+        orders.push_back(std::make_pair(CAssetOrderKey(assetid, side, AssetOrderUnitPrice(side, order.amount, order.price), tx.GetHash(), v), order));
+    }
+    return(!orders.empty());
+}
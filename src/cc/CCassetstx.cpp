@@ -17,6 +17,62 @@
 #include "CCtokens.h"
 #include "komodo_bitcoind.h"
 
+// the tokenorders item of an order output, from the decoded order transaction
+UniValue AssetOrderToJSON(struct CCcontract_info *cpAssets, struct CCcontract_info *cpTokens, uint256 txid, int32_t vout,
+                          uint256 assetid, const CAssetOrderValue &order)
+{
+    UniValue item(UniValue::VOBJ);
+    char numstr[32], funcidstr[16], origaddr[64], origtokenaddr[64];
+
+    funcidstr[0] = order.funcid;
+    funcidstr[1] = 0;
+    item.push_back(Pair("funcid", funcidstr));
+    item.push_back(Pair("txid", txid.GetHex()));
+    item.push_back(Pair("vout", (int64_t)vout));
+    if (order.funcid == 'b' || order.funcid == 'B')
+    {
+        sprintf(numstr, "%.8f", (double)order.amount / COIN);
+        item.push_back(Pair("amount", numstr));
+        sprintf(numstr, "%.8f", (double)order.amount0 / COIN);
+        item.push_back(Pair("bidamount", numstr));
+    }
+    else
+    {
+        sprintf(numstr, "%llu", (long long)order.amount);
+        item.push_back(Pair("amount", numstr));
+        sprintf(numstr, "%llu", (long long)order.amount0);
+        item.push_back(Pair("askamount", numstr));
+    }
+    if (order.origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
+    {
+        GetCCaddress(cpAssets, origaddr, pubkey2pk(order.origpubkey));
+        item.push_back(Pair("origaddress", origaddr));
+        GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(order.origpubkey));
+        item.push_back(Pair("origtokenaddress", origtokenaddr));
+    }
+    if (assetid != zeroid)
+        item.push_back(Pair("tokenid", assetid.GetHex()));
+    if (order.assetid2 != zeroid)
+        item.push_back(Pair("otherid", order.assetid2.GetHex()));
+    if (order.price > 0)
+    {
+        if (order.funcid == 's' || order.funcid == 'S' || order.funcid == 'e' || order.funcid == 'e')
+        {
+            sprintf(numstr, "%.8f", (double)order.price / COIN);
+            item.push_back(Pair("totalrequired", numstr));
+            sprintf(numstr, "%.8f", (double)order.price / (COIN * order.amount0));
+            item.push_back(Pair("price", numstr));
+        }
+        else
+        {
+            item.push_back(Pair("totalrequired", (int64_t)order.price));
+            sprintf(numstr, "%.8f", (double)order.amount0 / (order.price * COIN));
+            item.push_back(Pair("price", numstr));
+        }
+    }
+    return(item);
+}
+
 UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
 {
 	UniValue result(UniValue::VARR);  
@@ -29,24 +85,22 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
 
 	auto addOrders = [&](struct CCcontract_info *cp, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it)
 	{
-		uint256 txid, hashBlock, assetid, assetid2;
-		int64_t price;
-		std::vector<uint8_t> origpubkey;
+		uint256 txid, hashBlock, assetid;
+		CAssetOrderValue order;
 		CTransaction ordertx;
-		uint8_t funcid, evalCode;
-		char numstr[32], funcidstr[16], origaddr[64], origtokenaddr[64];
+		uint8_t evalCode;
 
         txid = it->first.txhash;
         LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking txid=" << txid.GetHex() << std::endl);
         if ( myGetTransaction(txid, ordertx, hashBlock) != 0 )
         {
 			// for logging: funcid = DecodeAssetOpRet(vintx.vout[vintx.vout.size() - 1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey);
-            if (ordertx.vout.size() > 0 && (funcid = DecodeAssetTokenOpRet(ordertx.vout[ordertx.vout.size()-1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey)) != 0)
+            if (ordertx.vout.size() > 0 && (order.funcid = DecodeAssetTokenOpRet(ordertx.vout[ordertx.vout.size()-1].scriptPubKey, evalCode, assetid, order.assetid2, order.price, order.origpubkey)) != 0)
             {
-                LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking ordertx.vout.size()=" << ordertx.vout.size() << " funcid=" << (char)(funcid ? funcid : ' ') << " assetid=" << assetid.GetHex() << std::endl);
+                LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking ordertx.vout.size()=" << ordertx.vout.size() << " funcid=" << (char)(order.funcid ? order.funcid : ' ') << " assetid=" << assetid.GetHex() << std::endl);
 
                 if (pk == CPubKey() && (refassetid == zeroid || assetid == refassetid)  // tokenorders
-                    || pk != CPubKey() && pk == pubkey2pk(origpubkey) && (funcid == 'S' || funcid == 's'))  // mytokenorders, returns only asks (is this correct?)
+                    || pk != CPubKey() && pk == pubkey2pk(order.origpubkey) && (order.funcid == 'S' || order.funcid == 's'))  // mytokenorders, returns only asks (is this correct?)
                 {
 
                     LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << std::endl);
@@ -55,56 +109,10 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
                         return;
                     }
 
-                    UniValue item(UniValue::VOBJ);
-
-                    funcidstr[0] = funcid;
-                    funcidstr[1] = 0;
-                    item.push_back(Pair("funcid", funcidstr));
-                    item.push_back(Pair("txid", txid.GetHex()));
-                    item.push_back(Pair("vout", (int64_t)it->first.index));
-                    if (funcid == 'b' || funcid == 'B')
-                    {
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[it->first.index].nValue / COIN);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / COIN);
-                        item.push_back(Pair("bidamount", numstr));
-                    }
-                    else
-                    {
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[it->first.index].nValue);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[0].nValue);
-                        item.push_back(Pair("askamount", numstr));
-                    }
-                    if (origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
-                    {
-                        GetCCaddress(cp, origaddr, pubkey2pk(origpubkey));  
-                        item.push_back(Pair("origaddress", origaddr));
-                        GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(origpubkey));
-                        item.push_back(Pair("origtokenaddress", origtokenaddr));
-                    }
-                    if (assetid != zeroid)
-                        item.push_back(Pair("tokenid", assetid.GetHex()));
-                    if (assetid2 != zeroid)
-                        item.push_back(Pair("otherid", assetid2.GetHex()));
-                    if (price > 0)
-                    {
-                        if (funcid == 's' || funcid == 'S' || funcid == 'e' || funcid == 'e')
-                        {
-                            sprintf(numstr, "%.8f", (double)price / COIN);
-                            item.push_back(Pair("totalrequired", numstr));
-                            sprintf(numstr, "%.8f", (double)price / (COIN * ordertx.vout[0].nValue));
-                            item.push_back(Pair("price", numstr));
-                        }
-                        else
-                        {
-                            item.push_back(Pair("totalrequired", (int64_t)price));
-                            sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / (price * COIN));
-                            item.push_back(Pair("price", numstr));
-                        }
-                    }
-                    result.push_back(item);
-                    LOGSTREAM("ccassets", CCLOG_DEBUG1, stream << "addOrders() added order funcId=" << (char)(funcid ? funcid : ' ') << " it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << " tokenid=" << assetid.GetHex() << std::endl);
+                    order.amount = ordertx.vout[it->first.index].nValue;
+                    order.amount0 = ordertx.vout[0].nValue;
+                    result.push_back(AssetOrderToJSON(cp, cpTokens, txid, it->first.index, assetid, order));
+                    LOGSTREAM("ccassets", CCLOG_DEBUG1, stream << "addOrders() added order funcId=" << (char)(order.funcid ? order.funcid : ' ') << " it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << " tokenid=" << assetid.GetHex() << std::endl);
                 }
             }
         }
@@ -114,7 +122,6 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
 
 	char assetsUnspendableAddr[64];
 	GetCCaddress(cpAssets, assetsUnspendableAddr, GetUnspendable(cpAssets, NULL));
-	SetCCunspents(unspentOutputsCoins, assetsUnspendableAddr,true);
 
 	char assetsTokensUnspendableAddr[64];
     std::vector<uint8_t> vopretNonfungible;
@@ -123,6 +130,35 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
         if (vopretNonfungible.size() > 0)
             cpAssets->additionalTokensEvalcode2 = vopretNonfungible.begin()[0];
     }
+
+    if (fAssetOrderIndex)
+    {
+        // the orderbook index has the decoded orders, the same ones the address scan finds:
+        // bids and the asks on the tokens addresses below, best price first for a single token
+        std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > orders, asks;
+        uint8_t evalcode2 = cpAssets->additionalTokensEvalcode2;
+        bool fMore;
+        if (refassetid == zeroid)
+        {
+            if (!GetAssetOrderBook(zeroid, 0, NULL, false, 0, orders, fMore))
+                return(result);
+        }
+        else if (!GetAssetOrderBook(refassetid, ASSET_ORDER_BID, NULL, false, 0, orders, fMore) ||
+                 !GetAssetOrderBook(refassetid, ASSET_ORDER_ASK, NULL, false, 0, asks, fMore))
+            return(result);
+        orders.insert(orders.end(), asks.begin(), asks.end());
+
+        for (const std::pair<CAssetOrderKey, CAssetOrderValue> &order : orders)
+        {
+            if (order.second.evalcode2 != 0 && order.second.evalcode2 != evalcode2 && order.second.evalcode2 != additionalEvalCode)
+                continue;
+            if (pk == CPubKey() || pk == pubkey2pk(order.second.origpubkey) && (order.second.funcid == 'S' || order.second.funcid == 's'))
+                result.push_back(AssetOrderToJSON(cpAssets, cpTokens, order.first.txhash, order.first.index, order.first.tokenid, order.second));
+        }
+        return(result);
+    }
+
+	SetCCunspents(unspentOutputsCoins, assetsUnspendableAddr,true);
 	GetTokensCCaddress(cpAssets, assetsTokensUnspendableAddr, GetUnspendable(cpAssets, NULL));
 	SetCCunspents(unspentOutputsTokens, assetsTokensUnspendableAddr,true);
 
@@ -832,6 +832,22 @@ UniValue FinalizeCCTxExt(bool remote, uint64_t skipmask, struct CCcontract_info
 /// @param CCflag if true the function searches for cc outputs, otherwise for normal outputs
 void SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,bool CCflag = true);
 
+/// overloaded SetCCunspents stops reading the address index once maxOutputs unspent outputs are collected
+/// @param[out] unspentOutputs vector of pairs of address key and amount, at most maxOutputs are added
+/// @param coinaddr address where unspent outputs are searched
+/// @param CCflag if true the function searches for cc outputs, otherwise for normal outputs
+/// @param maxOutputs the most outputs to return
+/// @returns false if the address has more than maxOutputs unspent outputs
+bool SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,bool CCflag,size_t maxOutputs);
+
+/// SetCCtokenunspents returns the confirmed unspent cc outputs of a token on an address from the token index,
+/// in the same order as SetCCunspents. The outputs are not validated and their script is not filled in
+/// @param[out] unspentOutputs vector of pairs of address key and amount
+/// @param coinaddr cc address where unspent outputs are searched
+/// @param tokenid id of the token
+/// @returns false if the token index is not enabled, then SetCCunspents should be used
+bool SetCCtokenunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,uint256 tokenid);
+
 /// SetCCtxids returns a vector of all outputs on an address
 /// @param[out] addressIndex vector of pairs of address index key and amount
 /// @param coinaddr address where the unspent outputs are searched
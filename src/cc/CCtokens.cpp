@@ -625,7 +625,9 @@ int64_t AddTokenCCInputs(struct CCcontract_info *cp, CMutableTransaction &mtx, C
         cp->additionalTokensEvalcode2 = vopretNonfungible.begin()[0];
 
 	GetTokensCCaddress(cp, tokenaddr, pk);
-	SetCCunspents(unspentOutputs, tokenaddr,true);
+	// with the token index only this token's outputs are listed, they are still validated below
+	if (!SetCCtokenunspents(unspentOutputs, tokenaddr, tokenid))
+		SetCCunspents(unspentOutputs, tokenaddr,true);
 
 
     if (unspentOutputs.empty()) {
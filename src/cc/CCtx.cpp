@@ -418,6 +418,56 @@ void SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValu
     }
 }
 
+bool SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,bool ccflag,size_t maxOutputs)
+{
+    int32_t type=0; uint160 hashBytes; size_t n = 0; bool fMore = false;
+    if ( KOMODO_NSPV_SUPERLITE )
+    {
+        NSPV_CCunspents(unspentOutputs,coinaddr,ccflag);
+        if ( unspentOutputs.size() > maxOutputs )
+        {
+            unspentOutputs.resize(maxOutputs);
+            return(false);
+        }
+        return(true);
+    }
+    CBitcoinAddress address(coinaddr);
+    if ( address.GetIndexKey(hashBytes, type, ccflag) == 0 )
+        return(true);
+    ScanAddressUnspent(hashBytes, type, NULL, false, [&](const CAddressUnspentKey &key, const CAddressUnspentValue &value) {
+        if ( n == maxOutputs )
+        {
+            fMore = true;
+            return(false);
+        }
+        unspentOutputs.push_back(std::make_pair(key, value));
+        n++;
+        return(true);
+    });
+    return(!fMore);
+}
+
+bool SetCCtokenunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,uint256 tokenid)
+{
+    int32_t type=0; uint160 hashBytes; size_t n = unspentOutputs.size();
+    if ( KOMODO_NSPV_SUPERLITE )
+        return(false);
+    CBitcoinAddress address(coinaddr);
+    if ( address.GetIndexKey(hashBytes, type, true) == 0 )
+        return(false);
+    CAddressIndexIteratorKey addressKey(type, hashBytes);
+    if ( !ScanTokenUnspent(tokenid, &addressKey, [&](const CTokenUnspentKey &key, const CTokenUnspentValue &value) {
+            unspentOutputs.push_back(std::make_pair(CAddressUnspentKey(key.type, key.hashBytes, key.txhash, key.index), CAddressUnspentValue(value.satoshis, CScript(), value.blockHeight)));
+            return(true);
+        }) )
+    {
+        // let the caller fall back to the address index
+        unspentOutputs.resize(n);
+        return(false);
+    }
+    return(true);
+}
+
 void SetCCtxids(std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,char *coinaddr,bool ccflag)
 {
     int32_t type=0,i,n; char *ptr; std::string addrstr; uint160 hashBytes; std::vector<std::pair<uint160, int> > addresses;
@@ -533,6 +583,14 @@ int32_t CCgetspenttxid(uint256 &spenttxid,int32_t &vini,int32_t &height,uint256
 int64_t CCaddress_balance(char *coinaddr,int32_t CCflag)
 {
     int64_t sum = 0; std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    if ( fAddressBalanceIndex && !KOMODO_NSPV_SUPERLITE )
+    {
+        // Running balance instead of walking every unspent output of the address
+        uint160 hashBytes; int32_t type = 0; CAddressBalanceValue value;
+        CBitcoinAddress address(coinaddr);
+        if ( address.GetIndexKey(hashBytes, type, CCflag != 0) != 0 && GetAddressBalance(hashBytes, type, value) )
+            return(value.balance);
+    }
     SetCCunspents(unspentOutputs,coinaddr,CCflag!=0?true:false);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
@@ -561,6 +619,13 @@ int64_t CCtoken_balance(char *coinaddr,uint256 reftokenid)
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 	uint8_t evalCode;
 
+    if ( SetCCtokenunspents(unspentOutputs,coinaddr,reftokenid) != 0 )
+    {
+        // the token index only holds outputs of reftokenid, no transaction has to be loaded
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+            sum += it->second.satoshis;
+        return(sum);
+    }
     SetCCunspents(unspentOutputs,coinaddr,true);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
@@ -28,6 +28,8 @@
 #include "komodo_utils.h"
 #include "komodo_bitcoind.h"
 #include "komodo_interest.h"
+#include "rust/metrics.h"
+#include "threadpool.h"
 
 #include <assert.h>
 
@@ -135,8 +137,11 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        MetricsStaticIncrementCounter("elosys.coins.cache.lookups", "result", "hit");
         return it;
+    }
+    MetricsStaticIncrementCounter("elosys.coins.cache.lookups", "result", "miss");
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
@@ -805,7 +810,7 @@ CAmount CCoinsViewCache::GetValueIn(int32_t nHeight,int64_t &interestp,const CTr
     return nResult;
 }
 
-static bool HaveJoinSplitRequirementsWorkerNullifier(const CCoinsViewCache *coinCache,const std::vector<const SpendDescription*> vSpend, int threadNum)
+static bool HaveJoinSplitRequirementsWorkerNullifier(const CCoinsViewCache *coinCache,const std::vector<const SpendDescription*>& vSpend, int threadNum)
 {
     //Perform Sapling Spend checks
     for (int i = 0; i < vSpend.size(); i++) {
@@ -817,7 +822,7 @@ static bool HaveJoinSplitRequirementsWorkerNullifier(const CCoinsViewCache *coin
     return true;
 }
 
-static bool HaveJoinSplitRequirementsWorkerAnchor(const CCoinsViewCache *coinCache,const std::vector<const SpendDescription*> vSpend, int threadNum)
+static bool HaveJoinSplitRequirementsWorkerAnchor(const CCoinsViewCache *coinCache,const std::vector<const SpendDescription*>& vSpend, int threadNum)
 {
     //Perform Sapling Spend checks
     for (int i = 0; i < vSpend.size(); i++) {
@@ -867,6 +872,7 @@ bool CCoinsViewCache::HaveJoinSplitRequirements(const CTransaction& tx, int maxP
 
     //Create a Vector of futures to be collected later
     std::vector<std::future<bool>> vFutures;
+    CTaskGroup validationGroup(GetValidationThreadPool());
 
     //Setup spend batches
     std::vector<const SpendDescription*> vSpend;
@@ -877,17 +883,15 @@ bool CCoinsViewCache::HaveJoinSplitRequirements(const CTransaction& tx, int maxP
         vSpend.emplace_back(&(tx.vShieldedSpend[i]));
     }
 
-    //Push batches of spends to async threads
+    //Push batches of spends to the validation pool
     if (!vSpend.empty()) {
-        vFutures.emplace_back(std::async(std::launch::async, HaveJoinSplitRequirementsWorkerNullifier, this, vSpend, 1));
-        vFutures.emplace_back(std::async(std::launch::async, HaveJoinSplitRequirementsWorkerAnchor, this, vSpend, 2));
+        vFutures.emplace_back(validationGroup.Submit([this, &vSpend]() { return HaveJoinSplitRequirementsWorkerNullifier(this, vSpend, 1); }));
+        vFutures.emplace_back(validationGroup.Submit([this, &vSpend]() { return HaveJoinSplitRequirementsWorkerAnchor(this, vSpend, 2); }));
     }
 
 
-    //Wait for all threads to complete
-    for (auto &future : vFutures) {
-        future.wait();
-    }
+    //Wait for all tasks to complete
+    validationGroup.Wait();
 
     //Collect the async results
     bool ret = true;
@@ -904,7 +908,7 @@ bool CCoinsViewCache::HaveJoinSplitRequirements(const CTransaction& tx, int maxP
     return ret;
 }
 
-static bool HaveJoinSplitRequirementsWorkerDuplicateSpendProofs(const CCoinsViewCache *coinCache,const std::vector<const SpendDescription*> vSpend, int threadNum)
+static bool HaveJoinSplitRequirementsWorkerDuplicateSpendProofs(const CCoinsViewCache *coinCache,const std::vector<const SpendDescription*>& vSpend, int threadNum)
 {
     //Perform Sapling Spend checks
     for (int i = 0; i < vSpend.size(); i++) {
@@ -917,7 +921,7 @@ static bool HaveJoinSplitRequirementsWorkerDuplicateSpendProofs(const CCoinsView
     return true;
 }
 
-static bool HaveJoinSplitRequirementsWorkerDuplicateOutputProofs(const CCoinsViewCache *coinCache,const std::vector<const OutputDescription*> vOutput, int threadNum)
+static bool HaveJoinSplitRequirementsWorkerDuplicateOutputProofs(const CCoinsViewCache *coinCache,const std::vector<const OutputDescription*>& vOutput, int threadNum)
 {
     //Perform Sapling Spend checks
     for (int i = 0; i < vOutput.size(); i++) {
@@ -938,6 +942,7 @@ bool CCoinsViewCache::HaveJoinSplitRequirementsDuplicateProofs(const CTransactio
 
     //Create a Vector of futures to be collected later
     std::vector<std::future<bool>> vFutures;
+    CTaskGroup validationGroup(GetValidationThreadPool());
 
     //Setup spend & output batches
     std::vector<const SpendDescription*> vSpend;
@@ -955,23 +960,21 @@ bool CCoinsViewCache::HaveJoinSplitRequirementsDuplicateProofs(const CTransactio
         vOutput.emplace_back(&(tx.vShieldedOutput[i]));
     }
 
-    //Push batches of spends to async threads
+    //Push batches of spends to the validation pool
     if (!vSpend.empty()) {
         //Perform SpendDescription validations
-        vFutures.emplace_back(std::async(std::launch::async, HaveJoinSplitRequirementsWorkerDuplicateSpendProofs, this, vSpend, 1));
+        vFutures.emplace_back(validationGroup.Submit([this, &vSpend]() { return HaveJoinSplitRequirementsWorkerDuplicateSpendProofs(this, vSpend, 1); }));
     }
 
 
-    //Push batches of output to async threads
+    //Push batches of output to the validation pool
     if (!vOutput.empty()) {
         //Perform SpendDescription validations
-        vFutures.emplace_back(std::async(std::launch::async, HaveJoinSplitRequirementsWorkerDuplicateOutputProofs, this, vOutput, 2));
+        vFutures.emplace_back(validationGroup.Submit([this, &vOutput]() { return HaveJoinSplitRequirementsWorkerDuplicateOutputProofs(this, vOutput, 2); }));
     }
 
-    //Wait for all threads to complete
-    for (auto &future : vFutures) {
-        future.wait();
-    }
+    //Wait for all tasks to complete
+    validationGroup.Wait();
 
     //Collect the async results
     bool ret = true;
@@ -0,0 +1,52 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSUPPLYINDEX_H
+#define BITCOIN_COINSUPPLYINDEX_H
+
+#include "amount.h"
+#include "serialize.h"
+
+/**
+ * Running totals of the chain up to and including a block, as komodo_coinsupply
+ * sums them block by block. Stored per block hash, so the entries of blocks
+ * that are disconnected stay valid for the branch they belong to.
+ */
+struct CCoinSupplyValue {
+    //! Transparent supply: outputs created minus inputs spent
+    CAmount nSupply;
+    //! Value held by the Sprout and Sapling pools
+    CAmount nShielded;
+    //! Value held by the Sprout pool alone
+    CAmount nSprout;
+    //! Notary pay of the coinbases
+    CAmount nNotaryPay;
+    //! Provably unspendable outputs (OP_RETURN) and outputs to the burn address
+    CAmount nBurned;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nSupply);
+        READWRITE(nShielded);
+        READWRITE(nSprout);
+        READWRITE(nNotaryPay);
+        READWRITE(nBurned);
+    }
+
+    CCoinSupplyValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nSupply = 0;
+        nShielded = 0;
+        nSprout = 0;
+        nNotaryPay = 0;
+        nBurned = 0;
+    }
+};
+
+#endif // BITCOIN_COINSUPPLYINDEX_H
@@ -0,0 +1,129 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COMPACTSAPLINGINDEX_H
+#define BITCOIN_COMPACTSAPLINGINDEX_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <array>
+#include <vector>
+
+/**
+ * Compact Sapling blocks for light wallets, modeled on the ZIP-307 CompactBlock
+ * format: per output only what trial decryption needs (cmu, ephemeral key and the
+ * first 52 bytes of the note ciphertext), per spend only the nullifier.
+ */
+
+/** Leading bytes of encCiphertext holding leadbyte, d, value and rcm (ZIP-307) */
+static const size_t COMPACT_NOTE_CIPHERTEXT_SIZE = 52;
+
+struct CCompactSaplingOutput {
+    uint256 cmu;
+    uint256 ephemeralKey;
+    std::array<unsigned char, COMPACT_NOTE_CIPHERTEXT_SIZE> ciphertext;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(cmu);
+        READWRITE(ephemeralKey);
+        READWRITE(ciphertext);
+    }
+
+    CCompactSaplingOutput() {
+        ciphertext.fill(0);
+    }
+
+    explicit CCompactSaplingOutput(const OutputDescription& output) {
+        cmu = output.cmu;
+        ephemeralKey = output.ephemeralKey;
+        std::copy(output.encCiphertext.begin(), output.encCiphertext.begin() + COMPACT_NOTE_CIPHERTEXT_SIZE, ciphertext.begin());
+    }
+};
+
+struct CCompactSaplingTx {
+    //! Position of the transaction in its block
+    uint32_t nIndex;
+    uint256 txid;
+    std::vector<uint256> vNullifiers;
+    std::vector<CCompactSaplingOutput> vOutputs;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nIndex);
+        READWRITE(txid);
+        READWRITE(vNullifiers);
+        READWRITE(vOutputs);
+    }
+
+    CCompactSaplingTx() : nIndex(0) {}
+
+    CCompactSaplingTx(uint32_t nIndexIn, const CTransaction& tx) : nIndex(nIndexIn), txid(tx.GetHash()) {
+        for (const SpendDescription& spend : tx.vShieldedSpend)
+            vNullifiers.push_back(spend.nullifier);
+        for (const OutputDescription& output : tx.vShieldedOutput)
+            vOutputs.emplace_back(output);
+    }
+};
+
+struct CCompactSaplingBlock {
+    int nHeight;
+    uint256 hash;
+    uint256 hashPrevBlock;
+    uint32_t nTime;
+    uint256 hashFinalSaplingRoot;
+    //! Only the transactions with Sapling spends or outputs
+    std::vector<CCompactSaplingTx> vtx;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nHeight);
+        READWRITE(hash);
+        READWRITE(hashPrevBlock);
+        READWRITE(nTime);
+        READWRITE(hashFinalSaplingRoot);
+        READWRITE(vtx);
+    }
+
+    CCompactSaplingBlock() : nHeight(0), nTime(0) {}
+
+    CCompactSaplingBlock(const CBlock& block, int nHeightIn) :
+        nHeight(nHeightIn), hash(block.GetHash()), hashPrevBlock(block.hashPrevBlock),
+        nTime(block.nTime), hashFinalSaplingRoot(block.hashFinalSaplingRoot) {
+        for (uint32_t i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = block.vtx[i];
+            if (!tx.vShieldedSpend.empty() || !tx.vShieldedOutput.empty())
+                vtx.emplace_back(i, tx);
+        }
+    }
+};
+
+/** Keyed by height, big endian so that a cursor walks the chain in order */
+struct CCompactSaplingIndexKey {
+    int nHeight;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 4;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, nHeight);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        nHeight = ser_readdata32be(s);
+    }
+
+    explicit CCompactSaplingIndexKey(int nHeightIn = 0) : nHeight(nHeightIn) {}
+};
+
+#endif // BITCOIN_COMPACTSAPLINGINDEX_H
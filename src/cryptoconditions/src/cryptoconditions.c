@@ -257,6 +257,25 @@ int cc_visit(CC *cond, CCVisitor visitor) {
 int cc_verify(const struct CC *cond, const unsigned char *msg, size_t msgLength, int doHashMsg,
               const unsigned char *condBin, size_t condBinLength,
               VerifyEval verifyEval, void *evalContext) {
+    if (!cc_verifySignatures(cond, msg, msgLength, doHashMsg, condBin, condBinLength)) {
+        return 0;
+    }
+
+    if (!cc_verifyEval(cond, verifyEval, evalContext)) {
+        //fprintf(stderr,"cc_verify error D\n");
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * Everything cc_verify checks except the eval nodes: the condition matches
+ * condBin and the signatures are valid. The result only depends on the
+ * arguments, so callers may cache it.
+ */
+int cc_verifySignatures(const struct CC *cond, const unsigned char *msg, size_t msgLength, int doHashMsg,
+                        const unsigned char *condBin, size_t condBinLength) {
     unsigned char targetBinary[1000];
     //fprintf(stderr,"in cc_verify cond.%p msg.%p[%d] dohash.%d condbin.%p[%d]\n",cond,msg,(int32_t)msgLength,doHashMsg,condBin,(int32_t)condBinLength);
     const size_t binLength = cc_conditionBinary(cond, targetBinary);
@@ -281,11 +300,6 @@ int cc_verify(const struct CC *cond, const unsigned char *msg, size_t msgLength,
         fprintf(stderr," cc_verify error C\n");
         return 0;
     }
-
-    if (!cc_verifyEval(cond, verifyEval, evalContext)) {
-        //fprintf(stderr,"cc_verify error D\n");
-        return 0;
-    }
     return 1;
 }
 
@@ -4,6 +4,7 @@
 
 #include "dbwrapper.h"
 
+#include "rust/metrics.h"
 #include "util.h"
 
 #include <boost/filesystem.hpp>
@@ -118,4 +119,12 @@ void HandleError(const leveldb::Status& status)
     throw dbwrapper_error("Unknown database error");
 }
 
+void RecordRead(bool fFound)
+{
+    if (fFound)
+        MetricsStaticIncrementCounter("elosys.leveldb.reads", "result", "found");
+    else
+        MetricsStaticIncrementCounter("elosys.leveldb.reads", "result", "notfound");
+}
+
 };
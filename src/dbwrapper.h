@@ -35,6 +35,9 @@ namespace dbwrapper_private {
  */
 void HandleError(const leveldb::Status& status);
 
+/** Count a point lookup in the metrics, fFound is false when the key was missing */
+void RecordRead(bool fFound);
+
 };
 
 /** Batch of changes queued to be written to a CDBWrapper */
@@ -210,6 +213,7 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        dbwrapper_private::RecordRead(status.ok());
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -255,6 +259,7 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        dbwrapper_private::RecordRead(status.ok());
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
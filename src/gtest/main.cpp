@@ -2,6 +2,7 @@
 #include "crypto/common.h"
 #include "key.h"
 #include "pubkey.h"
+#include "script/sigcache.h"
 #include "zcash/JoinSplit.hpp"
 #include "util.h"
 
@@ -19,6 +20,7 @@ ZCJoinSplit* params;
 int main(int argc, char **argv) {
   assert(init_and_check_sodium() != -1);
   ECC_Start();
+  InitSignatureCache();
 
   boost::filesystem::path sapling_spend = ZC_GetParamsDir() / "sapling-spend.params";
   boost::filesystem::path sapling_output = ZC_GetParamsDir() / "sapling-output.params";
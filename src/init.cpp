@@ -26,6 +26,9 @@
 #include "primitives/block.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockencodings.h"
+#include "blockfilereader.h"
+#include "blockindexsnapshot.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
@@ -48,10 +51,18 @@
 #include "metrics.h"
 #include "miner.h"
 #include "net.h"
+#include "netpoller.h"
+#include "policy/policy.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "rust/metrics.h"
+#include "saplingcache.h"
+#include "script/serverchecker.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
+#include "threadpool.h"
+#include "txcache.h"
 #include "txdb.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
@@ -64,6 +75,8 @@
 #include "wallet/asyncrpcoperation_saplingconsolidation.h"
 #include "wallet/asyncrpcoperation_sweeptoaddress.h"
 #endif
+#include <atomic>
+#include <limits>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -113,6 +126,8 @@ assetchain chainName;
 CWallet* pwalletMain = NULL;
 #endif
 bool fFeeEstimatesInitialized = false;
+//! Only dump the mempool once it has been loaded, so an early shutdown does not truncate mempool.dat
+static std::atomic<bool> fDumpMempoolLater(false);
 
 #if ENABLE_ZMQ
 static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
@@ -263,6 +278,9 @@ void Shutdown()
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
 
+    if (fDumpMempoolLater && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
+
     if (fFeeEstimatesInitialized)
     {
         boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
@@ -304,6 +322,7 @@ void Shutdown()
     if (pwalletMain)
         pwalletMain->Flush(true);
 #endif
+    StopValidationThreadPool();
 
 #if ENABLE_ZMQ
     if (pzmqNotificationInterface) {
@@ -418,13 +437,20 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-exportdir=<dir>", _("Specify directory to be used when exporting data"));
+    strUsage += HelpMessageOpt("-blockindexsnapshot", strprintf(_("Load the block index from a flat snapshot written at shutdown instead of walking the block index database (default: %u)"), DEFAULT_BLOCKINDEX_SNAPSHOT));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-txcachesize=<n>", strprintf(_("Keep up to <n> megabytes of transactions read through -txindex in memory, 0 to disable (default: %u)"), DEFAULT_TX_CACHE_SIZE));
+    strUsage += HelpMessageOpt("-mappedblockfiles=<n>", strprintf(_("Keep up to <n> of the most recently read block files memory mapped, 0 to read them through stdio (default: %u)"), DEFAULT_MAPPED_BLOCK_FILES));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-mempooltxinputlimit=<n>", _("[DEPRECATED FROM OVERWINTER] Set the maximum number of transparent inputs in a transaction that the mempool will accept (default: 0 = no limit applied)"));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
-    strUsage += HelpMessageOpt("-maxprocessingthreads=<n>", strprintf(_("Set the number of processing threads used (default: %i)"),GetNumCores()));
+    strUsage += HelpMessageOpt("-maxprocessingthreads=<n>", strprintf(_("Set the number of threads in the shared validation pool used for Sapling checks and wallet note decryption (default: %i)"),GetNumCores()));
+    strUsage += HelpMessageOpt("-saplingbatchverify", strprintf(_("Verify Sapling proofs in a block with randomized batches, falling back to individual checks on failure (default: %u)"), DEFAULT_SAPLING_BATCH_VERIFY));
 
 #ifndef _WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "komodod.pid"));
@@ -440,6 +466,11 @@ std::string HelpMessage(HelpMessageMode mode)
     // strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
+    strUsage += HelpMessageOpt("-addressbalanceindex", strprintf(_("Maintain the balance, total received and transaction count of every address for getaddressbalance, built in the background from -addressindex when first enabled (default: %u)"), DEFAULT_ADDRESSBALANCEINDEX));
+    strUsage += HelpMessageOpt("-compactsaplingindex", strprintf(_("Maintain compact Sapling blocks (ZIP-307 style) for light wallet backends, served by getcompactsaplingblocks and REST (default: %u)"), DEFAULT_COMPACTSAPLINGINDEX));
+    strUsage += HelpMessageOpt("-tokenindex", strprintf(_("Maintain an index of the unspent token outputs of every token and CC address, used by the token balance RPCs and tokenutxos (default: %u)"), DEFAULT_TOKENINDEX));
+    strUsage += HelpMessageOpt("-assetorderindex", strprintf(_("Maintain an orderbook index of the open token bids and asks sorted by price, used by tokenorders and tokenorderbook (default: %u)"), DEFAULT_ASSETORDERINDEX));
+    strUsage += HelpMessageOpt("-coinsupplyindex", strprintf(_("Maintain running totals of the coin supply, shielded pools, notary pay and burned coins per block, used by coinsupply (default: %u)"), DEFAULT_COINSUPPLYINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -447,6 +478,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), 86400));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-compactblocks", strprintf(_("Exchange new blocks with supporting peers as short transaction ids, rebuilt from the mempool (default: %u)"), DEFAULT_COMPACT_BLOCKS));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s)"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)"));
@@ -458,6 +490,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), 5000));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), 1000));
+    strUsage += HelpMessageOpt("-msgworkers=<n>", strprintf(_("Number of threads handling read-only peer messages such as getdata and getheaders, 0 handles them on the message handler thread (default: %d, maximum: %d)"), DEFAULT_MSG_WORKER_THREADS, MAX_MSG_WORKER_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-i2psam=<ip:port>", strprintf(_("I2P SAM proxy to reach I2P peers and accept I2P connections (default: none)")));
     strUsage += HelpMessageOpt("-i2pacceptincoming", strprintf(_("If set and -i2psam is also set then incoming I2P connections are accepted via the SAM proxy. If this is not set but -i2psam is set then only outgoing connections will be made to the I2P network. Ignored if -i2psam is not set. Listening for incoming I2P connections is done through the SAM proxy, not by binding to a local address and port (default: 1)")));
@@ -473,6 +506,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketpoller=<backend>", strprintf(_("Wait for peer socket readiness with <backend>, epoll (Linux only) or select (default: %s)"), DEFAULT_SOCKET_POLLER));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -540,6 +574,9 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", 1));
+#ifdef ENABLE_WALLET
+        strUsage += HelpMessageOpt("-checkwalletbalances", strprintf("Verify the wallet balance ledger against a full wallet scan on every balance query, logging and rebuilding it on a mismatch (default: %u)", 0));
+#endif
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)", 100));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", 0));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", 0));
@@ -549,7 +586,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", 0));
         strUsage += HelpMessageOpt("-nuparams=hexBranchId:activationHeight", "Use given activation height for specified network upgrade (regtest-only)");
     }
-    string debugCategories = "addrman, alert, bench, coindb, db, deletetx, estimatefee, http, libevent, lock, mempool, net, partitioncheck, pow, proxy, prune, "
+    string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, deletetx, estimatefee, http, libevent, lock, mempool, net, partitioncheck, pow, proxy, prune, "
                              "rand, reindex, rpc, selectcoins, tor, zmq, zrpc, zrpcunsafe (implies zrpc)"; // Don't translate these
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
         _("If <category> is not supplied or if <category> = 1, output all debugging information.") + " " + _("<category> can be:") + " " + debugCategories + ".");
@@ -561,7 +598,9 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 0));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxccparsecachesize=<n>", strprintf("Keep up to <n> parsed crypto-condition fulfillments between mempool accept and block connection (default: %u)", DEFAULT_CC_PARSE_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsaplingcachesize=<n>", strprintf("Limit size of the Sapling bundle validity cache to <n> MiB (default: %u)", DEFAULT_MAX_SAPLING_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying (default: %s)"),
@@ -628,6 +667,9 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-metricsui", _("Set to 1 for a persistent metrics screen, 0 for sequential metrics output (default: 1 if running in a console, 0 otherwise)"));
         strUsage += HelpMessageOpt("-metricsrefreshtime", strprintf(_("Number of seconds between metrics refreshes (default: %u if running in a console, %u otherwise)"), 1, 600));
     }
+    strUsage += HelpMessageOpt("-prometheusport=<port>", _("Expose node metrics in the Prometheus exposition format. An HTTP listener will be started on <port>, which responds to GET requests on any request path. Use -metricsallowip and -metricsbind to control access."));
+    strUsage += HelpMessageOpt("-metricsallowip=<ip>", _("Allow metrics connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times (default: localhost only)"));
+    strUsage += HelpMessageOpt("-metricsbind=<addr>", _("Bind the metrics listener to the given address (default: all interfaces, connections are still limited to -metricsallowip)"));
     strUsage += HelpMessageGroup(_("Komodo Asset Chain options:"));
     strUsage += HelpMessageOpt("-ac_algo", _("Choose PoW mining algorithm, default is Equihash"));
     strUsage += HelpMessageOpt("-ac_blocktime", _("Block time in seconds, default is 60"));
@@ -796,6 +838,11 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        LoadMempool();
+        fDumpMempoolLater = !ShutdownRequested();
+    }
 }
 
 void ThreadNotifyRecentlyAdded()
@@ -984,6 +1031,10 @@ bool AttemptDatabaseOpen(size_t nBlockTreeDBCache, bool dbCompression, size_t db
         pcoinsTip = new CCoinsViewCache(pcoinscatcher);
         pnotarisations = new NotarisationDB(100*1024*1024, false, fReindex);
 
+        // Without snapshots the journal of index writes would only grow
+        if (!fReindex && !GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCKINDEX_SNAPSHOT))
+            pblocktree->EraseBlockIndexSnapshotId();
+
         if (fReindex) {
             boost::filesystem::remove(GetDataDir() / KOMODO_STATE_FILENAME);
             boost::filesystem::remove(GetDataDir() / "signedmasks");
@@ -1177,6 +1228,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
     LogPrintf("Maximum number of processing threads used in multithreaded functions %i\n", maxProcessingThreads);
+    // Shared workers for block validation and wallet note decryption
+    StartValidationThreadPool(maxProcessingThreads);
+    fSaplingBatchVerify = GetBoolArg("-saplingbatchverify", DEFAULT_SAPLING_BATCH_VERIFY);
+
+    if (GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) > MAX_PLAUSIBLE_SIG_CACHE_SIZE)
+        InitWarning(strprintf(_("-maxsigcachesize is now given in MiB, not in entries. %d MiB (capped at %d) will be used for the signature cache, check your configuration."),
+            GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE), MAX_MAX_SIG_CACHE_SIZE));
+    InitSignatureCache();
+
+    // Sapling bundles verified on mempool accept are not verified again in ConnectBlock
+    int64_t nSaplingCacheSize = std::max((int64_t)0, std::min((int64_t)MAX_MAX_SAPLING_CACHE_SIZE,
+        GetArg("-maxsaplingcachesize", DEFAULT_MAX_SAPLING_CACHE_SIZE)));
+    InitSaplingBundleCache(((size_t)nSaplingCacheSize) << 20);
 
     // when specifying an explicit binding address, you want to listen on it
     // even when -connect or -proxy is specified
@@ -1277,7 +1341,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     //fprintf(stderr,"nMaxConnections %d\n",nMaxConnections);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    std::string strSocketPoller = GetArg("-socketpoller", DEFAULT_SOCKET_POLLER);
+    if (strSocketPoller != "epoll" && strSocketPoller != "select")
+        return InitError(strprintf(_("Unknown -socketpoller backend: '%s'"), strSocketPoller));
+    int nMaxPollable = FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS;
+#ifdef __linux__
+    // epoll is not bound by FD_SETSIZE, only by the descriptor limit below
+    if (strSocketPoller == "epoll")
+        nMaxPollable = std::numeric_limits<int>::max() - MIN_CORE_FILEDESCRIPTORS;
+#endif
+    nMaxConnections = std::max(std::min(nMaxConnections, nMaxPollable), 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     //fprintf(stderr,"nMaxConnections %d FD_SETSIZE.%d nBind.%d expr.%d \n",nMaxConnections,FD_SETSIZE,nBind,(int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
@@ -1469,6 +1542,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
 #endif
 
+    // The mempool must be able to hold at least a couple of full blocks
+    int64_t nMempoolSizeMin = (2 * DEFAULT_BLOCK_MAX_SIZE + 999999) / 1000000;
+    if (GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) < nMempoolSizeMin)
+        return InitError(strprintf(_("-maxmempool must be at least %d MB"), nMempoolSizeMin));
+
     // Default value of 0 for mempooltxinputlimit means no limit is applied
     if (mapArgs.count("-mempooltxinputlimit")) {
         int64_t limit = GetArg("-mempooltxinputlimit", 0);
@@ -1583,6 +1661,22 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Count uptime
     MarkStartTime();
 
+    // Start the Prometheus exporter before anything updates gauges incrementally
+    if (mapArgs.count("-prometheusport")) {
+        int64_t nPrometheusPort = GetArg("-prometheusport", -1);
+        if (nPrometheusPort < 1 || nPrometheusPort > 65535)
+            return InitError(strprintf(_("Invalid port %d specified in -prometheusport"), nPrometheusPort));
+
+        std::vector<const char*> vAllowIPs;
+        if (mapMultiArgs.count("-metricsallowip")) {
+            for (const std::string& strAllow : mapMultiArgs["-metricsallowip"])
+                vAllowIPs.push_back(strAllow.c_str());
+        }
+        const char* pszBind = mapArgs.count("-metricsbind") ? mapArgs["-metricsbind"].c_str() : NULL;
+        if (!metrics_run(pszBind, vAllowIPs.data(), vAllowIPs.size(), (uint16_t)nPrometheusPort))
+            return InitError(_("Failed to start Prometheus metrics exporter"));
+    }
+
     if ((chainparams.NetworkIDString() != "regtest") &&
             GetBoolArg("-showmetrics", 0) &&
             !fPrintToConsole && !GetBoolArg("-daemon", false)) {
@@ -1960,11 +2054,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    GetBlockFileReader().SetMaxMappedFiles(GetArg("-mappedblockfiles", DEFAULT_MAPPED_BLOCK_FILES));
+    int64_t nTxCacheSize = std::max(GetArg("-txcachesize", DEFAULT_TX_CACHE_SIZE), (int64_t)0);
+    GetTxCache().SetMaxUsage(nTxCacheSize << 20);
+
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Max cache setting possible %.1fMiB\n", nMaxDbCache);
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+    LogPrintf("* Using up to %dMiB for the transaction cache\n", nTxCacheSize);
 
     if ( !fReindex ) {
         if (nMaxConnections > 0) {//Online mode
@@ -1987,6 +2086,38 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 fReindex = true;
             }
 
+            bool fTokenIndex = GetBoolArg("-tokenindex", DEFAULT_TOKENINDEX);
+            pblocktree->ReadFlag("tokenindex", checkval);
+            if ( checkval != fTokenIndex && fTokenIndex != 0 ) {
+                pblocktree->WriteFlag("tokenindex", fTokenIndex);
+                fprintf(stderr,"set tokenindex, will reindex. could take a while.\n");
+                fReindex = true;
+            }
+
+            bool fAssetOrderIndex = GetBoolArg("-assetorderindex", DEFAULT_ASSETORDERINDEX);
+            pblocktree->ReadFlag("assetorderindex", checkval);
+            if ( checkval != fAssetOrderIndex && fAssetOrderIndex != 0 ) {
+                pblocktree->WriteFlag("assetorderindex", fAssetOrderIndex);
+                fprintf(stderr,"set assetorderindex, will reindex. could take a while.\n");
+                fReindex = true;
+            }
+
+            bool fCoinSupplyIndex = GetBoolArg("-coinsupplyindex", DEFAULT_COINSUPPLYINDEX);
+            pblocktree->ReadFlag("coinsupplyindex", checkval);
+            if ( checkval != fCoinSupplyIndex && fCoinSupplyIndex != 0 ) {
+                pblocktree->WriteFlag("coinsupplyindex", fCoinSupplyIndex);
+                fprintf(stderr,"set coinsupplyindex, will reindex. could take a while.\n");
+                fReindex = true;
+            }
+
+            bool fCompactSaplingIndex = GetBoolArg("-compactsaplingindex", DEFAULT_COMPACTSAPLINGINDEX);
+            pblocktree->ReadFlag("compactsaplingindex", checkval);
+            if ( checkval != fCompactSaplingIndex && fCompactSaplingIndex != 0 ) {
+                pblocktree->WriteFlag("compactsaplingindex", fCompactSaplingIndex);
+                fprintf(stderr,"set compactsaplingindex, will reindex. could take a while.\n");
+                fReindex = true;
+            }
+
             //One time reindex to enable transaction archiving.
             pblocktree->ReadFlag("archiverule", checkval);
             if (checkval != fArchive) {
@@ -2475,6 +2606,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         //Set Transaction Deletion Options
         fTxDeleteEnabled = GetBoolArg("-deletetx", false);
         fTxConflictDeleteEnabled = GetBoolArg("-deleteconflicttx", true);
+        fCheckWalletBalances = GetBoolArg("-checkwalletbalances", false);
 
         fDeleteInterval = GetArg("-deleteinterval", DEFAULT_TX_DELETE_INTERVAL);
         if (fDeleteInterval < 1)
@@ -2799,6 +2931,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Start the thread that updates komodo internal structures
     threadGroup.create_thread(&ThreadUpdateKomodoInternals);
 
+    if (fAddressBalanceIndex && pblocktree->IsAddressBalanceIndexBuilding())
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "addrbalance", &ThreadBuildAddressBalanceIndex));
+
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
 
@@ -2831,6 +2966,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
         // Run a thread to flush wallet periodically
         threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
+
+        // Run a thread to rebuild the Sapling witnesses while RPC stays available
+        threadGroup.create_thread(boost::bind(&ThreadRebuildSaplingWallet, pwalletMain));
     }
 #endif
 
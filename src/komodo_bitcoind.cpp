@@ -2055,9 +2055,51 @@ int32_t komodo_acpublic(uint32_t tiptime)
     return(acpublic);
 }
 
+// outputs to this address have never counted toward the supply
+static bool komodo_isburnaddress(const CTxDestination &address)
+{
+    static const CKeyID burnid = []() { CKeyID keyid; CBitcoinAddress("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY").GetKeyID(keyid); return keyid; }();
+    CKeyID keyid;
+    return CBitcoinAddress(address).GetKeyID(keyid) && keyid == burnid;
+}
+
+int64_t komodo_txvoutsum(const CTransaction &tx,int64_t *zfundsp,int64_t *sproutfundsp,int64_t *burnedp)
+{
+    CTxDestination address; int64_t voutsum = 0;
+    for (const CTxOut &txout : tx.vout)
+    {
+        if ( ExtractDestination(txout.scriptPubKey,address) != 0 )
+        {
+            if ( komodo_isburnaddress(address) )
+                *burnedp += txout.nValue;
+            else voutsum += txout.nValue;
+        }
+        // other outputs without a destination, e.g. bare multisig, stay out
+        // of the supply as they always have, but only these are burned
+        else if ( txout.scriptPubKey.IsUnspendable() )
+            *burnedp += txout.nValue;
+    }
+    BOOST_FOREACH(const JSDescription& joinsplit, tx.vjoinsplit)
+    {
+        *zfundsp -= joinsplit.vpub_new;
+        *zfundsp += joinsplit.vpub_old;
+        *sproutfundsp -= joinsplit.vpub_new;
+        *sproutfundsp += joinsplit.vpub_old;
+    }
+    *zfundsp -= tx.valueBalance;
+    return(voutsum);
+}
+
+int64_t komodo_blocknewcoins(int64_t voutsum,int64_t vinsum)
+{
+    if ( chainName.isKMD() && (voutsum-vinsum) == 100003*SATOSHIDEN ) // 15 times
+        return(3 * SATOSHIDEN);
+    return(voutsum - vinsum);
+}
+
 int64_t komodo_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,CBlock *pblock)
 {
-    CTxDestination address; int32_t i,j,m,n,vout; uint8_t *script; uint256 txid,hashBlock; int64_t zfunds=0,vinsum=0,voutsum=0,sproutfunds=0;
+    int32_t i,j,m,n,vout; uint256 txid,hashBlock; int64_t zfunds=0,vinsum=0,voutsum=0,sproutfunds=0,burned=0;
     n = pblock->vtx.size();
     for (i=0; i<n; i++)
     {
@@ -2078,37 +2120,13 @@ int64_t komodo_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,C
                 vinsum += vintx.vout[vout].nValue;
             }
         }
-        if ( (m= tx.vout.size()) > 0 )
-        {
-            for (j=0; j<m-1; j++)
-            {
-                if ( ExtractDestination(tx.vout[j].scriptPubKey,address) != 0 && strcmp("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY",CBitcoinAddress(address).ToString().c_str()) != 0 )
-                    voutsum += tx.vout[j].nValue;
-                else printf("skip %.8f -> %s\n",dstr(tx.vout[j].nValue),CBitcoinAddress(address).ToString().c_str());
-            }
-            script = (uint8_t *)&tx.vout[j].scriptPubKey[0];
-            if ( script == 0 || script[0] != 0x6a )
-            {
-                if ( ExtractDestination(tx.vout[j].scriptPubKey,address) != 0 && strcmp("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY",CBitcoinAddress(address).ToString().c_str()) != 0 )
-                    voutsum += tx.vout[j].nValue;
-            }
-        }
-        BOOST_FOREACH(const JSDescription& joinsplit, tx.vjoinsplit)
-        {
-            zfunds -= joinsplit.vpub_new;
-            zfunds += joinsplit.vpub_old;
-            sproutfunds -= joinsplit.vpub_new;
-            sproutfunds += joinsplit.vpub_old;
-        }
-        zfunds -= tx.valueBalance;
+        voutsum += komodo_txvoutsum(tx,&zfunds,&sproutfunds,&burned);
     }
     *zfundsp = zfunds;
     *sproutfundsp = sproutfunds;
-    if ( chainName.isKMD() && (voutsum-vinsum) == 100003*SATOSHIDEN ) // 15 times
-        return(3 * SATOSHIDEN);
     //if ( voutsum-vinsum+zfunds > 100000*SATOSHIDEN || voutsum-vinsum+zfunds < 0 )
     //.    fprintf(stderr,"ht.%d vins %.8f, vouts %.8f -> %.8f zfunds %.8f\n",nHeight,dstr(vinsum),dstr(voutsum),dstr(voutsum)-dstr(vinsum),dstr(zfunds));
-    return(voutsum - vinsum);
+    return(komodo_blocknewcoins(voutsum,vinsum));
 }
 
 int64_t komodo_coinsupply(int64_t *zfundsp,int64_t *sproutfundsp,int32_t height)
@@ -2116,8 +2134,20 @@ int64_t komodo_coinsupply(int64_t *zfundsp,int64_t *sproutfundsp,int32_t height)
     CBlockIndex *pindex; CBlock block; int64_t zfunds=0,sproutfunds=0,supply = 0;
     //fprintf(stderr,"coinsupply %d\n",height);
     *zfundsp = *sproutfundsp = 0;
-    if ( (pindex= komodo_chainactive(height)) != 0 )
     {
+        // the walk below only follows pprev, which never changes
+        LOCK(cs_main);
+        pindex = komodo_chainactive(height);
+    }
+    if ( pindex != 0 )
+    {
+        CCoinSupplyValue totals;
+        if ( GetCoinSupply(pindex,totals) )
+        {
+            *zfundsp = totals.nShielded;
+            *sproutfundsp = totals.nSprout;
+            return(totals.nSupply);
+        }
         while ( pindex != 0 && pindex->nHeight > 0 )
         {
             if ( pindex->newcoins == 0 && pindex->zfunds == 0 )
@@ -2203,7 +2233,7 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
         LOCK(cs_main);
         CBlockIndex* pblockindex = chainActive[tipindex->nHeight];
         CBlock block; CTxDestination addressout;
-        if ( ReadBlockFromDisk(block, pblockindex, 1) && komodo_isPoS(&block, nHeight, &addressout) != 0 && IsMine(*pwalletMain,addressout) != 0 )
+        if ( ReadBlockFromDisk(block, pblockindex, 1, false) && komodo_isPoS(&block, nHeight, &addressout) != 0 && IsMine(*pwalletMain,addressout) != 0 )
         {
               resetstaker = true;
               fprintf(stderr, "[%s:%d] Reset ram staker after mining a block!\n",chainName.symbol().c_str(),nHeight);
@@ -218,6 +218,25 @@ int32_t komodo_checkPOW(int64_t stakeTxValue, int32_t slowflag,CBlock *pblock,in
 
 int32_t komodo_acpublic(uint32_t tiptime);
 
+/*******
+ * @brief the outputs of a transaction that count toward the coin supply
+ * @param[in] tx the transaction
+ * @param[in,out] zfundsp plus the value the transaction moves into the shielded pools
+ * @param[in,out] sproutfundsp plus the value it moves into the Sprout pool
+ * @param[in,out] burnedp plus the value of the provably unspendable outputs and
+ *                 of the outputs to the burn address
+ * @returns the value of the outputs counted
+ */
+int64_t komodo_txvoutsum(const CTransaction &tx,int64_t *zfundsp,int64_t *sproutfundsp,int64_t *burnedp);
+
+/*******
+ * @brief the new coins of a block
+ * @param[in] voutsum the komodo_txvoutsum of its transactions
+ * @param[in] vinsum the value of the inputs its transactions spend
+ * @returns the change in transparent supply
+ */
+int64_t komodo_blocknewcoins(int64_t voutsum,int64_t vinsum);
+
 int64_t komodo_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,CBlock *pblock);
 
 int64_t komodo_coinsupply(int64_t *zfundsp,int64_t *sproutfundsp,int32_t height);
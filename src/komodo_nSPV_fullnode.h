@@ -158,17 +158,18 @@ int32_t NSPV_getaddressutxos(struct NSPV_utxosresp *ptr,char *coinaddr,bool isCC
 {
     int64_t total = 0,interest=0; uint32_t locktime; int32_t ind=0,tipheight,maxlen,txheight,n = 0,len = 0;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,coinaddr,isCC);
+    tipheight = chainActive.Tip()->nHeight;
     maxlen = MAX_BLOCK_SIZE(tipheight) - 512;
     maxlen /= sizeof(*ptr->utxos);
+    // an address with maxlen or more utxos cannot be answered, stop reading the index there
+    bool fComplete = SetCCunspents(unspentOutputs,coinaddr,isCC,maxlen-1);
     strncpy(ptr->coinaddr,coinaddr,sizeof(ptr->coinaddr)-1);
     ptr->CCflag = isCC;
     ptr->filter = filter;
     if ( skipcount < 0 )
         skipcount = 0;
-    if ( (ptr->numutxos= (int32_t)unspentOutputs.size()) >= 0 && ptr->numutxos < maxlen )
+    if ( fComplete && (ptr->numutxos= (int32_t)unspentOutputs.size()) >= 0 && ptr->numutxos < maxlen )
     {
-        tipheight = chainActive.Tip()->nHeight;
         ptr->nodeheight = tipheight;
         if ( skipcount >= ptr->numutxos )
             skipcount = ptr->numutxos-1;
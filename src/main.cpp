@@ -26,6 +26,9 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
+#include "blockfilereader.h"
+#include "blockindexsnapshot.h"
 #include "importcoin.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -41,7 +44,9 @@
 #include "netmessagemaker.h"
 #include "pow.h"
 #include "script/interpreter.h"
+#include "txcache.h"
 #include "txdb.h"
+#include "threadpool.h"
 #include "txmempool.h"
 #include "ui_interface.h"
 #include "undo.h"
@@ -51,6 +56,7 @@
 #include "wallet/asyncrpcoperation_sendmany.h"
 #include "wallet/asyncrpcoperation_shieldcoinbase.h"
 #include "policy/fees.h"
+#include "policy/policy.h"
 #include "notaries_staked.h"
 #include "komodo_extern_globals.h"
 #include "komodo_gateway.h"
@@ -62,10 +68,13 @@
 #include "komodo_interest.h"
 #include "rpc/net.h"
 #include "cc/CCinclude.h"
+#include "cc/CCassets.h"
+#include "rust/metrics.h"
 
 #include <cstring>
 #include <algorithm>
 #include <atomic>
+#include <iterator>
 #include <sstream>
 #include <map>
 #include <unordered_map>
@@ -85,6 +94,8 @@ using namespace std;
 #endif
 
 #include "librustzcash.h"
+#include "compactsaplingindex.h"
+#include "saplingcache.h"
 
 /**
  * Global state
@@ -110,6 +121,11 @@ bool fProof = true;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fCompactSaplingIndex = false;
+bool fAddressBalanceIndex = false;
+bool fTokenIndex = false;
+bool fAssetOrderIndex = false;
+bool fCoinSupplyIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
@@ -120,6 +136,7 @@ size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
 int maxProcessingThreads = 1;
+bool fSaplingBatchVerify = DEFAULT_SAPLING_BATCH_VERIFY;
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download.
  */
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -255,9 +272,13 @@ namespace {
         int64_t nTime;  //! Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //! Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //! The timeout for this block request (for disconnecting a slow peer)
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock;  //! Optional, used for cmpctblock reconstruction
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+    /** Peers asked to announce new blocks with cmpctblock, oldest first. Requires cs_main. */
+    list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
     /** Number of blocks in flight with validated headers. */
     int nQueuedValidatedHeaders = 0;
 
@@ -393,6 +414,7 @@ namespace {
 
         BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
+        lNodesAnnouncingHeaderAndIDs.remove(nodeid);
         EraseOrphansFor(nodeid);
         nPreferredDownload -= state->fPreferredDownload;
 
@@ -401,14 +423,16 @@ namespace {
 
     void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
     {
-        /*    int expired = pool.Expire(GetTime() - age);
-         if (expired != 0)
-         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+        std::vector<uint256> vRemoved;
+        int expired = pool.Expire(GetTime() - age, &vRemoved);
+        if (expired != 0)
+            LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+
+        pool.TrimToSize(limit, &vRemoved);
 
-         std::vector<uint256> vNoSpendsRemaining;
-         pool.TrimToSize(limit, &vNoSpendsRemaining);
-         BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
-         pcoinsTip->Uncache(removed);*/
+        // Wallet transactions that left the mempool are no longer trusted
+        BOOST_FOREACH(const uint256& removed, vRemoved)
+            GetMainSignals().UpdatedTransaction(removed);
     }
 
     // Requires cs_main.
@@ -445,6 +469,28 @@ namespace {
         mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
     }
 
+    /**
+     * Select a peer that just delivered our new tip to push its next blocks
+     * with cmpctblock, replacing the peer selected longest ago.
+     * @param evicted receives the replaced peer, or -1
+     * @returns true if the peer was newly selected
+     */
+    // Requires cs_main.
+    bool MaybeSetPeerAsAnnouncingHeaderAndIDs(const CNode* pfrom, NodeId& evicted) {
+        evicted = -1;
+        if (!pfrom->fProvidesHeaderAndIDs)
+            return false;
+        NodeId nodeid = pfrom->GetId();
+        if (std::find(lNodesAnnouncingHeaderAndIDs.begin(), lNodesAnnouncingHeaderAndIDs.end(), nodeid) != lNodesAnnouncingHeaderAndIDs.end())
+            return false;
+        if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_HIGH_BANDWIDTH_PEERS) {
+            evicted = lNodesAnnouncingHeaderAndIDs.front();
+            lNodesAnnouncingHeaderAndIDs.pop_front();
+        }
+        lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+        return true;
+    }
+
     /** Check whether the last unknown block a peer advertized is not yet known. */
     void ProcessBlockAvailability(NodeId nodeid) {
         CNodeState *state = State(nodeid);
@@ -1302,8 +1348,8 @@ CheckTransationResults ContextualCheckTransactionSingleThreaded(
 }
 
 CheckTransationResults ContextualCheckTransactionBindingSigWorker(
-    const std::vector<const CTransaction*> vtx,
-    const std::vector<uint256> vTxSig,
+    const std::vector<const CTransaction*>& vtx,
+    const std::vector<uint256>& vTxSig,
     const uint32_t threadNumber) {
 
     //Results to be returned
@@ -1361,8 +1407,8 @@ CheckTransationResults ContextualCheckTransactionBindingSigWorker(
 }
 
 CheckTransationResults ContextualCheckTransactionSaplingSpendWorker(
-    const std::vector<const SpendDescription*> vSpend,
-    const std::vector<uint256> vSpendSig,
+    const std::vector<const SpendDescription*>& vSpend,
+    const std::vector<uint256>& vSpendSig,
     const uint32_t threadNumber) {
 
     //Results to be returned
@@ -1401,7 +1447,7 @@ CheckTransationResults ContextualCheckTransactionSaplingSpendWorker(
 }
 
 CheckTransationResults ContextualCheckTransactionSaplingOutputWorker(
-    const std::vector<const OutputDescription*> vOutput,
+    const std::vector<const OutputDescription*>& vOutput,
     const uint32_t threadNumber) {
 
     //Results to be returned
@@ -1434,6 +1480,65 @@ CheckTransationResults ContextualCheckTransactionSaplingOutputWorker(
 
 }
 
+/**
+ * Verify a thread's share of Sapling spends and outputs with a single batch verifier.
+ * The spend auth signatures are checked as each spend is queued, and the Groth16 proofs
+ * are checked together with one randomized multi-pairing per circuit. If anything in the
+ * batch fails, the descriptions are re-checked one at a time by the per-item workers so
+ * the error reported is the same as without batching.
+ */
+CheckTransationResults ContextualCheckTransactionSaplingBatchWorker(
+    const std::vector<const SpendDescription*>& vSpend,
+    const std::vector<uint256>& vSpendSig,
+    const std::vector<const OutputDescription*>& vOutput,
+    const uint32_t threadNumber) {
+
+    auto ctx = librustzcash_sapling_batch_verifier_init();
+
+    bool queued = true;
+    for (int i = 0; queued && i < vSpend.size(); i++) {
+        queued = librustzcash_sapling_batch_verifier_queue_spend(
+            ctx,
+            vSpend[i]->cv.begin(),
+            vSpend[i]->anchor.begin(),
+            vSpend[i]->nullifier.begin(),
+            vSpend[i]->rk.begin(),
+            vSpend[i]->zkproof.begin(),
+            vSpend[i]->spendAuthSig.begin(),
+            vSpendSig[i].begin()
+        );
+    }
+
+    for (int i = 0; queued && i < vOutput.size(); i++) {
+        queued = librustzcash_sapling_batch_verifier_queue_output(
+            ctx,
+            vOutput[i]->cv.begin(),
+            vOutput[i]->cmu.begin(),
+            vOutput[i]->ephemeralKey.begin(),
+            vOutput[i]->zkproof.begin()
+        );
+    }
+
+    if (queued) {
+        //validate also frees the batch verifier
+        if (librustzcash_sapling_batch_verifier_validate(ctx)) {
+            return CheckTransationResults();
+        }
+    } else {
+        librustzcash_sapling_batch_verifier_free(ctx);
+    }
+
+    //Batch failed, find the offending description
+    LogPrint("bench", "%s: Sapling batch of %u spends and %u outputs failed, falling back to per-item checks\n",
+             __func__, vSpend.size(), vOutput.size());
+
+    CheckTransationResults txResults = ContextualCheckTransactionSaplingSpendWorker(vSpend, vSpendSig, threadNumber);
+    if (!txResults.validationPassed) {
+        return txResults;
+    }
+    return ContextualCheckTransactionSaplingOutputWorker(vOutput, threadNumber);
+}
+
 /**
  * Check a transaction contextually against a set of consensus rules valid at a given block height.
  *
@@ -1447,10 +1552,8 @@ bool ContextualCheckTransactionMultithreaded(int32_t slowflag, const std::vector
         CValidationState &state,
         const int nHeight,
         const int dosLevel,
-        bool (*isInitBlockDownload)(),int32_t validateprices) {
-
-      //Create a Vector of futures to be collected later
-      std::vector<std::future<CheckTransationResults>> vFutures;
+        bool (*isInitBlockDownload)(),int32_t validateprices,
+        SaplingCacheMode saplingCacheMode) {
 
       bool isInitialBlockDownload = isInitBlockDownload();
 
@@ -1470,6 +1573,9 @@ bool ContextualCheckTransactionMultithreaded(int32_t slowflag, const std::vector
       std::vector<const OutputDescription*> vOutput;
       std::vector<std::vector<const OutputDescription*>> vvOutput;
 
+      //Sapling bundles to add to the validity cache once all checks have passed
+      std::vector<libzcash::BundleCacheEntry> vSaplingCacheEntries;
+
       //Create Thread Vectors
       for (int i = 0; i < maxProcessingThreads; i++) {
           vvtx.emplace_back(vtx);
@@ -1528,8 +1634,17 @@ bool ContextualCheckTransactionMultithreaded(int32_t slowflag, const std::vector
 
           //Skip costly sapling checks on intial download below the hardcoded checkpoints
           if (!fCheckpointsEnabled || nHeight >= Checkpoints::GetTotalBlocksEstimate(Params().Checkpoints())) {
-              //Verify Sapling
+              //Verify Sapling, unless this bundle's proofs and signatures were already verified
+              //when the transaction was accepted to the mempool
+              bool fSaplingCached = false;
               if (!tx->vShieldedSpend.empty() || !tx->vShieldedOutput.empty()) {
+                  auto cacheEntry = GetSaplingBundleCacheEntry(*tx, dataToBeSigned);
+                  fSaplingCached = SaplingBundleCacheContains(cacheEntry, saplingCacheMode);
+                  if (!fSaplingCached && saplingCacheMode == SaplingCacheMode::Store) {
+                      vSaplingCacheEntries.emplace_back(cacheEntry);
+                  }
+              }
+              if (!fSaplingCached && (!tx->vShieldedSpend.empty() || !tx->vShieldedOutput.empty())) {
                   //Push tx to thread vector
                   vvtx[t].emplace_back(tx);
                   vvTxSig[t].emplace_back(dataToBeSigned);
@@ -1568,33 +1683,60 @@ bool ContextualCheckTransactionMultithreaded(int32_t slowflag, const std::vector
           }
       }
 
-      //Push batches of txs to async threads
+      //Create a Vector of futures to be collected later, the batches are run on the shared
+      //validation pool and referenced in place until the task group has been waited on
+      int64_t nSaplingStart = GetTimeMicros();
+      std::vector<std::future<CheckTransationResults>> vFutures;
+      CTaskGroup validationGroup(GetValidationThreadPool());
+
+      //Push batches of txs to the validation pool
       for (int i = 0; i < vvtx.size(); i++) {
           //Perform transaction level checks
           if (!vvtx[i].empty()) {
-              vFutures.emplace_back(std::async(std::launch::async, ContextualCheckTransactionBindingSigWorker, vvtx[i], vvTxSig[i], i));
+              vFutures.emplace_back(validationGroup.Submit([&vvtx, &vvTxSig, i]() {
+                  return ContextualCheckTransactionBindingSigWorker(vvtx[i], vvTxSig[i], i);
+              }));
           }
       }
 
-      //Push batches of spends to async threads
-      for (int i = 0; i < vvSpend.size(); i++) {
-          //Perform SpendDescription validations
-          if (!vvSpend[i].empty()) {
-              vFutures.emplace_back(std::async(std::launch::async, ContextualCheckTransactionSaplingSpendWorker, vvSpend[i], vvSpendSig[i], i + vvtx.size()));
+      if (fSaplingBatchVerify) {
+          //Push batches of spends and outputs to the validation pool, one batch verifier per task
+          for (int i = 0; i < vvSpend.size(); i++) {
+              if (!vvSpend[i].empty() || !vvOutput[i].empty()) {
+                  uint32_t threadNumber = i + vvtx.size();
+                  vFutures.emplace_back(validationGroup.Submit([&vvSpend, &vvSpendSig, &vvOutput, i, threadNumber]() {
+                      return ContextualCheckTransactionSaplingBatchWorker(vvSpend[i], vvSpendSig[i], vvOutput[i], threadNumber);
+                  }));
+              }
+          }
+      } else {
+          //Push batches of spends to the validation pool
+          for (int i = 0; i < vvSpend.size(); i++) {
+              //Perform SpendDescription validations
+              if (!vvSpend[i].empty()) {
+                  uint32_t threadNumber = i + vvtx.size();
+                  vFutures.emplace_back(validationGroup.Submit([&vvSpend, &vvSpendSig, i, threadNumber]() {
+                      return ContextualCheckTransactionSaplingSpendWorker(vvSpend[i], vvSpendSig[i], threadNumber);
+                  }));
+              }
           }
-      }
 
-      //Push batches of outputs to async threads
-      for (int i = 0; i < vvOutput.size(); i++) {
-          //Perform OutputDescription validations
-          if (!vvOutput[i].empty()) {
-              vFutures.emplace_back(std::async(std::launch::async, ContextualCheckTransactionSaplingOutputWorker, vvOutput[i], i + vvtx.size() + vvSpend.size()));
+          //Push batches of outputs to the validation pool
+          for (int i = 0; i < vvOutput.size(); i++) {
+              //Perform OutputDescription validations
+              if (!vvOutput[i].empty()) {
+                  uint32_t threadNumber = i + vvtx.size() + vvSpend.size();
+                  vFutures.emplace_back(validationGroup.Submit([&vvOutput, i, threadNumber]() {
+                      return ContextualCheckTransactionSaplingOutputWorker(vvOutput[i], threadNumber);
+                  }));
+              }
           }
       }
 
-      //Wait for all threads to complete
-      for (auto &future : vFutures) {
-          future.wait();
+      //Wait for all batches to complete, helping the pool while waiting
+      validationGroup.Wait();
+      if (!vFutures.empty()) {
+          MetricsHistogram("elosys.block.sapling.seconds", (GetTimeMicros() - nSaplingStart) * 0.000001);
       }
 
       bool checkResults = true;
@@ -1617,6 +1759,10 @@ bool ContextualCheckTransactionMultithreaded(int32_t slowflag, const std::vector
         return state.DoS(failedResult.dosLevel, error(failedResult.errorString.c_str()), REJECT_INVALID, failedResult.reasonString);
       }
 
+      for (const auto& entry : vSaplingCacheEntries) {
+          SaplingBundleCacheInsert(entry);
+      }
+
       return true;
 }
 
@@ -2247,7 +2393,8 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
  * @param dosLevel
  * @returns true on success
  */
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,bool* pfMissingInputs, bool fRejectAbsurdFee, int dosLevel)
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,bool* pfMissingInputs, bool fRejectAbsurdFee, int dosLevel,
+                        bool fOverrideMempoolLimit, int64_t nAcceptTime)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs != nullptr)
@@ -2313,7 +2460,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
     std::vector<const CTransaction*> vptx;
     vptx.emplace_back(&tx);
-    if (!ContextualCheckTransactionMultithreaded(0, vptx, 0, state, nextBlockHeight, (dosLevel == -1) ? 10 : dosLevel))
+    if (!ContextualCheckTransactionMultithreaded(0, vptx, 0, state, nextBlockHeight, (dosLevel == -1) ? 10 : dosLevel, IsInitialBlockDownload, 1, SaplingCacheMode::Store))
     {
         return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
     }
@@ -2486,7 +2633,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         // it has passed ContextualCheckInputs and therefore this is correct.
         auto consensusBranchId = CurrentEpochBranchId(chainActive.Height() + 1, Params().GetConsensus());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), mempool.HasNoInputsOf(tx), fSpendsCoinbase, consensusBranchId);
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime != 0 ? nAcceptTime : GetTime(), dPriority, chainActive.Height(), mempool.HasNoInputsOf(tx), fSpendsCoinbase, consensusBranchId);
         unsigned int nSize = entry.GetTxSize();
 
         // Accept a tx if it contains joinsplits and has at least the default fee specified by z_sendmany.
@@ -2502,6 +2649,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
             }
         }
 
+        // Once the mempool has been trimmed, require at least the fee rate of the evicted packages
+        CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+        if (!tx.IsCoinImport() && mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+        {
+            return state.DoS(0, error("AcceptToMemoryPool: mempool min fee not met %s, %d < %d", hash.ToString(), nFees, mempoolRejectFee), REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+        }
+
         // Require that free transactions have sufficient priority to be mined in the next block.
         if (GetBoolArg("-relaypriority", false) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
             fprintf(stderr,"accept failure.6\n");
@@ -2594,8 +2748,21 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                 if (fSpentIndex) {
                     pool.addSpentIndex(entry, view);
                 }
+
+                // Add memory orderbook index
+                std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > orders;
+                if (fAssetOrderIndex && GetAssetOrderOutputs(tx, -1, orders)) {
+                    pool.addAssetOrderIndex(hash, orders);
+                }
             }
         }
+
+        // Trim the mempool and make sure the new transaction survived
+        if (!fOverrideMempoolLimit) {
+            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+            if (!pool.exists(hash))
+                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
     }
     return true;
 }
@@ -2627,6 +2794,17 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
     return true;
 }
 
+bool GetCompactSaplingBlocks(int nStart, int nEnd, std::vector<CCompactSaplingBlock> &vBlocks)
+{
+    if (!fCompactSaplingIndex)
+        return error("Compact sapling index not enabled");
+
+    if (!pblocktree->ReadCompactSaplingBlocks(nStart, nEnd, vBlocks))
+        return error("Unable to read compact sapling blocks");
+
+    return true;
+}
+
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 {
     if (!fSpentIndex)
@@ -2653,6 +2831,80 @@ bool GetAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool ScanAddressIndex(uint160 addressHash, int type, int start, int end,
+                      const CAddressIndexKey* pStartAfter, bool fReverse,
+                      const std::function<bool(const CAddressIndexKey&, CAmount)>& visit)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ScanAddressIndex(addressHash, type, start, end, pStartAfter, fReverse, visit))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool ScanAddressUnspent(uint160 addressHash, int type, const CAddressUnspentKey* pStartAfter, bool fReverse,
+                        const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)>& visit)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ScanAddressUnspentIndex(addressHash, type, pStartAfter, fReverse, visit))
+        return error("unable to get unspent outputs for address");
+
+    return true;
+}
+
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (fAddressBalanceIndex && pblocktree->ReadAddressBalance(CAddressIndexIteratorKey(type, addressHash), value))
+        return true;
+
+    value.SetNull();
+    uint256 lastTx;
+    return ScanAddressIndex(addressHash, type, 0, 0, NULL, false,
+        [&value, &lastTx](const CAddressIndexKey& key, CAmount nValue) {
+            if (nValue > 0)
+                value.received += nValue;
+            value.balance += nValue;
+            if (key.txhash != lastTx) {
+                value.txcount++;
+                lastTx = key.txhash;
+            }
+            return true;
+        });
+}
+
+void ThreadBuildAddressBalanceIndex()
+{
+    size_t nTotal = 0;
+    int64_t nStart = GetTimeMillis();
+    bool fComplete = false;
+    while (!fComplete) {
+        boost::this_thread::interruption_point();
+        size_t nBuilt;
+        {
+            // Keeps blocks from being connected while a step reads the address index
+            LOCK(cs_main);
+            if (!fAddressBalanceIndex)
+                return;
+            if (!pblocktree->BuildAddressBalanceIndex(10000, chainActive.Height(), nBuilt, fComplete)) {
+                LogPrintf("%s: failed to build the address balance index\n", __func__);
+                return;
+            }
+        }
+        nTotal += nBuilt;
+        if (!fComplete && nTotal % 1000000 < nBuilt)
+            LogPrintf("Address balance index: %u addresses built\n", nTotal);
+    }
+    if (nTotal > 0)
+        LogPrintf("Address balance index: built %u addresses in %dms\n", nTotal, GetTimeMillis() - nStart);
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
@@ -2665,6 +2917,80 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool ScanTokenUnspent(const uint256 &tokenid, const CAddressIndexIteratorKey* pAddress,
+                      const std::function<bool(const CTokenUnspentKey&, const CTokenUnspentValue&)>& visit)
+{
+    // Not an error, the CC helpers fall back to the address index
+    if (!fTokenIndex)
+        return false;
+
+    if (!pblocktree->ScanTokenUnspentIndex(tokenid, pAddress, visit))
+        return error("unable to get unspent outputs for token");
+
+    return true;
+}
+
+bool GetCoinSupply(const CBlockIndex *pindex, CCoinSupplyValue &value)
+{
+    if (!fCoinSupplyIndex || pindex == NULL)
+        return false;
+
+    // the transactions of the genesis block are never connected
+    if (pindex->nHeight == 0) {
+        value.SetNull();
+        return true;
+    }
+    return pblocktree->ReadCoinSupply(pindex->GetBlockHash(), value);
+}
+
+bool GetAssetOrderBook(const uint256 &tokenid, unsigned char side, const CAssetOrderKey* pStartAfter, bool fMempool, size_t nCount,
+                       std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &orders, bool &fMore)
+{
+    typedef std::pair<CAssetOrderKey, CAssetOrderValue> Order;
+
+    if (!fAssetOrderIndex)
+        return error("orderbook index not enabled");
+
+    // the best bids have the highest prices
+    const bool fReverse = !tokenid.IsNull() && side == ASSET_ORDER_BID;
+    auto fBefore = [fReverse](const Order &a, const Order &b) { return fReverse ? b.first < a.first : a.first < b.first; };
+    // one more than asked tells whether there is a next page
+    const size_t nWanted = nCount > 0 ? nCount + 1 : 0;
+
+    LOCK2(cs_main, mempool.cs);
+
+    std::vector<Order> confirmed;
+    if (!pblocktree->ScanAssetOrderIndex(tokenid.IsNull() ? NULL : &tokenid, side, pStartAfter, fReverse,
+            [&](const CAssetOrderKey &key, const CAssetOrderValue &value) {
+                if (!fMempool || !mempool.mapNextTx.count(COutPoint(key.txhash, key.index)))
+                    confirmed.push_back(make_pair(key, value));
+                return nWanted == 0 || confirmed.size() < nWanted;
+            }))
+        return error("unable to get orders for token");
+
+    std::vector<Order> pending;
+    if (fMempool) {
+        std::vector<Order> all;
+        mempool.getAssetOrders(tokenid, side, all);
+        if (fReverse)
+            std::reverse(all.begin(), all.end());
+        for (const Order &order : all) {
+            if (pStartAfter != NULL && !fBefore(make_pair(*pStartAfter, CAssetOrderValue()), order))
+                continue;
+            if (!mempool.mapNextTx.count(COutPoint(order.first.txhash, order.first.index)))
+                pending.push_back(order);
+        }
+    }
+
+    // the confirmed orders not read yet all come after the last one read
+    orders.clear();
+    std::merge(confirmed.begin(), confirmed.end(), pending.begin(), pending.end(), std::back_inserter(orders), fBefore);
+    fMore = nCount > 0 && orders.size() > nCount;
+    if (fMore)
+        orders.resize(nCount);
+    return true;
+}
+
 struct CompareBlocksByHeightMain
 {
     bool operator()(const CBlockIndex* a, const CBlockIndex* b) const
@@ -2707,6 +3033,42 @@ bool myAddtomempool(const CTransaction &tx, CValidationState *pstate, bool fSkip
     return true;
 }
 
+/**
+ * Read a confirmed transaction through the transaction index, from the
+ * transaction cache when it was read recently.
+ * @returns false if the index does not know hash or the read fails
+ */
+static bool ReadTransactionFromTxIndex(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
+{
+    if (GetTxCache().Get(hash, txOut, hashBlock))
+        return true;
+
+    // Taken before the index is read, so a block connected or disconnected
+    // meanwhile keeps the result out of the cache. Callers may not hold cs_main.
+    uint64_t nCacheGeneration = GetTxCache().GetGeneration();
+    CDiskTxPos postx;
+    if (!pblocktree->ReadTxIndex(hash, postx))
+        return false;
+
+    // Found the transaction in the index. Load the block header to get the block hash
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+    CBlockHeader header;
+    try {
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> txOut;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    if (txOut.GetHash() != hash)
+        return error("%s: txid mismatch", __func__);
+    GetTxCache().Put(txOut, hashBlock, nCacheGeneration);
+    return true;
+}
+
 /*****
  * @brief get a transaction by its hash (without locks)
  * @param[in] hash what to look for
@@ -2741,26 +3103,8 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
     if (fTxIndex) // if we have a transaction index
     {
         // transaction was not in mempool. Look through the blocks
-        CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(hash, postx))
-        {
-            // Found the transaction in the index. Load the block to get the block hash
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
-            if (txOut.GetHash() != hash)
-                return error("%s: txid mismatch", __func__);
+        if (ReadTransactionFromTxIndex(hash, txOut, hashBlock))
             return true;
-        }
     }
     return false;
 }
@@ -2803,24 +3147,8 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
     }
 
     if (fTxIndex) {
-        CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
-            if (txOut.GetHash() != hash)
-                return error("%s: txid mismatch", __func__);
+        if (ReadTransactionFromTxIndex(hash, txOut, hashBlock))
             return true;
-        }
     }
 
     CBlockIndex *pindexSlow = nullptr;
@@ -2887,24 +3215,10 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
 bool ReadBlockFromDisk(int32_t height,CBlock& block, const CDiskBlockPos& pos,bool checkPOW)
 {
     uint8_t pubkey33[33];
-    block.SetNull();
-
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-    {
-        //fprintf(stderr,"readblockfromdisk err A\n");
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-    }
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        fprintf(stderr,"readblockfromdisk err B\n");
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
-    }
+    // Served from a mapping of the block file when possible
+    if (!GetBlockFileReader().ReadBlock(pos, block))
+        return false;
     // Check the header
     if ( 0 && checkPOW != 0 )
     {
@@ -2921,13 +3235,13 @@ bool ReadBlockFromDisk(int32_t height,CBlock& block, const CDiskBlockPos& pos,bo
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW)
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW,bool fCheckHash)
 {
     if ( pindex == 0 )
         return false;
     if (!ReadBlockFromDisk(pindex->nHeight,block, pindex->GetBlockPos(),checkPOW))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash())
+    if (fCheckHash && block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
                      pindex->ToString(), pindex->GetBlockPos().ToString());
     return true;
@@ -3594,6 +3908,37 @@ int8_t GetAddressType(const CScript &scriptPubKey, CTxDestination &vDest, txnout
     return keyType;
 }
 
+/** The CC addresses of a CC output as keyed by the token index, none for other outputs */
+static std::vector<uint160> GetTokenIndexAddresses(const CScript &scriptPubKey)
+{
+    std::vector<uint160> vAddresses;
+    vector<vector<unsigned char>> vSols;
+    CTxDestination vDest;
+    txnouttype txType = TX_PUBKEYHASH;
+    if (GetAddressType(scriptPubKey, vDest, txType, vSols) == 3)
+        for (auto addr : vSols)
+            vAddresses.push_back(addr.size() == 20 ? uint160(addr) : Hash160(addr));
+    return vAddresses;
+}
+
+/**
+ * The token carried by the CC outputs of a transaction, decoded from its opret
+ * the same way CCtoken_balance does: a create transaction carries its own txid.
+ */
+static bool GetTokenIndexId(const CTransaction &tx, uint256 &tokenid)
+{
+    vscript_t vopret;
+    if (tx.vout.empty() || !GetOpReturnData(tx.vout.back().scriptPubKey, vopret) || vopret.size() < 2 || vopret[0] != EVAL_TOKENS)
+        return false;
+    uint8_t evalCode;
+    std::vector<CPubKey> voutPubkeys;
+    std::vector<std::pair<uint8_t, vscript_t>> oprets;
+    uint8_t funcId = DecodeTokenOpRet(tx.vout.back().scriptPubKey, evalCode, tokenid, voutPubkeys, oprets);
+    if (funcId == 'c')
+        tokenid = tx.GetHash();
+    return funcId != 0 && !tokenid.IsNull();
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
@@ -3614,6 +3959,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CTokenUnspentKey, CTokenUnspentValue> > tokenIndex;
+    std::vector<std::pair<COutPoint, uint256> > tokenOutpoints;
+    std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > orderIndex;
+    std::vector<std::pair<COutPoint, std::pair<CAssetOrderKey, CAssetOrderValue> > > orderOutpoints;
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
@@ -3640,6 +3989,28 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             }
         }
 
+        uint256 tokenid;
+        if (fTokenIndex && GetTokenIndexId(tx, tokenid)) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                std::vector<uint160> vAddresses = GetTokenIndexAddresses(tx.vout[k].scriptPubKey);
+                for (const uint160 &addrHash : vAddresses)
+                    tokenIndex.push_back(make_pair(CTokenUnspentKey(tokenid, 3, addrHash, hash, k), CTokenUnspentValue()));
+                if (!vAddresses.empty())
+                    tokenOutpoints.push_back(make_pair(COutPoint(hash, k), uint256()));
+            }
+        }
+
+        if (fAssetOrderIndex) {
+            // the outputs' order records, not the transaction decoded again, say what to close
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                std::pair<CAssetOrderKey, CAssetOrderValue> order;
+                if (!tx.vout[k].scriptPubKey.IsPayToCryptoCondition() || !pblocktree->ReadAssetOrderOutpoint(COutPoint(hash, k), order))
+                    continue;
+                orderIndex.push_back(make_pair(order.first, CAssetOrderValue()));
+                orderOutpoints.push_back(make_pair(COutPoint(hash, k), make_pair(order.first, CAssetOrderValue())));
+            }
+        }
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
         {
@@ -3702,6 +4073,22 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                         }
                     }
                 }
+
+                // restore spent token outputs, their token record outlives the spend
+                if (fTokenIndex && pblocktree->ReadTokenOutpoint(out, tokenid)) {
+                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
+                    // undo.nHeight is only set for the last output of a transaction
+                    const CCoins *coins = view.AccessCoins(out.hash);
+                    int nPrevHeight = coins != NULL ? coins->nHeight : undo.nHeight;
+                    for (const uint160 &addrHash : GetTokenIndexAddresses(prevout.scriptPubKey))
+                        tokenIndex.push_back(make_pair(CTokenUnspentKey(tokenid, 3, addrHash, out.hash, out.n), CTokenUnspentValue(prevout.nValue, nPrevHeight)));
+                }
+
+                // reopen the orders filled or cancelled by this transaction
+                std::pair<CAssetOrderKey, CAssetOrderValue> order;
+                if (fAssetOrderIndex && view.GetOutputFor(tx.vin[j]).scriptPubKey.IsPayToCryptoCondition() &&
+                    pblocktree->ReadAssetOrderOutpoint(out, order))
+                    orderIndex.push_back(order);
             }
         }
         else if (tx.IsCoinImport())
@@ -3741,8 +4128,21 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+        if (fAddressBalanceIndex && !pblocktree->UpdateAddressBalanceIndex(addressIndex, true, pindex->pprev->GetBlockHash())) {
+            return AbortNode(state, "Failed to write address balance index");
+        }
     }
 
+    if (fTokenIndex && !pblocktree->UpdateTokenIndex(tokenIndex, tokenOutpoints))
+        return AbortNode(state, "Failed to write token index");
+
+    if (fAssetOrderIndex && !pblocktree->UpdateAssetOrderIndex(orderIndex, orderOutpoints))
+        return AbortNode(state, "Failed to write orderbook index");
+
+    if (fCompactSaplingIndex)
+        if (!pblocktree->EraseCompactSaplingBlock(pindex->nHeight))
+            return AbortNode(state, "Failed to delete compact sapling block");
+
     return fClean;
 }
 
@@ -3752,6 +4152,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    // A mapping would keep the preallocated tail alive (and block truncation on Windows)
+    if (fFinalize)
+        GetBlockFileReader().Invalidate(nLastBlockFile);
+
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
         if (fFinalize)
@@ -3900,7 +4304,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
     if ( fCheckPOW != 0 && (pindex->nStatus & BLOCK_VALID_CONTEXT) != BLOCK_VALID_CONTEXT ) // Activate Jan 15th, 2019
     {
-        if ( !ContextualCheckBlock(1,block, state, pindex->pprev) )
+        if ( !ContextualCheckBlock(1,block, state, pindex->pprev, fJustCheck) )
         {
             fprintf(stderr,"ContextualCheckBlock failed ht.%d\n",(int32_t)pindex->nHeight);
             if ( pindex->nTime > 1547510400 )
@@ -4016,6 +4420,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CTokenUnspentKey, CTokenUnspentValue> > tokenIndex;
+    std::vector<std::pair<COutPoint, uint256> > tokenOutpoints;
+    // tokens of the outputs created in this block, not in the token index yet
+    std::map<COutPoint, uint256> mapBlockTokens;
+    std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > orderIndex;
+    std::vector<std::pair<COutPoint, std::pair<CAssetOrderKey, CAssetOrderValue> > > orderOutpoints;
+    // orders opened in this block, not in the orderbook index yet
+    std::map<COutPoint, CAssetOrderKey> mapBlockOrders;
+    // what the block adds to the running supply totals
+    int64_t nSupplyVouts = 0, nSupplyVins = 0, nBlockShielded = 0, nBlockSprout = 0, nBlockBurned = 0;
     // Construct the incremental merkle tree at the current
     // block position,
     auto old_sprout_tree_root = view.GetBestAnchor(SPROUT);
@@ -4109,6 +4523,42 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     }
                 }
             }
+            if (fTokenIndex && !fJustCheck)
+            {
+                for (size_t j = 0; j < tx.vin.size(); j++)
+                {
+                    const COutPoint &out = tx.vin[j].prevout;
+                    std::vector<uint160> vAddresses = GetTokenIndexAddresses(view.GetOutputFor(tx.vin[j]).scriptPubKey);
+                    if (vAddresses.empty())
+                        continue;
+                    uint256 tokenid;
+                    std::map<COutPoint, uint256>::const_iterator itToken = mapBlockTokens.find(out);
+                    if (itToken != mapBlockTokens.end())
+                        tokenid = itToken->second;
+                    else if (!pblocktree->ReadTokenOutpoint(out, tokenid))
+                        continue;
+                    // remove the spent output from the token index
+                    for (const uint160 &addrHash : vAddresses)
+                        tokenIndex.push_back(make_pair(CTokenUnspentKey(tokenid, 3, addrHash, out.hash, out.n), CTokenUnspentValue()));
+                }
+            }
+            if (fAssetOrderIndex && !fJustCheck)
+            {
+                for (size_t j = 0; j < tx.vin.size(); j++)
+                {
+                    const COutPoint &out = tx.vin[j].prevout;
+                    if (!view.GetOutputFor(tx.vin[j]).scriptPubKey.IsPayToCryptoCondition())
+                        continue;
+                    // close the order filled or cancelled by this input
+                    std::pair<CAssetOrderKey, CAssetOrderValue> order;
+                    std::map<COutPoint, CAssetOrderKey>::const_iterator itOrder = mapBlockOrders.find(out);
+                    if (itOrder != mapBlockOrders.end())
+                        order.first = itOrder->second;
+                    else if (!pblocktree->ReadAssetOrderOutpoint(out, order))
+                        continue;
+                    orderIndex.push_back(make_pair(order.first, CAssetOrderValue()));
+                }
+            }
             // Add in sigops done by pay-to-script-hash inputs;
             // this is to prevent a "rogue miner" from creating
             // an incredibly-expensive-to-validate block.
@@ -4162,6 +4612,38 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             }
         }
 
+        uint256 tokenid;
+        if (fTokenIndex && !fJustCheck && GetTokenIndexId(tx, tokenid)) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                std::vector<uint160> vAddresses = GetTokenIndexAddresses(tx.vout[k].scriptPubKey);
+                if (vAddresses.empty())
+                    continue;
+                // record the token CC output as unspent, and which token it carries
+                for (const uint160 &addrHash : vAddresses)
+                    tokenIndex.push_back(make_pair(CTokenUnspentKey(tokenid, 3, addrHash, txhash, k), CTokenUnspentValue(tx.vout[k].nValue, pindex->nHeight)));
+                tokenOutpoints.push_back(make_pair(COutPoint(txhash, k), tokenid));
+                mapBlockTokens[COutPoint(txhash, k)] = tokenid;
+            }
+        }
+
+        std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > orders;
+        if (fAssetOrderIndex && !fJustCheck && GetAssetOrderOutputs(tx, pindex->nHeight, orders)) {
+            // record the open orders, and the order each output opened
+            for (const std::pair<CAssetOrderKey, CAssetOrderValue> &order : orders) {
+                orderIndex.push_back(order);
+                orderOutpoints.push_back(make_pair(COutPoint(txhash, order.first.index), order));
+                mapBlockOrders[COutPoint(txhash, order.first.index)] = order.first;
+            }
+        }
+
+        if (fCoinSupplyIndex && !fJustCheck) {
+            // the same sums as komodo_newcoins, with the spent outputs still in the view
+            if (!tx.IsMint())
+                for (const CTxIn &txin : tx.vin)
+                    nSupplyVins += view.GetOutputFor(txin).nValue;
+            nSupplyVouts += komodo_txvoutsum(tx, &nBlockShielded, &nBlockSprout, &nBlockBurned);
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -4257,6 +4739,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(100, false);
     int64_t nTime2 = GetTimeMicros(); nTimeVerify += nTime2 - nTimeStart;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs-1), nTimeVerify * 0.000001);
+    // Scripts are checked in parallel with the connect loop, this is the wait for the rest
+    MetricsHistogram("elosys.block.scripts.seconds", (nTime2 - nTime1) * 0.000001);
+    MetricsCounter("elosys.block.inputs", nInputs);
 
     if (fJustCheck)
         return true;
@@ -4295,9 +4780,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     ConnectNotarisations(block, pindex->nHeight); // MoMoM notarisation DB.
 
-    if (fTxIndex)
+    if (fTxIndex) {
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
+        // A transaction mined again after a reorg must not be served from its old block
+        GetTxCache().Erase(block.vtx);
+    }
     if (fAddressIndex) {
         if (!pblocktree->WriteAddressIndex(addressIndex)) {
             return AbortNode(state, "Failed to write address index");
@@ -4306,12 +4794,36 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+
+        if (fAddressBalanceIndex && !pblocktree->UpdateAddressBalanceIndex(addressIndex, false, pindex->GetBlockHash())) {
+            return AbortNode(state, "Failed to write address balance index");
+        }
     }
 
     if (fSpentIndex)
         if (!pblocktree->UpdateSpentIndex(spentIndex))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fTokenIndex && !pblocktree->UpdateTokenIndex(tokenIndex, tokenOutpoints))
+        return AbortNode(state, "Failed to write token index");
+
+    if (fAssetOrderIndex && !pblocktree->UpdateAssetOrderIndex(orderIndex, orderOutpoints))
+        return AbortNode(state, "Failed to write orderbook index");
+
+    if (fCoinSupplyIndex) {
+        // the totals of a block build on its parent's, a reindex fills in the blocks before the index was enabled
+        CCoinSupplyValue supply;
+        if (GetCoinSupply(pindex->pprev, supply)) {
+            supply.nSupply += komodo_blocknewcoins(nSupplyVouts, nSupplyVins);
+            supply.nShielded += nBlockShielded;
+            supply.nSprout += nBlockSprout;
+            supply.nNotaryPay += notarypaycheque;
+            supply.nBurned += nBlockBurned;
+            if (!pblocktree->WriteCoinSupply(pindex->GetBlockHash(), supply))
+                return AbortNode(state, "Failed to write coin supply index");
+        }
+    }
+
     if (fTimestampIndex)
     {
         unsigned int logicalTS = pindex->nTime;
@@ -4334,6 +4846,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             return AbortNode(state, "Failed to write blockhash index");
     }
 
+    if (fCompactSaplingIndex)
+        if (!pblocktree->WriteCompactSaplingBlock(CCompactSaplingBlock(block, pindex->nHeight)))
+            return AbortNode(state, "Failed to write compact sapling block");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -4462,6 +4978,11 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
         }
+        // Refresh the block index snapshot daily and at shutdown, while every index entry is on disk
+        if ((fPeriodicFlush || (mode == FLUSH_STATE_ALWAYS && ShutdownRequested())) && setDirtyBlockIndex.empty() &&
+            GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCKINDEX_SNAPSHOT)) {
+            WriteBlockIndexSnapshot();
+        }
     } catch (const std::runtime_error& e) {
         return AbortNode(state, std::string("System error while flushing: ") + e.what());
     }
@@ -4575,6 +5096,7 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
         DisconnectNotarisations(block);
+        GetTxCache().Erase(block.vtx);
     }
     pindexDelete->segid = -2;
     pindexDelete->nNotaryPay = 0;
@@ -4599,11 +5121,12 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
             CValidationState stateDummy;
 
             // don't keep staking or invalid transactions
-            if (tx.IsCoinBase() || (i == block.vtx.size()-1 && komodo_newStakerActive(0, pindexDelete->nTime) == 0 && komodo_isPoS((CBlock *)&block,pindexDelete->nHeight,0) != 0) || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
+            if (tx.IsCoinBase() || (i == block.vtx.size()-1 && komodo_newStakerActive(0, pindexDelete->nTime) == 0 && komodo_isPoS((CBlock *)&block,pindexDelete->nHeight,0) != 0) || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, false, -1, true))
             {
                 mempool.remove(tx, removed, true);
             }
         }
+        LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
         if (sproutAnchorBeforeDisconnect != sproutAnchorAfterDisconnect) {
             // The anchor may not change between block disconnects,
             // in which case we don't want to evict from the mempool yet!
@@ -4824,6 +5347,7 @@ bool ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *pblock)
     int64_t nTime2 = GetTimeMicros();
     nTimeReadFromDisk += nTime2 - nTime1;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    MetricsHistogram("elosys.block.read.seconds", (nTime2 - nTime1) * 0.000001);
     int64_t nTime3;
     {
         CCoinsViewCache view(pcoinsTip);
@@ -4840,11 +5364,13 @@ bool ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *pblock)
         mapBlockSource.erase(pindexNew->GetBlockHash());
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        MetricsHistogram("elosys.block.connect.seconds", (nTime3 - nTime2) * 0.000001);
         if ( KOMODO_NSPV_FULLNODE )
             assert(view.Flush());
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    MetricsHistogram("elosys.block.flush.seconds", (nTime4 - nTime3) * 0.000001);
     // Write the chain state to disk, if necessary.
     if ( KOMODO_NSPV_FULLNODE )
     {
@@ -4853,6 +5379,7 @@ bool ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *pblock)
     }
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
+    MetricsHistogram("elosys.block.chainstate.seconds", (nTime5 - nTime4) * 0.000001);
     // Remove conflicting transactions from the mempool.
     list<CTransaction> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload());
@@ -4887,6 +5414,9 @@ bool ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *pblock)
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    MetricsHistogram("elosys.block.total.seconds", (nTime6 - nTime1) * 0.000001);
+    MetricsIncrementCounter("elosys.block.connected");
+    MetricsGauge("elosys.chain.height", pindexNew->nHeight);
     if ( KOMODO_LONGESTCHAIN != 0 && (pindexNew->nHeight == KOMODO_LONGESTCHAIN || pindexNew->nHeight == KOMODO_LONGESTCHAIN+1) )
         KOMODO_INSYNC = (int32_t)pindexNew->nHeight;
     else KOMODO_INSYNC = 0;
@@ -5214,10 +5744,34 @@ bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock)
                     LOCK(cs_main);
                     ht = chainActive.Height();
                 }
+                // Peers in high bandwidth mode get the new tip pushed as a
+                // cmpctblock right away instead of an inv they have to answer
+                CInv inv(MSG_BLOCK, hashNewTip);
+                std::unique_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
                 LOCK(cs_vNodes);
                 for(CNode* pnode : vNodes)
                     if (ht > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                    {
+                        if (pnode->fPreferHeaderAndIDs && pblock != NULL && pblock->GetHash() == hashNewTip &&
+                            pblock->vtx.size() <= MAX_CMPCTBLOCK_TXN)
+                        {
+                            bool fKnown;
+                            {
+                                LOCK(pnode->cs_inventory);
+                                fKnown = pnode->setInventoryKnown.count(inv) != 0;
+                                if (!fKnown)
+                                    pnode->setInventoryKnown.insert(inv);
+                            }
+                            if (!fKnown)
+                            {
+                                if (!pcmpctblock)
+                                    pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock));
+                                pnode->PushMessage(NetMsgType::CMPCTBLOCK, *pcmpctblock);
+                            }
+                        }
+                        else
+                            pnode->PushInventory(inv);
+                    }
             }
             // Notify external listeners about the new tip.
             GetMainSignals().UpdatedBlockTip(pindexNewTip);
@@ -5265,7 +5819,7 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex) {
             return false;
         }
     }
-    //LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
 
     // The resulting new best tip may not be in setBlockIndexCandidates anymore, so
     // add it again.
@@ -5532,6 +6086,7 @@ bool FindBlockPos(int32_t tmpflag,CValidationState &state, CDiskBlockPos &pos, u
                     tmpBlockFiles[1].SetNull();
                     pos.nFile = TMPFILE_START+1;
                     pos.nPos = (*ptr)[1].nSize;
+                    GetBlockFileReader().Invalidate(pos.nFile);
                     boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
                     LogPrintf("Prune: deleted temp blk (%05u)\n",nFile);
                 }
@@ -5559,6 +6114,7 @@ bool FindBlockPos(int32_t tmpflag,CValidationState &state, CDiskBlockPos &pos, u
                     tmpBlockFiles[0].SetNull();
                     pos.nFile = TMPFILE_START;
                     pos.nPos = (*ptr)[0].nSize;
+                    GetBlockFileReader().Invalidate(pos.nFile);
                     boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
                     LogPrintf("Prune: deleted temp blk (%05u)\n",nFile);
                 }
@@ -5987,7 +6543,7 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
     return true;
 }
 
-bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState& state, CBlockIndex * const pindexPrev)
+bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState& state, CBlockIndex * const pindexPrev, bool fJustCheck)
 {
     const int nHeight = pindexPrev == NULL ? 0 : pindexPrev->nHeight + 1;
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -6033,7 +6589,8 @@ bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState
     }
 
     // Check transaction contextually against consensus rules at block height
-    if (!ContextualCheckTransactionMultithreaded(slowflag,vptx,pindexPrev, state, nHeight, 100)) {
+    if (!ContextualCheckTransactionMultithreaded(slowflag,vptx,pindexPrev, state, nHeight, 100, IsInitialBlockDownload, 1,
+                                                 fJustCheck ? SaplingCacheMode::CheckOnly : SaplingCacheMode::Consume)) {
         return false; // Failure reason has been set in validation state object
     }
 
@@ -6444,7 +7001,7 @@ bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex
     {
         return false;
     }
-    if (!ContextualCheckBlock(0,block, state, pindexPrev))
+    if (!ContextualCheckBlock(0,block, state, pindexPrev, true))
     {
         return false;
     }
@@ -6537,6 +7094,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        GetBlockFileReader().Invalidate(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -6701,24 +7259,33 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
-    LogPrintf("%s: start loading guts\n", __func__);
-    {
+    int64_t nStart = GetTimeMillis();
+    vector<pair<int, CBlockIndex*> > vSortedByHeight;
+    bool fFromSnapshot = false;
+    if (GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCKINDEX_SNAPSHOT)) {
         LOCK(cs_main);
-        if (!pblocktree->LoadBlockIndexGuts())
-            return false;
+        fFromSnapshot = LoadBlockIndexSnapshot(vSortedByHeight);
     }
-    LogPrintf("%s: loaded guts\n", __func__);
-    boost::this_thread::interruption_point();
+    if (!fFromSnapshot) {
+        LogPrintf("%s: start loading guts\n", __func__);
+        {
+            LOCK(cs_main);
+            if (!pblocktree->LoadBlockIndexGuts())
+                return false;
+        }
+        LogPrintf("%s: loaded guts\n", __func__);
 
-    // Calculate nChainWork
-    vector<pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for(const auto& item : mapBlockIndex)
-    {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        for(const auto& item : mapBlockIndex)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    LogPrintf("%s: read %u block index entries from %s in %dms\n", __func__, vSortedByHeight.size(),
+              fFromSnapshot ? "the snapshot" : "leveldb", GetTimeMillis() - nStart);
+    boost::this_thread::interruption_point();
 
     uiInterface.ShowProgress(_("Loading block index DB..."), 0, false);
     int cur_height_num = 0;
@@ -6726,7 +7293,9 @@ bool static LoadBlockIndexDB()
     for(const auto& item : vSortedByHeight)
     {
         CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        // Calculate nChainWork, the snapshot carries it for all but the journaled entries
+        if (!fFromSnapshot || pindex->nChainWork == 0)
+            pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -6849,6 +7418,33 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
 
+    // The address balance index is derived from the address index and can be
+    // switched on or off without a reindex; switching it on schedules a build
+    pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex);
+    bool fWantAddressBalanceIndex = GetBoolArg("-addressbalanceindex", DEFAULT_ADDRESSBALANCEINDEX);
+    if (fWantAddressBalanceIndex && !fAddressIndex) {
+        LogPrintf("%s: -addressbalanceindex requires -addressindex, ignoring it\n", __func__);
+        fWantAddressBalanceIndex = false;
+    }
+    if (fWantAddressBalanceIndex != fAddressBalanceIndex) {
+        if (!pblocktree->ResetAddressBalanceIndex(fWantAddressBalanceIndex, pcoinsTip->GetBestBlock()) ||
+            !pblocktree->WriteFlag("addressbalanceindex", fWantAddressBalanceIndex))
+            return error("%s: failed to reset the address balance index", __func__);
+        fAddressBalanceIndex = fWantAddressBalanceIndex;
+    }
+    // Blocks connected after the last chainstate flush are connected again,
+    // and would apply their balance deltas a second time
+    uint256 hashBalanceBest;
+    if (fAddressBalanceIndex && (!pblocktree->ReadAddressBalanceBestBlock(hashBalanceBest) ||
+                                 hashBalanceBest != pcoinsTip->GetBestBlock())) {
+        LogPrintf("%s: address balance index is at %s, chainstate at %s, rebuilding it\n", __func__,
+                  hashBalanceBest.ToString(), pcoinsTip->GetBestBlock().ToString());
+        if (!pblocktree->ResetAddressBalanceIndex(true, pcoinsTip->GetBestBlock()))
+            return error("%s: failed to reset the address balance index", __func__);
+    }
+    LogPrintf("%s: address balance index %s%s\n", __func__, fAddressBalanceIndex ? "enabled" : "disabled",
+              fAddressBalanceIndex && pblocktree->IsAddressBalanceIndexBuilding() ? " (building)" : "");
+
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
     LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
@@ -6857,6 +7453,22 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    // Check whether we have a token index
+    pblocktree->ReadFlag("tokenindex", fTokenIndex);
+    LogPrintf("%s: token index %s\n", __func__, fTokenIndex ? "enabled" : "disabled");
+
+    // Check whether we have an orderbook index
+    pblocktree->ReadFlag("assetorderindex", fAssetOrderIndex);
+    LogPrintf("%s: orderbook index %s\n", __func__, fAssetOrderIndex ? "enabled" : "disabled");
+
+    // Check whether we have a coin supply index
+    pblocktree->ReadFlag("coinsupplyindex", fCoinSupplyIndex);
+    LogPrintf("%s: coin supply index %s\n", __func__, fCoinSupplyIndex ? "enabled" : "disabled");
+
+    // Check whether we have a compact sapling block index
+    pblocktree->ReadFlag("compactsaplingindex", fCompactSaplingIndex);
+    LogPrintf("%s: compact sapling index %s\n", __func__, fCompactSaplingIndex ? "enabled" : "disabled");
+
     // Fill in-memory data
     for(const auto& item : mapBlockIndex)
     {
@@ -6899,6 +7511,7 @@ bool static LoadBlockIndexDB()
 	      progress);
 
     EnforceNodeDeprecation(chainActive.Height(), true);
+    LogPrintf("%s: block index ready in %dms\n", __func__, GetTimeMillis() - nStart);
     CBlockIndex *pindex;
     if ( (pindex= chainActive.Tip()) != 0 )
     {
@@ -7247,6 +7860,10 @@ bool InitBlockIndex()
         // Use the provided setting for -addressindex in the new database
         fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
         pblocktree->WriteFlag("addressindex", fAddressIndex);
+        // Maintained block by block from here, so there is nothing to build
+        fAddressBalanceIndex = fAddressIndex && GetBoolArg("-addressbalanceindex", DEFAULT_ADDRESSBALANCEINDEX);
+        pblocktree->ResetAddressBalanceIndex(false, pcoinsTip->GetBestBlock());
+        pblocktree->WriteFlag("addressbalanceindex", fAddressBalanceIndex);
 
         // Use the provided setting for -timestampindex in the new database
         fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
@@ -7254,6 +7871,16 @@ bool InitBlockIndex()
 
         fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
         pblocktree->WriteFlag("spentindex", fSpentIndex);
+
+        fTokenIndex = GetBoolArg("-tokenindex", DEFAULT_TOKENINDEX);
+        pblocktree->WriteFlag("tokenindex", fTokenIndex);
+        fAssetOrderIndex = GetBoolArg("-assetorderindex", DEFAULT_ASSETORDERINDEX);
+        pblocktree->WriteFlag("assetorderindex", fAssetOrderIndex);
+        fCoinSupplyIndex = GetBoolArg("-coinsupplyindex", DEFAULT_COINSUPPLYINDEX);
+        pblocktree->WriteFlag("coinsupplyindex", fCoinSupplyIndex);
+
+        fCompactSaplingIndex = GetBoolArg("-compactsaplingindex", DEFAULT_COMPACTSAPLINGINDEX);
+        pblocktree->WriteFlag("compactsaplingindex", fCompactSaplingIndex);
         fprintf(stderr,"fAddressIndex.%d/%d fSpentIndex.%d/%d\n",fAddressIndex,DEFAULT_ADDRESSINDEX,fSpentIndex,DEFAULT_SPENTINDEX);
         LogPrintf("Initializing databases...\n");
     }
@@ -7396,6 +8023,166 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
     return nLoaded > 0;
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+/** Append hash and its in-mempool parents to vOrder, parents first */
+static void AddMempoolTxTopological(const uint256& hash, std::set<uint256>& setDone, std::vector<const CTxMemPoolEntry*>& vOrder)
+{
+    AssertLockHeld(mempool.cs);
+    // An explicit stack of transactions and the next input to follow, a long
+    // chain of unconfirmed transactions would otherwise recurse once per ancestor
+    std::vector<std::pair<CTxMemPool::indexed_transaction_set::const_iterator, size_t>> vStack;
+    auto Visit = [&](const uint256& hashVisit) {
+        if (!setDone.insert(hashVisit).second)
+            return;
+        CTxMemPool::indexed_transaction_set::const_iterator it = mempool.mapTx.find(hashVisit);
+        if (it != mempool.mapTx.end())
+            vStack.emplace_back(it, 0);
+    };
+
+    Visit(hash);
+    while (!vStack.empty()) {
+        CTxMemPool::indexed_transaction_set::const_iterator it = vStack.back().first;
+        size_t& nIn = vStack.back().second;
+        if (nIn < it->GetTx().vin.size()) {
+            Visit(it->GetTx().vin[nIn++].prevout.hash);
+        } else {
+            vOrder.push_back(&*it);
+            vStack.pop_back();
+        }
+    }
+}
+
+bool DumpMempool()
+{
+    int64_t nStart = GetTimeMicros();
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    boost::filesystem::path pathTmp = GetDataDir() / "mempool.dat.new";
+
+    try {
+        FILE* file = fopen(pathTmp.string().c_str(), "wb");
+        if (!file)
+            return error("%s: Failed to open %s", __func__, pathTmp.string());
+
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        uint64_t nCount = 0;
+        {
+            LOCK(mempool.cs);
+            // Parents before children, so that a sequential load finds every input
+            std::set<uint256> setDone;
+            std::vector<const CTxMemPoolEntry*> vOrder;
+            vOrder.reserve(mempool.mapTx.size());
+            for (CTxMemPool::indexed_transaction_set::const_iterator it = mempool.mapTx.begin(); it != mempool.mapTx.end(); it++)
+                AddMempoolTxTopological(it->GetTx().GetHash(), setDone, vOrder);
+
+            nCount = vOrder.size();
+            fileout << MEMPOOL_DUMP_VERSION;
+            fileout << nCount;
+            BOOST_FOREACH(const CTxMemPoolEntry* entry, vOrder) {
+                fileout << entry->GetTx();
+                fileout << entry->GetTime();
+            }
+            fileout << mempool.mapDeltas;
+        }
+
+        FileCommit(fileout.Get());
+        fileout.fclose();
+        if (!RenameOver(pathTmp, path))
+            return error("%s: Failed to rename %s", __func__, pathTmp.string());
+        LogPrintf("Dumped %u mempool transactions to disk in %.2fms\n", nCount, (GetTimeMicros() - nStart) * 0.001);
+    } catch (const std::exception& e) {
+        return error("%s: Failed to dump mempool: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool LoadMempool()
+{
+    int64_t nStart = GetTimeMicros();
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file) {
+        LogPrintf("%s: No mempool file %s found\n", __func__, path.string());
+        return false;
+    }
+
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    std::vector<std::pair<CTransaction, int64_t> > vtx;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    try {
+        uint64_t nVersion;
+        filein >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("%s: Unknown mempool file version %u", __func__, nVersion);
+
+        uint64_t nCount;
+        filein >> nCount;
+        vtx.reserve(std::min(nCount, (uint64_t)1000000));
+        for (uint64_t i = 0; i < nCount; i++) {
+            CTransaction tx;
+            int64_t nTime;
+            filein >> tx;
+            filein >> nTime;
+            vtx.push_back(std::make_pair(tx, nTime));
+        }
+        filein >> mapDeltas;
+    } catch (const std::exception& e) {
+        return error("%s: Failed to deserialize mempool data on disk: %s", __func__, e.what());
+    }
+
+    // Deltas first, so that prioritised transactions pass the fee checks
+    for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); it++)
+        mempool.PrioritiseTransaction(it->first, it->first.GetHex(), it->second.first, it->second.second);
+
+    int64_t nNow = GetTime();
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height() + 1;
+    }
+
+    // Verify the Sapling proofs and signatures on the validation pool without holding cs_main.
+    // Bundles that verify are stored in the Sapling validity cache, so the sequential
+    // AcceptToMemoryPool below only has to check inputs against the UTXO set.
+    {
+        CTaskGroup group(GetValidationThreadPool());
+        for (size_t i = 0; i < vtx.size(); i++) {
+            if (vtx[i].second < nNow - nExpiryTimeout)
+                continue;
+            const CTransaction* ptx = &vtx[i].first;
+            if (ptx->vShieldedSpend.empty() && ptx->vShieldedOutput.empty())
+                continue;
+            group.Submit([ptx, nHeight]() {
+                CValidationState state;
+                std::vector<const CTransaction*> vptx(1, ptx);
+                return ContextualCheckTransactionMultithreaded(0, vptx, 0, state, nHeight, 10, IsInitialBlockDownload, 1, SaplingCacheMode::Store);
+            });
+        }
+        group.Wait();
+    }
+
+    int nLoaded = 0, nFailed = 0, nExpired = 0;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (ShutdownRequested())
+            return false;
+        if (vtx[i].second < nNow - nExpiryTimeout) {
+            nExpired++;
+            continue;
+        }
+        CValidationState state;
+        LOCK(cs_main);
+        if (AcceptToMemoryPool(mempool, state, vtx[i].first, true, NULL, false, -1, false, vtx[i].second))
+            nLoaded++;
+        else
+            nFailed++;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired in %.2fms\n",
+              nLoaded, nFailed, nExpired, (GetTimeMicros() - nStart) * 0.001);
+    return true;
+}
+
 void static CheckBlockIndex()
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -7703,124 +8490,153 @@ void static ProcessGetData(CNode* pfrom)
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
+    // Block requested by the last entry handled, it is read from disk and sent
+    // after cs_main is released so serving it does not hold up validation
+    CInv invBlock;
+    int nBlockHeight = 0;
+    CDiskBlockPos blockPos;
+    uint256 hashBlock;
+    bool fSendBlock = false;
+    bool fSendCompact = false;
 
-    while (it != pfrom->vRecvGetData.end()) {
-        // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->nSendSize >= SendBufferSize())
-            break;
+    {
+        LOCK(cs_main);
 
-        const CInv &inv = *it;
-        {
-            boost::this_thread::interruption_point();
-            it++;
+        while (it != pfrom->vRecvGetData.end()) {
+            // Don't bother if send buffer is too full to respond anyway
+            if (pfrom->nSendSize >= SendBufferSize())
+                break;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            const CInv &inv = *it;
             {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
+                boost::this_thread::interruption_point();
+                it++;
+
+                if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                        (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                        (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                    bool send = false;
+                    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                    if (mi != mapBlockIndex.end())
+                    {
+                        if (chainActive.Contains(mi->second)) {
+                            send = true;
+                        } else {
+                            static const int nOneMonth = 30 * 24 * 60 * 60;
+                            // To prevent fingerprinting attacks, only send blocks outside of the active
+                            // chain if they are valid, and no more than a month older (both in time, and in
+                            // best equivalent proof of work) than the best header chain we know about.
+                            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+                            (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
+                            if (!send) {
+                                LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                            }
                         }
                     }
-                }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
-                {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second,1))
+                    // Pruned nodes may have deleted the block, so check whether
+                    // it's available before trying to send.
+                    if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                     {
-                        assert(!"cannot load block from disk");
+                        invBlock = inv;
+                        nBlockHeight = mi->second->nHeight;
+                        blockPos = mi->second->GetBlockPos();
+                        hashBlock = mi->second->GetBlockHash();
+                        fSendBlock = true;
+                        // Older blocks are unlikely to be in the peer's mempool
+                        fSendCompact = inv.type == MSG_CMPCT_BLOCK &&
+                            mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
                     }
-                    else
+                }
+                else if (inv.IsKnownType())
+                {
+                    // Send stream from relay memory
+                    bool pushed = false;
                     {
-                        if (inv.type == MSG_BLOCK)
-                        {
-                            //uint256 hash; int32_t z;
-                            //hash = block.GetHash();
-                            //for (z=31; z>=0; z--)
-                            //    fprintf(stderr,"%02x",((uint8_t *)&hash)[z]);
-                            //fprintf(stderr," send block %d\n",komodo_block2height(&block));
-                            pfrom->PushMessage(NetMsgType::BLOCK, block);
+                        LOCK(cs_mapRelay);
+                        map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                        if (mi != mapRelay.end()) {
+                            pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                            pushed = true;
                         }
-                        else // MSG_FILTERED_BLOCK)
-                        {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter)
-                            {
-                                CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                                pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
-                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                                // This avoids hurting performance by pointlessly requiring a round-trip
-                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                                // they must either disconnect and retry or request the full block.
-                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                                // however we MUST always provide at least what the remote peer needs
-                                typedef std::pair<unsigned int, uint256> PairType;
-                                BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage(NetMsgType::TX, block.vtx[pair.first]);
-                            }
-                            // else
-                            // no response
+                    }
+                    if (!pushed && inv.type == MSG_TX) {
+                        CTransaction tx;
+                        if (mempool.lookup(inv.hash, tx)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << tx;
+                            pfrom->PushMessage(NetMsgType::TX, ss);
+                            pushed = true;
                         }
                     }
-                    // Trigger the peer node to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue)
-                    {
-                        // Bypass PushInventory, this must send even if redundant,
-                        // and we want it right after the last block so they don't
-                        // wait for other stuff first.
-                        vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-                        pfrom->PushMessage(NetMsgType::INV, vInv);
-                        pfrom->hashContinue.SetNull();
+                    if (!pushed) {
+                        vNotFound.push_back(inv);
                     }
                 }
+
+                if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
+                    break;
+            }
+        }
+    }
+
+
+    if (fSendBlock)
+    {
+        // Send block from disk. cs_main is no longer held, so the block file
+        // may have been pruned in the meantime
+        CBlock block;
+        if (!ReadBlockFromDisk(nBlockHeight, block, blockPos, 1) || block.GetHash() != hashBlock)
+        {
+            LogPrint("net", "%s: cannot load block %s from disk for peer=%d\n", __func__, hashBlock.ToString(), pfrom->GetId());
+            vNotFound.push_back(invBlock);
+        }
+        else
+        {
+            if (fSendCompact && block.vtx.size() <= MAX_CMPCTBLOCK_TXN)
+            {
+                CBlockHeaderAndShortTxIDs cmpctblock(block);
+                pfrom->PushMessage(NetMsgType::CMPCTBLOCK, cmpctblock);
+            }
+            else if (invBlock.type == MSG_BLOCK || invBlock.type == MSG_CMPCT_BLOCK)
+            {
+                pfrom->PushMessage(NetMsgType::BLOCK, block);
             }
-            else if (inv.IsKnownType())
+            else // MSG_FILTERED_BLOCK)
             {
-                // Send stream from relay memory
-                bool pushed = false;
+                LOCK(pfrom->cs_filter);
+                if (pfrom->pfilter)
                 {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage(NetMsgType::TX, ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed) {
-                    vNotFound.push_back(inv);
+                    CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                    pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
+                    // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                    // This avoids hurting performance by pointlessly requiring a round-trip
+                    // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                    // they must either disconnect and retry or request the full block.
+                    // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                    // however we MUST always provide at least what the remote peer needs
+                    typedef std::pair<unsigned int, uint256> PairType;
+                    BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                    if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                        pfrom->PushMessage(NetMsgType::TX, block.vtx[pair.first]);
                 }
+                // else
+                // no response
             }
-
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
-                break;
+        }
+        // Trigger the peer node to send a getblocks request for the next batch of inventory
+        if (invBlock.hash == pfrom->hashContinue)
+        {
+            // Bypass PushInventory, this must send even if redundant,
+            // and we want it right after the last block so they don't
+            // wait for other stuff first.
+            vector<CInv> vInv;
+            {
+                LOCK(cs_main);
+                vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+            }
+            pfrom->PushMessage(NetMsgType::INV, vInv);
+            pfrom->hashContinue.SetNull();
         }
     }
 
@@ -7846,6 +8662,51 @@ void static ProcessGetData(CNode* pfrom)
 
 void komodo_netevent(std::vector<uint8_t> payload);
 
+/** Validate a block a peer sent us, either in full or reconstructed from a cmpctblock */
+static void ProcessBlockFromPeer(CNode* pfrom, CBlock& block, const std::string& strCommand)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    pfrom->AddInventoryKnown(inv);
+
+    CValidationState state;
+    // Process all blocks from whitelisted peers, even if not requested,
+    // unless we're still syncing with the network.
+    // Such an unrequested block may still be processed, subject to the
+    // conditions in AcceptBlock().
+    bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
+    ProcessNewBlock(0,0,state, pfrom, &block, forceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+        return;
+    }
+
+    // The peer that delivered our new tip first is likely to be fast next
+    // time as well, ask it to push new blocks to us without an inv round trip
+    bool fHighBandwidth = false;
+    NodeId evicted = -1;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() != NULL && chainActive.Tip()->GetBlockHash() == inv.hash)
+            fHighBandwidth = MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom, evicted);
+    }
+    if (fHighBandwidth) {
+        pfrom->PushMessage(NetMsgType::SENDCMPCT, true, COMPACT_BLOCKS_VERSION);
+        if (evicted != -1) {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes) {
+                if (pnode->GetId() == evicted)
+                    pnode->PushMessage(NetMsgType::SENDCMPCT, false, COMPACT_BLOCKS_VERSION);
+            }
+        }
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     int32_t nProtocolVersion;
@@ -8045,6 +8906,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             State(pfrom->GetId())->fCurrentlyConnected = true;
             AddressCurrentlyConnected(State(pfrom->GetId())->address);
         }
+
+        // Tell the peer we serve compact blocks. Peers that don't know the
+        // message ignore it and keep exchanging full blocks with us.
+        if (GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS) && !KOMODO_NSPV_SUPERLITE)
+            pfrom->PushMessage(NetMsgType::SENDCMPCT, false, COMPACT_BLOCKS_VERSION);
     }
 
 
@@ -8341,7 +9207,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (chainActive.Tip()->GetBlockTime() > GetTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
                         nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        // Peers that serve compact blocks only need to send what our mempool lacks
+                        vToFetch.push_back(pfrom->fProvidesHeaderAndIDs ? CInv(MSG_CMPCT_BLOCK, inv.hash) : inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -8624,6 +9491,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // Solutions don't depend on the chain, so the whole message is checked
+        // in parallel before the serial contextual checks under cs_main. The
+        // blocks later reuse the result instead of verifying them again.
+        int nInvalid = CheckEquihashSolutions(headers, chainparams);
+        if (nInvalid >= 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("invalid Equihash solution in header %s", headers[nInvalid].GetHash().ToString());
+        }
+
         LOCK(cs_main);
 
         if (nCount == 0) {
@@ -8709,28 +9586,191 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CBlock block;
         vRecv >> block;
 
-        CInv inv(MSG_BLOCK, block.GetHash());
-        LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+        LogPrint("net", "received block %s peer=%d\n", block.GetHash().ToString(), pfrom->id);
 
-        pfrom->AddInventoryKnown(inv);
+        ProcessBlockFromPeer(pfrom, block, strCommand);
+    }
 
-        CValidationState state;
-        // Process all blocks from whitelisted peers, even if not requested,
-        // unless we're still syncing with the network.
-        // Such an unrequested block may still be processed, subject to the
-        // conditions in AcceptBlock().
-        bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
-        ProcessNewBlock(0,0,state, pfrom, &block, forceProcessing, NULL);
-        int nDoS;
-        if (state.IsInvalid(nDoS)) {
-            pfrom->PushMessage(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0) {
+
+    else if (strCommand == NetMsgType::SENDCMPCT)
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        // Versions we don't know are ignored, the peer then gets full blocks
+        if (nCMPCTBLOCKVersion == COMPACT_BLOCKS_VERSION && GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS)) {
+            pfrom->fProvidesHeaderAndIDs = true;
+            pfrom->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        const uint256 hash = cmpctblock.header.GetHash();
+        LogPrint("cmpctblock", "received cmpctblock %s peer=%d\n", hash.ToString(), pfrom->id);
+
+        // Don't go through the mempool for a header that can't be a block
+        if (!CheckEquihashSolution(&cmpctblock.header, chainparams)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("cmpctblock %s has an invalid equihash solution, peer=%d", hash.ToString(), pfrom->id);
+        }
+
+        CBlock block;
+        bool fReconstructed = false;
+        {
+            LOCK(cs_main);
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hash));
+
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                return true;
+
+            BlockMap::iterator miPrev = mapBlockIndex.find(cmpctblock.header.hashPrevBlock);
+            if (miPrev == mapBlockIndex.end()) {
+                // Doesn't connect to anything we know, sync the headers first
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), hash);
+                return true;
+            }
+            UpdateBlockAvailability(pfrom->GetId(), hash);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+            if (itInFlight != mapBlocksInFlight.end() &&
+                (itInFlight->second.first != pfrom->GetId() || itInFlight->second.second->partialBlock)) {
+                // Already being downloaded from another peer, or reconstructed from this one
+                return true;
+            }
+
+            std::shared_ptr<PartiallyDownloadedBlock> partialBlock;
+            ReadStatus status = READ_STATUS_FAILED;
+            // Only a block on top of our tip is likely to be made of our mempool
+            if (miPrev->second == chainActive.Tip()) {
+                partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+                status = partialBlock->InitData(cmpctblock);
+            }
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us an invalid cmpctblock", pfrom->id);
+            }
+
+            // The block counts as requested from this peer from here on
+            MarkBlockAsInFlight(pfrom->GetId(), hash, chainparams.GetConsensus());
+            if (status == READ_STATUS_FAILED) {
+                vector<CInv> vGetData(1, CInv(MSG_BLOCK, hash));
+                pfrom->PushMessage(NetMsgType::GETDATA, vGetData);
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < partialBlock->GetTxCount(); i++) {
+                if (!partialBlock->IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (req.indexes.empty()) {
+                status = partialBlock->FillBlock(block, std::vector<CTransaction>());
+                if (status == READ_STATUS_OK) {
+                    fReconstructed = true;
+                } else {
+                    // A short id matched the wrong mempool transaction
+                    vector<CInv> vGetData(1, CInv(MSG_BLOCK, hash));
+                    pfrom->PushMessage(NetMsgType::GETDATA, vGetData);
+                }
+            } else {
+                mapBlocksInFlight[hash].second->partialBlock = partialBlock;
+                req.blockhash = hash;
+                pfrom->PushMessage(NetMsgType::GETBLOCKTXN, req);
+            }
+        }
+
+        if (fReconstructed)
+            ProcessBlockFromPeer(pfrom, block, strCommand);
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN)
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        int nHeight = 0;
+        CDiskBlockPos blockPos;
+        bool fSendFull = false;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+            if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second) || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint("cmpctblock", "peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+                return true;
+            }
+            nHeight = mi->second->nHeight;
+            blockPos = mi->second->GetBlockPos();
+            // Only recent blocks are announced with cmpctblock, answer anything
+            // older with the full block instead of letting the request time out
+            fSendFull = nHeight < chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+        }
+
+        // Read without cs_main, a block pruned in the meantime fails the hash check
+        CBlock block;
+        if (!ReadBlockFromDisk(nHeight, block, blockPos, 1) || block.GetHash() != req.blockhash)
+            return error("%s: cannot load block %s from disk", __func__, req.blockhash.ToString());
+
+        if (fSendFull) {
+            pfrom->PushMessage(NetMsgType::BLOCK, block);
+            return true;
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
                 LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), nDoS);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage(NetMsgType::BLOCKTXN, resp);
+    }
+
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        bool fBlockRead = false;
+        {
+            LOCK(cs_main);
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(resp.blockhash);
+            if (itInFlight == mapBlocksInFlight.end() || !itInFlight->second.second->partialBlock ||
+                itInFlight->second.first != pfrom->GetId()) {
+                LogPrint("cmpctblock", "peer %d sent us block transactions for a block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            ReadStatus status = itInFlight->second.second->partialBlock->FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us invalid compact block transactions", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // A short id matched the wrong mempool transaction, fetch the full block
+                MarkBlockAsInFlight(pfrom->GetId(), resp.blockhash, chainparams.GetConsensus());
+                vector<CInv> vGetData(1, CInv(MSG_BLOCK, resp.blockhash));
+                pfrom->PushMessage(NetMsgType::GETDATA, vGetData);
+            } else {
+                fBlockRead = true;
             }
         }
 
+        if (fBlockRead)
+            ProcessBlockFromPeer(pfrom, block, strCommand);
     }
 
 
@@ -8891,6 +9931,82 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 }
 
 // requires LOCK(cs_vRecvMsg)
+/**
+ * Messages that only read chain state, taking cs_main themselves where needed,
+ * and touch no other peer's state. They may be handled on the message worker
+ * pool while the message handler carries on with other peers. addr is not one
+ * of them as it relays into other peers' vAddrToSend.
+ */
+static bool IsReadOnlyMessage(const CNode* pfrom, const std::string& strCommand, const CDataStream& vRecv)
+{
+    if (!pfrom->fSuccessfullyConnected || KOMODO_NSPV_SUPERLITE)
+        return false;
+    if (strCommand == NetMsgType::PING || strCommand == NetMsgType::GETDATA ||
+        strCommand == NetMsgType::GETHEADERS || strCommand == NetMsgType::GETBLOCKS ||
+        strCommand == NetMsgType::GETBLOCKTXN)
+        return true;
+    if (strCommand == NetMsgType::GETNSPV && KOMODO_NSPV == 0 && GetBoolArg("-nspv_msg", DEFAULT_NSPV_PROCESSING)) {
+        // Broadcasts and remote rpc calls can change state
+        try {
+            CDataStream ss(vRecv);
+            std::vector<uint8_t> payload;
+            ss >> payload;
+            return !payload.empty() && payload[0] != NSPV_BROADCAST && payload[0] != NSPV_REMOTERPC;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/** Process one message, report failures and account for the time it took */
+static void HandleMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, unsigned int nMessageSize)
+{
+    int64_t nStart = GetTimeMicros();
+    bool fRet = false;
+    try
+    {
+        if (strCommand == NetMsgType::GETNSPV && pfrom->fMessageOffloaded) {
+            // The nSPV handlers expect the chain not to move underneath them
+            LOCK(cs_main);
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, nTimeReceived);
+        } else {
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, nTimeReceived);
+        }
+        boost::this_thread::interruption_point();
+    }
+    catch (const std::ios_base::failure& e)
+    {
+        pfrom->PushMessage(NetMsgType::REJECT, strCommand, REJECT_MALFORMED, string("error parsing message"));
+        if (strstr(e.what(), "end of data"))
+        {
+            // Allow exceptions from under-length message on vRecv
+            LogPrintf("%s(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", __func__, SanitizeString(strCommand), nMessageSize, e.what());
+        }
+        else if (strstr(e.what(), "size too large"))
+        {
+            // Allow exceptions from over-long size
+            LogPrintf("%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(strCommand), nMessageSize, e.what());
+        }
+        else
+        {
+            //PrintExceptionContinue(&e, "ProcessMessages()");
+        }
+    }
+    catch (const boost::thread_interrupted&) {
+        throw;
+    }
+    catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessMessages()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ProcessMessages()");
+    }
+    pfrom->RecordProcessingTime(strCommand, GetTimeMicros() - nStart);
+
+    if (!fRet)
+        LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", "ProcessMessages", SanitizeString(strCommand), nMessageSize, pfrom->id);
+}
+
 bool ProcessMessages(CNode* pfrom)
 {
     //if (fDebug)
@@ -8906,8 +10022,18 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
-    if (!pfrom->vRecvGetData.empty())
+    if (!pfrom->vRecvGetData.empty()) {
+        // Nothing can be served while the send buffer is full, SocketSendData
+        // wakes us once it has drained
+        if (pfrom->nSendSize >= SendBufferSize())
+            return fOk;
+        // The rest of a getdata is read from disk and sent on a worker too.
+        // The worker owns the peer until it is done, so responses stay in order
+        if (pfrom->fSuccessfullyConnected && !KOMODO_NSPV_SUPERLITE &&
+            OffloadNodeMessage(pfrom, [pfrom]() { ProcessGetData(pfrom); }))
+            return fOk;
         ProcessGetData(pfrom);
+    }
 
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
@@ -8964,41 +10090,17 @@ bool ProcessMessages(CNode* pfrom)
         }
 
         // Process message
-        bool fRet = false;
-        try
-        {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
-            boost::this_thread::interruption_point();
-        }
-        catch (const std::ios_base::failure& e)
-        {
-            pfrom->PushMessage(NetMsgType::REJECT, strCommand, REJECT_MALFORMED, string("error parsing message"));
-            if (strstr(e.what(), "end of data"))
-            {
-                // Allow exceptions from under-length message on vRecv
-                LogPrintf("%s(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", __func__, SanitizeString(strCommand), nMessageSize, e.what());
-            }
-            else if (strstr(e.what(), "size too large"))
-            {
-                // Allow exceptions from over-long size
-                LogPrintf("%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(strCommand), nMessageSize, e.what());
-            }
-            else
-            {
-                //PrintExceptionContinue(&e, "ProcessMessages()");
-            }
-        }
-        catch (const boost::thread_interrupted&) {
-            throw;
-        }
-        catch (const std::exception& e) {
-            PrintExceptionContinue(&e, "ProcessMessages()");
-        } catch (...) {
-            PrintExceptionContinue(NULL, "ProcessMessages()");
+        if (IsReadOnlyMessage(pfrom, strCommand, vRecv)) {
+            // The worker owns the peer until the message is handled, so its
+            // later messages are not looked at before this one is done
+            std::shared_ptr<CDataStream> pRecv = std::make_shared<CDataStream>(vRecv);
+            int64_t nTimeReceived = msg.nTime;
+            if (OffloadNodeMessage(pfrom, [pfrom, strCommand, pRecv, nTimeReceived, nMessageSize]() {
+                    HandleMessage(pfrom, strCommand, *pRecv, nTimeReceived, nMessageSize);
+                }))
+                break;
         }
-
-        if (!fRet)
-            LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
+        HandleMessage(pfrom, strCommand, vRecv, msg.nTime, nMessageSize);
 
         break;
     }
@@ -29,11 +29,13 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "coins.h"
+#include "coinsupplyindex.h"
 #include "consensus/consensus.h"
 #include "consensus/upgrades.h"
 #include "net.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "saplingcache.h"
 #include "script/script.h"
 #include "script/serverchecker.h"
 #include "script/standard.h"
@@ -46,6 +48,7 @@
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -65,7 +68,11 @@ class CValidationState;
 class PrecomputedTransactionData;
 
 struct CNodeStateStats;
-#define DEFAULT_MEMPOOL_EXPIRY 1
+struct CCompactSaplingBlock;
+/** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
+static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
 
 /** Default for -blockmaxsize and -blockminsize, which control the range of sizes the mining code will create **/
 static const unsigned int DEFAULT_BLOCK_MAX_SIZE = 2000000;//MAX_BLOCK_SIZE;
@@ -123,6 +130,9 @@ static const unsigned int WITNESS_WRITE_UPDATES = 10000;
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 
+/** Default for -saplingbatchverify */
+static const bool DEFAULT_SAPLING_BATCH_VERIFY = true;
+
 /** Default NSPV support enabled */
 static const bool DEFAULT_NSPV_PROCESSING = false;
 
@@ -131,6 +141,18 @@ static const bool DEFAULT_NSPV_PROCESSING = false;
 #define DEFAULT_ADDRESSINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 #define DEFAULT_SPENTINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 static const bool DEFAULT_TIMESTAMPINDEX = false;
+/** Default for -compactsaplingindex */
+static const bool DEFAULT_COMPACTSAPLINGINDEX = false;
+/** Default for -addressbalanceindex */
+static const bool DEFAULT_ADDRESSBALANCEINDEX = false;
+/** Default for -tokenindex */
+static const bool DEFAULT_TOKENINDEX = false;
+/** Default for -assetorderindex */
+static const bool DEFAULT_ASSETORDERINDEX = false;
+/** Default for -coinsupplyindex */
+static const bool DEFAULT_COINSUPPLYINDEX = false;
+/** Maximum number of compact Sapling blocks returned by a single REST/RPC request */
+static const int MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST = 1000;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
 
@@ -164,6 +186,11 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fCompactSaplingIndex;
+extern bool fAddressBalanceIndex;
+extern bool fTokenIndex;
+extern bool fAssetOrderIndex;
+extern bool fCoinSupplyIndex;
 extern bool fArchive;
 extern bool fProof;
 extern bool fIsBareMultisigStd;
@@ -177,6 +204,7 @@ extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern int64_t nMaxTipAge;
 extern int maxProcessingThreads;
+extern bool fSaplingBatchVerify;
 
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
@@ -328,10 +356,18 @@ void PruneAndFlush();
  * @param pfMissingInputs
  * @param fRejectAbsurdFee
  * @param dosLevel
+ * @param fOverrideMempoolLimit don't trim the mempool to -maxmempool after adding (used while reorganizing)
+ * @param nAcceptTime mempool entry time, 0 for now (used when loading mempool.dat)
  * @returns true on success
  */
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, int dosLevel=-1);
+                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, int dosLevel=-1,
+                        bool fOverrideMempoolLimit=false, int64_t nAcceptTime=0);
+
+/** Dump the mempool and its prioritisation deltas to mempool.dat */
+bool DumpMempool();
+/** Load mempool.dat and revalidate its transactions against the current tip */
+bool LoadMempool();
 
 
 struct CNodeStateStats {
@@ -673,6 +709,121 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** Running totals of an address, keyed by CAddressIndexIteratorKey */
+struct CAddressBalanceValue {
+    CAmount balance;
+    //! Sum of all credits, including change
+    CAmount received;
+    //! Number of transactions crediting or debiting the address
+    int64_t txcount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(txcount);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txcount = 0;
+    }
+
+    bool IsNull() const {
+        return balance == 0 && received == 0 && txcount == 0;
+    }
+};
+
+/**
+ * An unspent CC output of a token transaction, ordered by token and then by the
+ * CC address holding it, so a holder's outputs or a token's are a key range
+ */
+struct CTokenUnspentKey {
+    uint256 tokenid;
+    unsigned int type;
+    uint160 hashBytes;
+    uint256 txhash;
+    size_t index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 89;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        tokenid.Serialize(s);
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s);
+        txhash.Serialize(s);
+        ser_writedata32(s, index);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        tokenid.Unserialize(s);
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s);
+        txhash.Unserialize(s);
+        index = ser_readdata32(s);
+    }
+
+    CTokenUnspentKey(uint256 tokenidIn, unsigned int addressType, uint160 addressHash, uint256 txid, size_t indexValue) {
+        tokenid = tokenidIn;
+        type = addressType;
+        hashBytes = addressHash;
+        txhash = txid;
+        index = indexValue;
+    }
+
+    CTokenUnspentKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        tokenid.SetNull();
+        type = 0;
+        hashBytes.SetNull();
+        txhash.SetNull();
+        index = 0;
+    }
+};
+
+struct CTokenUnspentValue {
+    CAmount satoshis;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(satoshis);
+        READWRITE(blockHeight);
+    }
+
+    CTokenUnspentValue(CAmount sats, int height) {
+        satoshis = sats;
+        blockHeight = height;
+    }
+
+    CTokenUnspentValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        satoshis = -1;
+        blockHeight = 0;
+    }
+
+    bool IsNull() const {
+        return (satoshis == -1);
+    }
+};
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -760,14 +911,20 @@ struct CheckTransationResults
 //Validate a batch of transactions
 CheckTransationResults ContextualCheckTransactionSingleThreaded(const CTransaction tx, const int nHeight, const int dosLevel, const bool isInitialBlockDownload, const uint32_t threadNumber);
 //Validate a batch of transactions
-CheckTransationResults ContextualCheckTransactionBindingSigWorker(const std::vector<const CTransaction*> vtx, const std::vector<uint256> vTxSig, const uint32_t threadNumber);
+CheckTransationResults ContextualCheckTransactionBindingSigWorker(const std::vector<const CTransaction*>& vtx, const std::vector<uint256>& vTxSig, const uint32_t threadNumber);
 //Validate a batch of Sapling spend descriptions
-CheckTransationResults ContextualCheckTransactionSaplingSpendWorker(const std::vector<const SpendDescription*> vSpend, const std::vector<uint256> vSpendSig, const uint32_t threadNumber);
+CheckTransationResults ContextualCheckTransactionSaplingSpendWorker(const std::vector<const SpendDescription*>& vSpend, const std::vector<uint256>& vSpendSig, const uint32_t threadNumber);
 //Validate a batch of Sapling output descriptions
-CheckTransationResults ContextualCheckTransactionSaplingOutputWorker(const std::vector<const OutputDescription*> vOutput, const uint32_t threadNumber);
-/** Check a transaction contextually against a set of consensus rules */
+CheckTransationResults ContextualCheckTransactionSaplingOutputWorker(const std::vector<const OutputDescription*>& vOutput, const uint32_t threadNumber);
+
+CheckTransationResults ContextualCheckTransactionSaplingBatchWorker(const std::vector<const SpendDescription*>& vSpend, const std::vector<uint256>& vSpendSig, const std::vector<const OutputDescription*>& vOutput, const uint32_t threadNumber);
+/** Check transactions contextually against a set of consensus rules. Sapling bundles found in the
+ *  validity cache skip proof and binding signature checks; saplingCacheMode says whether newly
+ *  verified bundles are added (mempool accept), hits are evicted (block validation) or neither
+ *  (block template checks). */
 bool ContextualCheckTransactionMultithreaded(int32_t slowflag, const std::vector<const CTransaction*> vptx, CBlockIndex * const pindexPrev, CValidationState &state, int nHeight, int dosLevel,
-                                bool (*isInitBlockDownload)() = IsInitialBlockDownload,int32_t validateprices=1);
+                                bool (*isInitBlockDownload)() = IsInitialBlockDownload,int32_t validateprices=1,
+                                SaplingCacheMode saplingCacheMode=SaplingCacheMode::Consume);
 
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
@@ -861,16 +1018,62 @@ public:
 
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+/** Read the compact Sapling blocks for heights nStart..nEnd of the active chain */
+bool GetCompactSaplingBlocks(int nStart, int nEnd, std::vector<CCompactSaplingBlock> &vBlocks);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
+/**
+ * Walk the address index or the unspent outputs of an address record by record,
+ * resuming after pStartAfter when set, instead of collecting everything first.
+ */
+bool ScanAddressIndex(uint160 addressHash, int type, int start, int end,
+                      const CAddressIndexKey* pStartAfter, bool fReverse,
+                      const std::function<bool(const CAddressIndexKey&, CAmount)>& visit);
+bool ScanAddressUnspent(uint160 addressHash, int type, const CAddressUnspentKey* pStartAfter, bool fReverse,
+                        const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)>& visit);
+/**
+ * Balance, total received and transaction count of an address. Answered from
+ * the -addressbalanceindex when it covers the address, otherwise summed from
+ * the address index.
+ */
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value);
+/** Build the address balance index from the address index, a step at a time under cs_main */
+void ThreadBuildAddressBalanceIndex();
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/**
+ * Walk the confirmed unspent CC outputs of a token from the -tokenindex, only
+ * those held by one CC address when pAddress is set.
+ */
+bool ScanTokenUnspent(const uint256 &tokenid, const CAddressIndexIteratorKey* pAddress,
+                      const std::function<bool(const CTokenUnspentKey&, const CTokenUnspentValue&)>& visit);
+/**
+ * A page of the open orders of one side of a token's book from the
+ * -assetorderindex, best price first: asks ascending, bids descending. Every
+ * token's orders in key order when tokenid is null. With fMempool the orders
+ * opened in the mempool are merged in and those it fills or cancels left out.
+ * At most nCount orders after pStartAfter, all of them when nCount is 0;
+ * fMore tells whether there are more.
+ */
+bool GetAssetOrderBook(const uint256 &tokenid, unsigned char side, const CAssetOrderKey* pStartAfter, bool fMempool, size_t nCount,
+                       std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &orders, bool &fMore);
+/**
+ * Running supply totals up to and including a block from the -coinsupplyindex.
+ * False when the index is disabled or does not cover the block, komodo_coinsupply
+ * then sums the blocks.
+ */
+bool GetCoinSupply(const CBlockIndex *pindex, CCoinSupplyValue &value);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos,bool checkPOW);
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW);
+/**
+ * Read the block of a block index entry. fCheckHash=false skips recomputing the
+ * block hash for callers that only look at transactions of blocks already
+ * connected to the index, where the position itself is trusted.
+ */
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW,bool fCheckHash = true);
 bool PruneOneBlockFile(bool tempfile, const int fileNumber);
 
 /** Functions for validating blocks and updating the block tree */
@@ -901,7 +1104,8 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex *pindexPrev);
-bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState& state, CBlockIndex *pindexPrev);
+/** fJustCheck is set when the block is only checked (TestBlockValidity) and will be validated again when it connects */
+bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState& state, CBlockIndex *pindexPrev, bool fJustCheck = false);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex *pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
@@ -31,12 +31,15 @@
 #include "clientversion.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "threadpool.h"
 #include "ui_interface.h"
 #include "crypto/common.h"
 #include "tls/utiltls.h"
 #include "komodo_defs.h"
 #include "komodo_globals.h"
 #include "notaries_staked.h"
+#include "netpoller.h"
+#include "rust/metrics.h"
 
 #ifdef _WIN32
 #include <string.h>
@@ -44,6 +47,9 @@
 #include <fcntl.h>
 #endif
 
+#include <set>
+#include <unordered_map>
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -102,6 +108,9 @@ static bool vfLimited[NET_MAX] = {};
 static CNode* pnodeLocalHost = NULL;
 uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
+static std::unique_ptr<CSocketPoller> socketPoller;
+// Set when vNodes gained a socket the edge triggered poller has not registered yet
+static std::atomic<bool> fSocketSetChanged(false);
 CAddrMan addrman;
 int nMaxConnections = DEFAULT_MAX_PEER_CONNECTIONS;
 bool bOverrideMaxConnections=false;
@@ -121,6 +130,19 @@ std::unique_ptr<i2p::sam::Session> m_i2p_sam_session;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
+
+static bool IsServiceableSocket(SOCKET hSocket)
+{
+    return socketPoller ? socketPoller->IsServiceable(hSocket) : IsSelectableSocket(hSocket);
+}
+
+static void NotifySocketSetChanged()
+{
+    fSocketSetChanged = true;
+    if (socketPoller)
+        socketPoller->Wakeup();
+}
+
 map<CInv, CDataStream> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
@@ -139,7 +161,14 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
-static boost::condition_variable messageHandlerCondition;
+
+// Message handler wakeups, fMsgProcWake is guarded by mutexMsgProc
+static boost::mutex mutexMsgProc;
+static boost::condition_variable condMsgProc;
+static bool fMsgProcWake = false;
+
+// Workers for peer messages that do not mutate validation state
+static std::unique_ptr<CThreadPool> msgWorkers;
 
 // Denial-of-service detection/prevention
 // Key is IP address, value is banned-until-time
@@ -485,7 +514,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
 
     if (connected)
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsServiceableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -581,6 +610,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
         }
+        NotifySocketSetChanged();
 
         pnode->nTimeConnected = GetTime();
 
@@ -615,6 +645,8 @@ void CNode::CloseSocketDisconnect(bool sendShutDownSSL)
                     SSL_free(ssl);
                     ssl = NULL;
                 }
+                if (socketPoller)
+                    socketPoller->RemoveSocket(hSocket);
                 CloseSocket(hSocket);
                 LogPrint("net", "disconnecting peer=%d\n", id);
             }
@@ -881,6 +913,10 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
 
     stats.m_addr_processed = m_addr_processed.load();
     stats.m_addr_rate_limited = m_addr_rate_limited.load();
+    {
+        LOCK(cs_msgProcessingTime);
+        stats.mapProcessingTimePerMsgCmd = mapProcessingTimePerMsgCmd;
+    }
 
     // Leave string empty if addrLocal invalid (not filled in yet)
     stats.addrLocal = addrLocal.IsValid() ? addrLocal.ToString() : "";
@@ -893,6 +929,8 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
     }
 
     stats.m_wants_addrv2 = m_wants_addrv2;
+    stats.fProvidesHeaderAndIDs = fProvidesHeaderAndIDs;
+    stats.fPreferHeaderAndIDs = fPreferHeaderAndIDs;
 }
 
 // requires LOCK(cs_vRecvMsg)
@@ -927,7 +965,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            WakeMessageHandler();
         }
     }
 
@@ -1001,6 +1039,7 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 void SocketSendData(CNode *pnode)
 {
     std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    const bool fSendBufferFull = pnode->nSendSize >= SendBufferSize();
 
     while (it != pnode->vSendMsg.end())
     {
@@ -1092,6 +1131,47 @@ void SocketSendData(CNode *pnode)
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+
+    // Message processing for this peer stops while its send buffer is full
+    if (fSendBufferFull && pnode->nSendSize < SendBufferSize())
+        WakeMessageHandler();
+}
+
+void WakeMessageHandler()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutexMsgProc);
+        fMsgProcWake = true;
+    }
+    condMsgProc.notify_one();
+}
+
+bool OffloadNodeMessage(CNode* pnode, std::function<void()> task)
+{
+    if (!msgWorkers)
+        return false;
+
+    pnode->fMessageOffloaded = true;
+    {
+        LOCK(cs_vNodes);
+        pnode->AddRef();
+    }
+    msgWorkers->Submit([pnode, task]() {
+        try {
+            task();
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "OffloadNodeMessage()");
+        } catch (...) {
+            PrintExceptionContinue(NULL, "OffloadNodeMessage()");
+        }
+        pnode->fMessageOffloaded = false;
+        {
+            LOCK(cs_vNodes);
+            pnode->Release();
+        }
+        WakeMessageHandler();
+    });
+    return true;
 }
 
 static list<CNode*> vNodesDisconnected;
@@ -1282,7 +1362,8 @@ static bool AttemptToEvictConnection(bool fPreferNewConnection) {
     return true;
 }
 
-static void AcceptConnection(const ListenSocket& hListenSocket) {
+/** @returns false once there is no pending connection left to accept */
+static bool AcceptConnection(const ListenSocket& hListenSocket) {
     struct sockaddr_storage sockaddr;
     socklen_t len = sizeof(sockaddr);
     SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
@@ -1293,7 +1374,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         if (nErr != WSAEWOULDBLOCK) {
             LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
         }
-        return;
+        return false;
     }
 
     if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr)) {
@@ -1305,6 +1386,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
 
     CreateNodeFromAcceptedSocket(hSocket, whitelisted, addr_bind, addr);
+    return true;
 }
 
 void CreateNodeFromAcceptedSocket(SOCKET hSocket,
@@ -1340,7 +1422,7 @@ void CreateNodeFromAcceptedSocket(SOCKET hSocket,
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!IsServiceableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1478,6 +1560,7 @@ SetSocketNonBlocking(hSocket, true);
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+    NotifySocketSetChanged();
 }
 
 #if defined(USE_TLS)
@@ -1493,9 +1576,39 @@ void ThreadNonTLSPoolsCleaner()
 
 #endif // USE_TLS
 
+/** Whether to read from a peer, see the flow control notes in ThreadSocketHandler */
+static bool WantsReceive(CNode* pnode)
+{
+    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+    return lockRecv && (
+        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+        pnode->GetTotalRecvSize() <= ReceiveFloodSize());
+}
+
+static bool HasPendingSend(CNode* pnode)
+{
+    // A busy lock means another thread is queueing or sending data
+    TRY_LOCK(pnode->cs_vSend, lockSend);
+    return !lockSend || !pnode->vSendMsg.empty();
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    const bool fEdgeTriggered = socketPoller->IsEdgeTriggered();
+    // Edge triggered bookkeeping: the node behind each registered socket and
+    // the nodes that may still be serviced without waiting for a new event
+    std::unordered_map<SOCKET, CNode*> mapPolledNodes;
+    std::set<CNode*> setReadyNodes;
+    bool fProgress = false;
+    int64_t nLastInactivityCheck = 0;
+
+    if (fEdgeTriggered) {
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+            socketPoller->AddSocket(hListenSocket.socket);
+        }
+    }
+
     while (true)
     {
         //
@@ -1516,6 +1629,15 @@ void ThreadSocketHandler()
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
 
+                    // forget the poller registration before the descriptor can be reused
+                    if (pnode->hSocketPolled != INVALID_SOCKET) {
+                        std::unordered_map<SOCKET, CNode*>::iterator it = mapPolledNodes.find(pnode->hSocketPolled);
+                        if (it != mapPolledNodes.end() && it->second == pnode)
+                            mapPolledNodes.erase(it);
+                        pnode->hSocketPolled = INVALID_SOCKET;
+                    }
+                    setReadyNodes.erase(pnode);
+
                     // close socket and cleanup
                     pnode->CloseSocketDisconnect();
 
@@ -1559,101 +1681,111 @@ void ThreadSocketHandler()
         if(vNodes.size() != nPrevNodeCount) {
             nPrevNodeCount = vNodes.size();
             uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
-        }
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+            int nNodes, nInbound = 0;
+            {
+                LOCK(cs_vNodes);
+                nNodes = vNodes.size();
+                BOOST_FOREACH(CNode* pnode, vNodes)
+                    if (pnode->fInbound)
+                        nInbound++;
+            }
+            MetricsGauge("elosys.net.peers", nNodes - nInbound, "direction", "outbound");
+            MetricsGauge("elosys.net.peers", nInbound, "direction", "inbound");
         }
 
+        std::vector<CSocketEvent> vEvents;
+        if (fEdgeTriggered)
         {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
+            //
+            // Register the sockets of new nodes, each is watched until it is closed
+            //
+            if (fSocketSetChanged.exchange(false))
             {
-                LOCK(pnode->cs_hSocket);
-
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signaling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes)
                 {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
+                    if (pnode->hSocketPolled != INVALID_SOCKET)
+                        continue;
+                    LOCK(pnode->cs_hSocket);
+                    if (pnode->hSocket == INVALID_SOCKET)
+                        continue;
+                    if (!socketPoller->AddSocket(pnode->hSocket)) {
+                        pnode->fDisconnect = true;
                         continue;
                     }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+                    pnode->hSocketPolled = pnode->hSocket;
+                    mapPolledNodes[pnode->hSocket] = pnode;
+                    // Data may have arrived before registration, so start out ready
+                    pnode->fPollRecvReady = true;
+                    pnode->fPollSendReady = true;
+                    setReadyNodes.insert(pnode);
                 }
             }
+
+            // Only sleep when no node made progress, flood limited nodes stay
+            // ready and are retried at the old polling frequency
+            static const std::vector<CSocketEvent> vNoInterest;
+            socketPoller->Wait(fProgress ? 0 : 50, vNoInterest, vEvents);
         }
+        else
+        {
+            //
+            // Find which sockets have data to receive
+            //
+            std::vector<CSocketEvent> vInterest;
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+                vInterest.push_back(CSocketEvent(hListenSocket.socket, true, false));
+            }
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
             {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes)
+                {
+                    LOCK(pnode->cs_hSocket);
+
+                    if (pnode->hSocket == INVALID_SOCKET)
+                        continue;
+
+                    // Implement the following logic:
+                    // * If there is data to send, select() for sending data. As this only
+                    //   happens when optimistic write failed, we choose to first drain the
+                    //   write buffer in this case before receiving more. This avoids
+                    //   needlessly queueing received data, if the remote peer is not themselves
+                    //   receiving data. This means properly utilizing TCP flow control signaling.
+                    // * Otherwise, if there is no (complete) message in the receive buffer,
+                    //   or there is space left in the buffer, select() for receiving data.
+                    // * (if neither of the above applies, there is certainly one message
+                    //   in the receiver buffer ready to be processed).
+                    // Together, that means that at least one of the following is always possible,
+                    // so we don't deadlock:
+                    // * We send some data.
+                    // * We wait for data to be received (and disconnect after timeout).
+                    // * We process a message in the buffer (message handler thread).
+                    bool fSend = HasPendingSend(pnode);
+                    vInterest.push_back(CSocketEvent(pnode->hSocket, !fSend && WantsReceive(pnode), fSend));
+                }
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
+
+            socketPoller->Wait(50, vInterest, vEvents); // frequency to poll pnode->vSend
         }
+        boost::this_thread::interruption_point();
 
         //
         // Accept new connections
         //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        BOOST_FOREACH(const CSocketEvent& event, vEvents)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (!event.fRecv)
+                continue;
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
             {
-                AcceptConnection(hListenSocket);
+                if (hListenSocket.socket != INVALID_SOCKET && hListenSocket.socket == event.hSocket)
+                {
+                    // Edge triggered listeners have to be drained
+                    while (AcceptConnection(hListenSocket) && fEdgeTriggered) {}
+                }
             }
         }
 
@@ -1661,26 +1793,100 @@ void ThreadSocketHandler()
         // Service each socket
         //
         vector<CNode*> vNodesCopy;
+        std::unordered_map<SOCKET, CSocketEvent> mapEvents;
+        if (fEdgeTriggered)
         {
+            BOOST_FOREACH(const CSocketEvent& event, vEvents)
+            {
+                std::unordered_map<SOCKET, CNode*>::iterator it = mapPolledNodes.find(event.hSocket);
+                if (it == mapPolledNodes.end())
+                    continue;
+                if (event.fRecv || event.fError)
+                    it->second->fPollRecvReady = true;
+                if (event.fSend)
+                    it->second->fPollSendReady = true;
+                setReadyNodes.insert(it->second);
+            }
+            LOCK(cs_vNodes);
+            vNodesCopy.assign(setReadyNodes.begin(), setReadyNodes.end());
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                pnode->AddRef();
+        }
+        else
+        {
+            BOOST_FOREACH(const CSocketEvent& event, vEvents)
+                mapEvents[event.hSocket] = event;
             LOCK(cs_vNodes);
             vNodesCopy = vNodes;
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->AddRef();
         }
+        fProgress = false;
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             boost::this_thread::interruption_point();
 
-            if (tlsmanager.threadSocketHandler(pnode,fdsetRecv,fdsetSend,fdsetError)==-1){
-                continue;
+            if (fEdgeTriggered)
+            {
+                // Keep going until the socket would block, the poller only
+                // reports the next transition
+                bool fRecv = pnode->fPollRecvReady && WantsReceive(pnode);
+                bool fSend = pnode->fPollSendReady && HasPendingSend(pnode);
+                int nBlocked = 0;
+                if (fRecv || fSend) {
+                    nBlocked = tlsmanager.threadSocketHandler(pnode, fRecv, fSend, false);
+                    if (nBlocked == -1) {
+                        setReadyNodes.erase(pnode);
+                        continue;
+                    }
+                    fProgress = true;
+                }
+                if (nBlocked & SOCKET_RECV_BLOCKED)
+                    pnode->fPollRecvReady = false;
+                if (nBlocked & SOCKET_SEND_BLOCKED)
+                    pnode->fPollSendReady = false;
+                // A writable socket with nothing queued needs no attention, the
+                // optimistic send in EndMessage takes care of new data
+                if (!pnode->fPollRecvReady && !(pnode->fPollSendReady && HasPendingSend(pnode)))
+                    setReadyNodes.erase(pnode);
+            }
+            else
+            {
+                CSocketEvent event;
+                {
+                    LOCK(pnode->cs_hSocket);
+                    std::unordered_map<SOCKET, CSocketEvent>::const_iterator it = mapEvents.find(pnode->hSocket);
+                    if (it != mapEvents.end())
+                        event = it->second;
+                }
+                int nBlocked = tlsmanager.threadSocketHandler(pnode, event.fRecv, event.fSend, event.fError);
+                if (nBlocked == -1) {
+                    continue;
+                }
+                // A level triggered poller may report the socket again at
+                // once, preventive measure from exhausting CPU usage
+                if (nBlocked & SOCKET_RECV_BLOCKED)
+                    MilliSleep(1);
             }
+        }
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                pnode->Release();
+        }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
+        //
+        // Inactivity checking
+        //
+        int64_t nTime = GetTime();
+        if (nTime != nLastInactivityCheck)
+        {
+            nLastInactivityCheck = nTime;
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes)
             {
+                if (pnode->fDisconnect || nTime - pnode->nTimeConnected <= 60)
+                    continue;
                 if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
                 {
                     LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
@@ -1703,11 +1909,6 @@ void ThreadSocketHandler()
                 }
             }
         }
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-                pnode->Release();
-        }
     }
 }
 
@@ -2044,9 +2245,6 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 
 void ThreadMessageHandler()
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
-
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true)
     {
@@ -2071,6 +2269,10 @@ void ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
+            // A worker owns the peer, it wakes us when it is done
+            if (pnode->fMessageOffloaded)
+                continue;
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -2079,6 +2281,9 @@ void ThreadMessageHandler()
                     if (!g_signals.ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
 
+                    if (pnode->fMessageOffloaded)
+                        continue;
+
                     if (pnode->nSendSize < SendBufferSize())
                     {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
@@ -2105,8 +2310,12 @@ void ThreadMessageHandler()
                 pnode->Release();
         }
 
+        // SendMessages still needs to run periodically for pings and trickling
+        boost::unique_lock<boost::mutex> lock(mutexMsgProc);
         if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+            condMsgProc.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100),
+                                   []() { return fMsgProcWake; });
+        fMsgProcWake = false;
     }
 }
 
@@ -2338,6 +2547,10 @@ void LoadPeers() {
 
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 {
+    if (!socketPoller) {
+        socketPoller = MakeSocketPoller(GetArg("-socketpoller", DEFAULT_SOCKET_POLLER));
+        LogPrintf("Using %s for peer socket readiness\n", socketPoller->GetName());
+    }
 
     if (GetBoolArg("-nspv_msg", DEFAULT_NSPV_PROCESSING)) {
         nLocalServices |= NODE_NSPV;
@@ -2394,6 +2607,13 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     else
         threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "dnsseed", &ThreadDNSAddressSeed));
 
+    // Handle read-only messages next to the message handler
+    int nMsgWorkers = std::max(0, std::min((int)GetArg("-msgworkers", DEFAULT_MSG_WORKER_THREADS), MAX_MSG_WORKER_THREADS));
+    if (nMsgWorkers > 0 && !msgWorkers) {
+        msgWorkers.reset(new CThreadPool(nMsgWorkers, "msgworker"));
+        LogPrintf("Message worker pool started with %d threads\n", nMsgWorkers);
+    }
+
     // Send and receive from sockets, accept connections
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
@@ -2429,6 +2649,11 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 bool StopNode()
 {
     LogPrintf("StopNode()\n");
+    if (msgWorkers) {
+        // Finishes the queued messages, the peers stay alive until CNetCleanup
+        msgWorkers->Stop();
+        msgWorkers.reset();
+    }
     if (semOutbound)
         for (int i=0; i<MAX_OUTBOUND_CONNECTIONS; i++)
             semOutbound->post();
@@ -2521,12 +2746,14 @@ void CNode::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
     nTotalBytesRecv += bytes;
+    MetricsStaticCounter("elosys.net.bytes", bytes, "direction", "recv");
 }
 
 void CNode::RecordBytesSent(uint64_t bytes)
 {
     LOCK(cs_totalBytesSent);
     nTotalBytesSent += bytes;
+    MetricsStaticCounter("elosys.net.bytes", bytes, "direction", "sent");
 }
 
 uint64_t CNode::GetTotalBytesRecv()
@@ -2688,6 +2915,10 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     ssl = sslIn;
     nServices = 0;
     hSocket = hSocketIn;
+    hSocketPolled = INVALID_SOCKET;
+    fPollRecvReady = false;
+    fPollSendReady = false;
+    fMessageOffloaded = false;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2714,6 +2945,8 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fGetAddr = false;
     fRelayTxes = false;
     fSentAddr = false;
+    fProvidesHeaderAndIDs = false;
+    fPreferHeaderAndIDs = false;
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
     nPingUsecStart = 0;
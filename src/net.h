@@ -37,7 +37,9 @@
 #include "util/strencodings.h"
 #include "util.h"
 
+#include <atomic>
 #include <deque>
+#include <functional>
 #include <stdint.h>
 
 #ifndef _WIN32
@@ -92,6 +94,10 @@ static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 384;
 /** The period before a network upgrade activates, where connections to upgrading peers are preferred (in blocks). */
 static const int NETWORK_UPGRADE_PEER_PREFERENCE_BLOCK_PERIOD = 24 * 24 * 3;
+/** Default number of threads handling read-only peer messages off the message handler thread, 0 disables them */
+static const int DEFAULT_MSG_WORKER_THREADS = 2;
+/** Maximum for -msgworkers */
+static const int MAX_MSG_WORKER_THREADS = 16;
 
 extern std::atomic<bool> fNetworkActive;
 
@@ -112,6 +118,15 @@ void LoadPeers();
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/** Wake the message handler thread, e.g. when a complete message was received */
+void WakeMessageHandler();
+/**
+ * Run the handling of one message of pnode on the message worker pool. The
+ * message handler leaves pnode alone until the task has finished, which keeps
+ * the messages of a peer in order.
+ * @returns false if there is no worker pool, the caller handles the message then
+ */
+bool OffloadNodeMessage(CNode* pnode, std::function<void()> task);
 SSL_CTX* create_context(bool server_side);
 EVP_PKEY *generate_key();
 X509 *generate_x509(EVP_PKEY *pkey);
@@ -268,6 +283,16 @@ extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 
 typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
+struct CMsgProcessingTime
+{
+    uint64_t nCount;
+    int64_t nTotalUsec;
+    int64_t nMaxUsec;
+
+    CMsgProcessingTime() : nCount(0), nTotalUsec(0), nMaxUsec(0) {}
+};
+typedef std::map<std::string, CMsgProcessingTime> mapMsgCmdTime; //command, processing time
+
 class CNodeStats
 {
 public:
@@ -293,6 +318,7 @@ public:
     std::string addrLocal;
     uint64_t m_addr_processed{0};
     uint64_t m_addr_rate_limited{0};
+    mapMsgCmdTime mapProcessingTimePerMsgCmd;
     // Address of this peer
     CAddress addr;
     // Bind address of our side of the connection
@@ -304,6 +330,8 @@ public:
      * messages, implying a preference to receive ADDRv2 instead of ADDR ones.
      */
     bool m_wants_addrv2;
+    bool fProvidesHeaderAndIDs;
+    bool fPreferHeaderAndIDs;
 };
 
 
@@ -377,6 +405,10 @@ public:
     uint64_t nServices;
     SOCKET hSocket;
     CCriticalSection cs_hSocket;
+    // Edge triggered poller state, only touched by the socket handler thread
+    SOCKET hSocketPolled;
+    bool fPollRecvReady;
+    bool fPollSendReady;
     CDataStream ssSend;
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
@@ -387,6 +419,9 @@ public:
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    // Set while a message of this peer is handled by the message worker pool,
+    // the worker owns the peer's message state until it is cleared
+    std::atomic<bool> fMessageOffloaded;
     uint64_t nRecvBytes;
     int nRecvVersion;
 
@@ -433,6 +468,11 @@ public:
      */
     bool m_wants_addrv2{false};
 
+    // Set by the peer's sendcmpct: it understands cmpctblock, and wants new
+    // blocks announced with cmpctblock instead of inv (high bandwidth mode)
+    std::atomic<bool> fProvidesHeaderAndIDs;
+    std::atomic<bool> fPreferHeaderAndIDs;
+
 protected:
 
     // Denial-of-service detection/prevention
@@ -512,6 +552,9 @@ private:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd GUARDED_BY(cs_vSend);
 
+    CCriticalSection cs_msgProcessingTime;
+    mapMsgCmdTime mapProcessingTimePerMsgCmd GUARDED_BY(cs_msgProcessingTime);
+
 public:
 
     NodeId GetId() const {
@@ -557,6 +600,15 @@ public:
 
 
 
+    void RecordProcessingTime(const std::string& strCommand, int64_t nUsec)
+    {
+        LOCK(cs_msgProcessingTime);
+        CMsgProcessingTime& time = mapProcessingTimePerMsgCmd[strCommand];
+        time.nCount++;
+        time.nTotalUsec += nUsec;
+        time.nMaxUsec = std::max(time.nMaxUsec, nUsec);
+    }
+
     void AddAddressKnown(const CAddress& _addr)
     {
         addrKnown.insert(_addr.GetKey());
@@ -10,6 +10,7 @@
 #include "netbase.h"
 
 #include "hash.h"
+#include "netpoller.h"
 #include "sync.h"
 #include "uint256.h"
 #include "random.h"
@@ -212,14 +213,7 @@ bool static InterruptibleRecv(char* data, size_t len, int timeout, SOCKET& hSock
         } else { // Other error or blocking
             int nErr = WSAGetLastError();
             if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL) {
-                if (!IsSelectableSocket(hSocket)) {
-                    return false;
-                }
-                struct timeval tval = MillisToTimeval(std::min(endTime - curTime, maxWait));
-                fd_set fdset;
-                FD_ZERO(&fdset);
-                FD_SET(hSocket, &fdset);
-                int nRet = select(hSocket + 1, &fdset, NULL, NULL, &tval);
+                int nRet = WaitForSocket(hSocket, false, std::min(endTime - curTime, maxWait));
                 if (nRet == SOCKET_ERROR) {
                     return false;
                 }
@@ -398,14 +392,6 @@ std::unique_ptr<Sock> CreateSockTCP(const CService& address_family)
         return nullptr;
     }
 
-    // Ensure that waiting for I/O on this socket won't result in undefined
-    // behavior.
-    if (!IsSelectableSocket(hSocket)) {
-        CloseSocket(hSocket);
-        LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
-        return nullptr;
-    }
-
 #ifdef SO_NOSIGPIPE
     int set = 1;
     // Set the no-sigpipe option on the socket for BSD systems, other UNIXes
@@ -529,11 +515,7 @@ bool ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRet, int
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL)
         {
-            struct timeval timeout = MillisToTimeval(nTimeout);
-            fd_set fdset;
-            FD_ZERO(&fdset);
-            FD_SET(hSocket, &fdset);
-            int nRet = select(hSocket + 1, NULL, &fdset, NULL, &timeout);
+            int nRet = WaitForSocket(hSocket, true, nTimeout);
             if (nRet == 0)
             {
                 LogPrint("net", "connection to %s timeout\n", addrConnect.ToString());
@@ -542,7 +524,7 @@ bool ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRet, int
             }
             if (nRet == SOCKET_ERROR)
             {
-                LogPrint("net","select() for %s failed: %s\n", addrConnect.ToString(), NetworkErrorString(WSAGetLastError()));
+                LogPrint("net","waiting for %s failed: %s\n", addrConnect.ToString(), NetworkErrorString(WSAGetLastError()));
                 CloseSocket(hSocket);
                 return false;
             }
@@ -555,7 +537,7 @@ bool ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRet, int
             }
             if (nRet != 0)
             {
-                LogPrint("net","connect() to %s failed after select(): %s\n", addrConnect.ToString(), NetworkErrorString(nRet));
+                LogPrint("net","connect() to %s failed after waiting: %s\n", addrConnect.ToString(), NetworkErrorString(nRet));
                 CloseSocket(hSocket);
                 return false;
             }
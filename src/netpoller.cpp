@@ -0,0 +1,226 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netpoller.h"
+
+#include "netbase.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#ifndef WIN32
+#include <poll.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/** Level triggered select() backend, the interest set is rebuilt on every call */
+class CSelectSocketPoller : public CSocketPoller
+{
+public:
+    std::string GetName() const { return "select"; }
+    bool IsEdgeTriggered() const { return false; }
+    bool IsServiceable(SOCKET hSocket) const { return IsSelectableSocket(hSocket); }
+    bool AddSocket(SOCKET hSocket) { return IsSelectableSocket(hSocket); }
+    void RemoveSocket(SOCKET hSocket) {}
+    // Wait never blocks for long, so there is nothing to interrupt
+    void Wakeup() {}
+
+    bool Wait(int64_t nTimeoutMs, const std::vector<CSocketEvent>& vInterest, std::vector<CSocketEvent>& vEvents)
+    {
+        struct timeval timeout = MillisToTimeval(nTimeoutMs);
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        fd_set fdsetError;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        bool have_fds = false;
+
+        for (const CSocketEvent& interest : vInterest) {
+            if (!IsSelectableSocket(interest.hSocket))
+                continue;
+            FD_SET(interest.hSocket, &fdsetError);
+            if (interest.fRecv)
+                FD_SET(interest.hSocket, &fdsetRecv);
+            if (interest.fSend)
+                FD_SET(interest.hSocket, &fdsetSend);
+            hSocketMax = std::max(hSocketMax, interest.hSocket);
+            have_fds = true;
+        }
+
+        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (nSelect == SOCKET_ERROR) {
+            bool fResult = !have_fds;
+            if (have_fds) {
+                int nErr = WSAGetLastError();
+                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+                // Let the receive path find out which socket is broken
+                for (const CSocketEvent& interest : vInterest) {
+                    if (interest.fRecv)
+                        vEvents.push_back(CSocketEvent(interest.hSocket, true, false, false));
+                }
+            }
+            MilliSleep(nTimeoutMs);
+            return fResult;
+        }
+
+        for (const CSocketEvent& interest : vInterest) {
+            if (!IsSelectableSocket(interest.hSocket))
+                continue;
+            CSocketEvent event(interest.hSocket,
+                               FD_ISSET(interest.hSocket, &fdsetRecv),
+                               FD_ISSET(interest.hSocket, &fdsetSend),
+                               FD_ISSET(interest.hSocket, &fdsetError));
+            if (event.fRecv || event.fSend || event.fError)
+                vEvents.push_back(event);
+        }
+        return true;
+    }
+};
+
+#ifdef __linux__
+/** Edge triggered epoll backend, with an eventfd to interrupt epoll_wait */
+class CEpollSocketPoller : public CSocketPoller
+{
+private:
+    int epfd;
+    int wakefd;
+
+public:
+    CEpollSocketPoller() : epfd(-1), wakefd(-1)
+    {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0)
+            return;
+        wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = wakefd;
+        if (wakefd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev) != 0) {
+            if (wakefd >= 0)
+                close(wakefd);
+            close(epfd);
+            epfd = wakefd = -1;
+        }
+    }
+
+    ~CEpollSocketPoller()
+    {
+        if (epfd >= 0) {
+            close(wakefd);
+            close(epfd);
+        }
+    }
+
+    bool IsValid() const { return epfd >= 0; }
+
+    std::string GetName() const { return "epoll"; }
+    bool IsEdgeTriggered() const { return true; }
+    bool IsServiceable(SOCKET hSocket) const { return hSocket != INVALID_SOCKET; }
+
+    bool AddSocket(SOCKET hSocket)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = hSocket;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, hSocket, &ev) == 0)
+            return true;
+        // A descriptor that was reused before its old registration went away
+        if (errno == EEXIST && epoll_ctl(epfd, EPOLL_CTL_MOD, hSocket, &ev) == 0)
+            return true;
+        LogPrintf("%s: epoll_ctl failed for socket %d: %s\n", __func__, hSocket, NetworkErrorString(errno));
+        return false;
+    }
+
+    void RemoveSocket(SOCKET hSocket)
+    {
+        // Closing the descriptor removes it as well, so a missing entry is fine
+        struct epoll_event ev;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, hSocket, &ev);
+    }
+
+    void Wakeup()
+    {
+        uint64_t one = 1;
+        if (write(wakefd, &one, sizeof(one)) < 0) {
+            // The counter is already non-zero, a wakeup is pending anyway
+        }
+    }
+
+    bool Wait(int64_t nTimeoutMs, const std::vector<CSocketEvent>& vInterest, std::vector<CSocketEvent>& vEvents)
+    {
+        struct epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, (int)nTimeoutMs);
+        if (n < 0) {
+            if (errno == EINTR)
+                return true;
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            MilliSleep(nTimeoutMs);
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == wakefd) {
+                uint64_t count;
+                if (read(wakefd, &count, sizeof(count)) < 0) {
+                    // Drained by an earlier wakeup
+                }
+                continue;
+            }
+            uint32_t flags = events[i].events;
+            bool fError = (flags & (EPOLLERR | EPOLLHUP)) != 0;
+            // Hang ups and errors surface through recv, like with select()
+            vEvents.push_back(CSocketEvent(events[i].data.fd,
+                                           (flags & (EPOLLIN | EPOLLRDHUP)) != 0 || fError,
+                                           (flags & EPOLLOUT) != 0,
+                                           fError));
+        }
+        return true;
+    }
+};
+#endif // __linux__
+
+} // anon namespace
+
+std::unique_ptr<CSocketPoller> MakeSocketPoller(const std::string& strBackend)
+{
+#ifdef __linux__
+    if (strBackend == "epoll") {
+        std::unique_ptr<CEpollSocketPoller> poller(new CEpollSocketPoller());
+        if (poller->IsValid())
+            return std::move(poller);
+        LogPrintf("%s: epoll unavailable (%s), falling back to select\n", __func__, NetworkErrorString(errno));
+    }
+#else
+    if (strBackend == "epoll")
+        LogPrintf("%s: epoll is not available on this platform, falling back to select\n", __func__);
+#endif
+    return std::unique_ptr<CSocketPoller>(new CSelectSocketPoller());
+}
+
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeoutMs)
+{
+#ifdef WIN32
+    struct timeval timeout = MillisToTimeval(nTimeoutMs);
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(hSocket, &fdset);
+    return select(hSocket + 1, fWrite ? NULL : &fdset, fWrite ? &fdset : NULL, NULL, &timeout);
+#else
+    struct pollfd pfd;
+    pfd.fd = hSocket;
+    pfd.events = fWrite ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    int nRet = poll(&pfd, 1, (int)nTimeoutMs);
+    return nRet < 0 ? SOCKET_ERROR : nRet;
+#endif
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETPOLLER_H
+#define BITCOIN_NETPOLLER_H
+
+#include "compat.h"
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** Default for -socketpoller */
+#ifdef __linux__
+static const char* const DEFAULT_SOCKET_POLLER = "epoll";
+#else
+static const char* const DEFAULT_SOCKET_POLLER = "select";
+#endif
+
+/** Directions in which servicing a socket stopped because it would block */
+enum SocketBlocked {
+    SOCKET_RECV_BLOCKED = 1,
+    SOCKET_SEND_BLOCKED = 2,
+};
+
+/** Interest in, or readiness of, one socket */
+struct CSocketEvent
+{
+    SOCKET hSocket;
+    bool fRecv;
+    bool fSend;
+    bool fError;
+
+    CSocketEvent(SOCKET hSocketIn = INVALID_SOCKET, bool fRecvIn = false, bool fSendIn = false, bool fErrorIn = false) :
+        hSocket(hSocketIn), fRecv(fRecvIn), fSend(fSendIn), fError(fErrorIn) {}
+};
+
+/**
+ * Readiness notification for the sockets served by ThreadSocketHandler.
+ *
+ * The select() backend is level triggered: it is handed the full interest set
+ * on every Wait and can only watch sockets below FD_SETSIZE. The epoll backend
+ * is edge triggered: sockets are registered once, each readiness transition is
+ * reported once, and the caller keeps servicing a socket until it would block.
+ */
+class CSocketPoller
+{
+public:
+    virtual ~CSocketPoller() {}
+
+    virtual std::string GetName() const = 0;
+
+    /** True if sockets are registered once and readiness is reported on transitions */
+    virtual bool IsEdgeTriggered() const = 0;
+
+    /** Whether the backend is able to watch this socket at all */
+    virtual bool IsServiceable(SOCKET hSocket) const = 0;
+
+    /** Start watching a socket for both directions (edge triggered backends) */
+    virtual bool AddSocket(SOCKET hSocket) = 0;
+
+    /** Stop watching a socket, must be called before it is closed; thread safe */
+    virtual void RemoveSocket(SOCKET hSocket) = 0;
+
+    /**
+     * Wait until a socket is ready, Wakeup is called or nTimeoutMs passes.
+     * @param vInterest the sockets and directions to watch (level triggered backends)
+     * @param vEvents receives the ready sockets
+     * @returns false on a wait error
+     */
+    virtual bool Wait(int64_t nTimeoutMs, const std::vector<CSocketEvent>& vInterest, std::vector<CSocketEvent>& vEvents) = 0;
+
+    /** Make a Wait in progress return early; thread safe */
+    virtual void Wakeup() = 0;
+};
+
+/**
+ * Create a poller backend ("epoll" or "select"). Falls back to select() if the
+ * requested backend is not available on this platform.
+ */
+std::unique_ptr<CSocketPoller> MakeSocketPoller(const std::string& strBackend);
+
+/**
+ * Wait for a single socket to become readable or writable without the
+ * FD_SETSIZE limit of select() where poll() is available.
+ * @returns 1 if ready, 0 on timeout, SOCKET_ERROR on error
+ */
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeoutMs);
+
+#endif // BITCOIN_NETPOLLER_H
@@ -25,8 +25,10 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "crypto/equihash.h"
+#include "cuckoocache.h"
 #include "primitives/block.h"
 #include "streams.h"
+#include "threadpool.h"
 #include "uint256.h"
 #include "util.h"
 #include "komodo.h"
@@ -36,6 +38,8 @@
 
 #include "sodium.h"
 
+#include <boost/thread.hpp>
+
 #ifdef ENABLE_RUST
 #include "librustzcash.h"
 #endif // ENABLE_RUST
@@ -550,42 +554,170 @@ unsigned int CalculateNextWorkRequired(arith_uint256 bnAvg,
     return bnNew.GetCompact();
 }
 
-bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
+namespace {
+
+/**
+ * Header hashes whose Equihash solution was found valid. The solution is part
+ * of the hashed header, so a hit means the very same solution was verified
+ * before. Only headers with a valid solution are inserted and those are
+ * expensive to produce, so the unsalted hash bytes are fine as bucket keys.
+ */
+class CEquihashSolutionCache
+{
+private:
+    class Hasher
+    {
+    public:
+        template <uint8_t hash_select>
+        uint32_t operator()(const uint256& key) const
+        {
+            static_assert(hash_select < 8, "Hasher only has 8 hashes available.");
+            uint32_t u;
+            std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+            return u;
+        }
+    };
+    typedef CuckooCache::cache<uint256, Hasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs;
+
+public:
+    CEquihashSolutionCache()
+    {
+        setValid.setup_bytes(EQUIHASH_SOLUTION_CACHE_BYTES);
+    }
+
+    bool Contains(const uint256& hash)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs);
+        return setValid.contains(hash, false);
+    }
+
+    void Insert(const uint256& hash)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs);
+        setValid.insert(hash);
+    }
+};
+
+CEquihashSolutionCache equihashSolutionCache;
+
+/**
+ * BLAKE2b state initialised with the Equihash personalisation for (n, k),
+ * kept per thread so verifying a header only has to copy it.
+ */
+struct CEquihashBaseState
+{
+    unsigned int n;
+    unsigned int k;
+    crypto_generichash_blake2b_state state;
+    CDataStream ss;
+
+    CEquihashBaseState() : n(0), k(0), ss(SER_NETWORK, PROTOCOL_VERSION) {}
+};
+
+/** Whether the header is exempt from the check or needs to be verified */
+bool IsEquihashCheckRequired(const CBlockHeader *pblock)
 {
     if (ASSETCHAINS_ALGO != ASSETCHAINS_EQUIHASH)
-        return true;
-    
+        return false;
+
     if ( ASSETCHAINS_NK[0] != 0 && ASSETCHAINS_NK[1] != 0 && pblock->GetHash().ToString() == "027e3758c3a65b12aa1046462b486d0a63bfa1beae327897f56c5cfb7daaae71" )
-        return true;
+        return false;
 
+    if ( Params().NetworkIDString() == "regtest" )
+        return false;
+    return true;
+}
+
+bool VerifyEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
+{
     unsigned int n = params.EquihashN();
     unsigned int k = params.EquihashK();
 
-    if ( Params().NetworkIDString() == "regtest" )
-        return(true);
+    static thread_local CEquihashBaseState base;
+    if (base.n != n || base.k != k) {
+        EhInitialiseState(n, k, base.state);
+        base.n = n;
+        base.k = k;
+    }
     // Hash state
-    crypto_generichash_blake2b_state state;
-    EhInitialiseState(n, k, state);
+    crypto_generichash_blake2b_state state = base.state;
 
-    // I = the block header minus nonce and solution.
-    CEquihashInput I{*pblock};
+    // I = the block header minus nonce and solution, as in CEquihashInput,
+    // written directly so the solution is not copied along with the header.
     // I||V
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << I;
-    ss << pblock->nNonce;
+    base.ss.clear();
+    base.ss << pblock->nVersion << pblock->hashPrevBlock << pblock->hashMerkleRoot
+            << pblock->hashFinalSaplingRoot << pblock->nTime << pblock->nBits;
+    base.ss << pblock->nNonce;
 
     // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+    crypto_generichash_blake2b_update(&state, (unsigned char*)&base.ss[0], base.ss.size());
 
     bool isValid;
     EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
+    return isValid;
+}
+
+} // anon namespace
 
-    if (!isValid)
+bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
+{
+    if (!IsEquihashCheckRequired(pblock))
+        return true;
+
+    uint256 hash = pblock->GetHash();
+    if (equihashSolutionCache.Contains(hash))
+        return true;
+
+    if (!VerifyEquihashSolution(pblock, params))
         return error("CheckEquihashSolution(): invalid solution");
 
+    equihashSolutionCache.Insert(hash);
     return true;
 }
 
+int CheckEquihashSolutions(const std::vector<CBlockHeader>& vHeaders, const CChainParams& params, bool fUseCache)
+{
+    std::vector<const CBlockHeader*> vToVerify;
+    std::vector<uint256> vHashes;
+    std::vector<int> vIndex;
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        if (!IsEquihashCheckRequired(&vHeaders[i]))
+            continue;
+        uint256 hash = vHeaders[i].GetHash();
+        if (fUseCache && equihashSolutionCache.Contains(hash))
+            continue;
+        vToVerify.push_back(&vHeaders[i]);
+        vHashes.push_back(hash);
+        vIndex.push_back(i);
+    }
+
+    // Bytes rather than vector<bool>, the workers write neighbouring entries
+    std::vector<char> vValid(vToVerify.size(), 0);
+    if (vToVerify.size() == 1) {
+        vValid[0] = VerifyEquihashSolution(vToVerify[0], params);
+    } else if (!vToVerify.empty()) {
+        CTaskGroup group(GetValidationThreadPool());
+        for (size_t i = 0; i < vToVerify.size(); i++) {
+            group.Submit([&vToVerify, &vValid, &params, i]() {
+                vValid[i] = VerifyEquihashSolution(vToVerify[i], params);
+            });
+        }
+        group.Wait();
+    }
+
+    for (size_t i = 0; i < vToVerify.size(); i++) {
+        if (!vValid[i]) {
+            LogPrintf("CheckEquihashSolutions(): invalid solution in header %s\n", vHashes[i].ToString());
+            return vIndex[i];
+        }
+        equihashSolutionCache.Insert(vHashes[i]);
+    }
+    return -1;
+}
+
 int32_t komodo_is_special(uint8_t pubkeys[66][33],int32_t mids[66],uint32_t blocktimes[66],int32_t height,uint8_t pubkey33[33],uint32_t blocktime);
 int32_t komodo_currentheight();
 void komodo_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t height);
@@ -25,6 +25,7 @@
 #include "consensus/params.h"
 
 #include <stdint.h>
+#include <vector>
 
 class CBlockHeader;
 class CBlockIndex;
@@ -37,9 +38,21 @@ unsigned int CalculateNextWorkRequired(arith_uint256 bnAvg,
                                        int64_t nLastBlockTime, int64_t nFirstBlockTime,
                                        const Consensus::Params&);
 
+/** Memory used to remember headers whose Equihash solution was verified */
+static const size_t EQUIHASH_SOLUTION_CACHE_BYTES = 4 << 20;
+
 /** Check whether the Equihash solution in a block header is valid */
 bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams&);
 
+/**
+ * Check the Equihash solutions of a batch of headers, such as a headers
+ * message, on the validation thread pool. Valid solutions are remembered so
+ * CheckEquihashSolution returns without verifying them again.
+ * @param fUseCache false to verify headers even if they were seen before
+ * @returns the index of the first header with an invalid solution, or -1
+ */
+int CheckEquihashSolutions(const std::vector<CBlockHeader>& vHeaders, const CChainParams&, bool fUseCache = true);
+
 /**
  * @brief Check if given notaryid is allowed to mine a mindiff block in case of GAP
  *
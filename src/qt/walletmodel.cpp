@@ -110,7 +110,8 @@ CAmount WalletModel::getBalance(const CCoinControl *coinControl) const
 
 CAmount WalletModel::getUnconfirmedBalance() const
 {
-    return wallet->GetUnconfirmedBalance() + getBalanceZaddr("", 0, true) - getBalanceZaddr("", 1, true);
+    CWalletBalances balances = wallet->GetBalances();
+    return balances.nUnconfirmed + balances.nSaplingUnconfirmed;
 }
 
 CAmount WalletModel::getImmatureBalance() const
@@ -120,12 +121,12 @@ CAmount WalletModel::getImmatureBalance() const
 
 CAmount WalletModel::getPrivateBalance() const
 {
-    return getBalanceZaddr("", 1, true);
+    return wallet->GetBalances().nSaplingTrusted;
 }
 
 CAmount WalletModel::getPrivateWatchBalance() const
 {
-    return getBalanceZaddr("", 1, false) - getBalanceZaddr("", 1, true);
+    return wallet->GetBalances().nSaplingWatchOnlyTrusted;
 }
 
 CAmount WalletModel::getInterestBalance() const
@@ -145,10 +146,8 @@ CAmount WalletModel::getWatchBalance() const
 
 CAmount WalletModel::getWatchUnconfirmedBalance() const
 {
-    CAmount balance = wallet->GetUnconfirmedWatchOnlyBalance();
-     balance += getBalanceZaddr("", 0, false) - getBalanceZaddr("", 1, false);
-     balance -= (getBalanceZaddr("", 0, true) - getBalanceZaddr("", 1, true));
-    return balance;
+    CWalletBalances balances = wallet->GetBalances();
+    return balances.nWatchOnlyUnconfirmed + balances.nSaplingWatchOnlyUnconfirmed;
 }
 
 CAmount WalletModel::getWatchImmatureBalance() const
@@ -390,14 +389,14 @@ void WalletModel::checkBalanceChanged()
     CAmount newWatchUnconfBalance = 0;
     CAmount newWatchImmatureBalance = 0;
     CAmount newWatchPrivateBalance = 0;
-    CAmount newprivateBalance = getBalanceZaddr("", 1, true);
+    CAmount newprivateBalance = getPrivateBalance();
     CAmount newinterestBalance = (chainName.isKMD()) ? komodo_interestsum() : 0;
     if (haveWatchOnly())
     {
         newWatchOnlyBalance = getWatchBalance();
         newWatchUnconfBalance = getWatchUnconfirmedBalance();
         newWatchImmatureBalance = getWatchImmatureBalance();
-        newWatchPrivateBalance = getBalanceZaddr("", 1, false) - getBalanceZaddr("", 1, true);
+        newWatchPrivateBalance = getPrivateWatchBalance();
     }
 
     if(cachedBalance != newBalance || cachedUnconfirmedBalance != newUnconfirmedBalance || cachedImmatureBalance != newImmatureBalance ||
@@ -19,6 +19,7 @@
  *                                                                            *
  ******************************************************************************/
 
+#include "compactsaplingindex.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
@@ -206,6 +207,76 @@ static bool rest_headers(HTTPRequest* req,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_compactsaplingblocks(HTTPRequest* req,
+                                      const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    if (!fCompactSaplingIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Compact sapling index not enabled, restart with -compactsaplingindex");
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block count specified. Use /rest/compactsaplingblocks/<startheight>/<count>.<ext>.");
+
+    long start = strtol(path[0].c_str(), NULL, 10);
+    long count = strtol(path[1].c_str(), NULL, 10);
+    if (count < 1 || count > MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+
+    int nTip;
+    {
+        LOCK(cs_main);
+        nTip = chainActive.Height();
+    }
+    if (start < 0 || start > nTip)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Start height out of range: " + path[0]);
+
+    // The index is read without cs_main, every record carries its own hash and height
+    std::vector<CCompactSaplingBlock> vBlocks;
+    if (!GetCompactSaplingBlocks(start, std::min((long)nTip, start + count - 1), vBlocks))
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read compact sapling blocks");
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        CDataStream ssBlocks(SER_NETWORK, PROTOCOL_VERSION);
+        for (const CCompactSaplingBlock& block : vBlocks) {
+            ssBlocks << block;
+        }
+        if (rf == RF_BINARY) {
+            string binaryBlocks = ssBlocks.str();
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, binaryBlocks);
+        } else {
+            string strHex = HexStr(ssBlocks.begin(), ssBlocks.end()) + "\n";
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, strHex);
+        }
+        return true;
+    }
+    case RF_JSON: {
+        UniValue jsonBlocks(UniValue::VARR);
+        for (const CCompactSaplingBlock& block : vBlocks) {
+            jsonBlocks.push_back(compactSaplingBlockToJSON(block));
+        }
+        string strJSON = jsonBlocks.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -618,6 +689,7 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/compactsaplingblocks/", rest_compactsaplingblocks},
       {"/rest/getutxos", rest_getutxos},
 };
 
@@ -23,6 +23,7 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "compactsaplingindex.h"
 #include "crosschain.h"
 #include "base58.h"
 #include "consensus/validation.h"
@@ -30,8 +31,10 @@
 #include "main.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
+#include "saplingcache.h"
 #include "streams.h"
 #include "sync.h"
+#include "txcache.h"
 #include "util.h"
 #include "script/script.h"
 #include "script/script_error.h"
@@ -630,6 +633,112 @@ UniValue getblockhashes(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return result;
 }
 
+UniValue compactSaplingBlockToJSON(const CCompactSaplingBlock& block)
+{
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("height", block.nHeight));
+    result.push_back(Pair("hash", block.hash.GetHex()));
+    result.push_back(Pair("previousblockhash", block.hashPrevBlock.GetHex()));
+    result.push_back(Pair("time", (int64_t)block.nTime));
+    result.push_back(Pair("finalsaplingroot", block.hashFinalSaplingRoot.GetHex()));
+    UniValue txs(UniValue::VARR);
+    for (const CCompactSaplingTx& tx : block.vtx) {
+        UniValue objTx(UniValue::VOBJ);
+        objTx.push_back(Pair("index", (int64_t)tx.nIndex));
+        objTx.push_back(Pair("txid", tx.txid.GetHex()));
+        UniValue nullifiers(UniValue::VARR);
+        for (const uint256& nullifier : tx.vNullifiers) {
+            nullifiers.push_back(nullifier.GetHex());
+        }
+        objTx.push_back(Pair("nullifiers", nullifiers));
+        UniValue outputs(UniValue::VARR);
+        for (const CCompactSaplingOutput& output : tx.vOutputs) {
+            UniValue objOutput(UniValue::VOBJ);
+            objOutput.push_back(Pair("cmu", output.cmu.GetHex()));
+            objOutput.push_back(Pair("ephemeralKey", output.ephemeralKey.GetHex()));
+            objOutput.push_back(Pair("ciphertext", HexStr(output.ciphertext.begin(), output.ciphertext.end())));
+            outputs.push_back(objOutput);
+        }
+        objTx.push_back(Pair("outputs", outputs));
+        txs.push_back(objTx);
+    }
+    result.push_back(Pair("vtx", txs));
+    return result;
+}
+
+UniValue getcompactsaplingblocks(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getcompactsaplingblocks startheight ( endheight verbose )\n"
+            "\nReturns the compact Sapling blocks (ZIP-307 style) for a range of heights of the active chain.\n"
+            "Requires -compactsaplingindex. At most " + std::to_string(MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST) + " blocks are returned per call.\n"
+            "\nArguments:\n"
+            "1. startheight  (numeric, required) The first block height\n"
+            "2. endheight    (numeric, optional, default=startheight) The last block height, clamped to the tip\n"
+            "3. verbose      (boolean, optional, default=false) true for a json array, false for the serialized blocks as hex\n"
+            "\nResult (for verbose = false):\n"
+            "\"data\"         (string) The serialized compact blocks, concatenated, hex-encoded\n"
+            "\nResult (for verbose = true):\n"
+            "[\n"
+            "  {\n"
+            "    \"height\" : n,                (numeric) The block height\n"
+            "    \"hash\" : \"hash\",            (string) The block hash\n"
+            "    \"previousblockhash\" : \"hash\", (string) The hash of the previous block\n"
+            "    \"time\" : ttt,                (numeric) The block time\n"
+            "    \"finalsaplingroot\" : \"hash\",  (string) The Sapling note commitment tree root after this block\n"
+            "    \"vtx\" : [                    (array) Transactions with Sapling spends or outputs\n"
+            "      {\n"
+            "        \"index\" : n,             (numeric) Position in the block\n"
+            "        \"txid\" : \"id\",           (string) The transaction id\n"
+            "        \"nullifiers\" : [...],    (array) Nullifiers of the Sapling spends\n"
+            "        \"outputs\" : [            (array) Sapling outputs\n"
+            "          { \"cmu\" : \"hex\", \"ephemeralKey\" : \"hex\", \"ciphertext\" : \"hex\" (first 52 bytes) }\n"
+            "        ]\n"
+            "      }\n"
+            "    ]\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcompactsaplingblocks", "1000 1099")
+            + HelpExampleRpc("getcompactsaplingblocks", "1000, 1099, true")
+            );
+
+    if (!fCompactSaplingIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Compact sapling index not enabled, restart with -compactsaplingindex");
+
+    int nStart = params[0].get_int();
+    int nEnd = params.size() > 1 ? params[1].get_int() : nStart;
+    bool fVerbose = params.size() > 2 ? params[2].get_bool() : false;
+
+    {
+        LOCK(cs_main);
+        nEnd = std::min(nEnd, chainActive.Height());
+    }
+    if (nStart < 0 || nStart > nEnd)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    if (nEnd - nStart + 1 > MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %d blocks per call", MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST));
+
+    std::vector<CCompactSaplingBlock> vBlocks;
+    if (!GetCompactSaplingBlocks(nStart, nEnd, vBlocks))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Can't read compact sapling blocks");
+
+    if (!fVerbose) {
+        CDataStream ssBlocks(SER_NETWORK, PROTOCOL_VERSION);
+        for (const CCompactSaplingBlock& block : vBlocks) {
+            ssBlocks << block;
+        }
+        return HexStr(ssBlocks.begin(), ssBlocks.end());
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const CCompactSaplingBlock& block : vBlocks) {
+        result.push_back(compactSaplingBlockToJSON(block));
+    }
+    return result;
+}
+
 //! Sanity-check a height argument and interpret negative values.
 int interpretHeightArg(int nHeight, int currentHeight)
 {
@@ -1705,6 +1814,8 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    ret.push_back(Pair("saplingbundlecache", SaplingBundleCacheStatsToJSON()));
+    ret.push_back(Pair("txcache", TxCacheStatsToJSON()));
 
     if (Params().NetworkIDString() == "regtest") {
         ret.push_back(Pair("fullyNotified", mempool.IsFullyNotified()));
@@ -1724,6 +1835,22 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"saplingbundlecache\": {       (object) Sapling bundle validity cache\n"
+            "    \"inserts\": xxxxx           (numeric) Bundles verified and cached on mempool accept\n"
+            "    \"hits\": xxxxx              (numeric) Block lookups that skipped proof and binding signature checks\n"
+            "    \"misses\": xxxxx            (numeric) Block lookups that required full verification\n"
+            "    \"hitrate\": x.xxx           (numeric) hits / (hits + misses)\n"
+            "    \"mempoolhits\": xxxxx       (numeric) Mempool accept lookups of a bundle verified before\n"
+            "    \"mempoolmisses\": xxxxx     (numeric) Mempool accept lookups that required full verification\n"
+            "  }\n"
+            "  \"txcache\": {                (object) Cache of confirmed transactions read through -txindex\n"
+            "    \"entries\": xxxxx           (numeric) Cached transactions\n"
+            "    \"usage\": xxxxx             (numeric) Memory used by the cache in bytes\n"
+            "    \"maxusage\": xxxxx          (numeric) Memory limit set by -txcachesize\n"
+            "    \"hits\": xxxxx              (numeric) Lookups answered from memory\n"
+            "    \"misses\": xxxxx            (numeric) Lookups that read the block files\n"
+            "    \"hitrate\": x.xxx           (numeric) hits / (hits + misses)\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
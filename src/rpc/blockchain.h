@@ -18,3 +18,5 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 UniValue mempoolInfoToJSON();
 UniValue mempoolToJSON(bool fVerbose = false);
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+struct CCompactSaplingBlock;
+UniValue compactSaplingBlockToJSON(const CCompactSaplingBlock& block);
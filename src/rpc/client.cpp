@@ -125,12 +125,17 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblockhashes", 0 },
     { "getblockhashes", 1 },
     { "getblockhashes", 2 },
+    { "getcompactsaplingblocks", 0 },
+    { "getcompactsaplingblocks", 1 },
+    { "getcompactsaplingblocks", 2 },
     { "getspentinfo", 0},
     { "getaddresstxids", 0},
     { "getaddressbalance", 0},
     { "getaddressdeltas", 0},
     { "getaddressutxos", 0},
     { "getaddressmempool", 0},
+    { "tokenorderbook", 2 },
+    { "tokenorderbook", 4 },
     { "zcrawjoinsplit", 1 },
     { "zcrawjoinsplit", 2 },
     { "zcrawjoinsplit", 3 },
@@ -481,17 +481,27 @@ UniValue coinsupply(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"zfunds\" : \"0.777\",           (float) The shielded coin supply (in zaddrs)\n"
             "  \"sprout\" : \"0.077\",           (float) The sprout coin supply (in zcaddrs)\n"
            "  \"total\" :  \"777.777\",         (float) The total coin supply, i.e. sum of supply + zfunds\n"
+            "  \"notarypay\" : \"0.0\",          (float) The notary pay so far, only with -coinsupplyindex\n"
+            "  \"burned\" : \"0.0\",             (float) The value of the OP_RETURN and burn address outputs so far, only with -coinsupplyindex\n"
             "}\n"
+            "\nWith -coinsupplyindex the totals at any height are read from the index instead of summed block by block.\n"
             "\nExamples:\n"
             + HelpExampleCli("coinsupply", "420")
             + HelpExampleRpc("coinsupply", "420")
         );
-    if ( params.size() == 0 )
-        height = chainActive.Height();
-    else height = atoi(params[0].get_str());
-    currentHeight = chainActive.Height();
+    // komodo_coinsupply takes cs_main itself, only for the lookup of the block
+    CBlockIndex *pindex = 0;
+    {
+        LOCK(cs_main);
+        if ( params.size() == 0 )
+            height = chainActive.Height();
+        else height = atoi(params[0].get_str());
+        currentHeight = chainActive.Height();
+        if ( height >= 0 && height <= currentHeight )
+            pindex = chainActive[height];
+    }
 
-    if (height >= 0 && height <= currentHeight) {
+    if (pindex != 0) {
         if ( (supply= komodo_coinsupply(&zfunds,&sproutfunds,height)) > 0 )
         {
             result.push_back(Pair("result", "success"));
@@ -501,6 +511,12 @@ UniValue coinsupply(const UniValue& params, bool fHelp, const CPubKey& mypk)
             result.push_back(Pair("zfunds", ValueFromAmount(zfunds)));
             result.push_back(Pair("sprout", ValueFromAmount(sproutfunds)));
             result.push_back(Pair("total", ValueFromAmount(zfunds + supply)));
+            CCoinSupplyValue totals;
+            if ( GetCoinSupply(pindex, totals) )
+            {
+                result.push_back(Pair("notarypay", ValueFromAmount(totals.nNotaryPay)));
+                result.push_back(Pair("burned", ValueFromAmount(totals.nBurned)));
+            }
             if ( ASSETCHAINS_BLOCKTIME > 0 )
             {
                 blocks_per_year = 24*3600*365 / ASSETCHAINS_BLOCKTIME;
@@ -926,6 +942,131 @@ bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
     return a.second.time < b.second.time;
 }
 
+/** Largest number of records returned by one page of an address index query */
+static const int MAX_ADDRESS_INDEX_PAGE = 50000;
+/** Page size used when a cursor is passed without a limit */
+static const int DEFAULT_ADDRESS_INDEX_PAGE = 1000;
+
+static const char ADDRESS_CURSOR_INDEX = 'd';
+static const char ADDRESS_CURSOR_UNSPENT = 'u';
+
+/** Position in a paged walk over the address index of several addresses */
+struct CAddressIndexCursor
+{
+    bool fPaged;
+    int nLimit;
+    bool fReverse;
+    //! Position in the requested addresses to resume with
+    uint32_t nAddress;
+    //! Resume after the record below rather than at the start of the address
+    bool fStartAfter;
+    CAddressIndexKey indexKey;
+    CAddressUnspentKey unspentKey;
+
+    CAddressIndexCursor() : fPaged(false), nLimit(0), fReverse(false), nAddress(0), fStartAfter(false) {}
+};
+
+/**
+ * Read "limit", "cursor" and "reverse" of an address query. A cursor is the
+ * opaque "next" token of the previous page and fixes the direction.
+ */
+static void ParseAddressIndexCursor(const UniValue& params, char chKind,
+                                    const std::vector<std::pair<uint160, int> >& addresses,
+                                    CAddressIndexCursor& cursor)
+{
+    if (!params[0].isObject())
+        return;
+    const UniValue& obj = params[0].get_obj();
+    UniValue limitValue = find_value(obj, "limit");
+    UniValue cursorValue = find_value(obj, "cursor");
+    UniValue reverseValue = find_value(obj, "reverse");
+    if (limitValue.isNull() && cursorValue.isNull())
+        return;
+
+    cursor.fPaged = true;
+    cursor.nLimit = limitValue.isNull() ? DEFAULT_ADDRESS_INDEX_PAGE : limitValue.get_int();
+    if (cursor.nLimit <= 0 || cursor.nLimit > MAX_ADDRESS_INDEX_PAGE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Limit is expected to be between 1 and %d", MAX_ADDRESS_INDEX_PAGE));
+    if (reverseValue.isBool())
+        cursor.fReverse = reverseValue.get_bool();
+    if (cursorValue.isNull())
+        return;
+
+    std::string strCursor = cursorValue.get_str();
+    if (!IsHex(strCursor))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    std::vector<unsigned char> vch = ParseHex(strCursor);
+    CDataStream ss(vch, SER_NETWORK, PROTOCOL_VERSION);
+    unsigned int type;
+    uint160 hashBytes;
+    try {
+        char chCursorKind;
+        ss >> chCursorKind >> cursor.fReverse >> cursor.nAddress;
+        if (chCursorKind != chKind)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor belongs to a different query");
+        if (chKind == ADDRESS_CURSOR_INDEX) {
+            ss >> cursor.indexKey;
+            type = cursor.indexKey.type;
+            hashBytes = cursor.indexKey.hashBytes;
+        } else {
+            ss >> cursor.unspentKey;
+            type = cursor.unspentKey.type;
+            hashBytes = cursor.unspentKey.hashBytes;
+        }
+    } catch (const std::ios_base::failure&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (!ss.empty() || cursor.nAddress >= addresses.size() ||
+        addresses[cursor.nAddress].first != hashBytes || addresses[cursor.nAddress].second != (int)type)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor does not match the addresses");
+    cursor.fStartAfter = true;
+}
+
+static std::string EncodeAddressIndexCursor(const CAddressIndexCursor& cursor, char chKind)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << chKind << cursor.fReverse << cursor.nAddress;
+    if (chKind == ADDRESS_CURSOR_INDEX)
+        ss << cursor.indexKey;
+    else
+        ss << cursor.unspentKey;
+    return HexStr(ss.begin(), ss.end());
+}
+
+static UniValue AddressUtxoToJSON(const CAddressUnspentKey& key, const CAddressUnspentValue& value)
+{
+    std::string address;
+    if (!getAddressFromIndex(key.type, key.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    UniValue output(UniValue::VOBJ);
+    output.push_back(Pair("address", address));
+    output.push_back(Pair("txid", key.txhash.GetHex()));
+    output.push_back(Pair("outputIndex", (int)key.index));
+    output.push_back(Pair("script", HexStr(value.script.begin(), value.script.end())));
+    output.push_back(Pair("satoshis", value.satoshis));
+    output.push_back(Pair("height", value.blockHeight));
+    return output;
+}
+
+static UniValue AddressDeltaToJSON(const CAddressIndexKey& key, CAmount amount)
+{
+    std::string address;
+    if (!getAddressFromIndex(key.type, key.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    UniValue delta(UniValue::VOBJ);
+    delta.push_back(Pair("satoshis", amount));
+    delta.push_back(Pair("txid", key.txhash.GetHex()));
+    delta.push_back(Pair("index", (int)key.index));
+    delta.push_back(Pair("blockindex", (int)key.txindex));
+    delta.push_back(Pair("height", key.blockHeight));
+    delta.push_back(Pair("address", address));
+    return delta;
+}
+
 UniValue getaddressmempool(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() > 2 || params.size() == 0)
@@ -1012,8 +1153,13 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\" (number, optional) Return at most this many outputs and a cursor to the rest\n"
+            "  \"cursor\" (string, optional) The \"next\" value of the previous page\n"
+            "  \"reverse\" (boolean, optional, default=false) Walk the index backwards\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
+            "\nWith a limit or cursor the outputs are returned as {\"utxos\": [...], \"next\": \"cursor\"}, in index order\n"
+            "rather than by height; \"next\" is only present when there are more outputs.\n"
             "\nResult\n"
             "[\n"
             "  {\n"
@@ -1044,41 +1190,62 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    CAddressIndexCursor cursor;
+    ParseAddressIndexCursor(params, ADDRESS_CURSOR_UNSPENT, addresses, cursor);
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    UniValue utxos(UniValue::VARR);
+    CAddressIndexCursor next = cursor;
+    bool fMore = false;
+
+    if (cursor.fPaged) {
+        // Pages follow the index order so that a cursor can resume the walk
+        int nCount = 0;
+        for (uint32_t i = cursor.nAddress; i < addresses.size() && !fMore; i++) {
+            const CAddressUnspentKey* pStartAfter = (i == cursor.nAddress && cursor.fStartAfter) ? &cursor.unspentKey : NULL;
+            bool fFound = ScanAddressUnspent(addresses[i].first, addresses[i].second, pStartAfter, cursor.fReverse,
+                [&](const CAddressUnspentKey& key, const CAddressUnspentValue& value) {
+                    if (nCount == cursor.nLimit) {
+                        fMore = true;
+                        return false;
+                    }
+                    utxos.push_back(AddressUtxoToJSON(key, value));
+                    nCount++;
+                    next.nAddress = i;
+                    next.unspentKey = key;
+                    return true;
+                });
+            if (!fFound) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
         }
-    }
+    } else {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
 
-    UniValue utxos(UniValue::VARR);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
 
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
-        UniValue output(UniValue::VOBJ);
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
+            utxos.push_back(AddressUtxoToJSON(it->first, it->second));
         }
-
-        output.push_back(Pair("address", address));
-        output.push_back(Pair("txid", it->first.txhash.GetHex()));
-        output.push_back(Pair("outputIndex", (int)it->first.index));
-        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
-        output.push_back(Pair("satoshis", it->second.satoshis));
-        output.push_back(Pair("height", it->second.blockHeight));
-        utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || cursor.fPaged) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("utxos", utxos));
+        if (fMore) {
+            result.push_back(Pair("next", EncodeAddressIndexCursor(next, ADDRESS_CURSOR_UNSPENT)));
+        }
 
-        LOCK(cs_main);
-        result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
-        result.push_back(Pair("height", (int)chainActive.Height()));
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
+            result.push_back(Pair("height", (int)chainActive.Height()));
+        }
         return result;
     } else {
         return utxos;
@@ -1101,8 +1268,13 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& myp
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number, optional) Return at most this many deltas and a cursor to the rest\n"
+            "  \"cursor\" (string, optional) The \"next\" value of the previous page\n"
+            "  \"reverse\" (boolean, optional, default=false) Walk the index from the highest block down\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
+            "\nWith a limit or cursor the deltas are returned as {\"deltas\": [...], \"next\": \"cursor\"};\n"
+            "\"next\" is only present when there are more deltas.\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -1148,36 +1320,31 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& myp
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
-    }
+    CAddressIndexCursor cursor;
+    ParseAddressIndexCursor(params, ADDRESS_CURSOR_INDEX, addresses, cursor);
 
     UniValue deltas(UniValue::VARR);
-
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    CAddressIndexCursor next = cursor;
+    bool fMore = false;
+    int nCount = 0;
+
+    for (uint32_t i = cursor.nAddress; i < addresses.size() && !fMore; i++) {
+        const CAddressIndexKey* pStartAfter = (i == cursor.nAddress && cursor.fStartAfter) ? &cursor.indexKey : NULL;
+        bool fFound = ScanAddressIndex(addresses[i].first, addresses[i].second, start, end, pStartAfter, cursor.fReverse,
+            [&](const CAddressIndexKey& key, CAmount amount) {
+                if (cursor.fPaged && nCount == cursor.nLimit) {
+                    fMore = true;
+                    return false;
+                }
+                deltas.push_back(AddressDeltaToJSON(key, amount));
+                nCount++;
+                next.nAddress = i;
+                next.indexKey = key;
+                return true;
+            });
+        if (!fFound) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
-        delta.push_back(Pair("address", address));
-        deltas.push_back(delta);
     }
 
     UniValue result(UniValue::VOBJ);
@@ -1204,11 +1371,16 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& myp
         result.push_back(Pair("deltas", deltas));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
-
-        return result;
+    } else if (cursor.fPaged) {
+        result.push_back(Pair("deltas", deltas));
     } else {
         return deltas;
     }
+
+    if (fMore) {
+        result.push_back(Pair("next", EncodeAddressIndexCursor(next, ADDRESS_CURSOR_INDEX)));
+    }
+    return result;
 }
 
 CAmount checkburnaddress(CAmount &received, int64_t &nNotaryPay, int32_t &height, std::string sAddress)
@@ -1330,7 +1502,9 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp, const CPubKey& my
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"txcount\"  (numeric) The number of transactions crediting or debiting the addresses\n"
             "}\n"
+            "\nWith -addressbalanceindex the totals are read from running balances instead of the full address history.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
             + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
@@ -1342,27 +1516,24 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp, const CPubKey& my
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-
     CAmount balance = 0;
     CAmount received = 0;
+    int64_t txcount = 0;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAddressBalanceValue value;
+        if (!GetAddressBalance((*it).first, (*it).second, value)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
+        balance += value.balance;
+        received += value.received;
+        txcount += value.txcount;
     }
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("balance", balance));
     result.push_back(Pair("received", received));
+    result.push_back(Pair("txcount", txcount));
 
     return result;
 
@@ -1442,8 +1613,13 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids and a cursor to the rest\n"
+            "  \"cursor\" (string, optional) The \"next\" value of the previous page\n"
+            "  \"reverse\" (boolean, optional, default=false) Walk the index from the highest block down\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
+            "\nWith a limit or cursor the txids are returned as {\"txids\": [...], \"next\": \"cursor\"}, address by\n"
+            "address; \"next\" is only present when there are more txids.\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
@@ -1470,34 +1646,73 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             end = endValue.get_int();
         }
     }
+    if (start <= 0 || end <= 0) {
+        start = end = 0;
+    }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+    CAddressIndexCursor cursor;
+    ParseAddressIndexCursor(params, ADDRESS_CURSOR_INDEX, addresses, cursor);
+
+    if (cursor.fPaged) {
+        UniValue txids(UniValue::VARR);
+        CAddressIndexCursor next = cursor;
+        bool fMore = false;
+        int nCount = 0;
+
+        for (uint32_t i = cursor.nAddress; i < addresses.size() && !fMore; i++) {
+            const CAddressIndexKey* pStartAfter = (i == cursor.nAddress && cursor.fStartAfter) ? &cursor.indexKey : NULL;
+            // The records of a transaction are adjacent, a txid never spans two pages
+            bool fHaveLast = pStartAfter != NULL;
+            uint256 lastTxHash = fHaveLast ? pStartAfter->txhash : uint256();
+            bool fFound = ScanAddressIndex(addresses[i].first, addresses[i].second, start, end, pStartAfter, cursor.fReverse,
+                [&](const CAddressIndexKey& key, CAmount amount) {
+                    if (!fHaveLast || key.txhash != lastTxHash) {
+                        if (nCount == cursor.nLimit) {
+                            fMore = true;
+                            return false;
+                        }
+                        txids.push_back(key.txhash.GetHex());
+                        nCount++;
+                        fHaveLast = true;
+                        lastTxHash = key.txhash;
+                    }
+                    next.nAddress = i;
+                    next.indexKey = key;
+                    return true;
+                });
+            if (!fFound) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
         }
+
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("txids", txids));
+        if (fMore) {
+            result.push_back(Pair("next", EncodeAddressIndexCursor(next, ADDRESS_CURSOR_INDEX)));
+        }
+        return result;
     }
 
     std::set<std::pair<int, std::string> > txids;
     UniValue result(UniValue::VARR);
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        int height = it->first.blockHeight;
-        std::string txid = it->first.txhash.GetHex();
-
-        if (addresses.size() > 1) {
-            txids.insert(std::make_pair(height, txid));
-        } else {
-            if (txids.insert(std::make_pair(height, txid)).second) {
-                result.push_back(txid);
-            }
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        bool fFound = ScanAddressIndex((*it).first, (*it).second, start, end, NULL, false,
+            [&](const CAddressIndexKey& key, CAmount amount) {
+                int height = key.blockHeight;
+                std::string txid = key.txhash.GetHex();
+
+                if (addresses.size() > 1) {
+                    txids.insert(std::make_pair(height, txid));
+                } else {
+                    if (txids.insert(std::make_pair(height, txid)).second) {
+                        result.push_back(txid);
+                    }
+                }
+                return true;
+            });
+        if (!fFound) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
     }
 
@@ -135,6 +135,8 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "    \"version\": v,              (numeric) The peer version, such as 170002\n"
             "    \"subver\": \"/MagicBean:x.y.z[-v]/\",  (string) The string version\n"
             "    \"inbound\": true|false,     (boolean) Inbound (true) or Outbound (false)\n"
+            "    \"cmpctblocks\": true|false, (boolean) The peer sent sendcmpct and serves compact blocks\n"
+            "    \"cmpctblocks_hb\": true|false, (boolean) The peer asked for new blocks to be pushed as compact blocks\n"
             "    \"startingheight\": n,       (numeric) The starting height (block) of the peer\n"
             "    \"banscore\": n,             (numeric) The ban score\n"
             "    \"synced_headers\": n,       (numeric) The last header we have in common with this peer\n"
@@ -142,7 +144,14 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"processingtime_per_msg\": {  (json object) Time spent handling the messages of this peer, per command\n"
+            "       \"cmd\": {\n"
+            "         \"count\": n,            (numeric) Messages handled\n"
+            "         \"totalms\": n,          (numeric) Total handling time in milliseconds\n"
+            "         \"maxms\": n             (numeric) Longest handling time in milliseconds\n"
+            "       }, ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -204,6 +213,18 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
         obj.push_back(Pair("addr_processed", stats.m_addr_processed));
         obj.push_back(Pair("addr_rate_limited", stats.m_addr_rate_limited));
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        obj.push_back(Pair("cmpctblocks", stats.fProvidesHeaderAndIDs));
+        obj.push_back(Pair("cmpctblocks_hb", stats.fPreferHeaderAndIDs));
+
+        UniValue processingTime(UniValue::VOBJ);
+        BOOST_FOREACH(const mapMsgCmdTime::value_type &i, stats.mapProcessingTimePerMsgCmd) {
+            UniValue cmd(UniValue::VOBJ);
+            cmd.push_back(Pair("count", i.second.nCount));
+            cmd.push_back(Pair("totalms", i.second.nTotalUsec / 1000.0));
+            cmd.push_back(Pair("maxms", i.second.nMaxUsec / 1000.0));
+            processingTime.push_back(Pair(i.first, cmd));
+        }
+        obj.push_back(Pair("processingtime_per_msg", processingTime));
 
         ret.push_back(obj);
     }
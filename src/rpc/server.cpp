@@ -19,6 +19,7 @@
  ******************************************************************************/
 
 #include "rpc/server.h"
+#include "rpc/stats.h"
 
 #include "init.h"
 #include "key_io.h"
@@ -49,8 +50,8 @@ using namespace RPCServer;
 using namespace std;
 extern uint16_t ASSETCHAINS_P2PPORT,ASSETCHAINS_RPCPORT;
 
-bool fBuilingWitnessCache = false;
-bool fInitWitnessesBuilt = false;
+std::atomic<bool> fBuilingWitnessCache(false);
+std::atomic<bool> fInitWitnessesBuilt(false);
 bool fCleanUpMode = false;
 static bool fRPCRunning = false;
 static bool fRPCInWarmup = true;
@@ -288,6 +289,47 @@ UniValue stop(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return buf;
 }
 
+UniValue getrpcstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcstats\n"
+            "\nReturns statistics of the RPC calls served since startup and the calls executing now.\n"
+            "Latency quantiles are estimated from a histogram of the call durations.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"methods\": {\n"
+            "    \"method\": {\n"
+            "      \"calls\": n,          (numeric) Number of calls\n"
+            "      \"errors\": n,         (numeric) Number of calls that returned an error\n"
+            "      \"total_ms\": n,       (numeric) Total time spent in the calls\n"
+            "      \"max_ms\": n,         (numeric) Duration of the slowest call\n"
+            "      \"lockwait_ms\": n,    (numeric) Total time the calls waited on locks\n"
+            "      \"p50_ms\": n,         (numeric) Median duration\n"
+            "      \"p90_ms\": n,         (numeric) 90th percentile of the duration\n"
+            "      \"p99_ms\": n          (numeric) 99th percentile of the duration\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"inflight\": [\n"
+            "    {\n"
+            "      \"method\": \"name\",     (string) The method being executed\n"
+            "      \"elapsed_ms\": n,       (numeric) Time since the call started\n"
+            "      \"waiting_on\": \"lock\", (string, optional) The lock the call is blocked on\n"
+            "      \"lockwait_ms\": n       (numeric) Time the call waited on locks so far\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleRpc("getrpcstats", "")
+        );
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("methods", GetRPCStats().MethodsToJSON()));
+    result.push_back(Pair("inflight", GetRPCStats().InFlightToJSON()));
+    return result;
+}
+
 /**
  * Call Table
  */
@@ -300,6 +342,7 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "getnotarysendmany",      &getnotarysendmany,      true  },
     { "control",            "geterablockheights",     &geterablockheights,     true  },
     { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getrpcstats",            &getrpcstats,            true  },
 
     /* P2P networking */
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
@@ -326,6 +369,7 @@ static const CRPCCommand vRPCCommands[] =
     { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
+    { "blockchain",         "getcompactsaplingblocks", &getcompactsaplingblocks, true  },
     { "blockchain",         "getlastsegidstakes",     &getlastsegidstakes,     true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
@@ -527,9 +571,11 @@ static const CRPCCommand vRPCCommands[] =
     { "tokens",       "tokeninfo",        &tokeninfo,         true },
     { "tokens",       "tokenlist",        &tokenlist,         true },
     { "tokens",       "tokenorders",      &tokenorders,       true },
+    { "tokens",       "tokenorderbook",   &tokenorderbook,    true },
     { "tokens",       "mytokenorders",    &mytokenorders,     true },
     { "tokens",       "tokenaddress",     &tokenaddress,      true },
     { "tokens",       "tokenbalance",     &tokenbalance,      true },
+    { "tokens",       "tokenutxos",       &tokenutxos,        true },
     { "tokens",       "tokencreate",      &tokencreate,       true },
     { "tokens",       "tokentransfer",    &tokentransfer,     true },
     { "tokens",       "tokenbid",         &tokenbid,          true },
@@ -862,6 +908,13 @@ UniValue get_async_result(std::string sOpID)
     return oResult;
 }
 
+/** Calls that spend Sapling notes and so need the witnesses of the wallet */
+static bool IsSaplingSpendCommand(const std::string& strMethod)
+{
+    return strMethod == "z_sendmany" || strMethod == "z_sendmany_prepare_offline" ||
+           strMethod == "z_mergetoaddress" || strMethod == "z_createbuildinstructions";
+}
+
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
 {
     const CRPCCommand *pcmd = tableRPC[strMethod];
@@ -895,13 +948,14 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
           if (!fInitWitnessesBuilt && pcmd->name == "z_sendmany_prepare_offline")
               throw JSONRPCError(RPC_DISABLED_BEFORE_WITNESSES, "RPC Command disabled until witnesses are built.");
 
-          if (fBuilingWitnessCache)
-              throw JSONRPCError(RPC_BUILDING_WITNESS_CACHE, "RPC Interface disabled while builing witness cache. Check the debug.log for progress.");
+          if (fBuilingWitnessCache && IsSaplingSpendCommand(pcmd->name))
+              throw JSONRPCError(RPC_BUILDING_WITNESS_CACHE, "RPC Command disabled while building witness cache. Check the debug.log for progress.");
 
     }
 
 
     g_rpcSignals.PreCommand(*pcmd);
+    CRPCCallTracker tracker(pcmd->name);
 
     try
     {
@@ -921,14 +975,21 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
           }
         }
 
+        tracker.Success();
+        g_rpcSignals.PostCommand(*pcmd);
         return oResult;
     }
     catch (const std::exception& e)
     {
         printf("CRPCTable::execute() 2.3\n");
+        g_rpcSignals.PostCommand(*pcmd);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
-    g_rpcSignals.PostCommand(*pcmd);
+    catch (...)
+    {
+        g_rpcSignals.PostCommand(*pcmd);
+        throw;
+    }
 }
 
 std::vector<std::string> CRPCTable::listCommands() const
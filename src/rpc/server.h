@@ -25,6 +25,7 @@
 #include "rpc/protocol.h"
 #include "uint256.h"
 
+#include <atomic>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -36,8 +37,8 @@
 #include <univalue.h>
 #include <pubkey.h>
 
-extern bool fBuilingWitnessCache;
-extern bool fInitWitnessesBuilt;
+extern std::atomic<bool> fBuilingWitnessCache;
+extern std::atomic<bool> fInitWitnessesBuilt;
 extern bool fCleanUpMode;
 
 class AsyncRPCQueue;
@@ -258,8 +259,10 @@ extern UniValue coinsupply(const UniValue& params, bool fHelp, const CPubKey& my
 extern UniValue tokeninfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenlist(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue tokenorderbook(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenbalance(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue tokenutxos(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue assetsaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokencreate(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -391,6 +394,7 @@ extern UniValue getinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
 extern UniValue getiguanajson(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getnotarysendmany(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue geterablockheights(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getrpcstats(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue setpubkey(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue setstakingsplit(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getwalletinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -424,6 +428,7 @@ extern UniValue settxfee(const UniValue& params, bool fHelp, const CPubKey& mypk
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getcompactsaplingblocks(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockhash(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockheader(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -0,0 +1,140 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/stats.h"
+
+#include "rust/metrics.h"
+#include "sync.h"
+#include "utiltime.h"
+
+void CRPCMethodStats::Add(int64_t nMicros, bool fError, int64_t nLockWait)
+{
+    nCalls++;
+    if (fError)
+        nErrors++;
+    nTotalMicros += nMicros;
+    nMaxMicros = std::max(nMaxMicros, nMicros);
+    nLockWaitMicros += nLockWait;
+
+    size_t nBucket = 0;
+    while (nBucket < RPC_LATENCY_BUCKET_COUNT - 1 && nMicros > RPC_LATENCY_BUCKETS_MS[nBucket] * 1000)
+        nBucket++;
+    vBuckets[nBucket]++;
+}
+
+double CRPCMethodStats::Quantile(double q) const
+{
+    if (nCalls == 0)
+        return 0;
+
+    // Interpolate linearly inside the bucket holding the quantile; the open
+    // bucket at the end is capped by the slowest call seen
+    double nRank = q * nCalls;
+    uint64_t nBelow = 0;
+    for (size_t i = 0; i < RPC_LATENCY_BUCKET_COUNT; i++) {
+        if (vBuckets[i] == 0 || nBelow + vBuckets[i] < nRank) {
+            nBelow += vBuckets[i];
+            continue;
+        }
+        double nLower = i == 0 ? 0 : RPC_LATENCY_BUCKETS_MS[i - 1];
+        double nUpper = i == RPC_LATENCY_BUCKET_COUNT - 1 ? nMaxMicros / 1000.0 : RPC_LATENCY_BUCKETS_MS[i];
+        nUpper = std::min(nUpper, nMaxMicros / 1000.0);
+        if (nUpper < nLower)
+            return nUpper;
+        return nLower + (nUpper - nLower) * (nRank - nBelow) / vBuckets[i];
+    }
+    return nMaxMicros / 1000.0;
+}
+
+uint64_t CRPCStats::StartCall(const std::string& strMethod)
+{
+    const CLockWaitStats& lockWait = GetThreadLockWaitStats();
+    CInFlightCall call;
+    call.strMethod = strMethod;
+    call.nStartMicros = GetTimeMicros();
+    call.pLockWait = &lockWait;
+    call.nLockWaitStart = lockWait.nWaitMicros;
+
+    MetricsIncrementGauge("elosys.rpc.inflight", 1);
+
+    std::lock_guard<std::mutex> lock(cs);
+    uint64_t nId = nNextId++;
+    mapInFlight.emplace(nId, call);
+    return nId;
+}
+
+void CRPCStats::FinishCall(uint64_t nId, bool fError)
+{
+    int64_t nNow = GetTimeMicros();
+    std::string strMethod;
+    int64_t nMicros, nLockWait;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        std::map<uint64_t, CInFlightCall>::iterator it = mapInFlight.find(nId);
+        if (it == mapInFlight.end())
+            return;
+        strMethod = it->second.strMethod;
+        nMicros = nNow - it->second.nStartMicros;
+        nLockWait = it->second.pLockWait->nWaitMicros - it->second.nLockWaitStart;
+        mapInFlight.erase(it);
+        mapMethods[strMethod].Add(nMicros, fError, nLockWait);
+    }
+
+    MetricsDecrementGauge("elosys.rpc.inflight", 1);
+    MetricsIncrementCounter("elosys.rpc.calls", "method", strMethod.c_str());
+    if (fError)
+        MetricsIncrementCounter("elosys.rpc.errors", "method", strMethod.c_str());
+    MetricsHistogram("elosys.rpc.duration.seconds", nMicros / 1000000.0, "method", strMethod.c_str());
+    MetricsHistogram("elosys.rpc.lockwait.seconds", nLockWait / 1000000.0, "method", strMethod.c_str());
+}
+
+UniValue CRPCStats::MethodsToJSON() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    UniValue result(UniValue::VOBJ);
+    for (const auto& item : mapMethods) {
+        const CRPCMethodStats& stats = item.second;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("calls", stats.nCalls));
+        entry.push_back(Pair("errors", stats.nErrors));
+        entry.push_back(Pair("total_ms", stats.nTotalMicros / 1000.0));
+        entry.push_back(Pair("max_ms", stats.nMaxMicros / 1000.0));
+        entry.push_back(Pair("lockwait_ms", stats.nLockWaitMicros / 1000.0));
+        entry.push_back(Pair("p50_ms", stats.Quantile(0.5)));
+        entry.push_back(Pair("p90_ms", stats.Quantile(0.9)));
+        entry.push_back(Pair("p99_ms", stats.Quantile(0.99)));
+        result.push_back(Pair(item.first, entry));
+    }
+    return result;
+}
+
+UniValue CRPCStats::InFlightToJSON() const
+{
+    int64_t nNow = GetTimeMicros();
+    std::lock_guard<std::mutex> lock(cs);
+    UniValue result(UniValue::VARR);
+    for (const auto& item : mapInFlight) {
+        const CInFlightCall& call = item.second;
+        int64_t nLockWait = call.pLockWait->nWaitMicros - call.nLockWaitStart;
+        int64_t nWaitStart = call.pLockWait->nWaitStart;
+        const char* pszWaitLock = call.pLockWait->pszWaitLock;
+
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("method", call.strMethod));
+        entry.push_back(Pair("elapsed_ms", (nNow - call.nStartMicros) / 1000.0));
+        if (nWaitStart != 0 && pszWaitLock != nullptr) {
+            nLockWait += std::max<int64_t>(nNow - nWaitStart, 0);
+            entry.push_back(Pair("waiting_on", pszWaitLock));
+        }
+        entry.push_back(Pair("lockwait_ms", nLockWait / 1000.0));
+        result.push_back(entry);
+    }
+    return result;
+}
+
+CRPCStats& GetRPCStats()
+{
+    static CRPCStats stats;
+    return stats;
+}
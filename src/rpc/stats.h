@@ -0,0 +1,87 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_STATS_H
+#define BITCOIN_RPC_STATS_H
+
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+#include <univalue.h>
+
+struct CLockWaitStats;
+
+/** Upper bounds of the latency histogram buckets, in milliseconds */
+static const int64_t RPC_LATENCY_BUCKETS_MS[] = {1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000};
+static const size_t RPC_LATENCY_BUCKET_COUNT = sizeof(RPC_LATENCY_BUCKETS_MS) / sizeof(RPC_LATENCY_BUCKETS_MS[0]) + 1;
+
+/** Counters and latency histogram of one RPC method */
+struct CRPCMethodStats
+{
+    uint64_t nCalls;
+    uint64_t nErrors;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    int64_t nLockWaitMicros;
+    //! Calls per latency bucket, the last one counts everything slower
+    uint64_t vBuckets[RPC_LATENCY_BUCKET_COUNT];
+
+    CRPCMethodStats() : nCalls(0), nErrors(0), nTotalMicros(0), nMaxMicros(0), nLockWaitMicros(0), vBuckets() {}
+
+    void Add(int64_t nMicros, bool fError, int64_t nLockWait);
+    /** Estimate the q-quantile (0..1) of the latency in milliseconds from the histogram */
+    double Quantile(double q) const;
+};
+
+/**
+ * Statistics of the RPC calls served since startup: call and error counts and
+ * latency histograms per method, and the calls currently executing with the
+ * time they waited on locks so far.
+ */
+class CRPCStats
+{
+public:
+    /** Register a call that starts executing on the calling thread, @returns its id */
+    uint64_t StartCall(const std::string& strMethod);
+    void FinishCall(uint64_t nId, bool fError);
+
+    UniValue MethodsToJSON() const;
+    UniValue InFlightToJSON() const;
+
+private:
+    struct CInFlightCall
+    {
+        std::string strMethod;
+        int64_t nStartMicros;
+        //! Lock wait statistics of the executing thread and their value at the start
+        const CLockWaitStats* pLockWait;
+        int64_t nLockWaitStart;
+    };
+
+    mutable std::mutex cs;
+    uint64_t nNextId = 0;
+    std::map<std::string, CRPCMethodStats> mapMethods;
+    std::map<uint64_t, CInFlightCall> mapInFlight;
+};
+
+CRPCStats& GetRPCStats();
+
+/** Records one RPC call in GetRPCStats() for the lifetime of the object */
+class CRPCCallTracker
+{
+public:
+    explicit CRPCCallTracker(const std::string& strMethod) : nId(GetRPCStats().StartCall(strMethod)), fError(true) {}
+    ~CRPCCallTracker() { GetRPCStats().FinishCall(nId, fError); }
+
+    /** Mark the call as successful, it counts as an error otherwise */
+    void Success() { fError = false; }
+
+private:
+    uint64_t nId;
+    bool fError;
+};
+
+#endif // BITCOIN_RPC_STATS_H
@@ -201,6 +201,42 @@ extern "C" {
     /// `librustzcash_sapling_verification_ctx_init`.
     void librustzcash_sapling_verification_ctx_free(void *);
 
+    /// Creates a Sapling batch verifier for spend and output
+    /// proofs. It must be consumed by
+    /// `librustzcash_sapling_batch_verifier_validate` or freed with
+    /// `librustzcash_sapling_batch_verifier_free`.
+    void * librustzcash_sapling_batch_verifier_init();
+
+    /// Frees a Sapling batch verifier without validating it.
+    void librustzcash_sapling_batch_verifier_free(void *);
+
+    /// Check the encodings and spendAuthSig of a Sapling Spend
+    /// description, and queue its proof in the batch verifier.
+    bool librustzcash_sapling_batch_verifier_queue_spend(
+        void *ctx,
+        const unsigned char *cv,
+        const unsigned char *anchor,
+        const unsigned char *nullifier,
+        const unsigned char *rk,
+        const unsigned char *zkproof,
+        const unsigned char *spendAuthSig,
+        const unsigned char *sighashValue
+    );
+
+    /// Check the encodings of a Sapling Output description, and
+    /// queue its proof in the batch verifier.
+    bool librustzcash_sapling_batch_verifier_queue_output(
+        void *ctx,
+        const unsigned char *cv,
+        const unsigned char *cm,
+        const unsigned char *ephemeralKey,
+        const unsigned char *zkproof
+    );
+
+    /// Verify every queued proof with randomized batch pairings,
+    /// and free the batch verifier.
+    bool librustzcash_sapling_batch_verifier_validate(void *ctx);
+
     /// Compute a Sapling nullifier.
     ///
     /// The `diversifier` parameter must be 11 bytes in length.
@@ -206,6 +206,30 @@ void metrics_record_histogram(MetricsKey* callsite, double value);
 /// name MUST be a static constant, and all strings MUST be valid UTF-8.
 #define MetricsIncrementCounter(name, ...) MetricsCounter(name, 1, __VA_ARGS__)
 
+/// Increments a counter with optional static labels.
+///
+/// Unlike MetricsCounter with labels, the callsite is built once, so this is
+/// cheap enough for hot paths.
+///
+/// name and all label values MUST be static constants, and all strings MUST be
+/// valid UTF-8.
+#define MetricsStaticCounter(name, value, ...)            \
+    do {                                                  \
+        static constexpr const char* M_LABELS[] =         \
+            {T_FIELD_NAMES(__VA_ARGS__)};                 \
+        static constexpr const char* M_VALUES[] =         \
+            {T_FIELD_VALUES(__VA_ARGS__)};                \
+        static MetricsCallsite* CALLSITE =                \
+             M_CALLSITE(name, M_LABELS, M_VALUES);        \
+         metrics_static_increment_counter(CALLSITE, value); \
+    } while (0)
+
+/// Increments a counter with optional static labels by one.
+///
+/// name and all label values MUST be static constants, and all strings MUST be
+/// valid UTF-8.
+#define MetricsStaticIncrementCounter(name, ...) MetricsStaticCounter(name, 1, __VA_ARGS__)
+
 /// Updates a gauge.
 ///
 /// Gauges represent a single value that can go up or down over time, and always
@@ -700,6 +700,71 @@ pub extern "C" fn librustzcash_sapling_final_check(
     unsafe { &*ctx }.final_check(value_balance, unsafe { &*sighash_value }, binding_sig)
 }
 
+/// Creates a Sapling batch verifier for spend and output proofs. It must be
+/// consumed with [`librustzcash_sapling_batch_verifier_validate`] or freed with
+/// [`librustzcash_sapling_batch_verifier_free`].
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_batch_verifier_init() -> *mut sapling::ItemBatchVerifier {
+    Box::into_raw(Box::new(sapling::ItemBatchVerifier::new()))
+}
+
+/// Frees a Sapling batch verifier returned from
+/// [`librustzcash_sapling_batch_verifier_init`] without validating it.
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_batch_verifier_free(ctx: *mut sapling::ItemBatchVerifier) {
+    drop(unsafe { Box::from_raw(ctx) });
+}
+
+/// Checks the spendAuthSig and encodings of a Sapling Spend description, and
+/// queues its proof in the batch verifier.
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_batch_verifier_queue_spend(
+    ctx: *mut sapling::ItemBatchVerifier,
+    cv: *const [c_uchar; 32],
+    anchor: *const [c_uchar; 32],
+    nullifier: *const [c_uchar; 32],
+    rk: *const [c_uchar; 32],
+    zkproof: *const [c_uchar; GROTH_PROOF_SIZE],
+    spend_auth_sig: *const [c_uchar; 64],
+    sighash_value: *const [c_uchar; 32],
+) -> bool {
+    unsafe { &mut *ctx }.queue_spend(
+        unsafe { &*cv },
+        unsafe { &*anchor },
+        unsafe { &*nullifier },
+        unsafe { &*rk },
+        unsafe { &*zkproof },
+        unsafe { &*spend_auth_sig },
+        unsafe { &*sighash_value },
+    )
+}
+
+/// Checks the encodings of a Sapling Output description, and queues its proof in
+/// the batch verifier.
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_batch_verifier_queue_output(
+    ctx: *mut sapling::ItemBatchVerifier,
+    cv: *const [c_uchar; 32],
+    cm: *const [c_uchar; 32],
+    epk: *const [c_uchar; 32],
+    zkproof: *const [c_uchar; GROTH_PROOF_SIZE],
+) -> bool {
+    unsafe { &mut *ctx }.queue_output(
+        unsafe { &*cv },
+        unsafe { &*cm },
+        unsafe { &*epk },
+        unsafe { &*zkproof },
+    )
+}
+
+/// Verifies all queued proofs and frees the batch verifier.
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_batch_verifier_validate(
+    ctx: *mut sapling::ItemBatchVerifier,
+) -> bool {
+    unsafe { Box::from_raw(ctx) }.validate()
+}
+
 /// Sprout JoinSplit proof generation.
 #[no_mangle]
 pub extern "C" fn librustzcash_sprout_prove(
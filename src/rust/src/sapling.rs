@@ -6,13 +6,18 @@ use std::convert::TryInto;
 use std::io::{self, Read, Write};
 use std::{mem, ptr};
 
-use bellman::groth16::{prepare_verifying_key, Proof};
-use group::GroupEncoding;
+use bellman::{
+    gadgets::multipack,
+    groth16::{batch, prepare_verifying_key, Proof},
+};
+use bls12_381::Bls12;
+use group::{cofactor::CofactorGroup, GroupEncoding};
 use incrementalmerkletree::MerklePath;
 use memuse::DynamicUsage;
 use rand_core::OsRng;
 use zcash_encoding::Vector;
 use zcash_primitives::{
+    constants::SPENDING_KEY_GENERATOR,
     keys::OutgoingViewingKey,
     memo::MemoBytes,
     merkle_tree::merkle_path_from_slice,
@@ -693,6 +698,194 @@ impl Verifier {
     }
 }
 
+/// Batch verifier for individual Sapling spend and output descriptions.
+///
+/// Unlike [`BatchValidator`], this does not operate on whole bundles: the block
+/// validation workers in zcashd distribute spends and outputs independently of the
+/// transactions they belong to, and check binding signatures separately. Each
+/// description is deserialized and checked for small-order points when it is
+/// queued; the Groth16 proofs are accumulated and verified together with a single
+/// randomized multi-pairing per circuit in [`ItemBatchVerifier::validate`].
+///
+/// ZIP 216 is not enforced, matching [`SaplingVerificationContext::new(false)`]
+/// used by the per-item verification path.
+pub struct ItemBatchVerifier {
+    spend_proofs: batch::Verifier<Bls12>,
+    output_proofs: batch::Verifier<Bls12>,
+    spends_added: usize,
+    outputs_added: usize,
+}
+
+impl ItemBatchVerifier {
+    pub(crate) fn new() -> Self {
+        ItemBatchVerifier {
+            spend_proofs: batch::Verifier::new(),
+            output_proofs: batch::Verifier::new(),
+            spends_added: 0,
+            outputs_added: 0,
+        }
+    }
+
+    /// Checks the non-proof parts of a Sapling Spend description (including the
+    /// spendAuthSig), and queues its proof for batch verification.
+    ///
+    /// Returns `false` if the description is malformed or its signature is invalid.
+    #[allow(clippy::too_many_arguments)]
+    pub(crate) fn queue_spend(
+        &mut self,
+        cv: &[u8; 32],
+        anchor: &[u8; 32],
+        nullifier: &[u8; 32],
+        rk: &[u8; 32],
+        zkproof: &[u8; GROTH_PROOF_SIZE],
+        spend_auth_sig: &[u8; 64],
+        sighash_value: &[u8; 32],
+    ) -> bool {
+        let cv = match de_ct(jubjub::ExtendedPoint::from_bytes(cv)) {
+            Some(p) => p,
+            None => return false,
+        };
+        let anchor = match de_ct(bls12_381::Scalar::from_bytes(anchor)) {
+            Some(a) => a,
+            None => return false,
+        };
+        let rk = match redjubjub::PublicKey::read(&rk[..]) {
+            Ok(p) => p,
+            Err(_) => return false,
+        };
+        let spend_auth_sig = match Signature::read(&spend_auth_sig[..]) {
+            Ok(sig) => sig,
+            Err(_) => return false,
+        };
+        let zkproof = match Proof::read(&zkproof[..]) {
+            Ok(p) => p,
+            Err(_) => return false,
+        };
+
+        if bool::from(cv.is_small_order()) || bool::from(rk.0.is_small_order()) {
+            return false;
+        }
+
+        // The spendAuthSig is checked eagerly; it is cheap next to the proof and
+        // the signature message is specific to this description.
+        let mut data_to_be_signed = [0u8; 64];
+        data_to_be_signed[0..32].copy_from_slice(&rk.0.to_bytes());
+        data_to_be_signed[32..64].copy_from_slice(&sighash_value[..]);
+        if !rk.verify_with_zip216(
+            &data_to_be_signed,
+            &spend_auth_sig,
+            SPENDING_KEY_GENERATOR,
+            false,
+        ) {
+            return false;
+        }
+
+        let mut public_input = [bls12_381::Scalar::zero(); 7];
+        {
+            let affine = jubjub::AffinePoint::from(rk.0);
+            public_input[0] = affine.get_u();
+            public_input[1] = affine.get_v();
+        }
+        {
+            let affine = jubjub::AffinePoint::from(cv);
+            public_input[2] = affine.get_u();
+            public_input[3] = affine.get_v();
+        }
+        public_input[4] = anchor;
+        {
+            let nullifier = multipack::bytes_to_bits_le(nullifier);
+            let nullifier = multipack::compute_multipacking(&nullifier);
+            assert_eq!(nullifier.len(), 2);
+            public_input[5] = nullifier[0];
+            public_input[6] = nullifier[1];
+        }
+
+        self.spend_proofs.queue((zkproof, public_input.to_vec()));
+        self.spends_added += 1;
+        true
+    }
+
+    /// Checks the non-proof parts of a Sapling Output description, and queues its
+    /// proof for batch verification.
+    ///
+    /// Returns `false` if the description is malformed.
+    pub(crate) fn queue_output(
+        &mut self,
+        cv: &[u8; 32],
+        cm: &[u8; 32],
+        ephemeral_key: &[u8; 32],
+        zkproof: &[u8; GROTH_PROOF_SIZE],
+    ) -> bool {
+        let cv = match de_ct(jubjub::ExtendedPoint::from_bytes(cv)) {
+            Some(p) => p,
+            None => return false,
+        };
+        let cmu = match de_ct(bls12_381::Scalar::from_bytes(cm)) {
+            Some(a) => a,
+            None => return false,
+        };
+        let epk = match de_ct(jubjub::ExtendedPoint::from_bytes(ephemeral_key)) {
+            Some(p) => p,
+            None => return false,
+        };
+        let zkproof = match Proof::read(&zkproof[..]) {
+            Ok(p) => p,
+            Err(_) => return false,
+        };
+
+        if bool::from(cv.is_small_order()) || bool::from(epk.is_small_order()) {
+            return false;
+        }
+
+        let mut public_input = [bls12_381::Scalar::zero(); 5];
+        {
+            let affine = jubjub::AffinePoint::from(cv);
+            public_input[0] = affine.get_u();
+            public_input[1] = affine.get_v();
+        }
+        {
+            let affine = jubjub::AffinePoint::from(epk);
+            public_input[2] = affine.get_u();
+            public_input[3] = affine.get_v();
+        }
+        public_input[4] = cmu;
+
+        self.output_proofs.queue((zkproof, public_input.to_vec()));
+        self.outputs_added += 1;
+        true
+    }
+
+    /// Verifies every queued proof. Returns `false` if any of them is invalid; no
+    /// attempt is made to identify which one, so callers that need to report the
+    /// failing description should fall back to per-item verification.
+    pub(crate) fn validate(self) -> bool {
+        let mut rng = OsRng;
+
+        let spends_valid = self.spends_added == 0
+            || self
+                .spend_proofs
+                .verify(
+                    &mut rng,
+                    unsafe { SAPLING_SPEND_VK.as_ref() }.expect(
+                        "Parameters not loaded: SAPLING_SPEND_VK should have been initialized",
+                    ),
+                )
+                .is_ok();
+
+        spends_valid
+            && (self.outputs_added == 0
+                || self
+                    .output_proofs
+                    .verify(
+                        &mut rng,
+                        unsafe { SAPLING_OUTPUT_VK.as_ref() }.expect(
+                            "Parameters not loaded: SAPLING_OUTPUT_VK should have been initialized",
+                        ),
+                    )
+                    .is_ok())
+    }
+}
+
 struct BatchValidatorInner {
     validator: sapling_proofs::BatchValidator,
     queued_entries: CacheEntries,
@@ -0,0 +1,133 @@
+// Copyright (c) 2022-2023 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "saplingcache.h"
+
+#include "hash.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "util.h"
+
+#include <univalue.h>
+
+#include <atomic>
+#include <memory>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+const unsigned char ZCASH_SAPLING_VERICACHE_PERSONALIZATION[crypto_generichash_blake2b_PERSONALBYTES] =
+    {'S','a','p','l','i','n','g','V','e','r','i','C','a','c','h','e'};
+
+/**
+ * Valid Sapling bundle cache, to avoid verifying Sapling proofs and signatures
+ * twice for every transaction (once when accepted into memory pool, and again
+ * when accepted into the block chain).
+ *
+ * Lookups take a shared lock; CuckooCache erases are lock free, so readers
+ * only contend with inserts.
+ */
+class CSaplingBundleCache
+{
+private:
+    std::unique_ptr<libzcash::BundleValidityCache> setValid;
+    uint256 nonce;
+    boost::shared_mutex cs_saplingcache;
+
+public:
+    //! Lookups from block validation, the ones the cache is meant to save
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+    //! Lookups on mempool accept, which only hit for a bundle seen before
+    std::atomic<uint64_t> nMempoolHits{0};
+    std::atomic<uint64_t> nMempoolMisses{0};
+    std::atomic<uint64_t> nInserts{0};
+
+    void Setup(size_t nMaxCacheBytes)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_saplingcache);
+        nonce = GetRandHash();
+        if (nMaxCacheBytes == 0) {
+            setValid.reset();
+            return;
+        }
+        setValid = libzcash::NewBundleValidityCache("Sapling", nMaxCacheBytes);
+    }
+
+    libzcash::BundleCacheEntry ComputeEntry(const uint256& bundleCommitment, const uint256& sighash) const
+    {
+        CBLAKE2bWriter ss(SER_GETHASH, 0, ZCASH_SAPLING_VERICACHE_PERSONALIZATION);
+        ss << nonce << bundleCommitment << sighash;
+        uint256 hash = ss.GetHash();
+        libzcash::BundleCacheEntry entry;
+        std::copy(hash.begin(), hash.end(), entry.begin());
+        return entry;
+    }
+
+    bool Contains(const libzcash::BundleCacheEntry& entry, SaplingCacheMode mode)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_saplingcache);
+        bool fHit = setValid && setValid->contains(entry, mode == SaplingCacheMode::Consume);
+        if (mode == SaplingCacheMode::Consume) {
+            std::atomic<uint64_t>& nCounter = fHit ? nHits : nMisses;
+            nCounter++;
+        } else if (mode == SaplingCacheMode::Store) {
+            std::atomic<uint64_t>& nCounter = fHit ? nMempoolHits : nMempoolMisses;
+            nCounter++;
+        }
+        return fHit;
+    }
+
+    void Insert(const libzcash::BundleCacheEntry& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_saplingcache);
+        if (setValid) {
+            setValid->insert(entry);
+            nInserts++;
+        }
+    }
+};
+
+CSaplingBundleCache saplingBundleCache;
+
+}
+
+void InitSaplingBundleCache(size_t nMaxCacheBytes)
+{
+    saplingBundleCache.Setup(nMaxCacheBytes);
+    LogPrintf("Using %zu MiB for Sapling bundle validity cache\n", nMaxCacheBytes >> 20);
+}
+
+libzcash::BundleCacheEntry GetSaplingBundleCacheEntry(const CTransaction& tx, const uint256& sighash)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << tx.vShieldedSpend << tx.vShieldedOutput << tx.valueBalance << tx.bindingSig;
+    return saplingBundleCache.ComputeEntry(ss.GetHash(), sighash);
+}
+
+bool SaplingBundleCacheContains(const libzcash::BundleCacheEntry& entry, SaplingCacheMode mode)
+{
+    return saplingBundleCache.Contains(entry, mode);
+}
+
+void SaplingBundleCacheInsert(const libzcash::BundleCacheEntry& entry)
+{
+    saplingBundleCache.Insert(entry);
+}
+
+UniValue SaplingBundleCacheStatsToJSON()
+{
+    uint64_t nHits = saplingBundleCache.nHits;
+    uint64_t nMisses = saplingBundleCache.nMisses;
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("inserts", (uint64_t)saplingBundleCache.nInserts));
+    ret.push_back(Pair("hits", nHits));
+    ret.push_back(Pair("misses", nMisses));
+    ret.push_back(Pair("hitrate", (nHits + nMisses) > 0 ? (double)nHits / (nHits + nMisses) : 0.0));
+    ret.push_back(Pair("mempoolhits", (uint64_t)saplingBundleCache.nMempoolHits));
+    ret.push_back(Pair("mempoolmisses", (uint64_t)saplingBundleCache.nMempoolMisses));
+    return ret;
+}
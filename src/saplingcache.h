@@ -0,0 +1,56 @@
+// Copyright (c) 2022-2023 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SAPLINGCACHE_H
+#define BITCOIN_SAPLINGCACHE_H
+
+#include "uint256.h"
+#include "zcash/cache.h"
+
+#include <stdint.h>
+
+class CTransaction;
+class UniValue;
+
+/** Default for -maxsaplingcachesize, in MiB */
+static const unsigned int DEFAULT_MAX_SAPLING_CACHE_SIZE = 10;
+/** Upper bound for -maxsaplingcachesize, in MiB */
+static const unsigned int MAX_MAX_SAPLING_CACHE_SIZE = 16384;
+
+/** How a validation path uses the Sapling bundle validity cache */
+enum class SaplingCacheMode {
+    //! Block validation: a hit is evicted, the bundle is not checked again
+    Consume,
+    //! Mempool accept: newly verified bundles are added
+    Store,
+    //! Block template checks: look up only, the block is checked again when it connects
+    CheckOnly,
+};
+
+/** Allocate the Sapling bundle validity cache. Must be called once at startup. */
+void InitSaplingBundleCache(size_t nMaxCacheBytes);
+
+/**
+ * Compute the cache entry for the Sapling bundle of tx, bound to the given sighash.
+ * The entry commits to every spend and output description (including proofs and
+ * spendAuthSigs), the value balance and the binding signature, salted with a
+ * per-node nonce.
+ */
+libzcash::BundleCacheEntry GetSaplingBundleCacheEntry(const CTransaction& tx, const uint256& sighash);
+
+/**
+ * Returns true if the entry is known to have valid proofs and signatures. With
+ * SaplingCacheMode::Consume a hit is marked for eviction and the lookup counts
+ * as a block lookup, with Store it counts as a mempool lookup. CheckOnly
+ * lookups leave the cache and its counters alone.
+ */
+bool SaplingBundleCacheContains(const libzcash::BundleCacheEntry& entry, SaplingCacheMode mode);
+
+/** Record an entry whose proofs and signatures have been verified. */
+void SaplingBundleCacheInsert(const libzcash::BundleCacheEntry& entry);
+
+/** Hit/miss counters of block and mempool lookups for getmempoolinfo */
+UniValue SaplingBundleCacheStatsToJSON();
+
+#endif // BITCOIN_SAPLINGCACHE_H
@@ -22,6 +22,7 @@
 #include "script/cc.h"
 #include "cc/eval.h"
 
+#include "hash.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
@@ -107,6 +108,130 @@ bool ServerTransactionSignatureChecker::VerifySignature(const std::vector<unsign
     return true;
 }
 
+CCryptoConditionCache::CCRef CCryptoConditionCache::ReadFulfillment(const std::vector<unsigned char>& ffill, bool store)
+{
+    uint256 key = Hash(ffill.begin(), ffill.end());
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs);
+        std::map<uint256, CCRef>::const_iterator it = mapParsed.find(key);
+        if (it != mapParsed.end()) {
+            nParseHits++;
+            return it->second;
+        }
+    }
+    nParseMisses++;
+
+    CC *cond = nullptr;
+    int error = cc_readFulfillmentBinaryExt(ffill.data(), ffill.size(), &cond);
+    if (error || !cond) {
+        if (cond)
+            cc_free(cond);
+        return nullptr;
+    }
+    CCRef ref(cond, [](const CC *p) { cc_free(const_cast<CC*>(p)); });
+
+    int64_t nMaxCacheSize = GetArg("-maxccparsecachesize", DEFAULT_CC_PARSE_CACHE_SIZE);
+    if (!store || nMaxCacheSize <= 0)
+        return ref;
+
+    boost::unique_lock<boost::shared_mutex> lock(cs);
+    while (static_cast<int64_t>(mapParsed.size()) >= nMaxCacheSize) {
+        // Evict a random entry, as the signature cache does
+        std::map<uint256, CCRef>::iterator it = mapParsed.lower_bound(GetRandHash());
+        if (it == mapParsed.end())
+            it = mapParsed.begin();
+        mapParsed.erase(it);
+    }
+    mapParsed.emplace(key, ref);
+    return ref;
+}
+
+uint256 CCryptoConditionCache::VerifiedKey(const std::vector<unsigned char>& ffillBin, const std::vector<unsigned char>& condBin, const uint256& sighash)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << ffillBin << condBin << sighash;
+    return ss.GetHash();
+}
+
+bool CCryptoConditionCache::IsVerified(const uint256& key)
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs);
+    bool fFound = setVerified.count(key) != 0;
+    if (fFound)
+        nVerifyHits++;
+    else
+        nVerifyMisses++;
+    return fFound;
+}
+
+void CCryptoConditionCache::SetVerified(const uint256& key)
+{
+    // Same bound as the signature cache, a few bytes per entry
+    int64_t nMaxCacheSize = GetArg("-maxservercheckersize", 50000);
+    if (nMaxCacheSize <= 0) return;
+
+    boost::unique_lock<boost::shared_mutex> lock(cs);
+    while (static_cast<int64_t>(setVerified.size()) >= nMaxCacheSize) {
+        std::set<uint256>::iterator it = setVerified.lower_bound(GetRandHash());
+        if (it == setVerified.end())
+            it = setVerified.begin();
+        setVerified.erase(it);
+    }
+    setVerified.insert(key);
+}
+
+void CCryptoConditionCache::Clear()
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs);
+    mapParsed.clear();
+    setVerified.clear();
+}
+
+CCryptoConditionCache& GetCryptoConditionCache()
+{
+    static CCryptoConditionCache cache;
+    return cache;
+}
+
+int ServerTransactionSignatureChecker::CheckCryptoCondition(
+        const std::vector<unsigned char>& condBin,
+        const std::vector<unsigned char>& ffillBin,
+        const CScript& scriptCode,
+        uint32_t consensusBranchId) const
+{
+    // Hash type is one byte tacked on to the end of the fulfillment
+    if (ffillBin.empty())
+        return false;
+
+    CCryptoConditionCache& cache = GetCryptoConditionCache();
+    CCryptoConditionCache::CCRef cond = cache.ReadFulfillment(std::vector<unsigned char>(ffillBin.begin(), ffillBin.end() - 1), store);
+    if (!cond) return -1;
+
+    if (!IsSupportedCryptoCondition(cond.get())) return 0;
+    if (!IsSignedCryptoCondition(cond.get())) return 0;
+
+    uint256 sighash;
+    int nHashType = ffillBin.back();
+    try {
+        sighash = SignatureHash(CCPubKey(cond.get()), *txTo, nIn, nHashType, amount, consensusBranchId, this->txdata);
+    } catch (const std::logic_error& ex) {
+        return 0;
+    }
+
+    uint256 key = CCryptoConditionCache::VerifiedKey(ffillBin, condBin, sighash);
+    if (!cache.IsVerified(key)) {
+        if (!cc_verifySignatures(cond.get(), (const unsigned char*)&sighash, 32, 0, condBin.data(), condBin.size()))
+            return 0;
+        if (store)
+            cache.SetVerified(key);
+    }
+
+    VerifyEval eval = [] (CC *cond, void *checker) {
+        return ((ServerTransactionSignatureChecker*)checker)->CheckEvalCondition(cond);
+    };
+    return cc_verifyEval(cond.get(), eval, (void*)this);
+}
+
 /*
  * The reason that these functions are here is that the what used to be the
  * CachingTransactionSignatureChecker, now the ServerTransactionSignatureChecker,
@@ -22,11 +22,59 @@
 #define BITCOIN_SCRIPT_SERVERCHECKER_H
 
 #include "script/interpreter.h"
+#include "uint256.h"
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 class CPubKey;
 
+/** Default for -maxccparsecachesize, the number of parsed fulfillments kept */
+static const int64_t DEFAULT_CC_PARSE_CACHE_SIZE = 20000;
+
+/**
+ * Crypto-condition validation results shared by mempool accept and block
+ * connection, like the signature cache is for ECDSA.
+ *
+ * Parsed fulfillments are kept keyed by the hash of their serialization, so a
+ * transaction checked again at ConnectBlock skips the ASN.1 decode. The result
+ * of the signature checks (cc_verifySignatures) is kept keyed by fulfillment,
+ * condition and sighash. Eval nodes depend on the chain state and are always
+ * run again. Cached conditions are shared between threads and must not be
+ * modified.
+ */
+class CCryptoConditionCache
+{
+public:
+    typedef std::shared_ptr<const CC> CCRef;
+
+    /** Parse a fulfillment (without the hash type byte), from the cache if possible, null on failure */
+    CCRef ReadFulfillment(const std::vector<unsigned char>& ffill, bool store);
+
+    bool IsVerified(const uint256& key);
+    void SetVerified(const uint256& key);
+    static uint256 VerifiedKey(const std::vector<unsigned char>& ffillBin, const std::vector<unsigned char>& condBin, const uint256& sighash);
+
+    void Clear();
+
+    std::atomic<uint64_t> nParseHits{0};
+    std::atomic<uint64_t> nParseMisses{0};
+    std::atomic<uint64_t> nVerifyHits{0};
+    std::atomic<uint64_t> nVerifyMisses{0};
+
+private:
+    boost::shared_mutex cs;
+    std::map<uint256, CCRef> mapParsed;
+    std::set<uint256> setVerified;
+};
+
+CCryptoConditionCache& GetCryptoConditionCache();
+
 class ServerTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -37,6 +85,11 @@ public:
     ServerTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, bool storeIn) : TransactionSignatureChecker(txToIn, nIn, amount), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+    int CheckCryptoCondition(
+        const std::vector<unsigned char>& condBin,
+        const std::vector<unsigned char>& ffillBin,
+        const CScript& scriptCode,
+        uint32_t consensusBranchId) const;
     int CheckEvalCondition(const CC *cond) const;
 };
 
@@ -194,6 +194,63 @@ private:
     size_t nPos;
 };
 
+/* Minimal stream for reading from a buffer owned by someone else, such as a
+ * memory mapped file, without copying it first.
+ *
+ * The buffer must outlive the reader.
+ */
+class CBufferReader
+{
+public:
+    CBufferReader(int nTypeIn, int nVersionIn, const unsigned char* pbeginIn, size_t nSizeIn) :
+        nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), pend(pbeginIn + nSizeIn), pcur(pbeginIn) {}
+
+    int GetType() const          { return nType; }
+    int GetVersion() const       { return nVersion; }
+
+    size_t size() const          { return pend - pcur; }
+    bool empty() const           { return pcur == pend; }
+    /** Number of bytes consumed so far */
+    size_t GetPos() const        { return pcur - pbegin; }
+
+    void read_u8(unsigned char* pch, size_t nSize)
+    {
+        read(reinterpret_cast<char*>(pch), nSize);
+    }
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CBufferReader::read(): end of data");
+        if (nSize > 0) {
+            memcpy(pch, pcur, nSize);
+            pcur += nSize;
+        }
+    }
+
+    void ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CBufferReader::ignore(): end of data");
+        pcur += nSize;
+    }
+
+    template<typename T>
+    CBufferReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* const pbegin;
+    const unsigned char* const pend;
+    const unsigned char* pcur;
+};
+
 
 /** Double ended buffer combining vector and stream-like interfaces.
  *
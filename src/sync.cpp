@@ -35,6 +35,27 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+CLockWaitStats& GetThreadLockWaitStats()
+{
+    static thread_local CLockWaitStats stats;
+    return stats;
+}
+
+void LockWaitBegin(const char* pszName)
+{
+    CLockWaitStats& stats = GetThreadLockWaitStats();
+    stats.pszWaitLock = pszName;
+    stats.nWaitStart = GetTimeMicros();
+}
+
+void LockWaitEnd()
+{
+    CLockWaitStats& stats = GetThreadLockWaitStats();
+    stats.nWaitMicros += GetTimeMicros() - stats.nWaitStart;
+    stats.nWaitStart = 0;
+    stats.pszWaitLock = nullptr;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
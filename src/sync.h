@@ -23,6 +23,9 @@
 
 #include "threadsafety.h"
 
+#include <atomic>
+#include <stdint.h>
+
 #undef __cpuid
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -115,6 +118,27 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Time a thread spent blocked on contended LOCK()s. Each thread updates only
+ * its own instance, other threads may read it at any time.
+ */
+struct CLockWaitStats
+{
+    //! Total time blocked so far, in microseconds, without the wait in progress
+    std::atomic<int64_t> nWaitMicros;
+    //! Start of the wait in progress, 0 if the thread is not waiting
+    std::atomic<int64_t> nWaitStart;
+    //! Name of the lock waited for, a string literal
+    std::atomic<const char*> pszWaitLock;
+
+    CLockWaitStats() : nWaitMicros(0), nWaitStart(0), pszWaitLock(nullptr) {}
+};
+
+/** The lock wait statistics of the calling thread */
+CLockWaitStats& GetThreadLockWaitStats();
+void LockWaitBegin(const char* pszName);
+void LockWaitEnd();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_CAPABILITY CMutexLock
@@ -125,14 +149,14 @@ private:
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
+            LockWaitBegin(pszName);
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            LockWaitEnd();
         }
-#endif
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
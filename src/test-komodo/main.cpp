@@ -3,6 +3,7 @@
 #include "chainparams.h"
 #include "gtest/gtest.h"
 #include "crypto/common.h"
+#include "script/sigcache.h"
 #include "testutils.h"
 
 
@@ -11,6 +12,7 @@ int main(int argc, char **argv) {
     ECC_Start();
     ECCVerifyHandle handle;  // Inits secp256k1 verify context
     SetupNetworking();
+    InitSignatureCache();
     SelectParams(CBaseChainParams::REGTEST);
     chainName = assetchain(); // KMD by default
 
@@ -8,6 +8,8 @@
 #include "primitives/transaction.h"
 #include "script/interpreter.h"
 #include "script/serverchecker.h"
+#include "random.h"
+#include "utiltime.h"
 
 #include "testutils.h"
 
@@ -198,3 +200,75 @@ TEST_F(CCTest, testLargeCondition)
     EXPECT_EQ(1744, CCSig(cond).size());
     ASSERT_TRUE(CCVerify(mtxTo, cond));
 }
+
+
+TEST_F(CCTest, testConditionCacheHits)
+{
+    // Token validation needs the chain, only the conditions are of interest here
+    class EvalMock : public Eval
+    {
+    public:
+        bool Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
+        { return cond->code[0] == EVAL_TOKENS ? Valid() : Invalid("unexpected eval code"); }
+    };
+
+    EvalMock eval;
+    EVAL_TEST = &eval;
+
+    // A synthetic block of token transfers, each spending a tokens eval code
+    // and secp256k1 key 2 of 2 threshold like the tokens contract uses
+    const int nTx = 200;
+    std::vector<CTransaction> vtx;
+    std::vector<CScript> vScriptPubKey;
+    for (int i = 0; i < nTx; i++) {
+        CC *cond = CCNewThreshold(2, { CCNewEval({EVAL_TOKENS}), CCNewSecp256k1(notaryKey.GetPubKey()) });
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = i;
+        mtx.vout[0].scriptPubKey = CCPubKey(cond);
+        CCSign(mtx, cond);
+        vtx.push_back(mtx);
+        vScriptPubKey.push_back(CCPubKey(cond));
+        cc_free(cond);
+    }
+
+    CCryptoConditionCache& cache = GetCryptoConditionCache();
+    cache.Clear();
+
+    // Verifies every transaction and checks how the cache lookups went
+    auto VerifyBlock = [&](bool store, uint64_t nExpectHits, uint64_t nExpectMisses) {
+        uint64_t nParseHits = cache.nParseHits, nParseMisses = cache.nParseMisses;
+        uint64_t nVerifyHits = cache.nVerifyHits, nVerifyMisses = cache.nVerifyMisses;
+        for (int i = 0; i < nTx; i++) {
+            ScriptError error;
+            PrecomputedTransactionData txdata(vtx[i]);
+            ServerTransactionSignatureChecker checker(&vtx[i], 0, 0, store, txdata);
+            EXPECT_TRUE(VerifyScript(vtx[i].vin[0].scriptSig, vScriptPubKey[i], 0, checker, 0, &error));
+        }
+        EXPECT_EQ(nExpectHits, cache.nParseHits - nParseHits);
+        EXPECT_EQ(nExpectMisses, cache.nParseMisses - nParseMisses);
+        EXPECT_EQ(nExpectHits, cache.nVerifyHits - nVerifyHits);
+        EXPECT_EQ(nExpectMisses, cache.nVerifyMisses - nVerifyMisses);
+    };
+
+    // Connecting a block that was never in the mempool, nothing is cached
+    VerifyBlock(false, 0, nTx);
+    // Mempool accept of the same transactions fills the cache
+    VerifyBlock(true, 0, nTx);
+    // Connecting the block now parses and verifies nothing again
+    VerifyBlock(false, nTx, 0);
+
+    // A different signature is not taken from the cache
+    CMutableTransaction mtx(vtx[0]);
+    mtx.vout[0].nValue = 1000;
+    ScriptError error;
+    CTransaction tx(mtx);
+    PrecomputedTransactionData txdata(tx);
+    ServerTransactionSignatureChecker checker(&tx, 0, 0, false, txdata);
+    EXPECT_FALSE(VerifyScript(tx.vin[0].scriptSig, vScriptPubKey[0], 0, checker, 0, &error));
+
+    cache.Clear();
+    EVAL_TEST = 0;
+}
@@ -157,6 +157,119 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     BOOST_CHECK(it == pool.mapTx.get<1>().end());
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+    entry.dPriority = 10.0;
+
+    /* free parent, paid for by its child */
+    CMutableTransaction txParent = CMutableTransaction();
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_1;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(0LL).Time(1).FromTx(txParent));
+
+    CMutableTransaction txChild = CMutableTransaction();
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(40000LL).Time(2).FromTx(txChild));
+
+    /* unrelated, pays more than the parent but less than the package */
+    CMutableTransaction txOther = CMutableTransaction();
+    txOther.vin.resize(1);
+    txOther.vin[0].scriptSig = CScript() << OP_2;
+    txOther.vout.resize(1);
+    txOther.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txOther.vout[0].nValue = 5 * COIN;
+    pool.addUnchecked(txOther.GetHash(), entry.Fee(10000LL).Time(3).FromTx(txOther));
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+
+    // The parent carries the state of its whole package
+    CTxMemPool::indexed_transaction_set::const_iterator it = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 40000LL);
+
+    // The unrelated transaction is the cheapest package and goes first
+    std::vector<uint256> vRemoved;
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1, &vRemoved);
+    BOOST_CHECK_EQUAL(vRemoved.size(), 1);
+    BOOST_CHECK(vRemoved[0] == txOther.GetHash());
+    BOOST_CHECK(pool.exists(txParent.GetHash()));
+    BOOST_CHECK(pool.exists(txChild.GetHash()));
+    BOOST_CHECK(pool.GetMinFee(1).GetFeePerK() > 1000);
+
+    // Expiring the parent takes its child with it
+    vRemoved.clear();
+    BOOST_CHECK_EQUAL(pool.Expire(2, &vRemoved), 2);
+    BOOST_CHECK_EQUAL(vRemoved.size(), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolReaddParentTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction txGrandParent = CMutableTransaction();
+    txGrandParent.vin.resize(1);
+    txGrandParent.vin[0].scriptSig = CScript() << OP_1;
+    txGrandParent.vout.resize(1);
+    txGrandParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandParent.vout[0].nValue = 10 * COIN;
+
+    CMutableTransaction txParent = CMutableTransaction();
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vin[0].prevout.hash = txGrandParent.GetHash();
+    txParent.vin[0].prevout.n = 0;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+
+    CMutableTransaction txChild = CMutableTransaction();
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 10 * COIN;
+
+    // A reorg puts the parent back after its child stayed in the pool
+    pool.addUnchecked(txGrandParent.GetHash(), entry.Fee(1000LL).FromTx(txGrandParent));
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(30000LL).FromTx(txChild));
+    CTxMemPool::indexed_transaction_set::const_iterator it = pool.mapTx.find(txGrandParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 1);
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(2000LL).FromTx(txParent));
+
+    it = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 32000LL);
+    BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), it->GetTxSize() + pool.mapTx.find(txChild.GetHash())->GetTxSize());
+    it = pool.mapTx.find(txGrandParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 33000LL);
+
+    // Removing the child leaves the ancestors with their own state
+    std::list<CTransaction> removed;
+    pool.remove(txChild, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetCountWithDescendants(), 1);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetModFeesWithDescendants(), 2000LL);
+    it = pool.mapTx.find(txGrandParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 3000LL);
+    BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), it->GetTxSize() + pool.mapTx.find(txParent.GetHash())->GetTxSize());
+}
+
 BOOST_AUTO_TEST_CASE(RemoveWithoutBranchId) {
     CTxMemPool pool(CFeeRate(0));
     TestMemPoolEntryHelper entry;
@@ -94,4 +94,26 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(CheckEquihashSolutions_test)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const CChainParams& params = Params();
+
+    std::vector<CBlockHeader> headers(8, params.GenesisBlock().GetBlockHeader());
+    BOOST_CHECK_EQUAL(CheckEquihashSolutions(headers, params), -1);
+    BOOST_CHECK_EQUAL(CheckEquihashSolutions(headers, params, false), -1);
+
+    // The first invalid solution is reported, whatever order the workers finish in
+    headers[5].nSolution[10] ^= 0x01;
+    headers[3].nSolution[20] ^= 0x01;
+    BOOST_CHECK_EQUAL(CheckEquihashSolutions(headers, params), 3);
+    BOOST_CHECK(!CheckEquihashSolution(&headers[3], params));
+    BOOST_CHECK(!CheckEquihashSolution(&headers[5], params));
+    BOOST_CHECK(CheckEquihashSolution(&headers[0], params));
+
+    // A single header is checked on the calling thread
+    BOOST_CHECK_EQUAL(CheckEquihashSolutions(std::vector<CBlockHeader>(1, headers[5]), params, false), 0);
+    BOOST_CHECK_EQUAL(CheckEquihashSolutions(std::vector<CBlockHeader>(), params), -1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
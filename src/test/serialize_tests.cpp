@@ -417,4 +417,35 @@ BOOST_AUTO_TEST_CASE(class_methods)
     BOOST_CHECK(methodtest3 == methodtest4);
 }
 
+BOOST_AUTO_TEST_CASE(buffer_reader)
+{
+    int intval(100);
+    bool boolval(true);
+    std::string stringval("testing");
+    const char* charstrval("testing charstr");
+    CMutableTransaction txval;
+    CSerializeMethodsTestMany methodtest1(intval, boolval, stringval, charstrval, txval);
+    CSerializeMethodsTestMany methodtest2;
+
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << methodtest1 << intval;
+    std::vector<unsigned char> vch(ss.begin(), ss.end());
+
+    // Reads in place from the buffer
+    CBufferReader reader(SER_DISK, PROTOCOL_VERSION, vch.data(), vch.size());
+    reader >> methodtest2;
+    BOOST_CHECK(methodtest1 == methodtest2);
+    BOOST_CHECK_EQUAL(reader.size(), sizeof(intval));
+    BOOST_CHECK_EQUAL(reader.GetPos(), vch.size() - sizeof(intval));
+
+    // Never reads past the end of the span it was given
+    int intval2;
+    CBufferReader truncated(SER_DISK, PROTOCOL_VERSION, vch.data() + reader.GetPos(), sizeof(intval) - 1);
+    BOOST_CHECK_THROW(truncated >> intval2, std::ios_base::failure);
+    reader >> intval2;
+    BOOST_CHECK_EQUAL(intval2, intval);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader.ignore(1), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
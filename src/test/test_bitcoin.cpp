@@ -17,6 +17,7 @@
 #include "ui_interface.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "script/sigcache.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
 #include "wallet/db.h"
@@ -76,6 +77,7 @@ BasicTestingSetup::BasicTestingSetup()
     assert(init_and_check_sodium() != -1);
     ECC_Start();
     SetupEnvironment();
+    InitSignatureCache();
     fPrintToDebugLog = false; // don't want to write to debug.log file
     fCheckBlockIndex = true;
     SelectParams(CBaseChainParams::MAIN);
@@ -0,0 +1,83 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "primitives/transaction.h"
+#include "random.h"
+#include "txcache.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txcache_tests, BasicTestingSetup)
+
+static CTransaction MakeTransaction(int n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << n;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = n;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(txcache_get_put)
+{
+    CTxCache cache;
+    CTransaction tx = MakeTransaction(1), txOut;
+    uint256 hashBlock = GetRandHash(), hashOut;
+
+    BOOST_CHECK(!cache.Get(tx.GetHash(), txOut, hashOut));
+    cache.Put(tx, hashBlock, cache.GetGeneration());
+    BOOST_CHECK(cache.Get(tx.GetHash(), txOut, hashOut));
+    BOOST_CHECK(txOut == tx);
+    BOOST_CHECK(hashOut == hashBlock);
+
+    CTxCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 1);
+    BOOST_CHECK_EQUAL(stats.nHits, 1);
+    BOOST_CHECK_EQUAL(stats.nMisses, 1);
+    BOOST_CHECK(stats.nUsage > 0);
+
+    // A block that is connected or disconnected drops its transactions
+    cache.Erase(std::vector<CTransaction>(1, tx));
+    BOOST_CHECK(!cache.Get(tx.GetHash(), txOut, hashOut));
+    BOOST_CHECK_EQUAL(cache.GetStats().nUsage, 0);
+
+    // A read that raced with a connect or disconnect is not cached
+    uint64_t nGeneration = cache.GetGeneration();
+    cache.Erase(std::vector<CTransaction>(1, tx));
+    cache.Put(tx, hashBlock, nGeneration);
+    BOOST_CHECK(!cache.Get(tx.GetHash(), txOut, hashOut));
+}
+
+BOOST_AUTO_TEST_CASE(txcache_eviction)
+{
+    CTxCache cache;
+    std::vector<CTransaction> vtx;
+    for (int i = 0; i < 10; i++) {
+        vtx.push_back(MakeTransaction(i));
+        cache.Put(vtx.back(), uint256(), cache.GetGeneration());
+    }
+    size_t nEntryUsage = cache.GetStats().nUsage / 10;
+
+    // Touch the oldest so the second oldest is evicted first
+    CTransaction txOut;
+    uint256 hashOut;
+    BOOST_CHECK(cache.Get(vtx[0].GetHash(), txOut, hashOut));
+    cache.SetMaxUsage(nEntryUsage * 9);
+    BOOST_CHECK(cache.GetStats().nEntries <= 9);
+    BOOST_CHECK(cache.GetStats().nUsage <= nEntryUsage * 9);
+    BOOST_CHECK(cache.Get(vtx[0].GetHash(), txOut, hashOut));
+    BOOST_CHECK(!cache.Get(vtx[1].GetHash(), txOut, hashOut));
+    BOOST_CHECK(cache.Get(vtx[9].GetHash(), txOut, hashOut));
+
+    // A limit of zero disables the cache
+    cache.SetMaxUsage(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0);
+    cache.Put(vtx[0], uint256(), cache.GetGeneration());
+    BOOST_CHECK(!cache.Get(vtx[0].GetHash(), txOut, hashOut));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
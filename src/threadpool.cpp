@@ -0,0 +1,185 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "threadpool.h"
+
+#include "util.h"
+
+#include <algorithm>
+
+namespace {
+//! Pool and deque index of the current thread when it is a pool worker
+thread_local CThreadPool* tlsPool = nullptr;
+thread_local size_t tlsQueue = 0;
+
+std::mutex csValidationPool;
+std::unique_ptr<CThreadPool> validationPool;
+}
+
+CThreadPool::CThreadPool(int nThreads, const std::string& strNameIn) :
+    strName(strNameIn), nSubmitted(0), nNextQueue(0), fStopping(false)
+{
+    nThreads = std::max(nThreads, 1);
+    for (int i = 0; i < nThreads; i++) {
+        vQueues.emplace_back(new WorkQueue());
+    }
+    for (int i = 0; i < nThreads; i++) {
+        vThreads.emplace_back(&CThreadPool::WorkerThread, this, (size_t)i);
+    }
+}
+
+CThreadPool::~CThreadPool()
+{
+    Stop();
+}
+
+void CThreadPool::Submit(Task task)
+{
+    {
+        std::unique_lock<std::mutex> lock(csWake);
+        if (fStopping) {
+            // Nobody is left to pick the task up, keep the caller's semantics intact
+            lock.unlock();
+            task();
+            return;
+        }
+
+        // Queued and counted under csWake, so a worker that found no work
+        // either sees the task or is woken for it
+        if (tlsPool == this) {
+            WorkQueue& queue = *vQueues[tlsQueue];
+            std::lock_guard<std::mutex> lockQueue(queue.cs);
+            queue.tasks.push_front(std::move(task));
+        } else {
+            WorkQueue& queue = *vQueues[nNextQueue++ % vQueues.size()];
+            std::lock_guard<std::mutex> lockQueue(queue.cs);
+            queue.tasks.push_back(std::move(task));
+        }
+        nSubmitted++;
+    }
+    cvWake.notify_one();
+}
+
+bool CThreadPool::PopTask(size_t nHome, Task& task)
+{
+    {
+        WorkQueue& queue = *vQueues[nHome];
+        std::lock_guard<std::mutex> lock(queue.cs);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < vQueues.size(); i++) {
+        WorkQueue& queue = *vQueues[(nHome + i) % vQueues.size()];
+        std::lock_guard<std::mutex> lock(queue.cs);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void CThreadPool::WorkerThread(size_t nIndex)
+{
+    RenameThread(strName.c_str());
+    tlsPool = this;
+    tlsQueue = nIndex;
+
+    while (true) {
+        uint64_t nSeen;
+        {
+            std::lock_guard<std::mutex> lock(csWake);
+            nSeen = nSubmitted;
+        }
+
+        Task task;
+        if (PopTask(nIndex, task)) {
+            task();
+            continue;
+        }
+
+        // Nothing was queued when the deques were scanned, sleep until a
+        // task is submitted after that instead of scanning them again
+        std::unique_lock<std::mutex> lock(csWake);
+        if (fStopping && nSubmitted == nSeen)
+            break;
+        cvWake.wait(lock, [this, nSeen]() { return fStopping || nSubmitted != nSeen; });
+    }
+
+    tlsPool = nullptr;
+}
+
+void CThreadPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(csWake);
+        if (fStopping)
+            return;
+        fStopping = true;
+    }
+    cvWake.notify_all();
+    for (std::thread& thread : vThreads) {
+        if (thread.joinable())
+            thread.join();
+    }
+}
+
+bool CTaskGroup::State::RunTask()
+{
+    CThreadPool::Task task;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (tasks.empty())
+            return false;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    }
+    task();
+
+    std::lock_guard<std::mutex> lock(cs);
+    if (--nOutstanding == 0)
+        cv.notify_all();
+    return true;
+}
+
+void CTaskGroup::Wait()
+{
+    // Help with the group's own queued tasks instead of sleeping; this also
+    // keeps nested groups (a pool task waiting on its own sub-tasks) from
+    // deadlocking. The caller may hold cs_main, so other work is left alone.
+    while (state->RunTask()) {
+    }
+
+    // The remaining tasks are running on workers
+    std::unique_lock<std::mutex> lock(state->cs);
+    state->cv.wait(lock, [this]() { return state->nOutstanding == 0; });
+}
+
+void StartValidationThreadPool(int nThreads)
+{
+    std::lock_guard<std::mutex> lock(csValidationPool);
+    if (validationPool)
+        validationPool->Stop();
+    validationPool.reset(new CThreadPool(nThreads, "zcash-validate"));
+    LogPrintf("Validation thread pool started with %d threads\n", validationPool->Size());
+}
+
+void StopValidationThreadPool()
+{
+    std::lock_guard<std::mutex> lock(csValidationPool);
+    if (validationPool)
+        validationPool->Stop();
+}
+
+CThreadPool& GetValidationThreadPool()
+{
+    std::lock_guard<std::mutex> lock(csValidationPool);
+    if (!validationPool)
+        validationPool.reset(new CThreadPool(std::max((int)std::thread::hardware_concurrency() - 1, 1), "zcash-validate"));
+    return *validationPool;
+}
@@ -0,0 +1,139 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_THREADPOOL_H
+#define BITCOIN_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//
+// Persistent work-stealing thread pool.
+//
+// Every worker owns a deque of tasks. Tasks submitted from a worker go to the
+// front of that worker's own deque, tasks submitted from any other thread are
+// spread round-robin over all deques. An idle worker first drains its own
+// deque from the front and then steals from the back of the others, so a
+// single large batch of work is spread across all cores without a central
+// queue becoming the bottleneck.
+//
+// Usage:
+//
+// CTaskGroup group(GetValidationThreadPool());
+// std::future<bool> f = group.Submit([&]() { return CheckSomething(v); });
+// group.Wait(); // the calling thread helps run the group's queued tasks while waiting
+// bool ok = f.get();
+//
+class CThreadPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    CThreadPool(int nThreads, const std::string& strName);
+    ~CThreadPool();
+
+    /** Queue a task for execution by one of the workers */
+    void Submit(Task task);
+
+    /** Stop accepting work, run whatever is still queued and join the workers */
+    void Stop();
+
+    int Size() const { return (int)vThreads.size(); }
+
+private:
+    struct WorkQueue {
+        std::mutex cs;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> vQueues;
+    std::vector<std::thread> vThreads;
+    std::string strName;
+
+    std::mutex csWake;
+    std::condition_variable cvWake;
+    //! Bumped by every Submit, an idle worker sleeps until it changes. Guarded by csWake
+    uint64_t nSubmitted;
+    std::atomic<size_t> nNextQueue;
+    bool fStopping;
+
+    bool PopTask(size_t nHome, Task& task);
+    void WorkerThread(size_t nIndex);
+};
+
+//
+// A set of related tasks submitted to a CThreadPool that can be waited on as
+// a whole. Wait() is called on destruction, so a group may not outlive the
+// data its tasks reference.
+//
+// The tasks are kept in a queue of the group and the pool is handed one
+// runner per task that takes the next task from that queue. The thread in
+// Wait() takes tasks from the same queue, so it only ever runs work of its
+// own group, never an unrelated task that could be slow or need its locks.
+//
+class CTaskGroup
+{
+public:
+    explicit CTaskGroup(CThreadPool& poolIn) : pool(poolIn), state(std::make_shared<State>()) {}
+    ~CTaskGroup() { Wait(); }
+
+    CTaskGroup(const CTaskGroup&) = delete;
+    CTaskGroup& operator=(const CTaskGroup&) = delete;
+
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> Submit(F&& f)
+    {
+        typedef typename std::result_of<F()>::type R;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(state->cs);
+            state->tasks.push_back([task]() { (*task)(); });
+            state->nOutstanding++;
+        }
+        // The runner may be picked up after the group is gone, it shares the state
+        std::shared_ptr<State> stateRef = state;
+        pool.Submit([stateRef]() { stateRef->RunTask(); });
+        return result;
+    }
+
+    /** Block until every task submitted to this group has finished */
+    void Wait();
+
+private:
+    struct State {
+        std::mutex cs;
+        std::condition_variable cv;
+        std::deque<CThreadPool::Task> tasks;
+        //! Tasks submitted but not finished, queued or running
+        size_t nOutstanding = 0;
+
+        /** Run the next queued task of the group, returns false if none was queued */
+        bool RunTask();
+    };
+
+    CThreadPool& pool;
+    std::shared_ptr<State> state;
+};
+
+/** Create the shared validation pool with nThreads workers (-maxprocessingthreads) */
+void StartValidationThreadPool(int nThreads);
+/** Join the shared validation pool, called during shutdown */
+void StopValidationThreadPool();
+/**
+ * The shared validation pool. If it was not started explicitly (unit tests,
+ * utilities) it is created on first use with one worker per core.
+ */
+CThreadPool& GetValidationThreadPool();
+
+#endif // BITCOIN_THREADPOOL_H
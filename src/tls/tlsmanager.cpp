@@ -9,6 +9,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
+#include "netpoller.h"
 #include "tlsmanager.h"
 #include "utiltls.h"
 #include "random.h"
@@ -287,14 +288,8 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
             break;
         }
 
-        fd_set socketSet;
-        FD_ZERO(&socketSet);
-        FD_SET(hSocket, &socketSet);
-
-        struct timeval timeout = {timeoutSec, 0};
-
         if (sslErr == SSL_ERROR_WANT_READ) {
-            int result = select(hSocket + 1, &socketSet, NULL, NULL, &timeout);
+            int result = WaitForSocket(hSocket, false, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("tls", "TLS: ERROR: %s: %s():%d - WANT_READ timeout on %s\n", __FILE__, __func__, __LINE__,
                     (eRoutine == SSL_CONNECT ? "SSL_CONNECT" :
@@ -309,7 +304,7 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
                 break;
             }
         } else {
-            int result = select(hSocket + 1, NULL, &socketSet, NULL, &timeout);
+            int result = WaitForSocket(hSocket, true, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("tls", "TLS: ERROR: %s: %s():%d - WANT_WRITE timeout on %s\n", __FILE__, __func__, __LINE__,
                     (eRoutine == SSL_CONNECT ? "SSL_CONNECT" :
@@ -631,27 +626,24 @@ void TLSManager::cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection
  * @brief Handles send and recieve functionality in TLS Sockets.
  *
  * @param pnode reference to the CNode object.
- * @param fdsetRecv
- * @param fdsetSend
- * @param fdsetError
- * @return int returns -1 when socket is invalid. returns 0 otherwise.
+ * @param recvSet the socket is readable
+ * @param sendSet the socket is writable
+ * @param errorSet the socket has an error pending
+ * @return int returns -1 when socket is invalid. otherwise the SOCKET_*_BLOCKED
+ *         directions that stopped because they would block.
  */
-int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError)
+int TLSManager::threadSocketHandler(CNode* pnode, bool recvSet, bool sendSet, bool errorSet)
 {
     //
     // Receive
     //
-    bool recvSet = false, sendSet = false, errorSet = false;
+    int nBlocked = 0;
 
     {
         LOCK(pnode->cs_hSocket);
 
         if (pnode->hSocket == INVALID_SOCKET)
             return -1;
-
-        recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-        sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-        errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
     }
 
     if (recvSet || errorSet) {
@@ -736,11 +728,13 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
                                 __FILE__, __func__, __LINE__, nRet, error_str);
 
                         } else {
-                            // preventive measure from exhausting CPU usage
-                            //
-                            MilliSleep(1); // 1 msec
+                            // The caller decides whether to back off, an edge
+                            // triggered poller just waits for the next event
+                            nBlocked |= SOCKET_RECV_BLOCKED;
                         }
                     } else {
+                        if (nRet == WSAEWOULDBLOCK)
+                            nBlocked |= SOCKET_RECV_BLOCKED;
                         if (nRet != WSAEWOULDBLOCK && nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS) {
                             if (!pnode->fDisconnect)
                                 LogPrint("tls","TSL: ERROR: socket recv %s\n", NetworkErrorString(nRet));
@@ -762,10 +756,14 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
     //
     if (sendSet) {
         TRY_LOCK(pnode->cs_vSend, lockSend);
-        if (lockSend)
+        if (lockSend) {
             SocketSendData(pnode);
+            // Anything left over did not fit into the socket buffer
+            if (!pnode->vSendMsg.empty())
+                nBlocked |= SOCKET_SEND_BLOCKED;
+        }
     }
-    return 0;
+    return nBlocked;
 }
 /**
  * @brief Initialization of the server and client contexts
@@ -0,0 +1,150 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txcache.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+#include "primitives/transaction.h"
+#include "rust/metrics.h"
+
+CTxCache::CTxCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0), nGeneration(0), nHits(0), nMisses(0)
+{
+}
+
+bool CTxCache::Get(const uint256& txid, CTransaction& txOut, uint256& hashBlock)
+{
+    std::shared_ptr<const CTransaction> tx;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (nMaxUsage == 0)
+            return false;
+        EntryMap::iterator it = mapEntries.find(txid);
+        if (it == mapEntries.end()) {
+            nMisses++;
+            MetricsStaticIncrementCounter("elosys.txcache.lookups", "result", "miss");
+            return false;
+        }
+        lruTxids.splice(lruTxids.begin(), lruTxids, it->second.itLRU);
+        tx = it->second.tx;
+        hashBlock = it->second.hashBlock;
+    }
+    nHits++;
+    MetricsStaticIncrementCounter("elosys.txcache.lookups", "result", "hit");
+
+    // Copy outside of the lock, the entry is immutable
+    txOut = *tx;
+    return true;
+}
+
+uint64_t CTxCache::GetGeneration() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return nGeneration;
+}
+
+void CTxCache::Put(const CTransaction& tx, const uint256& hashBlock, uint64_t nGenerationIn)
+{
+    // The transaction with its shared_ptr control block, plus the map and list nodes
+    size_t nEntryUsage = memusage::MallocUsage(sizeof(CTransaction) + 2 * sizeof(void*)) + RecursiveDynamicUsage(tx) +
+                         memusage::MallocUsage(sizeof(EntryMap::value_type) + sizeof(void*)) +
+                         memusage::MallocUsage(sizeof(uint256) + 2 * sizeof(void*));
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (nEntryUsage > nMaxUsage || nGenerationIn != nGeneration || mapEntries.count(tx.GetHash()))
+            return;
+    }
+
+    std::shared_ptr<const CTransaction> ptx = std::make_shared<const CTransaction>(tx);
+
+    std::lock_guard<std::mutex> lock(cs);
+    // The block of tx may have been connected or disconnected while it was read
+    if (nGenerationIn != nGeneration)
+        return;
+    std::pair<EntryMap::iterator, bool> ret = mapEntries.emplace(tx.GetHash(), CEntry());
+    if (!ret.second)
+        return;
+    lruTxids.push_front(tx.GetHash());
+    CEntry& entry = ret.first->second;
+    entry.tx = ptx;
+    entry.hashBlock = hashBlock;
+    entry.nUsage = nEntryUsage;
+    entry.itLRU = lruTxids.begin();
+    nUsage += nEntryUsage;
+    EvictExcess();
+}
+
+void CTxCache::EraseEntry(EntryMap::iterator it)
+{
+    nUsage -= it->second.nUsage;
+    lruTxids.erase(it->second.itLRU);
+    mapEntries.erase(it);
+}
+
+void CTxCache::EvictExcess()
+{
+    while (nUsage > nMaxUsage && !lruTxids.empty())
+        EraseEntry(mapEntries.find(lruTxids.back()));
+}
+
+void CTxCache::Erase(const std::vector<CTransaction>& vtx)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    nGeneration++;
+    if (mapEntries.empty())
+        return;
+    for (const CTransaction& tx : vtx) {
+        EntryMap::iterator it = mapEntries.find(tx.GetHash());
+        if (it != mapEntries.end())
+            EraseEntry(it);
+    }
+}
+
+void CTxCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    nGeneration++;
+    mapEntries.clear();
+    lruTxids.clear();
+    nUsage = 0;
+}
+
+void CTxCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    nMaxUsage = nMaxUsageIn;
+    EvictExcess();
+}
+
+CTxCache::Stats CTxCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    Stats stats;
+    stats.nEntries = mapEntries.size();
+    stats.nUsage = nUsage;
+    stats.nMaxUsage = nMaxUsage;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    return stats;
+}
+
+CTxCache& GetTxCache()
+{
+    static CTxCache cache;
+    return cache;
+}
+
+UniValue TxCacheStatsToJSON()
+{
+    CTxCache::Stats stats = GetTxCache().GetStats();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("entries", (uint64_t)stats.nEntries));
+    ret.push_back(Pair("usage", (uint64_t)stats.nUsage));
+    ret.push_back(Pair("maxusage", (uint64_t)stats.nMaxUsage));
+    ret.push_back(Pair("hits", stats.nHits));
+    ret.push_back(Pair("misses", stats.nMisses));
+    ret.push_back(Pair("hitrate", (stats.nHits + stats.nMisses) > 0 ? (double)stats.nHits / (stats.nHits + stats.nMisses) : 0.0));
+    return ret;
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2023 The Elosys developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXCACHE_H
+#define BITCOIN_TXCACHE_H
+
+#include "coins.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <univalue.h>
+
+class CTransaction;
+
+/** Default for -txcachesize, in megabytes */
+static const int64_t DEFAULT_TX_CACHE_SIZE = 32;
+
+/**
+ * Cache of confirmed transactions read through the transaction index, keyed by
+ * txid and evicted least recently used first once the entries use more memory
+ * than the limit.
+ *
+ * The cache only holds what the block files already say, together with the hash
+ * of the block the index points to. Transactions of blocks that are connected
+ * or disconnected must be dropped with Erase so that a transaction mined again
+ * after a reorg is not reported in its old block. Unconfirmed transactions are
+ * never cached, the mempool is looked at first.
+ *
+ * Readers do not need cs_main. A reader takes the generation before it reads
+ * the transaction index and hands it to Put, which drops the entry if an Erase
+ * happened in between.
+ */
+class CTxCache
+{
+public:
+    explicit CTxCache(size_t nMaxUsageIn = DEFAULT_TX_CACHE_SIZE << 20);
+
+    /** Look up txid, @returns false if it is not cached */
+    bool Get(const uint256& txid, CTransaction& txOut, uint256& hashBlock);
+    /** Counter bumped by every Erase and Clear */
+    uint64_t GetGeneration() const;
+    /** Cache tx unless the cache was erased from since nGeneration was taken */
+    void Put(const CTransaction& tx, const uint256& hashBlock, uint64_t nGeneration);
+
+    /** Drop the transactions of a block that is connected or disconnected */
+    void Erase(const std::vector<CTransaction>& vtx);
+    void Clear();
+
+    /** Change the memory limit in bytes, 0 disables the cache */
+    void SetMaxUsage(size_t nMaxUsageIn);
+
+    struct Stats
+    {
+        size_t nEntries;
+        size_t nUsage;
+        size_t nMaxUsage;
+        uint64_t nHits;
+        uint64_t nMisses;
+    };
+    Stats GetStats() const;
+
+private:
+    struct CEntry
+    {
+        std::shared_ptr<const CTransaction> tx;
+        uint256 hashBlock;
+        size_t nUsage;
+        std::list<uint256>::iterator itLRU;
+    };
+    typedef std::unordered_map<uint256, CEntry, CCoinsKeyHasher> EntryMap;
+
+    mutable std::mutex cs;
+    size_t nMaxUsage;
+    size_t nUsage;
+    uint64_t nGeneration;
+    //! Most recently used txids at the front
+    std::list<uint256> lruTxids;
+    EntryMap mapEntries;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    void EraseEntry(EntryMap::iterator it);
+    void EvictExcess();
+};
+
+/** The cache used by GetTransaction and myGetTransaction */
+CTxCache& GetTxCache();
+
+/** Size and hit/miss counters of GetTxCache() for getmempoolinfo */
+UniValue TxCacheStatsToJSON();
+
+#endif // BITCOIN_TXCACHE_H
@@ -26,6 +26,8 @@
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
+#include "compactsaplingindex.h"
+#include "coinsupplyindex.h"
 #include "core_io.h"
 #include "komodo_bitcoind.h"
 
@@ -53,7 +55,18 @@ static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 'H';
 static const char DB_BLOCKHASHINDEX = 'h';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSBALANCEINDEX = 'w';
+static const char DB_ADDRESSBALANCE_CURSOR = 'W';
+static const char DB_ADDRESSBALANCE_BEST = 'L';
+static const char DB_TOKENUNSPENTINDEX = 'T';
+static const char DB_TOKENOUTPOINT = 'o';
+static const char DB_ASSETORDERINDEX = 'O';
+static const char DB_ASSETORDER_OUTPOINT = 'Q';
+static const char DB_COINSUPPLYINDEX = 'U';
+static const char DB_COMPACTSAPLINGINDEX = 'k';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_BLOCK_INDEX_JOURNAL = 'J';
+static const char DB_BLOCK_INDEX_SNAPSHOT = 'N';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_BEST_SPROUT_ANCHOR = 'a';
@@ -285,6 +298,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles)
         : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles) {
+    fBlockIndexJournal = Exists(DB_BLOCK_INDEX_SNAPSHOT);
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) const {
@@ -398,6 +412,8 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
                 return dbindex_old.GetSolution();
             }};
             batch.Write(key, dbindex);
+            if (fBlockIndexJournal)
+                batch.Write(make_pair(DB_BLOCK_INDEX_JOURNAL, key.second), '1');
         } catch (const runtime_error&) {
             return false;
         }
@@ -409,6 +425,8 @@ bool CBlockTreeDB::EraseBatchSync(const std::vector<const CBlockIndex*>& blockin
     CDBBatch batch(*this);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Erase(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()));
+        if (fBlockIndexJournal)
+            batch.Write(make_pair(DB_BLOCK_INDEX_JOURNAL, (*it)->GetBlockHash()), '1');
     }
     return WriteBatch(batch, true);
 }
@@ -456,41 +474,104 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+namespace {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+typedef std::vector<unsigned char> RawKey;
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+template <typename K>
+RawKey MakeRawKey(char chType, const K& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << make_pair(chType, key);
+    return RawKey(ss.begin(), ss.end());
+}
 
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            pair<char, CAddressUnspentKey> keyObj;
-            pcursor->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressUnspentKey indexKey = keyObj.second;
+/** A key past every record of an address */
+RawKey AddressRangeEnd(char chType, int type, const uint160& addressHash)
+{
+    RawKey key = MakeRawKey(chType, CAddressIndexIteratorKey(type, addressHash));
+    key.resize(key.size() + 64, 0xff);
+    return key;
+}
 
-            if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
-                try {
-                    CAddressUnspentValue nValue;
-                    pcursor->GetValue(nValue);
-                    unspentOutputs.push_back(make_pair(indexKey, nValue));
-                    pcursor->Next();
-                } catch (const std::exception& e) {
-                    return error("failed to get address unspent value");
-                }
-            } else {
-                break;
-            }
-        } catch (const std::exception& e) {
-            break;
+RawKey CurrentRawKey(CDBIterator& cursor)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    cursor.GetKeyDataStream(ssKey);
+    return RawKey(ssKey.begin(), ssKey.end());
+}
+
+void SeekRaw(CDBIterator& cursor, const RawKey& key)
+{
+    cursor.Seek(CFlatData((void*)key.data(), (void*)(key.data() + key.size())));
+}
+
+/**
+ * Visit the records with keys in [lower, upper), in key order or reversed,
+ * resuming after the record pStartAfter when set, until visit returns false.
+ */
+template <typename KeyType, typename ValueType, typename Visitor>
+bool ScanRange(CDBIterator& cursor, const RawKey& lower, const RawKey& upper,
+               const RawKey* pStartAfter, bool fReverse, const Visitor& visit)
+{
+    if (!fReverse) {
+        if (pStartAfter && lower < *pStartAfter) {
+            SeekRaw(cursor, *pStartAfter);
+            if (cursor.Valid() && CurrentRawKey(cursor) == *pStartAfter)
+                cursor.Next();
+        } else {
+            SeekRaw(cursor, lower);
         }
+    } else {
+        // Both bounds are exclusive, step back from wherever the seek lands
+        SeekRaw(cursor, pStartAfter && *pStartAfter < upper ? *pStartAfter : upper);
+        if (cursor.Valid())
+            cursor.Prev();
+        else
+            cursor.SeekToLast();
+    }
+
+    while (cursor.Valid()) {
+        boost::this_thread::interruption_point();
+        RawKey raw = CurrentRawKey(cursor);
+        if (raw < lower || !(raw < upper))
+            break;
+        pair<char, KeyType> keyObj;
+        ValueType value;
+        if (!cursor.GetKey(keyObj) || !cursor.GetValue(value))
+            return error("failed to read index record");
+        if (!visit(keyObj.second, value))
+            break;
+        if (fReverse)
+            cursor.Prev();
+        else
+            cursor.Next();
     }
     return true;
 }
 
+}
+
+bool CBlockTreeDB::ScanAddressUnspentIndex(uint160 addressHash, int type, const CAddressUnspentKey* pStartAfter, bool fReverse,
+                                           const AddressUnspentVisitor& visit) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    RawKey lower = MakeRawKey(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash));
+    RawKey upper = AddressRangeEnd(DB_ADDRESSUNSPENTINDEX, type, addressHash);
+    RawKey startAfter;
+    if (pStartAfter)
+        startAfter = MakeRawKey(DB_ADDRESSUNSPENTINDEX, *pStartAfter);
+    return ScanRange<CAddressUnspentKey, CAddressUnspentValue>(*pcursor, lower, upper, pStartAfter ? &startAfter : NULL, fReverse, visit);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    return ScanAddressUnspentIndex(addressHash, type, NULL, false,
+        [&unspentOutputs](const CAddressUnspentKey& key, const CAddressUnspentValue& value) {
+            unspentOutputs.push_back(make_pair(key, value));
+            return true;
+        });
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
@@ -505,48 +586,33 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ScanAddressIndex(uint160 addressHash, int type, int start, int end,
+                                    const CAddressIndexKey* pStartAfter, bool fReverse,
+                                    const AddressIndexVisitor& visit) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    RawKey lower, upper;
+    if (start > 0 && end > 0)
+        lower = MakeRawKey(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start));
+    else
+        lower = MakeRawKey(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash));
+    if (end > 0)
+        upper = MakeRawKey(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, end + 1));
+    else
+        upper = AddressRangeEnd(DB_ADDRESSINDEX, type, addressHash);
+    RawKey startAfter;
+    if (pStartAfter)
+        startAfter = MakeRawKey(DB_ADDRESSINDEX, *pStartAfter);
+    return ScanRange<CAddressIndexKey, CAmount>(*pcursor, lower, upper, pStartAfter ? &startAfter : NULL, fReverse, visit);
+}
+
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
-
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-
-    if (start > 0 && end > 0) {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
-    }
-
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            pair<char, CAddressIndexKey> keyObj;
-            pcursor->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressIndexKey indexKey = keyObj.second;
-
-            if (chType == DB_ADDRESSINDEX && indexKey.hashBytes == addressHash) {
-                if (end > 0 && indexKey.blockHeight > end) {
-                    break;
-                }
-                try {
-                    CAmount nValue;
-                    pcursor->GetValue(nValue);
-
-                    addressIndex.push_back(make_pair(indexKey, nValue));
-                    pcursor->Next();
-                } catch (const std::exception& e) {
-                    return error("failed to get address index value");
-                }
-            } else {
-                break;
-            }
-        } catch (const std::exception& e) {
-            break;
-        }
-    }
-
-    return true;
+    return ScanAddressIndex(addressHash, type, start, end, NULL, false,
+        [&addressIndex](const CAddressIndexKey& key, CAmount nValue) {
+            addressIndex.push_back(make_pair(key, nValue));
+            return true;
+        });
 }
 
 bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &address);
@@ -711,6 +777,262 @@ UniValue CBlockTreeDB::Snapshot(int top)
     return(result);
 }
 
+namespace {
+
+bool AddressKeyLess(const CAddressIndexIteratorKey &a, const CAddressIndexIteratorKey &b)
+{
+    // Same order as the serialized keys in leveldb
+    if (a.type != b.type)
+        return a.type < b.type;
+    return a.hashBytes < b.hashBytes;
+}
+
+bool AddressKeyEqual(const CAddressIndexIteratorKey &a, const CAddressIndexIteratorKey &b)
+{
+    return a.type == b.type && a.hashBytes == b.hashBytes;
+}
+
+struct AddressKeyCompare
+{
+    bool operator()(const CAddressIndexIteratorKey &a, const CAddressIndexIteratorKey &b) const
+    {
+        return AddressKeyLess(a, b);
+    }
+};
+
+}
+
+bool CBlockTreeDB::UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fDisconnect,
+                                             const uint256 &hashBest) {
+    // Net effect of the block per address; records of one transaction are
+    // adjacent, as they are generated transaction by transaction
+    std::map<CAddressIndexIteratorKey, CAddressBalanceValue, AddressKeyCompare> mapDelta;
+    std::map<CAddressIndexIteratorKey, uint256, AddressKeyCompare> mapLastTx;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        CAddressIndexIteratorKey key(it->first.type, it->first.hashBytes);
+        CAddressBalanceValue &delta = mapDelta[key];
+        delta.balance += it->second;
+        if (it->second > 0)
+            delta.received += it->second;
+        uint256 &lastTx = mapLastTx[key];
+        if (lastTx != it->first.txhash) {
+            delta.txcount++;
+            lastTx = it->first.txhash;
+        }
+    }
+
+    CAddressIndexIteratorKey cursor;
+    bool fBuilding = Read(DB_ADDRESSBALANCE_CURSOR, cursor);
+
+    CDBBatch batch(*this);
+    for (std::map<CAddressIndexIteratorKey, CAddressBalanceValue, AddressKeyCompare>::const_iterator it=mapDelta.begin(); it!=mapDelta.end(); it++) {
+        if (fBuilding && !AddressKeyLess(it->first, cursor))
+            break;
+        CAddressBalanceValue value;
+        if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, it->first), value))
+            value.SetNull();
+        int sign = fDisconnect ? -1 : 1;
+        value.balance += sign * it->second.balance;
+        value.received += sign * it->second.received;
+        value.txcount += sign * it->second.txcount;
+        if (value.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, it->first), value);
+    }
+    // The deltas are not idempotent, the marker tells on startup whether
+    // they went further than the chainstate that was flushed
+    batch.Write(DB_ADDRESSBALANCE_BEST, hashBest);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressBalanceBestBlock(uint256 &hashBest) const {
+    return Read(DB_ADDRESSBALANCE_BEST, hashBest);
+}
+
+bool CBlockTreeDB::ReadAddressBalance(const CAddressIndexIteratorKey &key, CAddressBalanceValue &value) const {
+    CAddressIndexIteratorKey cursor;
+    if (Read(DB_ADDRESSBALANCE_CURSOR, cursor) && !AddressKeyLess(key, cursor))
+        return false;
+    if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, key), value))
+        value.SetNull();
+    return true;
+}
+
+bool CBlockTreeDB::IsAddressBalanceIndexBuilding() const {
+    return Exists(DB_ADDRESSBALANCE_CURSOR);
+}
+
+bool CBlockTreeDB::ResetAddressBalanceIndex(bool fBuild, const uint256 &hashBest) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey()));
+
+    std::unique_ptr<CDBBatch> batch(new CDBBatch(*this));
+    size_t nErased = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        pair<char, CAddressIndexIteratorKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        batch->Erase(keyObj);
+        if (++nErased % 10000 == 0) {
+            if (!WriteBatch(*batch))
+                return false;
+            batch.reset(new CDBBatch(*this));
+        }
+        pcursor->Next();
+    }
+    if (fBuild)
+        batch->Write(DB_ADDRESSBALANCE_CURSOR, CAddressIndexIteratorKey());
+    else
+        batch->Erase(DB_ADDRESSBALANCE_CURSOR);
+    batch->Write(DB_ADDRESSBALANCE_BEST, hashBest);
+    return WriteBatch(*batch, true);
+}
+
+bool CBlockTreeDB::BuildAddressBalanceIndex(size_t nMaxAddresses, int nMaxHeight, size_t &nBuilt, bool &fComplete) {
+    nBuilt = 0;
+    fComplete = false;
+    CAddressIndexIteratorKey cursor;
+    if (!Read(DB_ADDRESSBALANCE_CURSOR, cursor)) {
+        fComplete = true;
+        return true;
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, cursor));
+
+    CDBBatch batch(*this);
+    bool fHaveAddress = false;
+    CAddressIndexIteratorKey current;
+    CAddressBalanceValue value;
+    uint256 lastTx;
+    fComplete = true;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        pair<char, CAddressIndexKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_ADDRESSINDEX)
+            break;
+        CAddressIndexIteratorKey key(keyObj.second.type, keyObj.second.hashBytes);
+        if (!fHaveAddress || !AddressKeyEqual(key, current)) {
+            if (fHaveAddress) {
+                batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, current), value);
+                if (++nBuilt >= nMaxAddresses) {
+                    // Resume from this address in the next step
+                    batch.Write(DB_ADDRESSBALANCE_CURSOR, key);
+                    fComplete = false;
+                    fHaveAddress = false;
+                    break;
+                }
+            }
+            fHaveAddress = true;
+            current = key;
+            value.SetNull();
+            lastTx.SetNull();
+        }
+        // Records of blocks past the chain tip are left over from before an
+        // unclean shutdown; the block adds them to the balance when it is
+        // connected again
+        if (keyObj.second.blockHeight > nMaxHeight) {
+            pcursor->Next();
+            continue;
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        value.balance += nValue;
+        if (nValue > 0)
+            value.received += nValue;
+        if (keyObj.second.txhash != lastTx) {
+            value.txcount++;
+            lastTx = keyObj.second.txhash;
+        }
+        pcursor->Next();
+    }
+    if (fHaveAddress) {
+        batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, current), value);
+        nBuilt++;
+    }
+    if (fComplete)
+        batch.Erase(DB_ADDRESSBALANCE_CURSOR);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::UpdateTokenIndex(const std::vector<std::pair<CTokenUnspentKey, CTokenUnspentValue> > &vect,
+                                    const std::vector<std::pair<COutPoint, uint256> > &vectOutpoints) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<COutPoint, uint256> >::const_iterator it=vectOutpoints.begin(); it!=vectOutpoints.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_TOKENOUTPOINT, it->first));
+        } else {
+            batch.Write(make_pair(DB_TOKENOUTPOINT, it->first), it->second);
+        }
+    }
+    for (std::vector<std::pair<CTokenUnspentKey, CTokenUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_TOKENUNSPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_TOKENUNSPENTINDEX, it->first), it->second);
+        }
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadTokenOutpoint(const COutPoint &outpoint, uint256 &tokenid) const {
+    return Read(make_pair(DB_TOKENOUTPOINT, outpoint), tokenid);
+}
+
+bool CBlockTreeDB::ScanTokenUnspentIndex(const uint256 &tokenid, const CAddressIndexIteratorKey* pAddress,
+                                         const TokenUnspentVisitor& visit) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    RawKey lower = pAddress ? MakeRawKey(DB_TOKENUNSPENTINDEX, make_pair(tokenid, *pAddress)) : MakeRawKey(DB_TOKENUNSPENTINDEX, tokenid);
+    RawKey upper = lower;
+    upper.resize(upper.size() + 64, 0xff);
+    return ScanRange<CTokenUnspentKey, CTokenUnspentValue>(*pcursor, lower, upper, NULL, false, visit);
+}
+
+bool CBlockTreeDB::UpdateAssetOrderIndex(const std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &vect,
+                                         const std::vector<std::pair<COutPoint, std::pair<CAssetOrderKey, CAssetOrderValue> > > &vectOutpoints) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<COutPoint, std::pair<CAssetOrderKey, CAssetOrderValue> > >::const_iterator it=vectOutpoints.begin(); it!=vectOutpoints.end(); it++) {
+        if (it->second.second.IsNull()) {
+            batch.Erase(make_pair(DB_ASSETORDER_OUTPOINT, it->first));
+        } else {
+            batch.Write(make_pair(DB_ASSETORDER_OUTPOINT, it->first), it->second);
+        }
+    }
+    for (std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_ASSETORDERINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_ASSETORDERINDEX, it->first), it->second);
+        }
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAssetOrderOutpoint(const COutPoint &outpoint, std::pair<CAssetOrderKey, CAssetOrderValue> &order) const {
+    return Read(make_pair(DB_ASSETORDER_OUTPOINT, outpoint), order);
+}
+
+bool CBlockTreeDB::ScanAssetOrderIndex(const uint256* pTokenid, unsigned char side, const CAssetOrderKey* pStartAfter, bool fReverse,
+                                       const AssetOrderVisitor& visit) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    RawKey lower, upper;
+    if (pTokenid && side != 0)
+        lower = MakeRawKey(DB_ASSETORDERINDEX, make_pair(*pTokenid, side));
+    else if (pTokenid)
+        lower = MakeRawKey(DB_ASSETORDERINDEX, *pTokenid);
+    else
+        lower = RawKey(1, DB_ASSETORDERINDEX);
+    upper = lower;
+    upper.resize(upper.size() + 128, 0xff);
+    RawKey startAfter;
+    if (pStartAfter)
+        startAfter = MakeRawKey(DB_ASSETORDERINDEX, *pStartAfter);
+    return ScanRange<CAssetOrderKey, CAssetOrderValue>(*pcursor, lower, upper, pStartAfter ? &startAfter : NULL, fReverse, visit);
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
@@ -768,6 +1090,51 @@ bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &lt
     return true;
 }
 
+bool CBlockTreeDB::WriteCoinSupply(const uint256 &hash, const CCoinSupplyValue &value) {
+    return Write(make_pair(DB_COINSUPPLYINDEX, hash), value);
+}
+
+bool CBlockTreeDB::ReadCoinSupply(const uint256 &hash, CCoinSupplyValue &value) const {
+    return Read(make_pair(DB_COINSUPPLYINDEX, hash), value);
+}
+
+bool CBlockTreeDB::WriteCompactSaplingBlock(const CCompactSaplingBlock &block) {
+    CDBBatch batch(*this);
+    batch.Write(make_pair(DB_COMPACTSAPLINGINDEX, CCompactSaplingIndexKey(block.nHeight)), block);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseCompactSaplingBlock(int nHeight) {
+    CDBBatch batch(*this);
+    batch.Erase(make_pair(DB_COMPACTSAPLINGINDEX, CCompactSaplingIndexKey(nHeight)));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadCompactSaplingBlocks(int nStart, int nEnd, std::vector<CCompactSaplingBlock> &vBlocks) const {
+
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CBlockTreeDB*>(this)->NewIterator());
+
+    pcursor->Seek(make_pair(DB_COMPACTSAPLINGINDEX, CCompactSaplingIndexKey(nStart)));
+
+    int nExpected = nStart;
+    while (pcursor->Valid() && nExpected <= nEnd) {
+        boost::this_thread::interruption_point();
+        pair<char, CCompactSaplingIndexKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_COMPACTSAPLINGINDEX || keyObj.second.nHeight != nExpected)
+            break;
+
+        CCompactSaplingBlock block;
+        if (!pcursor->GetValue(block))
+            return error("failed to get compact sapling block %d", nExpected);
+        vBlocks.push_back(block);
+
+        nExpected++;
+        pcursor->Next();
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -793,6 +1160,37 @@ bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     return true;
 }
 
+/****
+ * Create or update the in-memory entry for a block index record read from disk
+ * @param diskindex the record
+ * @returns the entry in mapBlockIndex
+ */
+static CBlockIndex* InsertDiskBlockIndex(const CDiskBlockIndex &diskindex)
+{
+    CBlockIndex* pindexNew            = InsertBlockIndex(diskindex.GetBlockHash());
+    pindexNew->pprev                  = InsertBlockIndex(diskindex.hashPrev);
+    pindexNew->nHeight                = diskindex.nHeight;
+    pindexNew->nFile                  = diskindex.nFile;
+    pindexNew->nDataPos               = diskindex.nDataPos;
+    pindexNew->nUndoPos               = diskindex.nUndoPos;
+    pindexNew->hashSproutAnchor       = diskindex.hashSproutAnchor;
+    pindexNew->nVersion               = diskindex.nVersion;
+    pindexNew->hashMerkleRoot         = diskindex.hashMerkleRoot;
+    pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
+    pindexNew->nTime                  = diskindex.nTime;
+    pindexNew->nBits                  = diskindex.nBits;
+    pindexNew->nNonce                 = diskindex.nNonce;
+    // the Equihash solution will be loaded lazily from the dbindex entry
+    pindexNew->nStatus                = diskindex.nStatus;
+    pindexNew->nCachedBranchId        = diskindex.nCachedBranchId;
+    pindexNew->nTx                    = diskindex.nTx;
+    pindexNew->nSproutValue           = diskindex.nSproutValue;
+    pindexNew->nSaplingValue          = diskindex.nSaplingValue;
+    pindexNew->segid                  = diskindex.segid;
+    pindexNew->nNotaryPay             = diskindex.nNotaryPay;
+    return pindexNew;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
@@ -824,27 +1222,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
                 // Construct block index object
-                CBlockIndex* pindexNew            = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev                  = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight                = diskindex.nHeight;
-                pindexNew->nFile                  = diskindex.nFile;
-                pindexNew->nDataPos               = diskindex.nDataPos;
-                pindexNew->nUndoPos               = diskindex.nUndoPos;
-                pindexNew->hashSproutAnchor       = diskindex.hashSproutAnchor;
-                pindexNew->nVersion               = diskindex.nVersion;
-                pindexNew->hashMerkleRoot         = diskindex.hashMerkleRoot;
-                pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
-                pindexNew->nTime                  = diskindex.nTime;
-                pindexNew->nBits                  = diskindex.nBits;
-                pindexNew->nNonce                 = diskindex.nNonce;
-                // the Equihash solution will be loaded lazily from the dbindex entry
-                pindexNew->nStatus                = diskindex.nStatus;
-                pindexNew->nCachedBranchId        = diskindex.nCachedBranchId;
-                pindexNew->nTx                    = diskindex.nTx;
-                pindexNew->nSproutValue           = diskindex.nSproutValue;
-                pindexNew->nSaplingValue          = diskindex.nSaplingValue;
-                pindexNew->segid                  = diskindex.segid;
-                pindexNew->nNotaryPay             = diskindex.nNotaryPay;
+                CBlockIndex* pindexNew = InsertDiskBlockIndex(diskindex);
 
                 if ( 0 ) // POW will be checked before any block is connected
                 {
@@ -882,3 +1260,66 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
     return true;
 }
+
+bool CBlockTreeDB::LoadBlockIndexEntries(const std::vector<uint256> &vHashes, std::vector<CBlockIndex*> &vInserted)
+{
+    for (const uint256& hash : vHashes) {
+        CDiskBlockIndex diskindex;
+        if (!ReadDiskBlockIndex(hash, diskindex))
+            return error("%s: failed to read index entry %s", __func__, hash.ToString());
+        bool fNew = mapBlockIndex.count(hash) == 0;
+        bool fNewPrev = !diskindex.hashPrev.IsNull() && mapBlockIndex.count(diskindex.hashPrev) == 0;
+        CBlockIndex* pindexNew = InsertDiskBlockIndex(diskindex);
+        if (fNew)
+            vInserted.push_back(pindexNew);
+        if (fNewPrev)
+            vInserted.push_back(pindexNew->pprev);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadBlockIndexSnapshotId(uint256 &id) const {
+    return Read(DB_BLOCK_INDEX_SNAPSHOT, id);
+}
+
+bool CBlockTreeDB::WriteBlockIndexSnapshotId(const uint256 &id) {
+    std::vector<uint256> vJournal;
+    if (!ReadBlockIndexJournal(vJournal))
+        return false;
+    CDBBatch batch(*this);
+    for (const uint256& hash : vJournal)
+        batch.Erase(make_pair(DB_BLOCK_INDEX_JOURNAL, hash));
+    batch.Write(DB_BLOCK_INDEX_SNAPSHOT, id);
+    if (!WriteBatch(batch, true))
+        return false;
+    fBlockIndexJournal = true;
+    return true;
+}
+
+bool CBlockTreeDB::EraseBlockIndexSnapshotId() {
+    std::vector<uint256> vJournal;
+    if (!ReadBlockIndexJournal(vJournal))
+        return false;
+    CDBBatch batch(*this);
+    for (const uint256& hash : vJournal)
+        batch.Erase(make_pair(DB_BLOCK_INDEX_JOURNAL, hash));
+    batch.Erase(DB_BLOCK_INDEX_SNAPSHOT);
+    fBlockIndexJournal = false;
+    return WriteBatch(batch, true);
+}
+
+bool CBlockTreeDB::ReadBlockIndexJournal(std::vector<uint256> &vHashes) const {
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CBlockTreeDB*>(this)->NewIterator());
+
+    pcursor->Seek(make_pair(DB_BLOCK_INDEX_JOURNAL, uint256()));
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX_JOURNAL) {
+            vHashes.push_back(key.second);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+    return true;
+}
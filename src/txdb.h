@@ -25,6 +25,7 @@
 #include "coins.h"
 #include "dbwrapper.h"
 
+#include <functional>
 #include <map>
 #include <string>
 #include <utility>
@@ -39,15 +40,28 @@ struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressBalanceValue;
+struct CTokenUnspentKey;
+struct CTokenUnspentValue;
+struct CAssetOrderKey;
+struct CAssetOrderValue;
+struct CCoinSupplyValue;
 struct CTimestampIndexKey;
 struct CTimestampIndexIteratorKey;
 struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CCompactSaplingBlock;
 class uint256;
 class CDiskBlockIndex;
 
+/** Called for each record of an address index scan, returns false to stop the scan */
+typedef std::function<bool(const CAddressIndexKey&, CAmount)> AddressIndexVisitor;
+typedef std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> AddressUnspentVisitor;
+typedef std::function<bool(const CTokenUnspentKey&, const CTokenUnspentValue&)> TokenUnspentVisitor;
+typedef std::function<bool(const CAssetOrderKey&, const CAssetOrderValue&)> AssetOrderVisitor;
+
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
 //! max. -dbcache (MiB)
@@ -111,6 +125,7 @@ public:
  * - address / amount
  * - timestamp index
  * - block hash / timestamp index
+ * - id of the current block index snapshot and the journal of index writes since
  */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -128,6 +143,9 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    //! Record the hashes of written or erased index entries while a snapshot exists
+    bool fBlockIndexJournal;
 public:
     /***
      * Write a batch of records and sync
@@ -218,6 +236,17 @@ public:
      */
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    /****
+     * Walk the unspent outputs of an address without collecting them
+     * @param addressHash the address
+     * @param type the address type
+     * @param pStartAfter resume after this record, as returned by a previous scan
+     * @param fReverse walk in descending key order
+     * @param visit called for each record until it returns false
+     * @returns true on success
+     */
+    bool ScanAddressUnspentIndex(uint160 addressHash, int type, const CAddressUnspentKey* pStartAfter, bool fReverse,
+                                 const AddressUnspentVisitor& visit);
     /*****
      * Write a batch of address index / amount records
      * @param vect a collection of address index/amount records
@@ -242,6 +271,115 @@ public:
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    /****
+     * Walk the address index records of an address in height order without collecting them
+     * @param addressHash the address to look for
+     * @param type the address type
+     * @param start the first height, if start and end are set
+     * @param end the last height, if set
+     * @param pStartAfter resume after this record, as returned by a previous scan
+     * @param fReverse walk from the highest record down
+     * @param visit called for each record until it returns false
+     * @returns true on success
+     */
+    bool ScanAddressIndex(uint160 addressHash, int type, int start, int end,
+                          const CAddressIndexKey* pStartAfter, bool fReverse,
+                          const AddressIndexVisitor& visit);
+    /****
+     * Apply the address index records of a connected or disconnected block to the
+     * running address balances. Addresses the background build has not reached
+     * yet are skipped, the build picks up their history from the address index.
+     * @param vect the address index records of the block
+     * @param fDisconnect true to revert the records
+     * @param hashBest the chain tip after the block, stored in the same batch
+     * @returns true on success
+     */
+    bool UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fDisconnect,
+                                   const uint256 &hashBest);
+    /****
+     * Read the chain tip the address balances were last updated to
+     * @param hashBest the result
+     * @returns false if no tip was stored
+     */
+    bool ReadAddressBalanceBestBlock(uint256 &hashBest) const;
+    /****
+     * Read the running balance of an address
+     * @param key the address type and hash
+     * @param value the result, null for an address without history
+     * @returns false if the background build has not covered the address yet
+     */
+    bool ReadAddressBalance(const CAddressIndexIteratorKey &key, CAddressBalanceValue &value) const;
+    /****
+     * Drop all address balances. When fBuild is set, a background build from the
+     * address index is scheduled, otherwise the balance index is left disabled.
+     * @param hashBest the current chain tip
+     * @returns true on success
+     */
+    bool ResetAddressBalanceIndex(bool fBuild, const uint256 &hashBest);
+    /****
+     * Aggregate the address index history of the next addresses into balances.
+     * The caller must hold cs_main so no block is connected in between.
+     * @param nMaxAddresses how many addresses to build in this step
+     * @param nMaxHeight the chain tip height, later records are skipped
+     * @param nBuilt the number of addresses built
+     * @param fComplete set when every address has been built
+     * @returns true on success
+     */
+    bool BuildAddressBalanceIndex(size_t nMaxAddresses, int nMaxHeight, size_t &nBuilt, bool &fComplete);
+    /****
+     * @returns true while a background build of the balance index is pending
+     */
+    bool IsAddressBalanceIndexBuilding() const;
+    /****
+     * Apply the token index changes of a connected or disconnected block
+     * @param vect unspent token outputs to write, or to erase when the value is null
+     * @param vectOutpoints token of each output created, or erased when the token is null
+     * @returns true on success
+     */
+    bool UpdateTokenIndex(const std::vector<std::pair<CTokenUnspentKey, CTokenUnspentValue> > &vect,
+                          const std::vector<std::pair<COutPoint, uint256> > &vectOutpoints);
+    /****
+     * Find the token of a CC output, spent or not
+     * @param outpoint the output
+     * @param tokenid the result
+     * @returns false if the output does not carry a token
+     */
+    bool ReadTokenOutpoint(const COutPoint &outpoint, uint256 &tokenid) const;
+    /****
+     * Walk the unspent outputs of a token in key order
+     * @param tokenid the token
+     * @param pAddress only the outputs held by this CC address, when set
+     * @param visit called for each record until it returns false
+     * @returns true on success
+     */
+    bool ScanTokenUnspentIndex(const uint256 &tokenid, const CAddressIndexIteratorKey* pAddress,
+                               const TokenUnspentVisitor& visit);
+    /****
+     * Apply the orderbook index changes of a connected or disconnected block
+     * @param vect open orders to write, or to erase when the value is null
+     * @param vectOutpoints order created by each output, or erased when the value is null
+     * @returns true on success
+     */
+    bool UpdateAssetOrderIndex(const std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &vect,
+                               const std::vector<std::pair<COutPoint, std::pair<CAssetOrderKey, CAssetOrderValue> > > &vectOutpoints);
+    /****
+     * Find the order an output created, filled or not
+     * @param outpoint the output
+     * @param order the result
+     * @returns false if the output is not an order
+     */
+    bool ReadAssetOrderOutpoint(const COutPoint &outpoint, std::pair<CAssetOrderKey, CAssetOrderValue> &order) const;
+    /****
+     * Walk the open orders in key order or reversed
+     * @param pTokenid only the orders of this token when set
+     * @param side only this side of the book when set, needs pTokenid
+     * @param pStartAfter resume after this record, as returned by a previous scan
+     * @param fReverse walk in descending key order
+     * @param visit called for each record until it returns false
+     * @returns true on success
+     */
+    bool ScanAssetOrderIndex(const uint256* pTokenid, unsigned char side, const CAssetOrderKey* pStartAfter, bool fReverse,
+                             const AssetOrderVisitor& visit);
     /****
      * Write a timestamp entry to the db
      * @param timestampIndex the record to write
@@ -272,6 +410,40 @@ public:
      * @returns true on success
      */
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS) const;
+    /****
+     * Write the running supply totals of a connected block
+     * @param hash the block hash (the key)
+     * @param value the totals up to and including the block
+     * @returns true on success
+     */
+    bool WriteCoinSupply(const uint256 &hash, const CCoinSupplyValue &value);
+    /*****
+     * Given a block hash, find its running supply totals
+     * @param hash the block hash (the key)
+     * @param value the totals (the value)
+     * @returns false if the block has none
+     */
+    bool ReadCoinSupply(const uint256 &hash, CCoinSupplyValue &value) const;
+    /****
+     * Append the compact Sapling block for a connected block
+     * @param block the record, keyed by its height
+     * @returns true on success
+     */
+    bool WriteCompactSaplingBlock(const CCompactSaplingBlock &block);
+    /****
+     * Remove the compact Sapling block at a height, used when the block is disconnected
+     * @param nHeight the height
+     * @returns true on success
+     */
+    bool EraseCompactSaplingBlock(int nHeight);
+    /****
+     * Read a contiguous range of compact Sapling blocks
+     * @param nStart first height
+     * @param nEnd last height (inclusive)
+     * @param vBlocks the results, stops early at the first missing height
+     * @returns true on success
+     */
+    bool ReadCompactSaplingBlocks(int nStart, int nEnd, std::vector<CCompactSaplingBlock> &vBlocks) const;
     /***
      * Store a flag value in the DB
      * @param name the key
@@ -292,6 +464,36 @@ public:
      * @returns true on success
      */
     bool LoadBlockIndexGuts();
+    /****
+     * Load selected block headers from disk, as LoadBlockIndexGuts does for all of them
+     * @param vHashes the block hashes
+     * @param vInserted the entries (including placeholder parents) that were not in mapBlockIndex yet
+     * @returns false if an entry is missing or unreadable
+     */
+    bool LoadBlockIndexEntries(const std::vector<uint256> &vHashes, std::vector<CBlockIndex*> &vInserted);
+    /****
+     * Read the id of the block index snapshot that matches this database
+     * @param id where to store the result
+     * @returns false if there is no valid snapshot
+     */
+    bool ReadBlockIndexSnapshotId(uint256 &id) const;
+    /****
+     * Mark a freshly written snapshot as current and start a new journal
+     * @param id the id stored in the snapshot header
+     * @returns true on success
+     */
+    bool WriteBlockIndexSnapshotId(const uint256 &id);
+    /****
+     * Invalidate any snapshot and stop journaling index writes
+     * @returns true on success
+     */
+    bool EraseBlockIndexSnapshotId();
+    /****
+     * Read the hashes of the index entries written or erased since the current snapshot
+     * @param vHashes the results
+     * @returns true on success
+     */
+    bool ReadBlockIndexJournal(std::vector<uint256> &vHashes) const;
     /****
      * Check if a block is on the active chain
      * @param hash the block hash
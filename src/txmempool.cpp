@@ -34,12 +34,16 @@
 #include "komodo_globals.h"
 #include "komodo_utils.h"
 #include "komodo_bitcoind.h"
+#include "rust/metrics.h"
+
+#include <cmath>
 
 using namespace std;
 
 CTxMemPoolEntry::CTxMemPoolEntry():
     nFee(0), nTxSize(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0),
-    hadNoDependencies(false), spendsCoinbase(false)
+    hadNoDependencies(false), spendsCoinbase(false), feeDelta(0),
+    nCountWithDescendants(1), nSizeWithDescendants(0), nModFeesWithDescendants(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
@@ -50,12 +54,16 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
                                  bool _spendsCoinbase, uint32_t _nBranchId):
     tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight),
     hadNoDependencies(poolHasNoInputsOf),
-    spendsCoinbase(_spendsCoinbase), nBranchId(_nBranchId)
+    spendsCoinbase(_spendsCoinbase), nBranchId(_nBranchId), feeDelta(0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
     nModSize = tx.CalculateModifiedSize(nTxSize);
     nUsageSize = RecursiveDynamicUsage(tx);
     feeRate = CFeeRate(nFee, nTxSize);
+
+    nCountWithDescendants = 1;
+    nSizeWithDescendants = nTxSize;
+    nModFeesWithDescendants = nFee;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -72,8 +80,24 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
+void CTxMemPoolEntry::UpdateFeeDelta(CAmount newFeeDelta)
+{
+    nModFeesWithDescendants += newFeeDelta - feeDelta;
+    feeDelta = newFeeDelta;
+}
+
+void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+{
+    nSizeWithDescendants += modifySize;
+    assert(int64_t(nSizeWithDescendants) > 0);
+    nModFeesWithDescendants += modifyFee;
+    nCountWithDescendants += modifyCount;
+    assert(int64_t(nCountWithDescendants) > 0);
+}
+
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), cachedInnerUsage(0), minReasonableRelayFee(_minRelayFee),
+    lastRollingFeeUpdate(GetTime()), blockSinceLastRollingFeeBump(false), rollingMinimumFeeRate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -120,8 +144,58 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // Used by main.cpp AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
-    mapTx.insert(entry);
-    const CTransaction& tx = mapTx.find(hash)->GetTx();
+    std::set<uint256> setAncestors;
+    CalculateMemPoolAncestors(entry.GetTx(), setAncestors);
+
+    // A transaction put back by a reorg may already have children in the pool.
+    // Note their ancestors before the insert links them to those of the new
+    // transaction, the difference gains them as descendants below.
+    std::vector<std::pair<const CTransaction*, std::set<uint256> > > vDescendants;
+    {
+        std::set<uint256> setDescendants;
+        std::vector<uint256> vToVisit(1, hash);
+        while (!vToVisit.empty()) {
+            uint256 hashParent = vToVisit.back();
+            vToVisit.pop_back();
+            for (std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.lower_bound(COutPoint(hashParent, 0));
+                 it != mapNextTx.end() && it->first.hash == hashParent; ++it) {
+                const CTransaction* ptxChild = it->second.ptx;
+                if (setDescendants.insert(ptxChild->GetHash()).second) {
+                    vToVisit.push_back(ptxChild->GetHash());
+                    vDescendants.push_back(std::make_pair(ptxChild, std::set<uint256>()));
+                    CalculateMemPoolAncestors(*ptxChild, vDescendants.back().second);
+                }
+            }
+        }
+    }
+
+    indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
+
+    // Update transaction for any feeDelta created by PrioritiseTransaction
+    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+    if (pos != mapDeltas.end() && pos->second.second != 0) {
+        mapTx.modify(newit, update_fee_delta(pos->second.second));
+    }
+
+    // The new transaction is a descendant of every in-mempool ancestor
+    for (const uint256& ancestor : setAncestors) {
+        mapTx.modify(mapTx.find(ancestor), update_descendant_state(newit->GetTxSize(), newit->GetModifiedFee(), 1));
+    }
+
+    // The in-pool descendants of the new transaction are descendants of it
+    // and of the ancestors they now reach through it
+    for (const std::pair<const CTransaction*, std::set<uint256> >& descendant : vDescendants) {
+        indexed_transaction_set::const_iterator itDescendant = mapTx.find(descendant.first->GetHash());
+        std::set<uint256> setNewAncestors;
+        CalculateMemPoolAncestors(*descendant.first, setNewAncestors);
+        for (const uint256& ancestor : setNewAncestors) {
+            if (!descendant.second.count(ancestor)) {
+                mapTx.modify(mapTx.find(ancestor), update_descendant_state(itDescendant->GetTxSize(), itDescendant->GetModifiedFee(), 1));
+            }
+        }
+    }
+
+    const CTransaction& tx = newit->GetTx();
     mapRecentlyAddedTx[tx.GetHash()] = &tx;
     nRecentlyAddedSequence += 1;
     if (!tx.IsCoinImport()) {
@@ -146,6 +220,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     totalTxSize += entry.GetTxSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
+    UpdateMetrics();
 
     return true;
 }
@@ -337,6 +412,47 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
     return true;
 }
 
+void CTxMemPool::addAssetOrderIndex(const uint256 &txhash, const std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &orders)
+{
+    LOCK(cs);
+    std::vector<CAssetOrderKey> inserted;
+
+    for (std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> >::const_iterator it = orders.begin(); it != orders.end(); it++) {
+        mapAssetOrders.insert(*it);
+        inserted.push_back(it->first);
+    }
+    if (!inserted.empty())
+        mapAssetOrdersInserted.insert(make_pair(txhash, inserted));
+}
+
+void CTxMemPool::getAssetOrders(const uint256 &tokenid, unsigned char side,
+                                std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &results)
+{
+    LOCK(cs);
+    mapAssetOrderIndex::iterator it = tokenid.IsNull() ? mapAssetOrders.begin() : mapAssetOrders.lower_bound(CAssetOrderKey(tokenid, side, 0, uint256(), 0));
+    for (; it != mapAssetOrders.end(); it++) {
+        if (!tokenid.IsNull() && (it->first.tokenid != tokenid || (side != 0 && it->first.side != side)))
+            break;
+        results.push_back(*it);
+    }
+}
+
+bool CTxMemPool::removeAssetOrderIndex(const uint256 txhash)
+{
+    LOCK(cs);
+    mapAssetOrderIndexInserted::iterator it = mapAssetOrdersInserted.find(txhash);
+
+    if (it != mapAssetOrdersInserted.end()) {
+        std::vector<CAssetOrderKey> keys = (*it).second;
+        for (std::vector<CAssetOrderKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
+            mapAssetOrders.erase(*mit);
+        }
+        mapAssetOrdersInserted.erase(it);
+    }
+
+    return true;
+}
+
 void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
@@ -356,21 +472,40 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
                 txToRemove.push_back(it->second.ptx->GetHash());
             }
         }
+
+        // Collect the whole set first, so the descendant state of the
+        // ancestors that stay can be corrected while the links still exist
+        std::vector<uint256> vRemove;
+        std::set<uint256> setRemove;
         while (!txToRemove.empty())
         {
             uint256 hash = txToRemove.front();
             txToRemove.pop_front();
-            if (!mapTx.count(hash))
+            if (!mapTx.count(hash) || !setRemove.insert(hash).second)
                 continue;
-            const CTransaction& tx = mapTx.find(hash)->GetTx();
+            vRemove.push_back(hash);
             if (fRecursive) {
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
-                    if (it == mapNextTx.end())
-                        continue;
+                for (std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(COutPoint(hash, 0));
+                     it != mapNextTx.end() && it->first.hash == hash; ++it) {
                     txToRemove.push_back(it->second.ptx->GetHash());
                 }
             }
+        }
+
+        for (const uint256& hash : vRemove) {
+            indexed_transaction_set::iterator it = mapTx.find(hash);
+            std::set<uint256> setAncestors;
+            CalculateMemPoolAncestors(it->GetTx(), setAncestors);
+            for (const uint256& ancestor : setAncestors) {
+                if (!setRemove.count(ancestor)) {
+                    mapTx.modify(mapTx.find(ancestor), update_descendant_state(-(int64_t)it->GetTxSize(), -it->GetModifiedFee(), -1));
+                }
+            }
+        }
+
+        for (const uint256& hash : vRemove)
+        {
+            const CTransaction& tx = mapTx.find(hash)->GetTx();
             mapRecentlyAddedTx.erase(hash);
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
@@ -394,6 +529,26 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             minerPolicyEstimator->removeTx(hash);
             removeAddressIndex(hash);
             removeSpentIndex(hash);
+            removeAssetOrderIndex(hash);
+        }
+        UpdateMetrics();
+    }
+}
+
+void CTxMemPool::CalculateMemPoolAncestors(const CTransaction &tx, std::set<uint256> &setAncestors) const
+{
+    AssertLockHeld(cs);
+    std::vector<const CTransaction*> vToVisit(1, &tx);
+    while (!vToVisit.empty()) {
+        const CTransaction* ptx = vToVisit.back();
+        vToVisit.pop_back();
+        if (ptx->IsCoinImport())
+            continue;
+        for (const CTxIn& txin : ptx->vin) {
+            indexed_transaction_set::const_iterator it = mapTx.find(txin.prevout.hash);
+            if (it != mapTx.end() && setAncestors.insert(txin.prevout.hash).second) {
+                vToVisit.push_back(&it->GetTx());
+            }
         }
     }
 }
@@ -587,6 +742,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     }
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 /**
@@ -616,9 +773,23 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapAssetOrders.clear();
+    mapAssetOrdersInserted.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    UpdateMetrics();
+}
+
+void CTxMemPool::UpdateMetrics() const
+{
+    AssertLockHeld(cs);
+    MetricsGauge("elosys.mempool.transactions", mapTx.size());
+    MetricsGauge("elosys.mempool.bytes", totalTxSize);
+    MetricsGauge("elosys.mempool.usage.bytes", cachedInnerUsage);
 }
 
 void CTxMemPool::check(const CCoinsViewCache *pcoins) const
@@ -865,6 +1036,16 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount> &deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        indexed_transaction_set::iterator it = mapTx.find(hash);
+        if (it != mapTx.end()) {
+            mapTx.modify(it, update_fee_delta(deltas.second));
+            // Now update all ancestors' modified fees with descendants
+            std::set<uint256> setAncestors;
+            CalculateMemPoolAncestors(it->GetTx(), setAncestors);
+            for (const uint256& ancestor : setAncestors) {
+                mapTx.modify(mapTx.find(ancestor), update_descendant_state(0, nFeeDelta, 0));
+            }
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -993,6 +1174,94 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 6 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 6 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
+    // Estimate the overhead of mapTx to be 12 pointers (3 per ordered index) + an allocation, as no exact formula for boost::multi_index_contained is implemented.
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(rollingMinimumFeeRate);
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < sizelimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < (double)minReasonableRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(rollingMinimumFeeRate), minReasonableRelayFee);
+}
+
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvRemoved)
+{
+    LOCK(cs);
+
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+
+        // Raise the mempool min fee to the fee rate of the evicted package plus
+        // the relay fee, so a package paying the same rate can't immediately
+        // take its place again before a block makes room.
+        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        removed = CFeeRate(removed.GetFeePerK() + minReasonableRelayFee.GetFeePerK());
+        trackPackageRemoved(removed);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        CTransaction tx = it->GetTx();
+        std::list<CTransaction> removedTxs;
+        remove(tx, removedTxs, true);
+        nTxnRemoved += removedTxs.size();
+        if (pvRemoved) {
+            for (const CTransaction& removedTx : removedTxs)
+                pvRemoved->push_back(removedTx.GetHash());
+        }
+    }
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+}
+
+int CTxMemPool::Expire(int64_t time, std::vector<uint256>* pvRemoved)
+{
+    LOCK(cs);
+    std::vector<CTransaction> vExpired;
+    indexed_transaction_set::index<entry_time>::type::iterator it = mapTx.get<entry_time>().begin();
+    while (it != mapTx.get<entry_time>().end() && it->GetTime() < time) {
+        vExpired.push_back(it->GetTx());
+        it++;
+    }
+
+    int nRemoved = 0;
+    for (const CTransaction& tx : vExpired) {
+        std::list<CTransaction> removed;
+        remove(tx, removed, true);
+        nRemoved += removed.size();
+        if (pvRemoved) {
+            for (const CTransaction& removedTx : removed)
+                pvRemoved->push_back(removedTx.GetHash());
+        }
+    }
+    return nRemoved;
 }
@@ -25,6 +25,7 @@
 
 #include "addressindex.h"
 #include "spentindex.h"
+#include "assetorderindex.h"
 #include "amount.h"
 #include "coins.h"
 #include "primitives/transaction.h"
@@ -33,6 +34,7 @@
 #undef foreach
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
+#include "boost/multi_index/tag.hpp"
 
 class CAutoFile;
 
@@ -51,6 +53,9 @@ inline bool AllowFree(double dPriority)
 /** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Half-life, in seconds, of the rolling minimum fee once the mempool stops evicting */
+static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+
 /**
  * CTxMemPool stores these:
  */
@@ -69,6 +74,14 @@ private:
     bool hadNoDependencies; //! Not dependent on any other txs when it entered the mempool
     bool spendsCoinbase; //! keep track of transactions that spend a coinbase
     uint32_t nBranchId; //! Branch ID this transaction is known to commit to, cached for efficiency
+    CAmount feeDelta; //! Fee delta set by prioritisetransaction
+
+    // Information about descendants of this transaction that are in the
+    // mempool; if we remove this transaction we must remove all of these
+    // descendants as well.
+    uint64_t nCountWithDescendants; //! number of descendant transactions, including this one
+    uint64_t nSizeWithDescendants;  //! ... and size
+    CAmount nModFeesWithDescendants;  //! ... and total modified fees
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
@@ -89,6 +102,40 @@ public:
 
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
     uint32_t GetValidatedBranchId() const { return nBranchId; }
+
+    CAmount GetModifiedFee() const { return nFee + feeDelta; }
+    void UpdateFeeDelta(CAmount newFeeDelta);
+    // Adjusts the descendant state, if this entry is not dirty.
+    void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+};
+
+struct update_descendant_state
+{
+    update_descendant_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) :
+        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount)
+    {}
+
+    void operator() (CTxMemPoolEntry &e)
+        { e.UpdateDescendantState(modifySize, modifyFee, modifyCount); }
+
+    private:
+        int64_t modifySize;
+        CAmount modifyFee;
+        int64_t modifyCount;
+};
+
+struct update_fee_delta
+{
+    update_fee_delta(CAmount _feeDelta) : feeDelta(_feeDelta) { }
+
+    void operator() (CTxMemPoolEntry &e) { e.UpdateFeeDelta(feeDelta); }
+
+private:
+    CAmount feeDelta;
 };
 
 // extracts a TxMemPoolEntry's transaction hash
@@ -104,7 +151,7 @@ struct mempoolentry_txid
 class CompareTxMemPoolEntryByFee
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         if (a.GetFeeRate() == b.GetFeeRate())
             return a.GetTime() < b.GetTime();
@@ -112,6 +159,58 @@ public:
     }
 };
 
+/**
+ * Sort an entry by max(fee rate of the entry's tx, fee rate with all
+ * descendants), lowest first. The entry at the front is the cheapest package
+ * to evict: a low fee parent is protected by a high fee child that pays for it.
+ */
+class CompareTxMemPoolEntryByDescendantScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        bool fUseADescendants = UseDescendantScore(a);
+        bool fUseBDescendants = UseDescendantScore(b);
+
+        double aModFee = fUseADescendants ? a.GetModFeesWithDescendants() : a.GetModifiedFee();
+        double aSize = fUseADescendants ? a.GetSizeWithDescendants() : a.GetTxSize();
+
+        double bModFee = fUseBDescendants ? b.GetModFeesWithDescendants() : b.GetModifiedFee();
+        double bSize = fUseBDescendants ? b.GetSizeWithDescendants() : b.GetTxSize();
+
+        // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+        double f1 = aModFee * bSize;
+        double f2 = aSize * bModFee;
+
+        if (f1 == f2) {
+            // Evict the newer transaction first
+            return a.GetTime() > b.GetTime();
+        }
+        return f1 < f2;
+    }
+
+    // Calculate which score to use for an entry (avoiding division).
+    bool UseDescendantScore(const CTxMemPoolEntry &a) const
+    {
+        double f1 = (double)a.GetModifiedFee() * a.GetSizeWithDescendants();
+        double f2 = (double)a.GetModFeesWithDescendants() * a.GetTxSize();
+        return f2 > f1;
+    }
+};
+
+class CompareTxMemPoolEntryByEntryTime
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        return a.GetTime() < b.GetTime();
+    }
+};
+
+// Multi_index tags for the mempool orderings used by eviction
+struct descendant_score {};
+struct entry_time {};
+
 class CBlockPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
@@ -148,6 +247,12 @@ private:
     uint64_t totalTxSize = 0; //! sum of all mempool tx' byte sizes
     uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    CFeeRate minReasonableRelayFee;
+
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
+
     std::map<uint256, const CTransaction*> mapRecentlyAddedTx;
     uint64_t nRecentlyAddedSequence = 0;
     uint64_t nNotifiedSequence = 0;
@@ -159,6 +264,8 @@ private:
 
     void checkNullifiers(ShieldedType type) const;
     void checkZkProofHash(ProofType type) const;
+    /** Publish the size of the pool to the metrics recorder */
+    void UpdateMetrics() const;
 
 public:
     typedef boost::multi_index_container<
@@ -170,6 +277,18 @@ public:
             boost::multi_index::ordered_non_unique<
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByFee
+            >,
+            // sorted by package fee rate, cheapest first, used by TrimToSize
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<descendant_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByDescendantScore
+            >,
+            // sorted by entry time, used by Expire
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<entry_time>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByEntryTime
             >
         >
     > indexed_transaction_set;
@@ -190,6 +309,16 @@ private:
     typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
+    typedef std::map<CAssetOrderKey, CAssetOrderValue> mapAssetOrderIndex;
+    mapAssetOrderIndex mapAssetOrders;
+
+    typedef std::map<uint256, std::vector<CAssetOrderKey> > mapAssetOrderIndexInserted;
+    mapAssetOrderIndexInserted mapAssetOrdersInserted;
+
+    /** In-mempool ancestors of tx, found by walking its inputs through mapTx */
+    void CalculateMemPoolAncestors(const CTransaction &tx, std::set<uint256> &setAncestors) const;
+    void trackPackageRemoved(const CFeeRate& rate);
+
 public:
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
@@ -215,6 +344,13 @@ public:
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool removeSpentIndex(const uint256 txhash);
+
+    /** Orders opened by a mempool transaction, as decoded by GetAssetOrderOutputs */
+    void addAssetOrderIndex(const uint256 &txhash, const std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &orders);
+    /** Mempool orders of one side of a token's book in key order, or of all tokens when tokenid is null */
+    void getAssetOrders(const uint256 &tokenid, unsigned char side,
+                        std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > &results);
+    bool removeAssetOrderIndex(const uint256 txhash);
     void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeWithAnchor(const uint256 &invalidRoot, ShieldedType type);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
@@ -223,6 +359,23 @@ public:
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void removeWithoutBranchId(uint32_t nMemPoolBranchId);
+
+    /**
+     * Remove transactions, with their descendants, from the mempool until its
+     * dynamic size is <= sizelimit, cheapest package first. The rolling
+     * minimum fee returned by GetMinFee is raised to the evicted fee rate.
+     */
+    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvRemoved = NULL);
+
+    /** Remove transactions (and their descendants) that entered the mempool before time. Returns the number removed. */
+    int Expire(int64_t time, std::vector<uint256>* pvRemoved = NULL);
+
+    /**
+     * The minimum fee to get into the mempool, which may itself not be enough
+     * for larger-sized transactions. It decays back to the relay fee with a
+     * half-life of ROLLING_FEE_HALFLIFE once blocks make room again.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
     void pruneSpent(const uint256& hash, CCoins &coins);
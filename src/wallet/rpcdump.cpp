@@ -89,6 +89,17 @@ std::string DecodeDumpString(const std::string &str) {
     return ret.str();
 }
 
+/**
+ * Rescan the chain from pindexStart for an import. Called without cs_main and
+ * cs_wallet held, the rescan takes them per batch of blocks so block
+ * connection is not stalled for the whole rescan.
+ */
+static void RescanWallet(CBlockIndex* pindexStart)
+{
+    if (pwalletMain->ScanForWalletTransactions(pindexStart, true, true, true, true) < 0)
+        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan aborted, a block could not be read from disk");
+}
+
 UniValue convertpassphrase(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() < 1 || params.size() > 1)
@@ -183,64 +194,70 @@ UniValue importprivkey(const UniValue& params, bool fHelp, const CPubKey& mypk)
             + HelpExampleRpc("importprivkey", "\"mykey\", \"testing\", true, 1000")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CBlockIndex* pindexRescan = NULL;
+    CKeyID vchAddress;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    EnsureWalletIsUnlocked();
+        EnsureWalletIsUnlocked();
 
-    string strSecret = params[0].get_str();
-    string strLabel = "";
-    int32_t height = 0;
-    uint8_t secret_key = 0;
-    CKey key;
-    if (params.size() > 1)
-        strLabel = params[1].get_str();
+        string strSecret = params[0].get_str();
+        string strLabel = "";
+        int32_t height = 0;
+        uint8_t secret_key = 0;
+        CKey key;
+        if (params.size() > 1)
+            strLabel = params[1].get_str();
 
-    // Whether to perform rescan after import
-    bool fRescan = true;
-    if (params.size() > 2)
-        fRescan = params[2].get_bool();
-    if ( fRescan && params.size() == 4 )
-        height = params[3].get_int();
+        // Whether to perform rescan after import
+        bool fRescan = true;
+        if (params.size() > 2)
+            fRescan = params[2].get_bool();
+        if ( fRescan && params.size() == 4 )
+            height = params[3].get_int();
 
 
-    if (params.size() > 4)
-    {
-        auto secret_key = AmountFromValue(params[4])/100000000;
-        key = DecodeCustomSecret(strSecret, secret_key);
-    } else {
-        key = DecodeSecret(strSecret);
-    }
+        if (params.size() > 4)
+        {
+            auto secret_key = AmountFromValue(params[4])/100000000;
+            key = DecodeCustomSecret(strSecret, secret_key);
+        } else {
+            key = DecodeSecret(strSecret);
+        }
 
-    if ( height < 0 || height > chainActive.Height() )
-        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan height is out of range.");
+        if ( height < 0 || height > chainActive.Height() )
+            throw JSONRPCError(RPC_WALLET_ERROR, "Rescan height is out of range.");
 
-    if (!key.IsValid()) throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
+        if (!key.IsValid()) throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
 
-    CPubKey pubkey = key.GetPubKey();
-    assert(key.VerifyPubKey(pubkey));
-    CKeyID vchAddress = pubkey.GetID();
-    {
-        pwalletMain->MarkDirty();
-        pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
+        CPubKey pubkey = key.GetPubKey();
+        assert(key.VerifyPubKey(pubkey));
+        vchAddress = pubkey.GetID();
+        {
+            pwalletMain->MarkDirty();
+            pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
 
-        // Don't throw error in case a key is already there
-        if (pwalletMain->HaveKey(vchAddress)) {
-            return EncodeDestination(vchAddress);
-        }
+            // Don't throw error in case a key is already there
+            if (pwalletMain->HaveKey(vchAddress)) {
+                return EncodeDestination(vchAddress);
+            }
 
-        pwalletMain->mapKeyMetadata[vchAddress].nCreateTime = 1;
+            pwalletMain->mapKeyMetadata[vchAddress].nCreateTime = 1;
 
-        if (!pwalletMain->AddKeyPubKey(key, pubkey))
-            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
+            if (!pwalletMain->AddKeyPubKey(key, pubkey))
+                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
 
-        // whenever a key is imported, we need to scan the whole chain
-        pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+            // whenever a key is imported, we need to scan the whole chain
+            pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
-        if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive[height], true, true, true, true);
+            if (fRescan)
+                pindexRescan = chainActive[height];
         }
     }
 
+    if (pindexRescan)
+        RescanWallet(pindexRescan);
+
     return EncodeDestination(vchAddress);
 }
 
@@ -302,55 +319,60 @@ UniValue importaddress(const UniValue& params, bool fHelp, const CPubKey& mypk)
             + HelpExampleRpc("importaddress", "\"myaddress\", \"testing\", false")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CBlockIndex* pindexRescan = NULL;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    EnsureWalletIsUnlocked();
+        EnsureWalletIsUnlocked();
 
-    CScript script;
+        CScript script;
 
-    CTxDestination dest = DecodeDestination(params[0].get_str());
-    if (IsValidDestination(dest)) {
-        script = GetScriptForDestination(dest);
-    } else if (IsHex(params[0].get_str())) {
-        std::vector<unsigned char> data(ParseHex(params[0].get_str()));
-        script = CScript(data.begin(), data.end());
-    } else {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Komodo address or script");
-    }
+        CTxDestination dest = DecodeDestination(params[0].get_str());
+        if (IsValidDestination(dest)) {
+            script = GetScriptForDestination(dest);
+        } else if (IsHex(params[0].get_str())) {
+            std::vector<unsigned char> data(ParseHex(params[0].get_str()));
+            script = CScript(data.begin(), data.end());
+        } else {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Komodo address or script");
+        }
 
-    string strLabel = "";
-    if (params.size() > 1)
-        strLabel = params[1].get_str();
+        string strLabel = "";
+        if (params.size() > 1)
+            strLabel = params[1].get_str();
 
-    // Whether to perform rescan after import
-    bool fRescan = true;
-    if (params.size() > 2)
-        fRescan = params[2].get_bool();
+        // Whether to perform rescan after import
+        bool fRescan = true;
+        if (params.size() > 2)
+            fRescan = params[2].get_bool();
 
-    {
-        if (::IsMine(*pwalletMain, script) == ISMINE_SPENDABLE)
-            throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
+        {
+            if (::IsMine(*pwalletMain, script) == ISMINE_SPENDABLE)
+                throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
 
-        // add to address book or update label
-        if (IsValidDestination(dest))
-            pwalletMain->SetAddressBook(dest, strLabel, "receive");
+            // add to address book or update label
+            if (IsValidDestination(dest))
+                pwalletMain->SetAddressBook(dest, strLabel, "receive");
 
-        // Don't throw error in case an address is already there
-        if (pwalletMain->HaveWatchOnly(script))
-            return NullUniValue;
+            // Don't throw error in case an address is already there
+            if (pwalletMain->HaveWatchOnly(script))
+                return NullUniValue;
 
-        pwalletMain->MarkDirty();
+            pwalletMain->MarkDirty();
 
-        if (!pwalletMain->AddWatchOnly(script))
-            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
+            if (!pwalletMain->AddWatchOnly(script))
+                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
 
-        if (fRescan)
-        {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true, true, true, true);
-            pwalletMain->ReacceptWalletTransactions();
+            if (fRescan)
+                pindexRescan = chainActive.Genesis();
         }
     }
 
+    if (pindexRescan) {
+        RescanWallet(pindexRescan);
+        pwalletMain->ReacceptWalletTransactions();
+    }
+
     return NullUniValue;
 }
 
@@ -402,204 +424,209 @@ UniValue importwallet(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
 UniValue importwallet_impl(const UniValue& params, bool fHelp, bool fImportZKeys)
 {
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
-    EnsureWalletIsUnlocked();
-
-    ifstream file;
-    file.open(params[0].get_str().c_str(), std::ios::in | std::ios::ate);
-    if (!file.is_open())
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
-
-    int64_t nTimeBegin = chainActive.Tip()->GetBlockTime();
-
+    CBlockIndex* pindexRescan = NULL;
     bool fGood = true;
-    int64_t lineNumber = 0;
-    int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
-    file.seekg(0, file.beg);
-
-    pwalletMain->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
-    while (file.good()) {
-        lineNumber++;
-        pwalletMain->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
-        std::string line;
-        std::getline(file, line);
-        if (line.empty() || line[0] == '#')
-            continue;
-
-        std::vector<std::string> vstr;
-        boost::split(vstr, line, boost::is_any_of(" "));
-        if (vstr.size() < 2)
-            continue;
-
-        // Let's see if the address is a valid Zcash spending key
-        if (fImportZKeys) {
-            auto spendingKey = DecodeSpendingKey(vstr[0]);
-            int64_t nTime = DecodeDumpTime(vstr[1]);
-
-            if (IsValidSpendingKey(spendingKey)) {
-                if (vstr.size() == 7 || vstr.size() == 9) {
-                    std::string addr;
-                    std::string addrName;
-                    if (vstr.size() == 9) {
-                      addr = vstr[6];
-                      addrName = vstr[8];
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        EnsureWalletIsUnlocked();
+
+        ifstream file;
+        file.open(params[0].get_str().c_str(), std::ios::in | std::ios::ate);
+        if (!file.is_open())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
+
+        int64_t nTimeBegin = chainActive.Tip()->GetBlockTime();
+
+        int64_t lineNumber = 0;
+        int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
+        file.seekg(0, file.beg);
+
+        pwalletMain->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
+        while (file.good()) {
+            lineNumber++;
+            pwalletMain->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
+            std::string line;
+            std::getline(file, line);
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::vector<std::string> vstr;
+            boost::split(vstr, line, boost::is_any_of(" "));
+            if (vstr.size() < 2)
+                continue;
+
+            // Let's see if the address is a valid Zcash spending key
+            if (fImportZKeys) {
+                auto spendingKey = DecodeSpendingKey(vstr[0]);
+                int64_t nTime = DecodeDumpTime(vstr[1]);
+
+                if (IsValidSpendingKey(spendingKey)) {
+                    if (vstr.size() == 7 || vstr.size() == 9) {
+                        std::string addr;
+                        std::string addrName;
+                        if (vstr.size() == 9) {
+                          addr = vstr[6];
+                          addrName = vstr[8];
+                        } else {
+                          addr = vstr[4];
+                          addrName = vstr[6];
+                        }
+                        LogPrint("zrpc", "Importing spending key for zaddr %s\n", addr);
+
+                        // Only include hdKeypath and seedFpStr if we have both
+                        boost::optional<std::string> hdKeypath = (vstr.size() > 7) ? boost::optional<std::string>(vstr[2]) : boost::none;
+                        boost::optional<std::string> seedFpStr = (vstr.size() > 7) ? boost::optional<std::string>(vstr[3]) : boost::none;
+                        auto addResult = boost::apply_visitor(
+                            AddSpendingKeyToWallet(pwalletMain, Params().GetConsensus(), nTime, hdKeypath, seedFpStr, true), spendingKey);
+                        if (addResult == KeyAlreadyExists){
+                            LogPrint("zrpc", "Skipping import of zaddr (key already present)\n");
+                        }
+
+                        if (addResult == KeyNotAdded) {
+                            // Something went wrong
+                            fGood = false;
+                        } else {
+                            auto extsk = boost::get<libzcash::SaplingExtendedSpendingKey>(spendingKey);
+                            pwalletMain->SetZAddressBook(extsk.DefaultAddress(), addrName, "", false);
+                        }
+
+                        continue;
                     } else {
-                      addr = vstr[4];
-                      addrName = vstr[6];
-                    }
-                    LogPrint("zrpc", "Importing spending key for zaddr %s\n", addr);
-
-                    // Only include hdKeypath and seedFpStr if we have both
-                    boost::optional<std::string> hdKeypath = (vstr.size() > 7) ? boost::optional<std::string>(vstr[2]) : boost::none;
-                    boost::optional<std::string> seedFpStr = (vstr.size() > 7) ? boost::optional<std::string>(vstr[3]) : boost::none;
-                    auto addResult = boost::apply_visitor(
-                        AddSpendingKeyToWallet(pwalletMain, Params().GetConsensus(), nTime, hdKeypath, seedFpStr, true), spendingKey);
-                    if (addResult == KeyAlreadyExists){
-                        LogPrint("zrpc", "Skipping import of zaddr (key already present)\n");
-                    }
-
-                    if (addResult == KeyNotAdded) {
-                        // Something went wrong
                         fGood = false;
-                    } else {
-                        auto extsk = boost::get<libzcash::SaplingExtendedSpendingKey>(spendingKey);
-                        pwalletMain->SetZAddressBook(extsk.DefaultAddress(), addrName, "", false);
+                        LogPrintf("Importing spending key failed - Invalid array size. Looking for 7 or 9, found %i in line %i.\n", vstr.size(), lineNumber);
                     }
-
-                    continue;
-                } else {
-                    fGood = false;
-                    LogPrintf("Importing spending key failed - Invalid array size. Looking for 7 or 9, found %i in line %i.\n", vstr.size(), lineNumber);
-                }
-          }
-
-            auto viewingKey = DecodeViewingKey(vstr[0]);
-            if (IsValidViewingKey(viewingKey)) {
-                if (vstr.size() == 7) {
-                    std::string addr = vstr[4];
-                    std::string addrName = vstr[6];
-                    LogPrint("zrpc", "Importing viewing key for zaddr %s\n", addr);
-                    auto addResult = boost::apply_visitor(AddViewingKeyToWallet(pwalletMain), viewingKey);
-                    if (addResult == SpendingKeyExists) {
-                        LogPrint("zrpc", "Skipping import of zaddr (spending key already present)\n");
-                    } else if (addResult == KeyAlreadyExists) {
-                        LogPrint("zrpc", "Skipping import of zaddr (viewing key already present)\n");
-                    }
-
-                    if (addResult == KeyNotAdded) {
-                        // Something went wrong
-                        fGood = false;
+              }
+
+                auto viewingKey = DecodeViewingKey(vstr[0]);
+                if (IsValidViewingKey(viewingKey)) {
+                    if (vstr.size() == 7) {
+                        std::string addr = vstr[4];
+                        std::string addrName = vstr[6];
+                        LogPrint("zrpc", "Importing viewing key for zaddr %s\n", addr);
+                        auto addResult = boost::apply_visitor(AddViewingKeyToWallet(pwalletMain), viewingKey);
+                        if (addResult == SpendingKeyExists) {
+                            LogPrint("zrpc", "Skipping import of zaddr (spending key already present)\n");
+                        } else if (addResult == KeyAlreadyExists) {
+                            LogPrint("zrpc", "Skipping import of zaddr (viewing key already present)\n");
+                        }
+
+                        if (addResult == KeyNotAdded) {
+                            // Something went wrong
+                            fGood = false;
+                        } else {
+                            auto extfvk = boost::get<libzcash::SaplingExtendedFullViewingKey>(viewingKey);
+                            pwalletMain->SetZAddressBook(extfvk.DefaultAddress(), addrName, "", false);
+                        }
+
+                        continue;
                     } else {
-                        auto extfvk = boost::get<libzcash::SaplingExtendedFullViewingKey>(viewingKey);
-                        pwalletMain->SetZAddressBook(extfvk.DefaultAddress(), addrName, "", false);
+                        fGood = false;
+                        LogPrintf("Importing spending key failed - Invalid array size. Looking for 7, found %i in line %i.\n", vstr.size(), lineNumber);;
                     }
-
-                    continue;
-                } else {
-                    fGood = false;
-                    LogPrintf("Importing spending key failed - Invalid array size. Looking for 7, found %i in line %i.\n", vstr.size(), lineNumber);;
                 }
-            }
 
-            auto diversifiedSpendingKey = DecodeDiversifiedSpendingKey(vstr[0]);
-            if (IsValidDiversifiedSpendingKey(diversifiedSpendingKey)) {
-                if (vstr.size() == 7) {
-                    std::string addr = vstr[4];
-                    std::string addrName = vstr[6];
-                    LogPrint("zrpc", "Importing diversified spending key for zaddr %s\n", addr);
-                    auto addResult = boost::apply_visitor(AddDiversifiedSpendingKeyToWallet(pwalletMain), diversifiedSpendingKey);
-                    if (addResult == KeyNotAdded || addResult == KeyAddedAddressNotAdded || addResult == KeyExistsAddressNotAdded) {
-                        // Something went wrong
-                        fGood = false;
+                auto diversifiedSpendingKey = DecodeDiversifiedSpendingKey(vstr[0]);
+                if (IsValidDiversifiedSpendingKey(diversifiedSpendingKey)) {
+                    if (vstr.size() == 7) {
+                        std::string addr = vstr[4];
+                        std::string addrName = vstr[6];
+                        LogPrint("zrpc", "Importing diversified spending key for zaddr %s\n", addr);
+                        auto addResult = boost::apply_visitor(AddDiversifiedSpendingKeyToWallet(pwalletMain), diversifiedSpendingKey);
+                        if (addResult == KeyNotAdded || addResult == KeyAddedAddressNotAdded || addResult == KeyExistsAddressNotAdded) {
+                            // Something went wrong
+                            fGood = false;
+                        } else {
+                            auto extdsk = boost::get<libzcash::SaplingDiversifiedExtendedSpendingKey>(diversifiedSpendingKey);
+                            auto pa = extdsk.extsk.ToXFVK().fvk.in_viewing_key().address(extdsk.d).get();
+                            pwalletMain->SetZAddressBook(pa, addrName, "", false);
+                        }
+
+                        continue;
                     } else {
-                        auto extdsk = boost::get<libzcash::SaplingDiversifiedExtendedSpendingKey>(diversifiedSpendingKey);
-                        auto pa = extdsk.extsk.ToXFVK().fvk.in_viewing_key().address(extdsk.d).get();
-                        pwalletMain->SetZAddressBook(pa, addrName, "", false);
+                        fGood = false;
+                        LogPrintf("Importing spending key failed - Invalid array size. Looking for 7, found %i in line %i.\n", vstr.size(), lineNumber);
                     }
-
-                    continue;
-                } else {
-                    fGood = false;
-                    LogPrintf("Importing spending key failed - Invalid array size. Looking for 7, found %i in line %i.\n", vstr.size(), lineNumber);
                 }
-            }
 
-            auto diversifiedViewingKey = DecodeDiversifiedViewingKey(vstr[0]);
-            if (IsValidDiversifiedViewingKey(diversifiedViewingKey)) {
-                if (vstr.size() == 7) {
-                    std::string addr = vstr[4];
-                    std::string addrName = vstr[6];
-                    LogPrint("zrpc", "Importing diversified viewing key for zaddr %s\n", addr);
-                    auto addResult = boost::apply_visitor(AddDiversifiedViewingKeyToWallet(pwalletMain), diversifiedViewingKey);
-                    if (addResult == KeyNotAdded || addResult == KeyAddedAddressNotAdded || addResult == KeyExistsAddressNotAdded) {
-                        // Something went wrong
-                        fGood = false;
+                auto diversifiedViewingKey = DecodeDiversifiedViewingKey(vstr[0]);
+                if (IsValidDiversifiedViewingKey(diversifiedViewingKey)) {
+                    if (vstr.size() == 7) {
+                        std::string addr = vstr[4];
+                        std::string addrName = vstr[6];
+                        LogPrint("zrpc", "Importing diversified viewing key for zaddr %s\n", addr);
+                        auto addResult = boost::apply_visitor(AddDiversifiedViewingKeyToWallet(pwalletMain), diversifiedViewingKey);
+                        if (addResult == KeyNotAdded || addResult == KeyAddedAddressNotAdded || addResult == KeyExistsAddressNotAdded) {
+                            // Something went wrong
+                            fGood = false;
+                        } else {
+                            auto extdfvk = boost::get<libzcash::SaplingDiversifiedExtendedFullViewingKey>(diversifiedViewingKey);
+                            auto pa = extdfvk.extfvk.fvk.in_viewing_key().address(extdfvk.d).get();
+                            pwalletMain->SetZAddressBook(pa, addrName, "", false);
+                        }
+
+                        continue;
                     } else {
-                        auto extdfvk = boost::get<libzcash::SaplingDiversifiedExtendedFullViewingKey>(diversifiedViewingKey);
-                        auto pa = extdfvk.extfvk.fvk.in_viewing_key().address(extdfvk.d).get();
-                        pwalletMain->SetZAddressBook(pa, addrName, "", false);
+                        fGood = false;
+                        LogPrintf("Importing spending key failed - Invalid array size. Looking for 7, found %i in line %i.\n", vstr.size(), lineNumber);
                     }
-
-                    continue;
-                } else {
-                    fGood = false;
-                    LogPrintf("Importing spending key failed - Invalid array size. Looking for 7, found %i in line %i.\n", vstr.size(), lineNumber);
                 }
-            }
 
-            // Not a valid key, so carry on and see if it's a Zcash style t-address.
-            LogPrint("zrpc", "Importing detected an error: invalid sapling key. Trying as a transparent key...\n");
+                // Not a valid key, so carry on and see if it's a Zcash style t-address.
+                LogPrint("zrpc", "Importing detected an error: invalid sapling key. Trying as a transparent key...\n");
 
-        }
+            }
 
-        CKey key = DecodeSecret(vstr[0]);
-        if (!key.IsValid())
-            continue;
-        CPubKey pubkey = key.GetPubKey();
-        assert(key.VerifyPubKey(pubkey));
-        CKeyID keyid = pubkey.GetID();
-        if (pwalletMain->HaveKey(keyid)) {
-            LogPrintf("Skipping import of %s (key already present)\n", EncodeDestination(keyid));
-            continue;
-        }
-        int64_t nTime = DecodeDumpTime(vstr[1]);
-        std::string strLabel;
-        bool fLabel = true;
-        for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
-            if (boost::algorithm::starts_with(vstr[nStr], "#"))
-                break;
-            if (vstr[nStr] == "change=1")
-                fLabel = false;
-            if (vstr[nStr] == "reserve=1")
-                fLabel = false;
-            if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
-                strLabel = DecodeDumpString(vstr[nStr].substr(6));
-                fLabel = true;
+            CKey key = DecodeSecret(vstr[0]);
+            if (!key.IsValid())
+                continue;
+            CPubKey pubkey = key.GetPubKey();
+            assert(key.VerifyPubKey(pubkey));
+            CKeyID keyid = pubkey.GetID();
+            if (pwalletMain->HaveKey(keyid)) {
+                LogPrintf("Skipping import of %s (key already present)\n", EncodeDestination(keyid));
+                continue;
             }
+            int64_t nTime = DecodeDumpTime(vstr[1]);
+            std::string strLabel;
+            bool fLabel = true;
+            for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
+                if (boost::algorithm::starts_with(vstr[nStr], "#"))
+                    break;
+                if (vstr[nStr] == "change=1")
+                    fLabel = false;
+                if (vstr[nStr] == "reserve=1")
+                    fLabel = false;
+                if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
+                    strLabel = DecodeDumpString(vstr[nStr].substr(6));
+                    fLabel = true;
+                }
+            }
+            LogPrintf("Importing %s...\n", EncodeDestination(keyid));
+            if (!pwalletMain->AddKeyPubKey(key, pubkey)) {
+                fGood = false;
+                continue;
+            }
+            pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTime;
+            if (fLabel)
+                pwalletMain->SetAddressBook(keyid, strLabel, "receive");
+            nTimeBegin = std::min(nTimeBegin, nTime);
         }
-        LogPrintf("Importing %s...\n", EncodeDestination(keyid));
-        if (!pwalletMain->AddKeyPubKey(key, pubkey)) {
-            fGood = false;
-            continue;
-        }
-        pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTime;
-        if (fLabel)
-            pwalletMain->SetAddressBook(keyid, strLabel, "receive");
-        nTimeBegin = std::min(nTimeBegin, nTime);
-    }
-    file.close();
-    pwalletMain->ShowProgress("", 100); // hide progress dialog in GUI
+        file.close();
+        pwalletMain->ShowProgress("", 100); // hide progress dialog in GUI
+
+        CBlockIndex *pindex = chainActive.Tip();
+        while (pindex && pindex->pprev && pindex->GetBlockTime() > nTimeBegin - 7200)
+            pindex = pindex->pprev;
 
-    CBlockIndex *pindex = chainActive.Tip();
-    while (pindex && pindex->pprev && pindex->GetBlockTime() > nTimeBegin - 7200)
-        pindex = pindex->pprev;
+        if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
+            pwalletMain->nTimeFirstKey = nTimeBegin;
 
-    if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
-        pwalletMain->nTimeFirstKey = nTimeBegin;
+        LogPrintf("Rescanning last %i blocks\n", chainActive.Genesis() - pindex->nHeight + 1);
+        pindexRescan = chainActive.Genesis();
+    }
 
-    LogPrintf("Rescanning last %i blocks\n", chainActive.Genesis() - pindex->nHeight + 1);
-    pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true, true, true, true);
+    RescanWallet(pindexRescan);
     pwalletMain->MarkDirty();
 
     if (!fGood)
@@ -905,11 +932,16 @@ UniValue rescan(const UniValue& params, bool fHelp, const CPubKey& mypk)
             + HelpExampleRpc("rescan", "")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CBlockIndex* pindexRescan = NULL;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    EnsureWalletIsUnlocked();
+        EnsureWalletIsUnlocked();
+
+        pindexRescan = chainActive[0];
+    }
 
-    pwalletMain->ScanForWalletTransactions(chainActive[0], true, true, true, true);
+    RescanWallet(pindexRescan);
 
     return NullUniValue;
 }
@@ -941,77 +973,82 @@ UniValue z_importkey(const UniValue& params, bool fHelp, const CPubKey& mypk)
             + HelpExampleRpc("z_importkey", "\"mykey\", \"no\"")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
-    EnsureWalletIsUnlocked();
-
-    // Whether to perform rescan after import
-    bool fRescan = true;
-    bool fIgnoreExistingKey = true;
-    if (params.size() > 1) {
-        auto rescan = params[1].get_str();
-        if (rescan.compare("whenkeyisnew") != 0) {
-            fIgnoreExistingKey = false;
-            if (rescan.compare("yes") == 0) {
-                fRescan = true;
-            } else if (rescan.compare("no") == 0) {
-                fRescan = false;
-            } else {
-                // Handle older API
-                UniValue jVal;
-                if (!jVal.read(std::string("[")+rescan+std::string("]")) ||
-                    !jVal.isArray() || jVal.size()!=1 || !jVal[0].isBool()) {
-                    throw JSONRPCError(
-                        RPC_INVALID_PARAMETER,
-                        "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
+    CBlockIndex* pindexRescan = NULL;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        EnsureWalletIsUnlocked();
+
+        // Whether to perform rescan after import
+        bool fRescan = true;
+        bool fIgnoreExistingKey = true;
+        if (params.size() > 1) {
+            auto rescan = params[1].get_str();
+            if (rescan.compare("whenkeyisnew") != 0) {
+                fIgnoreExistingKey = false;
+                if (rescan.compare("yes") == 0) {
+                    fRescan = true;
+                } else if (rescan.compare("no") == 0) {
+                    fRescan = false;
+                } else {
+                    // Handle older API
+                    UniValue jVal;
+                    if (!jVal.read(std::string("[")+rescan+std::string("]")) ||
+                        !jVal.isArray() || jVal.size()!=1 || !jVal[0].isBool()) {
+                        throw JSONRPCError(
+                            RPC_INVALID_PARAMETER,
+                            "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
+                    }
+                    fRescan = jVal[0].getBool();
                 }
-                fRescan = jVal[0].getBool();
             }
         }
-    }
 
-    // Height to rescan from
-    int nRescanHeight = 0;
-    if (params.size() > 2)
-        nRescanHeight = params[2].get_int();
-    if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
-    }
+        // Height to rescan from
+        int nRescanHeight = 0;
+        if (params.size() > 2)
+            nRescanHeight = params[2].get_int();
+        if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        }
 
-    string strSecret = params[0].get_str();
-    auto spendingkey = DecodeSpendingKey(strSecret);
-    if (!IsValidSpendingKey(spendingkey)) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid spending key");
-    }
+        string strSecret = params[0].get_str();
+        auto spendingkey = DecodeSpendingKey(strSecret);
+        if (!IsValidSpendingKey(spendingkey)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid spending key");
+        }
 
-    //Prevent Sprout key from being added to the wallet
-    if (boost::get<libzcash::SproutSpendingKey>(&spendingkey) != nullptr) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid spending key, Sprout not supported");
-    }
+        //Prevent Sprout key from being added to the wallet
+        if (boost::get<libzcash::SproutSpendingKey>(&spendingkey) != nullptr) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid spending key, Sprout not supported");
+        }
 
-    // Sapling support
-    auto addResult = boost::apply_visitor(AddSpendingKeyToWallet(pwalletMain, Params().GetConsensus()), spendingkey);
-    if (addResult == KeyAlreadyExists && fIgnoreExistingKey) {
-        return NullUniValue;
-    }
+        // Sapling support
+        auto addResult = boost::apply_visitor(AddSpendingKeyToWallet(pwalletMain, Params().GetConsensus()), spendingkey);
+        if (addResult == KeyAlreadyExists && fIgnoreExistingKey) {
+            return NullUniValue;
+        }
 
-    pwalletMain->MarkDirty();
-    if (addResult == KeyNotAdded) {
-        throw JSONRPCError(RPC_WALLET_ERROR, "Error adding spending key to wallet");
-    }
+        pwalletMain->MarkDirty();
+        if (addResult == KeyNotAdded) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding spending key to wallet");
+        }
 
-    //Add to ZAddress book
-    auto zInfo = boost::apply_visitor(libzcash::AddressInfoFromSpendingKey{}, spendingkey);
-    pwalletMain->SetZAddressBook(zInfo.second, zInfo.first, "");
+        //Add to ZAddress book
+        auto zInfo = boost::apply_visitor(libzcash::AddressInfoFromSpendingKey{}, spendingkey);
+        pwalletMain->SetZAddressBook(zInfo.second, zInfo.first, "");
 
-    // whenever a key is imported, we need to scan the whole chain
-    pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+        // whenever a key is imported, we need to scan the whole chain
+        pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
-    // We want to scan for transactions and notes
-    if (fRescan) {
-        pwalletMain->ScanForWalletTransactions(chainActive[nRescanHeight], true, true, true, true);
+        // We want to scan for transactions and notes
+        if (fRescan)
+            pindexRescan = chainActive[nRescanHeight];
     }
 
+    if (pindexRescan)
+        RescanWallet(pindexRescan);
+
     return NullUniValue;
 }
 
@@ -1047,76 +1084,81 @@ UniValue z_importviewingkey(const UniValue& params, bool fHelp, const CPubKey& m
           + HelpExampleRpc("z_importviewingkey", "\"vkey\", \"no\"")
       );
 
-  LOCK2(cs_main, pwalletMain->cs_wallet);
-
-  EnsureWalletIsUnlocked();
-
-  // Whether to perform rescan after import
-  bool fRescan = true;
-  bool fIgnoreExistingKey = true;
-  if (params.size() > 1) {
-      auto rescan = params[1].get_str();
-      if (rescan.compare("whenkeyisnew") != 0) {
-          fIgnoreExistingKey = false;
-          if (rescan.compare("no") == 0) {
-              fRescan = false;
-          } else if (rescan.compare("yes") != 0) {
-              throw JSONRPCError(
-                  RPC_INVALID_PARAMETER,
-                  "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
-          }
-      }
-  }
+  CBlockIndex* pindexRescan = NULL;
+  UniValue result(UniValue::VOBJ);
+  {
+    LOCK2(cs_main, pwalletMain->cs_wallet);
 
-  // Height to rescan from
-  int nRescanHeight = 0;
-  if (params.size() > 2) {
-      nRescanHeight = params[2].get_int();
-  }
-  if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
-      throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
-  }
+    EnsureWalletIsUnlocked();
 
-  string strVKey = params[0].get_str();
-  auto viewingkey = DecodeViewingKey(strVKey);
-  if (!IsValidViewingKey(viewingkey)) {
-      throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid viewing key");
-  }
+    // Whether to perform rescan after import
+    bool fRescan = true;
+    bool fIgnoreExistingKey = true;
+    if (params.size() > 1) {
+        auto rescan = params[1].get_str();
+        if (rescan.compare("whenkeyisnew") != 0) {
+            fIgnoreExistingKey = false;
+            if (rescan.compare("no") == 0) {
+                fRescan = false;
+            } else if (rescan.compare("yes") != 0) {
+                throw JSONRPCError(
+                    RPC_INVALID_PARAMETER,
+                    "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
+            }
+        }
+    }
 
-  auto addrInfo = boost::apply_visitor(libzcash::AddressInfoFromViewingKey{}, viewingkey);
-  UniValue result(UniValue::VOBJ);
-  result.pushKV("type", addrInfo.first);
-  result.pushKV("address", EncodePaymentAddress(addrInfo.second));
+    // Height to rescan from
+    int nRescanHeight = 0;
+    if (params.size() > 2) {
+        nRescanHeight = params[2].get_int();
+    }
+    if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    }
 
-  //Prevent Sprout key from being added to the wallet
-  if (boost::get<libzcash::SproutViewingKey>(&viewingkey) != nullptr) {
-      throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid viewing key, Sprout not supported");
-  }
+    string strVKey = params[0].get_str();
+    auto viewingkey = DecodeViewingKey(strVKey);
+    if (!IsValidViewingKey(viewingkey)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid viewing key");
+    }
 
-  auto addResult = boost::apply_visitor(AddViewingKeyToWallet(pwalletMain), viewingkey);
-  if (addResult == SpendingKeyExists) {
-      throw JSONRPCError(
-          RPC_WALLET_ERROR,
-          "The wallet already contains the private key for this viewing key");
-  } else if (addResult == KeyAlreadyExists && fIgnoreExistingKey) {
-      return result;
-  }
-  pwalletMain->MarkDirty();
-  if (addResult == KeyNotAdded) {
-      throw JSONRPCError(RPC_WALLET_ERROR, "Error adding viewing key to wallet");
-  }
+    auto addrInfo = boost::apply_visitor(libzcash::AddressInfoFromViewingKey{}, viewingkey);
+    result.pushKV("type", addrInfo.first);
+    result.pushKV("address", EncodePaymentAddress(addrInfo.second));
 
-  //Add to ZAddress book
-  pwalletMain->SetZAddressBook(addrInfo.second, addrInfo.first, "");
+    //Prevent Sprout key from being added to the wallet
+    if (boost::get<libzcash::SproutViewingKey>(&viewingkey) != nullptr) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid viewing key, Sprout not supported");
+    }
 
-  // whenever a key is imported, we need to scan the whole chain
-  pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+    auto addResult = boost::apply_visitor(AddViewingKeyToWallet(pwalletMain), viewingkey);
+    if (addResult == SpendingKeyExists) {
+        throw JSONRPCError(
+            RPC_WALLET_ERROR,
+            "The wallet already contains the private key for this viewing key");
+    } else if (addResult == KeyAlreadyExists && fIgnoreExistingKey) {
+        return result;
+    }
+    pwalletMain->MarkDirty();
+    if (addResult == KeyNotAdded) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error adding viewing key to wallet");
+    }
+
+    //Add to ZAddress book
+    pwalletMain->SetZAddressBook(addrInfo.second, addrInfo.first, "");
 
-  // We want to scan for transactions and notes
-  if (fRescan) {
-      pwalletMain->ScanForWalletTransactions(chainActive[nRescanHeight], true, true, true, true);
+    // whenever a key is imported, we need to scan the whole chain
+    pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+
+    // We want to scan for transactions and notes
+    if (fRescan)
+        pindexRescan = chainActive[nRescanHeight];
   }
 
+  if (pindexRescan)
+      RescanWallet(pindexRescan);
+
   return result;
 }
 
@@ -52,7 +52,7 @@ void getTransparentSpends(RpcTx &tx, vector<TransactionSpendT> &vSpend, CAmount
 
                 //Get Tx from block
                 CBlock block;
-                ReadBlockFromDisk(block, pindex, 1);
+                ReadBlockFromDisk(block, pindex, 1, false);
 
                 //Get Tx
                 for (int j = 0; j < block.vtx.size(); j++) {
@@ -272,7 +272,7 @@ void getSaplingSpends(const Consensus::Params& params, int nHeight, RpcTx &tx, s
 
                 //Get Tx from block
                 CBlock block;
-                ReadBlockFromDisk(block, pindex, 1);
+                ReadBlockFromDisk(block, pindex, 1, false);
 
                 //Get Tx
                 for (int j = 0; j < block.vtx.size(); j++) {
@@ -564,7 +564,7 @@ void getRpcArcTx(uint256 &txid, RpcArcTransaction &arcTx, bool fIncludeWatchonly
 
         //Get Tx from block
         CBlock block;
-        ReadBlockFromDisk(block, pindex, 1);
+        ReadBlockFromDisk(block, pindex, 1, false);
 
         if (nIndex > block.vtx.size() - 1){
             return; //Tx nIndex is invalid;
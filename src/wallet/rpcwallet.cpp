@@ -36,6 +36,9 @@
 #include "walletdb.h"
 #include "primitives/transaction.h"
 #include "zcbenchmarks.h"
+#include "blockfilereader.h"
+#include "netpoller.h"
+#include "threadpool.h"
 #include "script/interpreter.h"
 #include "zcash/address/zip32.h"
 #include "notaries_staked.h"
@@ -3315,6 +3318,30 @@ UniValue fundrawtransaction(const UniValue& params, bool fHelp, const CPubKey& m
     return result;
 }
 
+/**
+ * Run one sample of a zcbenchmark type whose optional third argument is a
+ * positive count of work items, nDefault when it is left out. benchmark runs
+ * the sample for that count and returns a result object, or an array of them,
+ * which is appended to detailed_results.
+ */
+static void RunCountedBenchmark(const UniValue& params, int nDefault, const std::string& strItem,
+                                UniValue& detailed_results, const std::function<UniValue(int)>& benchmark)
+{
+    int nCount = nDefault;
+    if (params.size() >= 3) {
+        nCount = params[2].get_int();
+    }
+    if (nCount <= 0) {
+        throw JSONRPCError(RPC_TYPE_ERROR, "Invalid " + strItem + " count");
+    }
+    UniValue result = benchmark(nCount);
+    if (result.isArray()) {
+        detailed_results.push_backV(result.getValues());
+    } else {
+        detailed_results.push_back(result);
+    }
+}
+
 UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (!EnsureWalletIsAvailable(fHelp)) {
@@ -3350,6 +3377,7 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
     }
 
     std::vector<double> sample_times;
+    UniValue detailed_results(UniValue::VARR);
 
     JSDescription samplejoinsplit;
 
@@ -3387,6 +3415,39 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
 #endif
         } else if (benchmarktype == "verifyequihash") {
             sample_times.push_back(benchmark_verify_equihash());
+        } else if (benchmarktype == "verifyequihash_parallel") {
+            // Number of headers per batch, a full headers message by default
+            RunCountedBenchmark(params, MAX_HEADERS_RESULTS, "header", detailed_results, [](int nHeaders) {
+                double serial, legacy;
+                double parallel = benchmark_verify_equihash_parallel(nHeaders, serial, legacy);
+                UniValue result(UniValue::VOBJ);
+                result.push_back(Pair("runningtime", parallel));
+                result.push_back(Pair("serialtime", serial));
+                result.push_back(Pair("legacytime", legacy));
+                result.push_back(Pair("headers", nHeaders));
+                result.push_back(Pair("threads", GetValidationThreadPool().Size()));
+                result.push_back(Pair("headerspersec", nHeaders / parallel));
+                result.push_back(Pair("serialheaderspersec", nHeaders / serial));
+                return result;
+            });
+        } else if (benchmarktype == "readblocks") {
+            // Number of blocks read per pass, from the tip back or at random heights
+            RunCountedBenchmark(params, 1000, "block", detailed_results, [](int nBlocks) {
+                UniValue result(UniValue::VOBJ);
+                for (bool fRandom : {false, true}) {
+                    std::string strAccess = fRandom ? "random" : "sequential";
+                    double stdio = benchmark_read_blocks(nBlocks, fRandom, 0, true);
+                    double mapped = benchmark_read_blocks(nBlocks, fRandom, DEFAULT_MAPPED_BLOCK_FILES, true);
+                    double trusted = benchmark_read_blocks(nBlocks, fRandom, DEFAULT_MAPPED_BLOCK_FILES, false);
+                    result.push_back(Pair(strAccess + "_stdio_blockspersec", nBlocks / stdio));
+                    result.push_back(Pair(strAccess + "_mmap_blockspersec", nBlocks / mapped));
+                    result.push_back(Pair(strAccess + "_mmap_nohash_blockspersec", nBlocks / trusted));
+                    if (!fRandom)
+                        result.push_back(Pair("runningtime", mapped));
+                }
+                result.push_back(Pair("blocks", nBlocks));
+                return result;
+            });
         } else if (benchmarktype == "validatelargetx") {
             // Number of inputs in the spending transaction that we will simulate
             int nInputs = 11130;
@@ -3426,11 +3487,78 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
             sample_times.push_back(benchmark_verify_sapling_spend());
         } else if (benchmarktype == "verifysaplingoutput") {
             sample_times.push_back(benchmark_verify_sapling_output());
+        } else if (benchmarktype == "verifysaplingbatch") {
+            // Number of spends and of outputs to verify per sample
+            RunCountedBenchmark(params, 64, "proof", detailed_results, [](int nProofs) {
+                double unbatched = benchmark_verify_sapling_batch(nProofs, false);
+                double batched = benchmark_verify_sapling_batch(nProofs, true);
+                UniValue result(UniValue::VOBJ);
+                result.push_back(Pair("runningtime", batched));
+                result.push_back(Pair("unbatchedtime", unbatched));
+                result.push_back(Pair("proofs", 2 * nProofs));
+                result.push_back(Pair("batchedproofspersec", 2 * nProofs / batched));
+                result.push_back(Pair("unbatchedproofspersec", 2 * nProofs / unbatched));
+                return result;
+            });
+        } else if (benchmarktype == "sigcachelookups") {
+            // Number of lookups per thread per sample
+            RunCountedBenchmark(params, 1000000, "lookup", detailed_results, [](int nLookups) {
+                UniValue results(UniValue::VARR);
+                for (int nThreads : {1, 4, 16}) {
+                    double t = benchmark_sigcache_lookups(nThreads, nLookups);
+                    UniValue result(UniValue::VOBJ);
+                    result.push_back(Pair("runningtime", t));
+                    result.push_back(Pair("threads", nThreads));
+                    result.push_back(Pair("lookupspersec", (double)nThreads * nLookups / t));
+                    results.push_back(result);
+                }
+                return results;
+            });
+        } else if (benchmarktype == "taskdispatch") {
+            // Number of rounds of maxProcessingThreads tasks per sample
+            RunCountedBenchmark(params, 1000, "round", detailed_results, [](int nRounds) {
+                double spawned = benchmark_task_dispatch(nRounds, false);
+                double pooled = benchmark_task_dispatch(nRounds, true);
+                double nTasks = (double)nRounds * std::max(maxProcessingThreads, 1);
+                UniValue result(UniValue::VOBJ);
+                result.push_back(Pair("tasks", nTasks));
+                result.push_back(Pair("spawnedusecpertask", 1e6 * spawned / nTasks));
+                result.push_back(Pair("pooledusecpertask", 1e6 * pooled / nTasks));
+                return result;
+            });
+        } else if (benchmarktype == "socketpoller" || benchmarktype == "tlssocketpoller") {
+            bool fTLS = benchmarktype == "tlssocketpoller";
+            // Number of synthetic local peers, select() serves only those below FD_SETSIZE
+            RunCountedBenchmark(params, 2000, "peer", detailed_results, [fTLS](int nPeers) {
+                UniValue results(UniValue::VARR);
+                for (const std::string& strBackend : {std::string("select"), std::string("epoll")}) {
+                    int nServed;
+                    uint64_t nMessages;
+                    double cpuPercent, avgLatencyUs, p99LatencyUs;
+                    double t = benchmark_socket_poller(strBackend, fTLS, nPeers, 10, nServed, nMessages,
+                                                       cpuPercent, avgLatencyUs, p99LatencyUs);
+                    UniValue result(UniValue::VOBJ);
+                    result.push_back(Pair("runningtime", t));
+                    result.push_back(Pair("backend", MakeSocketPoller(strBackend)->GetName()));
+                    result.push_back(Pair("tls", fTLS));
+                    result.push_back(Pair("peers", nServed));
+                    result.push_back(Pair("messages", nMessages));
+                    result.push_back(Pair("cpupercent", cpuPercent));
+                    result.push_back(Pair("avglatencyus", avgLatencyUs));
+                    result.push_back(Pair("p99latencyus", p99LatencyUs));
+                    results.push_back(result);
+                }
+                return results;
+            });
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
     }
 
+    if (!detailed_results.empty()) {
+        return detailed_results;
+    }
+
     UniValue results(UniValue::VARR);
     for (auto time : sample_times) {
         UniValue result(UniValue::VOBJ);
@@ -8435,6 +8563,80 @@ UniValue tokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
 }
 
 
+UniValue tokenorderbook(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    UniValue result(UniValue::VOBJ), orders(UniValue::VARR); uint256 tokenid; unsigned char side; CAssetOrderKey startAfter;
+    int64_t count = 100; bool fMempool = true, fMore = false;
+    struct CCcontract_info *cpAssets, assetsC, *cpTokens, tokensC;
+
+    if ( fHelp || params.size() < 2 || params.size() > 5 )
+        throw runtime_error("tokenorderbook tokenid bid|ask [count] [start] [includemempool]\n"
+                            "returns a page of the open orders of one side of the token's book from the orderbook index (-assetorderindex),\n"
+                            "best price first: bids from the highest price, asks from the lowest\n"
+                            "count is the page size, 100 by default and 1000 at most\n"
+                            "start is the \"next\" cursor of the previous page\n"
+                            "includemempool (default true) adds the orders of mempool transactions and leaves out those they fill or cancel\n");
+    if (ensure_CCrequirements(EVAL_ASSETS) < 0 || ensure_CCrequirements(EVAL_TOKENS) < 0)
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    if ( !fAssetOrderIndex )
+        throw JSONRPCError(RPC_MISC_ERROR, "Orderbook index not enabled, restart with -assetorderindex");
+
+    tokenid = Parseuint256((char *)params[0].get_str().c_str());
+    if ( tokenid == zeroid )
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "incorrect tokenid");
+    if ( params[1].get_str() == "bid" )
+        side = ASSET_ORDER_BID;
+    else if ( params[1].get_str() == "ask" )
+        side = ASSET_ORDER_ASK;
+    else
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "side must be bid or ask");
+    if ( params.size() > 2 )
+    {
+        count = params[2].get_int64();
+        if ( count < 1 || count > 1000 )
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be between 1 and 1000");
+    }
+    if ( params.size() > 3 && !params[3].get_str().empty() )
+    {
+        std::vector<unsigned char> vcursor = ParseHexV(params[3], "start");
+        if ( vcursor.size() != ::GetSerializeSize(startAfter, SER_DISK, CLIENT_VERSION) )
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid start cursor");
+        CDataStream ss(vcursor, SER_DISK, CLIENT_VERSION);
+        ss >> startAfter;
+        if ( startAfter.tokenid != tokenid || startAfter.side != side )
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "start cursor is for another book");
+    }
+    if ( params.size() > 4 )
+        fMempool = params[4].get_bool();
+
+    std::vector<std::pair<CAssetOrderKey, CAssetOrderValue> > book;
+    if ( !GetAssetOrderBook(tokenid, side, startAfter.tokenid.IsNull() ? NULL : &startAfter, fMempool, count, book, fMore) )
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the orderbook index");
+
+    cpAssets = CCinit(&assetsC, EVAL_ASSETS);
+    cpTokens = CCinit(&tokensC, EVAL_TOKENS);
+    for (const std::pair<CAssetOrderKey, CAssetOrderValue> &order : book)
+    {
+        UniValue item = AssetOrderToJSON(cpAssets, cpTokens, order.first.txhash, order.first.index, order.first.tokenid, order.second);
+        // satoshis per token, the sort order of the book
+        item.push_back(Pair("unitprice", (double)order.first.unitPrice / ASSET_ORDER_PRICE_SCALE));
+        item.push_back(Pair("height", order.second.blockHeight));
+        orders.push_back(item);
+    }
+    result.push_back(Pair("tokenid", tokenid.GetHex()));
+    result.push_back(Pair("side", params[1].get_str()));
+    result.push_back(Pair("orders", orders));
+    if ( fMore )
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << book.back().first;
+        result.push_back(Pair("next", HexStr(ss.begin(), ss.end())));
+    }
+    else
+        result.push_back(Pair("next", NullUniValue));
+    return(result);
+}
+
 UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     uint256 tokenid;
@@ -8489,6 +8691,53 @@ UniValue tokenbalance(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return(result);
 }
 
+bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &address);
+
+UniValue tokenutxos(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    UniValue result(UniValue::VARR); uint256 tokenid; CAddressIndexIteratorKey addressKey; bool fAddress = false;
+
+    if ( fHelp || params.size() < 1 || params.size() > 2 )
+        throw runtime_error("tokenutxos tokenid [pubkey]\n"
+                            "returns the confirmed unspent cc outputs of the token from the token index (-tokenindex),\n"
+                            "for every holder or only on the token cc address of pubkey\n"
+                            "the outputs are not validated, tokenbalance only counts the valid ones\n");
+    if ( ensure_CCrequirements(EVAL_TOKENS) < 0 )
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    if ( !fTokenIndex )
+        throw JSONRPCError(RPC_MISC_ERROR, "Token index not enabled, restart with -tokenindex");
+
+    LOCK(cs_main);
+
+    tokenid = Parseuint256((char *)params[0].get_str().c_str());
+    if ( params.size() == 2 )
+    {
+        char tokenaddr[64]; int32_t type = 0; struct CCcontract_info *cp,C;
+        cp = CCinit(&C,EVAL_TOKENS);
+        GetTokensCCaddress(cp, tokenaddr, pubkey2pk(ParseHex(params[1].get_str().c_str())));
+        if ( CBitcoinAddress(tokenaddr).GetIndexKey(addressKey.hashBytes, type, true) == 0 )
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid pubkey");
+        addressKey.type = type;
+        fAddress = true;
+    }
+
+    if ( !ScanTokenUnspent(tokenid, fAddress ? &addressKey : NULL, [&result](const CTokenUnspentKey &key, const CTokenUnspentValue &value) {
+            std::string address;
+            getAddressFromIndex(key.type, key.hashBytes, address);
+            UniValue output(UniValue::VOBJ);
+            output.push_back(Pair("address", address));
+            output.push_back(Pair("txid", key.txhash.GetHex()));
+            output.push_back(Pair("outputIndex", (int)key.index));
+            output.push_back(Pair("satoshis", value.satoshis));
+            output.push_back(Pair("height", value.blockHeight));
+            result.push_back(output);
+            return true;
+        }) )
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the token index");
+
+    return(result);
+}
+
 UniValue tokencreate(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     UniValue result(UniValue::VOBJ);
@@ -32,8 +32,10 @@
 #include "net.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
+#include "rust/metrics.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "threadpool.h"
 #include "timedata.h"
 #include "utilmoneystr.h"
 #include "zcash/Note.hpp"
@@ -87,6 +89,7 @@ bool fWalletRbf = DEFAULT_WALLET_RBF;
 int scanperc;
 bool fTxDeleteEnabled = false;
 bool fTxConflictDeleteEnabled = false;
+bool fCheckWalletBalances = false;
 int fDeleteInterval = DEFAULT_TX_DELETE_INTERVAL;
 unsigned int fDeleteTransactionsAfterNBlocks = DEFAULT_TX_RETENTION_BLOCKS;
 unsigned int fKeepLastNTransactions = DEFAULT_TX_RETENTION_LASTTX;
@@ -169,7 +172,8 @@ libzcash::SproutPaymentAddress CWallet::GenerateNewSproutZKey()
 SaplingPaymentAddress CWallet::GenerateNewSaplingZKey()
 {
     AssertLockHeld(cs_wallet); // mapSaplingZKeyMetadata
-
+    // Notes of this key become spendable
+    MarkBalancesDirty();
     // Create new metadata
     int64_t nCreationTime = GetTime();
     CKeyMetadata metadata(nCreationTime);
@@ -1116,6 +1120,7 @@ bool CWallet::AddWatchOnly(const CScript &dest)
 
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    MarkBalancesDirty();
 
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
@@ -1150,6 +1155,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    MarkBalancesDirty();
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
@@ -1290,13 +1296,23 @@ void CWallet::ChainTip(const CBlockIndex *pindex,
 {
     LOCK2(cs_main, cs_wallet);
 
+    // The transactions of the block moved in or out of the chain, the
+    // immature and unconfirmed ones are refreshed on the next query anyway
+    for (const CTransaction& tx : pblock->vtx) {
+        if (mapWallet.count(tx.GetHash()))
+            MarkBalancesStale(tx);
+    }
+
+    //While ScanForWalletTransactions runs it walks the active chain up to the tip and
+    //updates the Sapling wallet in order, including blocks connected meanwhile
     if (added) {
-        IncrementSaplingWallet(pindex);
+        if (!fRescanning)
+            IncrementSaplingWallet(pindex);
         // Prevent witness cache building && consolidation transactions
         // from being created when node is syncing after launch,
         // and also when node wakes up from suspension/hibernation and incoming blocks are old.
         bool initialDownloadCheck = IsInitialBlockDownload();
-        if (!initialDownloadCheck &&
+        if (!initialDownloadCheck && !fBuilingWitnessCache &&
             pblock->GetBlockTime() > GetTime() - 8640) //Last 144 blocks 2.4 * 60 * 60
         {
             // BuildWitnessCache(pindex, false);
@@ -1317,7 +1333,8 @@ void CWallet::ChainTip(const CBlockIndex *pindex,
         }
 
     } else {
-        DecrementSaplingWallet(pindex);
+        if (!fRescanning)
+            DecrementSaplingWallet(pindex);
         // DecrementNoteWitnesses(pindex);
         UpdateNullifierNoteMapForBlock(pblock);
     }
@@ -2140,7 +2157,7 @@ bool CWallet::ValidateSaplingWalletTrackedPositions(const CBlockIndex* pindex) {
 
                 //Retrieve the full block to get all of the transaction commitments
                 CBlock checkBlock;
-                ReadBlockFromDisk(checkBlock, pCheckIndex, 1);
+                ReadBlockFromDisk(checkBlock, pCheckIndex, 1, false);
                 CBlock *pCheckBlock = &checkBlock;
 
                 //Calculate Merkle Path
@@ -2195,13 +2212,254 @@ bool CWallet::ValidateSaplingWalletTrackedPositions(const CBlockIndex* pindex) {
 
 }
 
-void CWallet::IncrementSaplingWallet(const CBlockIndex* pindex) {
+/**
+ * Append the note commitments of a block to a Sapling wallet. The outputs of the
+ * wallet transactions in mapBlockNotes are appended one by one so that the notes
+ * of the wallet get marked, and the positions of these notes are added to
+ * mapPositions.
+ */
+static void AppendSaplingBlock(SaplingWallet& wallet, const CBlock& block, int nHeight,
+                               const std::map<uint256, std::set<int> >& mapBlockNotes,
+                               std::map<SaplingOutPoint, uint64_t>& mapPositions)
+{
+    for (int i = 0; i < block.vtx.size(); i++) {
+        uint256 txid = block.vtx[i].GetHash();
+        auto it = mapBlockNotes.find(txid);
 
-    AssertLockHeld(cs_main);
+        //Use single output appending for transaction that belong to the wallet so that they can be marked
+        if (it != mapBlockNotes.end()) {
+            wallet.CreateEmptyPositionsForTxid(nHeight, txid);
+            for (int j = 0; j < block.vtx[i].vShieldedOutput.size(); j++) {
+                if (it->second.count(j)) {
+                    wallet.AppendNoteCommitment(nHeight, txid, i, j, block.vtx[i].vShieldedOutput[j], true);
+
+                    //Get Merkle Path for note position
+                    MerklePath saplingMerklePath;
+                    assert(wallet.GetMerklePathOfNote(txid, j, saplingMerklePath));
+                    uint64_t position = saplingMerklePath.position();
+                    mapPositions[SaplingOutPoint(txid, j)] = position;
+
+                    LogPrint("saplingwallet", "Sapling Wallet - Merkle Path position %i\n", position);
+
+                } else {
+                    wallet.AppendNoteCommitment(nHeight, txid, i, j, block.vtx[i].vShieldedOutput[j], false);
+                }
+            }
+        } else {
+            //No transactions in this tx belong to the wallet, use full tx appending
+            wallet.ClearPositionsForTxid(txid);
+            wallet.AppendNoteCommitments(nHeight, block.vtx[i], i);
+        }
+    }
+}
+
+std::map<uint256, std::set<int> > CWallet::GetSaplingBlockNotes(const CBlock& block)
+{
+    AssertLockHeld(cs_wallet);
+
+    std::map<uint256, std::set<int> > mapBlockNotes;
+    for (const CTransaction& tx : block.vtx) {
+        uint256 txid = tx.GetHash();
+        auto it = mapWallet.find(txid);
+        if (it == mapWallet.end()) {
+            continue;
+        }
+
+        std::set<int>& setNotes = mapBlockNotes[txid];
+        for (int j = 0; j < tx.vShieldedOutput.size(); j++) {
+            if (it->second.mapSaplingNoteData.count(SaplingOutPoint(txid, j))) {
+                setNotes.insert(j);
+            }
+        }
+    }
+    return mapBlockNotes;
+}
+
+void CWallet::SetSaplingNotePositions(const std::map<uint256, std::set<int> >& mapNotes,
+                                      const std::map<SaplingOutPoint, uint64_t>& mapPositions)
+{
     AssertLockHeld(cs_wallet);
 
+    for (const auto& item : mapNotes) {
+        auto it = mapWallet.find(item.first);
+        if (it == mapWallet.end()) {
+            continue;
+        }
+
+        CWalletTx* pwtx = &it->second;
+        for (int j : item.second) {
+            auto posit = mapPositions.find(SaplingOutPoint(item.first, j));
+            auto opit = pwtx->mapSaplingNoteData.find(SaplingOutPoint(item.first, j));
+            if (posit != mapPositions.end() && opit != pwtx->mapSaplingNoteData.end()) {
+                opit->second.setPosition(posit->second);
+            }
+        }
+        UpdateSaplingNullifierNoteMapWithTx(pwtx);
+    }
+}
+
+bool CWallet::RebuildSaplingWallet(int nStartHeight, const CBlockIndex* pindexStop, int nGeneration)
+{
     int64_t nNow1 = GetTime();
     int64_t nNow2 = GetTime();
+    const CChainParams& chainParams = Params();
+
+    SaplingWallet rebuiltWallet;
+    std::map<uint256, std::set<int> > mapNotes;
+    std::map<SaplingOutPoint, uint64_t> mapPositions;
+    CBlockIndex* pblockindex;
+    int chainHeight;
+    double dProgressStart, dProgressTip;
+    bool uiShown = false;
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        if (nGeneration != nSaplingWalletGeneration) {
+            return false;
+        }
+
+        // Set Starting Values
+        pblockindex = chainActive[nStartHeight];
+        if (pblockindex == NULL) {
+            //A reorg took the wallet transactions out of the chain
+            saplingWallet.Reset();
+            fInitWitnessesBuilt = true;
+            fBuilingWitnessCache = false;
+            return true;
+        }
+
+        //Start from the Sapling frontier of the chain before the first wallet transaction
+        SaplingMerkleFrontier saplingFrontierTree;
+        pcoinsTip->GetSaplingFrontierAnchorAt(pblockindex->pprev->hashFinalSaplingRoot, saplingFrontierTree);
+        rebuiltWallet.InitNoteCommitmentTree(saplingFrontierTree);
+
+        chainHeight = chainActive.Height();
+        dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pblockindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
+    }
+
+    //Loop thru blocks to rebuild saplingWallet commitment tree, the locks are only
+    //taken to follow the active chain and the wallet transactions of each block
+    while (true) {
+
+        //exit loop if trying to shutdown
+        if (ShutdownRequested()) {
+            return false;
+        }
+
+        if (GetTime() >= nNow2 + 60) {
+            nNow2 = GetTime();
+            LogPrintf("Rebuilding Witnesses for block %d. Progress=%f\n", pblockindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pblockindex));
+        }
+
+        //Report Progress to the GUI and log file
+        int witnessHeight = pblockindex->nHeight;
+        if ((witnessHeight % 100 == 0 || GetTime() >= nNow1 + 15) && witnessHeight < chainHeight - 5 ) {
+            nNow1 = GetTime();
+            if (!uiShown) {
+                uiShown = true;
+                uiInterface.ShowProgress("Rebuilding Witnesses", 0, false);
+            }
+            scanperc = (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pblockindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100);
+            uiInterface.ShowProgress(_(("Rebuilding Witnesses for block " + std::to_string(witnessHeight) + "...").c_str()), std::max(1, std::min(99, scanperc)), false);
+        }
+
+        //Retrieve the full block to get all of the transaction commitments
+        CBlock block;
+        ReadBlockFromDisk(block, pblockindex, 1, false);
+
+        std::map<uint256, std::set<int> > mapBlockNotes;
+        {
+            LOCK2(cs_main, cs_wallet);
+            if (nGeneration != nSaplingWalletGeneration || !chainActive.Contains(pblockindex)) {
+                LogPrint("saplingwallet", "Sapling Wallet - rebuild interrupted at block %i\n", pblockindex->nHeight);
+                return false;
+            }
+            mapBlockNotes = GetSaplingBlockNotes(block);
+        }
+
+        //Create Checkpoint before incrementing wallet
+        rebuiltWallet.CheckpointNoteCommitmentTree(pblockindex->nHeight);
+        AppendSaplingBlock(rebuiltWallet, block, pblockindex->nHeight, mapBlockNotes, mapPositions);
+        for (const auto& item : mapBlockNotes) {
+            mapNotes[item.first].insert(item.second.begin(), item.second.end());
+        }
+
+        LOCK2(cs_main, cs_wallet);
+        if (nGeneration != nSaplingWalletGeneration || !chainActive.Contains(pblockindex)) {
+            LogPrint("saplingwallet", "Sapling Wallet - rebuild interrupted at block %i\n", pblockindex->nHeight);
+            return false;
+        }
+
+        //Check completeness, blocks connected meanwhile are replayed before the swap
+        if (pblockindex == pindexStop || pblockindex == chainActive.Tip()) {
+            saplingWallet = std::move(rebuiltWallet);
+            SetSaplingNotePositions(mapNotes, mapPositions);
+            fInitWitnessesBuilt = true;
+            fBuilingWitnessCache = false;
+
+            LogPrintf("Rebuilt Witnesses from block %d to %d\n", nStartHeight, pblockindex->nHeight);
+            if (uiShown) {
+                uiInterface.ShowProgress(_("Witness Cache Complete..."), 100, false);
+            }
+            return true;
+        }
+
+        //Set Variables for next loop
+        pblockindex = chainActive.Next(pblockindex);
+    }
+}
+
+bool CWallet::GetSaplingWalletRebuild(int& nStartHeight, int& nGeneration)
+{
+    LOCK(cs_wallet);
+    if (nSaplingRebuildHeight < 0) {
+        return false;
+    }
+
+    nStartHeight = nSaplingRebuildHeight;
+    nGeneration = nSaplingWalletGeneration;
+    nSaplingRebuildHeight = -1;
+    return true;
+}
+
+bool CWallet::IsSaplingWalletGeneration(int nGeneration)
+{
+    LOCK(cs_wallet);
+    return nGeneration == nSaplingWalletGeneration;
+}
+
+void ThreadRebuildSaplingWallet(CWallet* pwallet)
+{
+    RenameThread("zcash-witnesses");
+
+    while (true) {
+        int nStartHeight, nGeneration;
+        if (!pwallet->GetSaplingWalletRebuild(nStartHeight, nGeneration)) {
+            MilliSleep(250);
+            continue;
+        }
+
+        //A reorg below the replayed blocks starts over from the snapshot frontier
+        while (!pwallet->RebuildSaplingWallet(nStartHeight, NULL, nGeneration)) {
+            boost::this_thread::interruption_point();
+            if (ShutdownRequested() || !pwallet->IsSaplingWalletGeneration(nGeneration)) {
+                break;
+            }
+        }
+    }
+}
+
+void CWallet::IncrementSaplingWallet(const CBlockIndex* pindex) {
+
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    //The witness thread replays this block before it swaps in the rebuilt wallet
+    if (fBuilingWitnessCache && !fRescanning) {
+        return;
+    }
+
     bool rebuildWallet = false;
     int nMinimumHeight = pindex->nHeight;
     int lastCheckpoint = saplingWallet.GetLastCheckpointHeight();
@@ -2245,9 +2503,6 @@ void CWallet::IncrementSaplingWallet(const CBlockIndex* pindex) {
 
         //Rebuild
         if (rebuildWallet) {
-            //Disable the RPC z_sendmany RPC while rebuilding
-            fBuilingWitnessCache = true;
-
             //Don't recheck after a rebuild
             saplingWalletValidated = true;
 
@@ -2265,154 +2520,40 @@ void CWallet::IncrementSaplingWallet(const CBlockIndex* pindex) {
 
             }
 
-            LogPrint("\n\nsaplingwallet", "Sapling Wallet - rebuilding wallet from block %i\n\n", nMinimumHeight);
+            LogPrint("saplingwallet", "Sapling Wallet - rebuilding wallet from block %i\n", nMinimumHeight);
 
             //No transactions exists to begin wallet at this hieght
             if (nMinimumHeight > pindex->nHeight) {
-                LogPrint("\n\nsaplingwallet", "Sapling Wallet - no transactions exist at height %i to rebuild wallet\n\n", nMinimumHeight);
+                LogPrint("saplingwallet", "Sapling Wallet - no transactions exist at height %i to rebuild wallet\n", nMinimumHeight);
                 SaplingWalletReset();
                 return;
             }
 
-            // Set Starting Values
-            CBlockIndex* pblockindex = chainActive[nMinimumHeight];
-
-            //Create a new wallet
-            SaplingMerkleFrontier saplingFrontierTree;
-            pcoinsTip->GetSaplingFrontierAnchorAt(pblockindex->pprev->hashFinalSaplingRoot, saplingFrontierTree);
-            SaplingWalletReset();
-            saplingWallet.InitNoteCommitmentTree(saplingFrontierTree);
-
-            //Show in UI
-            int chainHeight = chainActive.Height();
-            bool uiShown = false;
-            const CChainParams& chainParams = Params();
-            double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pblockindex, false);
-            double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
-
-            //Loop thru blocks to rebuild saplingWallet commitment tree
-            while (pblockindex) {
-
-                //Create Checkpoint before incrementing wallet
-                saplingWallet.CheckpointNoteCommitmentTree(pblockindex->nHeight);
-
-                if (GetTime() >= nNow2 + 60) {
-                    nNow2 = GetTime();
-                    LogPrintf("Rebuilding Witnesses for block %d. Progress=%f\n", pblockindex->nHeight, Checkpoints::GuessVerificationProgress(Params().Checkpoints(), pblockindex));
-                }
-
-                //Report Progress to the GUI and log file
-                int witnessHeight = pblockindex->nHeight;
-                if ((witnessHeight % 100 == 0 || GetTime() >= nNow1 + 15) && witnessHeight < chainHeight - 5 ) {
-                    nNow1 = GetTime();
-                    if (!uiShown) {
-                        uiShown = true;
-                        uiInterface.ShowProgress("Rebuilding Witnesses", 0, false);
-                    }
-                    scanperc = (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pblockindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100);
-                    uiInterface.ShowProgress(_(("Rebuilding Witnesses for block " + std::to_string(witnessHeight) + "...").c_str()), std::max(1, std::min(99, scanperc)), false);
-                }
-
-                //exit loop if trying to shutdown
-                if (ShutdownRequested()) {
-                    break;
-                }
-
-                //Retrieve the full block to get all of the transaction commitments
-                CBlock block;
-                ReadBlockFromDisk(block, pblockindex, 1);
-                CBlock *pblock = &block;
-
-                for (int i = 0; i < pblock->vtx.size(); i++) {
-                    uint256 txid = pblock->vtx[i].GetHash();
-                    auto it = mapWallet.find(txid);
-
-                    //Use single output appending for transaction that belong to the wallet so that they can be marked
-                    if (it != mapWallet.end()) {
-                        saplingWallet.CreateEmptyPositionsForTxid(pblockindex->nHeight, txid);
-                        CWalletTx *pwtx = &(*it).second;
-                        for (int j = 0; j < pblock->vtx[i].vShieldedOutput.size(); j++) {
-                            SaplingOutPoint op = SaplingOutPoint(txid, j);
-                            auto opit = pwtx->mapSaplingNoteData.find(op);
-
-                            if (opit != pwtx->mapSaplingNoteData.end()) {
-                                saplingWallet.AppendNoteCommitment(pblockindex->nHeight, txid, i, j, pblock->vtx[i].vShieldedOutput[j], true);
-                                //Get Merkle Path for note position
-                                MerklePath saplingMerklePath;
-                                assert(saplingWallet.GetMerklePathOfNote(txid, j, saplingMerklePath));
-                                uint64_t position = saplingMerklePath.position();
-                                pwtx->mapSaplingNoteData[op].setPosition(position);
-
-                                LogPrint("saplingwallet", "Sapling Wallet - Merkle Path position %i\n", position);
-
-                            } else {
-                                saplingWallet.AppendNoteCommitment(pblockindex->nHeight, txid, i, j, pblock->vtx[i].vShieldedOutput[j], false);
-                            }
-                        }
-                        UpdateSaplingNullifierNoteMapWithTx(pwtx);
-                    } else {
-                        //No transactions in this tx belong to the wallet, use full tx appending
-                        saplingWallet.ClearPositionsForTxid(txid);
-                        saplingWallet.AppendNoteCommitments(pblockindex->nHeight,pblock->vtx[i],i);
-                    }
-                }
-
-                //Check completeness
-                if (pblockindex == pindex)
-                    break;
-
-                //Set Variables for next loop
-                pblockindex = chainActive.Next(pblockindex);
+            if (!fRescanning) {
+                //Replay the chain on the witness thread, only calls that spend
+                //notes are disabled until it has caught up with the tip
+                fBuilingWitnessCache = true;
+                nSaplingRebuildHeight = nMinimumHeight;
+                return;
             }
 
-            if (uiShown) {
-                uiInterface.ShowProgress(_("Witness Cache Complete..."), 100, false);
-            }
+            //The rescan replays the chain itself and needs the wallet at pindex
+            RebuildSaplingWallet(nMinimumHeight, pindex, nSaplingWalletGeneration);
+            return;
 
         } else {
 
             //Retrieve the full block to get all of the transaction commitments
             CBlock block;
-            ReadBlockFromDisk(block, pindex, 1);
-            CBlock *pblock = &block;
+            ReadBlockFromDisk(block, pindex, 1, false);
 
             //Create Checkpoint before incrementing wallet
             saplingWallet.CheckpointNoteCommitmentTree(pindex->nHeight);
 
-            for (int i = 0; i < pblock->vtx.size(); i++) {
-                uint256 txid = pblock->vtx[i].GetHash();
-                auto it = mapWallet.find(txid);
-
-                //Use single output appending for transaction that belong to the wallet so that they can be marked
-                if (it != mapWallet.end()) {
-                    saplingWallet.CreateEmptyPositionsForTxid(pindex->nHeight, txid);
-                    CWalletTx *pwtx = &(*it).second;
-                    for (int j = 0; j < pblock->vtx[i].vShieldedOutput.size(); j++) {
-                        SaplingOutPoint op = SaplingOutPoint(txid, j);
-                        auto opit = pwtx->mapSaplingNoteData.find(op);
-
-                        if (opit != pwtx->mapSaplingNoteData.end()) {
-                            saplingWallet.AppendNoteCommitment(pindex->nHeight, txid, i, j, pblock->vtx[i].vShieldedOutput[j], true);
-
-                            //Get Merkle Path for note position
-                            MerklePath saplingMerklePath;
-                            assert(saplingWallet.GetMerklePathOfNote(txid, j, saplingMerklePath));
-                            uint64_t position = saplingMerklePath.position();
-                            pwtx->mapSaplingNoteData[op].setPosition(position);
-
-                            LogPrint("saplingwallet", "Sapling Wallet - Merkle Path position %i\n", position);
-
-                        } else {
-                            saplingWallet.AppendNoteCommitment(pindex->nHeight, txid, i, j, pblock->vtx[i].vShieldedOutput[j], false);
-                        }
-                    }
-                    UpdateSaplingNullifierNoteMapWithTx(pwtx);
-                } else {
-                    //No transactions in this tx belong to the wallet, use full tx appending
-                    saplingWallet.ClearPositionsForTxid(txid);
-                    saplingWallet.AppendNoteCommitments(pindex->nHeight,pblock->vtx[i],i);
-                }
-            }
+            std::map<uint256, std::set<int> > mapBlockNotes = GetSaplingBlockNotes(block);
+            std::map<SaplingOutPoint, uint64_t> mapPositions;
+            AppendSaplingBlock(saplingWallet, block, pindex->nHeight, mapBlockNotes, mapPositions);
+            SetSaplingNotePositions(mapBlockNotes, mapPositions);
         }
     }
 
@@ -2433,6 +2574,11 @@ void CWallet::IncrementSaplingWallet(const CBlockIndex* pindex) {
 
 void CWallet::DecrementSaplingWallet(const CBlockIndex* pindex) {
 
+      //A rebuild in progress restarts by itself if it replayed this block
+      if (fBuilingWitnessCache) {
+          return;
+      }
+
       uint32_t uResultHeight{0};
       assert(pindex->nHeight >= 1);
       assert(saplingWallet.Rewind(pindex->nHeight - 1, uResultHeight));
@@ -3227,6 +3373,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        fBalancesCached = false;
     }
 }
 
@@ -3298,6 +3445,56 @@ void CWallet::UpdateNullifierNoteMapWithTx(const CWalletTx& wtx)
     }
 }
 
+/**
+ * Decrypt the Sapling notes of a wallet transaction once and add them to
+ * mapSaplingNoteCache and mapSaplingNotesByAddress. Notes already cached are
+ * left alone, so this is cheap to call on every AddToWallet.
+ */
+void CWallet::CacheSaplingNotes(const CWalletTx& wtx)
+{
+    LOCK(cs_wallet);
+    for (const mapSaplingNoteData_t::value_type& item : wtx.mapSaplingNoteData) {
+        const SaplingOutPoint& op = item.first;
+        const SaplingNoteData& nd = item.second;
+        if (mapSaplingNoteCache.count(op) || op.n >= wtx.vShieldedOutput.size())
+            continue;
+
+        const OutputDescription& output = wtx.vShieldedOutput[op.n];
+        auto optDeserialized = SaplingNotePlaintext::attempt_sapling_enc_decryption_deserialization(output.encCiphertext, nd.ivk, output.ephemeralKey);
+        if (!optDeserialized) {
+            LogPrintf("%s: could not decrypt note %s:%d\n", __func__, op.hash.ToString(), op.n);
+            continue;
+        }
+
+        auto notePt = optDeserialized.get();
+        auto maybe_pa = nd.ivk.address(notePt.d);
+        auto maybe_note = notePt.note(nd.ivk);
+        if (!maybe_pa || !maybe_note)
+            continue;
+
+        mapSaplingNoteCache.emplace(op, SaplingNoteCacheEntry(maybe_pa.get(), maybe_note.get(), notePt.memo()));
+        mapSaplingNotesByAddress[maybe_pa.get()].insert(op);
+    }
+}
+
+/**
+ * Drop the cached Sapling notes of a transaction that is leaving the wallet.
+ */
+void CWallet::UncacheSaplingNotes(const uint256& hash)
+{
+    LOCK(cs_wallet);
+    auto it = mapSaplingNoteCache.lower_bound(SaplingOutPoint(hash, 0));
+    while (it != mapSaplingNoteCache.end() && it->first.hash == hash) {
+        auto ait = mapSaplingNotesByAddress.find(it->second.address);
+        if (ait != mapSaplingNotesByAddress.end()) {
+            ait->second.erase(it->first);
+            if (ait->second.empty())
+                mapSaplingNotesByAddress.erase(ait);
+        }
+        it = mapSaplingNoteCache.erase(it);
+    }
+}
+
 /**
  * Update mapSproutNullifiersToNotes, computing the nullifier from a cached witness if necessary.
  */
@@ -3425,7 +3622,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         UpdateNullifierNoteMapWithTx(mapWallet[hash]);
+        CacheSaplingNotes(mapWallet[hash]);
         AddToSpends(hash);
+        MarkBalancesDirty();
     }
     else
     {
@@ -3435,6 +3634,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
         UpdateNullifierNoteMapWithTx(wtx);
+        CacheSaplingNotes(wtx);
         bool fInsertedNew = ret.second;
         if (fInsertedNew) {
             AddToSpends(hash);
@@ -3493,6 +3693,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        MarkBalancesStale(wtx);
 
         // Notify UI of new or updated transaction
         if (!fRescan) {
@@ -3553,8 +3754,10 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
  * Add a transaction to the wallet, or update it.
  * pblock is optional, but should be provided if the transaction is known to be in a block.
  * If fUpdate is true, existing transactions will be updated.
+ * pSaplingNoteData optionally supplies the notes already trial decrypted from vtx
+ * (see DecryptSaplingBlock), in which case vtx is not decrypted again.
  */
-void CWallet::AddToWalletIfInvolvingMe(const std::vector<CTransaction> &vtx, std::vector<CTransaction> &vAddedTxes, const CBlock* pblock, const int nHeight, bool fUpdate, std::set<SaplingPaymentAddress>& addressesFound, bool fRescan)
+void CWallet::AddToWalletIfInvolvingMe(const std::vector<CTransaction> &vtx, std::vector<CTransaction> &vAddedTxes, const CBlock* pblock, const int nHeight, bool fUpdate, std::set<SaplingPaymentAddress>& addressesFound, bool fRescan, const mapSaplingNoteData_t* pSaplingNoteData)
 {
     {
         AssertLockHeld(cs_wallet);
@@ -3573,9 +3776,24 @@ void CWallet::AddToWalletIfInvolvingMe(const std::vector<CTransaction> &vtx, std
         }
 
         //Step 2 -- decrypt transactions
-        auto saplingNoteDataAndAddressesToAdd = FindMySaplingNotes(vFilteredTxes, nHeight);
-        auto saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
-        auto addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
+        mapSaplingNoteData_t saplingNoteData;
+        SaplingIncomingViewingKeyMap addressesToAdd;
+        if (pSaplingNoteData) {
+            std::set<uint256> setFilteredTxes;
+            for (int i = 0; i < vFilteredTxes.size(); i++) {
+                setFilteredTxes.insert(vFilteredTxes[i].GetHash());
+            }
+            for (const auto &note : *pSaplingNoteData) {
+                if (setFilteredTxes.count(note.first.hash)) {
+                    saplingNoteData.insert(note);
+                    addressesToAdd.insert(std::make_pair(note.second.address, note.second.ivk));
+                }
+            }
+        } else {
+            auto saplingNoteDataAndAddressesToAdd = FindMySaplingNotes(vFilteredTxes, nHeight);
+            saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
+            addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
+        }
 
         //Step 3 -- add addresses
         for (const auto &addressToAdd : addressesToAdd) {
@@ -3689,6 +3907,8 @@ void CWallet::SyncTransactions(const std::vector<CTransaction> &vtx, const CBloc
 
     for (int i = 0; i < vOurs.size(); i++) {
         MarkAffectedTransactionsDirty(vOurs[i]);
+        // New and conflicting transactions change which unconfirmed credits are trusted
+        MarkBalancesStale(vOurs[i]);
     }
 }
 
@@ -3729,13 +3949,19 @@ bool CWallet::EraseFromWallet(const uint256 &hash)
 
     if (IsCrypted()) {
         if (!IsLocked()) {
-          if (mapWallet.erase(hash)) {
+          if (mapWallet.count(hash)) {
+              MarkBalancesStale(mapWallet[hash]);
+              mapWallet.erase(hash);
+              UncacheSaplingNotes(hash);
               uint256 chash = HashWithFP(hash);
               return CWalletDB(strWalletFile).EraseCryptedTx(chash);
           }
         }
     } else {
-        if (mapWallet.erase(hash)) {
+        if (mapWallet.count(hash)) {
+            MarkBalancesStale(mapWallet[hash]);
+            mapWallet.erase(hash);
+            UncacheSaplingNotes(hash);
             return CWalletDB(strWalletFile).EraseTx(hash);
         }
     }
@@ -3845,38 +4071,39 @@ mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
  * the result of FindMySaplingNotes (for the addresses available at the time) will
  * already have been cached in CWalletTx.mapSaplingNoteData.
  */
-static void DecryptSaplingNoteWorker(const CWallet *wallet, std::vector<const SaplingIncomingViewingKey*> vIvk, std::vector<const OutputDescription*> vOutput, std::vector<uint32_t> vPosition, const std::vector<uint256> vHash, const int &height, mapSaplingNoteData_t *noteData, SaplingIncomingViewingKeyMap *viewingKeysToAdd, int threadNumber)
+static bool TryDecryptSaplingOutput(const SaplingIncomingViewingKey &ivk, const OutputDescription &output, const uint256 &hash, uint32_t position, const int &height, SaplingOutPoint &op, SaplingNoteData &nd)
 {
-    for (int i = 0; i < vIvk.size(); i++) {
-        const SaplingIncomingViewingKey ivk = *vIvk[i];
-        const OutputDescription output = *vOutput[i];
-        const uint256 hash = vHash[i];
+    auto result = SaplingNotePlaintext::decrypt(Params().GetConsensus(), height, output.encCiphertext, ivk, output.ephemeralKey, output.cmu);
+    if (!result)
+        return false;
 
-        auto result = SaplingNotePlaintext::decrypt(Params().GetConsensus(), height, output.encCiphertext, ivk, output.ephemeralKey, output.cmu);
-        if (result) {
+    auto address = ivk.address(result.get().d);
 
-            auto address = ivk.address(result.get().d);
+    // We don't cache the nullifier here as computing it requires knowledge of the note position
+    // in the commitment tree, which can only be determined when the transaction has been mined.
+    op = SaplingOutPoint(hash, position);
+    nd = SaplingNoteData();
+    nd.ivk = ivk;
 
-            // We don't cache the nullifier here as computing it requires knowledge of the note position
-            // in the commitment tree, which can only be determined when the transaction has been mined.
-            SaplingOutPoint op {hash, vPosition[i]};
-            SaplingNoteData nd;
-            nd.ivk = ivk;
+    //Cache Address and value - in Memory Only
+    auto note = result.get();
+    nd.value = note.value();
+    nd.address = address.get();
 
-            //Cache Address and value - in Memory Only
-            auto note = result.get();
-            nd.value = note.value();
-            nd.address = address.get();
+    //Only add notes greater then this value
+    //dust filter
+    return nd.value >= minTxValue;
+}
 
-            if (nd.value >= minTxValue) {
-                //Only add notes greater then this value
-                //dust filter
-                {
-                    LOCK(wallet->cs_wallet_threadedfunction);
-                    viewingKeysToAdd->insert(make_pair(address.get(),ivk));
-                    noteData->insert(std::make_pair(op, nd));
-                }
-            }
+static void DecryptSaplingNoteWorker(const CWallet *wallet, const std::vector<const SaplingIncomingViewingKey*>& vIvk, const std::vector<const OutputDescription*>& vOutput, const std::vector<uint32_t>& vPosition, const std::vector<uint256>& vHash, const int &height, mapSaplingNoteData_t *noteData, SaplingIncomingViewingKeyMap *viewingKeysToAdd, int threadNumber)
+{
+    for (int i = 0; i < vIvk.size(); i++) {
+        SaplingOutPoint op;
+        SaplingNoteData nd;
+        if (TryDecryptSaplingOutput(*vIvk[i], *vOutput[i], vHash[i], vPosition[i], height, op, nd)) {
+            LOCK(wallet->cs_wallet_threadedfunction);
+            viewingKeysToAdd->insert(make_pair(nd.address, nd.ivk));
+            noteData->insert(std::make_pair(op, nd));
         }
     }
 }
@@ -3934,17 +4161,26 @@ std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::FindMySap
     }
 
 
-    std::vector<boost::thread*> decryptionThreads;
-    for (uint32_t i = 0; i < vvIvk.size(); ++i) {
-        if(!vvIvk[i].empty()) {
-            decryptionThreads.emplace_back(new boost::thread(DecryptSaplingNoteWorker, this, vvIvk[i], vvOutputDescrition[i], vvPosition[i], vvHash[i], height, &noteData, &viewingKeysToAdd, i));
+    {
+        CTaskGroup decryptionGroup(GetValidationThreadPool());
+        for (uint32_t i = 0; i < vvIvk.size(); ++i) {
+            if(!vvIvk[i].empty()) {
+                decryptionGroup.Submit([&, i]() {
+                    DecryptSaplingNoteWorker(this, vvIvk[i], vvOutputDescrition[i], vvPosition[i], vvHash[i], height, &noteData, &viewingKeysToAdd, i);
+                });
+            }
         }
+
+        // Wait for all buckets to be decrypted
+        decryptionGroup.Wait();
     }
 
-    // Cleanup
-    for (auto dthread : decryptionThreads) {
-        dthread->join();
-        delete dthread;
+    uint64_t nTrials = 0;
+    for (const auto& bucket : vvIvk)
+        nTrials += bucket.size();
+    if (nTrials > 0) {
+        MetricsCounter("elosys.wallet.trialdecrypt.attempts", nTrials);
+        MetricsCounter("elosys.wallet.trialdecrypt.notes", noteData.size());
     }
 
     //clean up pointers
@@ -3967,6 +4203,36 @@ std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::FindMySap
     return std::make_pair(noteData, viewingKeysToAdd);
 }
 
+/**
+ * Trial decrypt every Sapling output of a block against a fixed set of incoming
+ * viewing keys. Unlike FindMySaplingNotes this takes no wallet locks, so the
+ * rescan can run it for many blocks at once on the validation pool.
+ */
+static void DecryptSaplingBlock(const CBlock &block, const int &height, const std::vector<SaplingIncomingViewingKey> &vIvk, mapSaplingNoteData_t &noteData)
+{
+    uint64_t nTrials = 0;
+    for (const CTransaction &tx : block.vtx) {
+        if (tx.vShieldedOutput.empty())
+            continue;
+
+        uint256 hash = tx.GetHash();
+        for (uint32_t i = 0; i < tx.vShieldedOutput.size(); i++) {
+            for (const SaplingIncomingViewingKey &ivk : vIvk) {
+                SaplingOutPoint op;
+                SaplingNoteData nd;
+                if (TryDecryptSaplingOutput(ivk, tx.vShieldedOutput[i], hash, i, height, op, nd)) {
+                    noteData.insert(std::make_pair(op, nd));
+                }
+            }
+        }
+        nTrials += tx.vShieldedOutput.size() * vIvk.size();
+    }
+    if (nTrials > 0) {
+        MetricsCounter("elosys.wallet.trialdecrypt.attempts", nTrials);
+        MetricsCounter("elosys.wallet.trialdecrypt.notes", noteData.size());
+    }
+}
+
 bool CWallet::IsSproutNullifierFromMe(const uint256& nullifier) const
 {
     {
@@ -4023,6 +4289,10 @@ bool CWallet::GetSaplingNoteMerklePaths(std::vector<SaplingOutPoint> notes,
                                       uint256 &final_anchor)
 {
     LOCK(cs_wallet);
+    //The witnesses are stale until the rebuild is swapped in
+    if (fBuilingWitnessCache) {
+        return false;
+    }
     saplingMerklePaths.resize(notes.size());
     boost::optional<uint256> rt;
     int i = 0;
@@ -4875,7 +5145,7 @@ void CWallet::WitnessNoteCommitment(std::vector<uint256> commitments,
 
     while (pindex) {
         CBlock block;
-        ReadBlockFromDisk(block, pindex,1);
+        ReadBlockFromDisk(block, pindex, 1, false);
 
         BOOST_FOREACH(const CTransaction& tx, block.vtx)
         {
@@ -5327,10 +5597,126 @@ bool CWallet::initalizeArcTx() {
 
 }
 
+namespace {
+/** Blocks the rescan commits per cs_main/cs_wallet acquisition */
+static const int RESCAN_BATCH_SIZE = 100;
+/** Batches read from disk and trial decrypted ahead of the batch being committed */
+static const int RESCAN_BATCHES_AHEAD = 4;
+
+typedef std::shared_ptr<const std::vector<SaplingIncomingViewingKey>> CRescanIvks;
+
+struct CRescanBlock
+{
+    CBlockIndex *pindex;
+    //! The incoming viewing keys of the wallet when the block was queued
+    CRescanIvks vIvk;
+    CBlock block;
+    bool fReadFailed;
+    mapSaplingNoteData_t saplingNoteData;
+    std::promise<void> promise;
+    std::shared_future<void> ready;
+
+    CRescanBlock(CBlockIndex *pindexIn, const CRescanIvks &vIvkIn) :
+        pindex(pindexIn), vIvk(vIvkIn), fReadFailed(false), ready(promise.get_future().share()) {}
+};
+typedef std::vector<std::shared_ptr<CRescanBlock>> CRescanBatch;
+
+/**
+ * Reads rescan blocks from disk ahead of the committer and queues their trial
+ * decryption on the validation pool. It takes no locks, the committer picks the
+ * block indexes to read and the keys to decrypt with while it holds cs_main.
+ */
+class CRescanPrefetcher
+{
+public:
+    CRescanPrefetcher() : fStop(false), thread(&CRescanPrefetcher::ThreadPrefetch, this) {}
+
+    ~CRescanPrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    void Push(const CRescanBatch &batch)
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            queue.insert(queue.end(), batch.begin(), batch.end());
+        }
+        cv.notify_all();
+    }
+
+    /** Drop blocks that have not been read yet, used when the chain reorganized under the rescan */
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        queue.clear();
+    }
+
+private:
+    std::mutex cs;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<CRescanBlock>> queue;
+    bool fStop;
+    std::thread thread;
+
+    void ThreadPrefetch()
+    {
+        RenameThread("zcash-rescan");
+
+        while (true) {
+            std::shared_ptr<CRescanBlock> item;
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                cv.wait(lock, [this]() { return fStop || !queue.empty(); });
+                if (fStop)
+                    return;
+                item = queue.front();
+                queue.pop_front();
+            }
+
+            //The committer retries the read, a block is never committed without its transactions
+            if (!ReadBlockFromDisk(item->block, item->pindex, 1, false)) {
+                LogPrintf("%s: failed to read block %s\n", __func__, item->pindex->GetBlockHash().ToString());
+                item->fReadFailed = true;
+                item->promise.set_value();
+                continue;
+            }
+
+            bool fShieldedOutputs = false;
+            for (const CTransaction &tx : item->block.vtx) {
+                if (!tx.vShieldedOutput.empty()) {
+                    fShieldedOutputs = true;
+                    break;
+                }
+            }
+            if (!fShieldedOutputs || item->vIvk->empty()) {
+                item->promise.set_value();
+                continue;
+            }
+
+            GetValidationThreadPool().Submit([item]() {
+                DecryptSaplingBlock(item->block, item->pindex->nHeight, *item->vIvk, item->saplingNoteData);
+                item->promise.set_value();
+            });
+        }
+    }
+};
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * The scan is pipelined: a prefetch thread reads blocks ahead, the validation
+ * pool trial decrypts them in parallel, and this thread commits them in chain
+ * order, taking cs_main and cs_wallet once per batch of RESCAN_BATCH_SIZE blocks.
+ * Returns the number of transactions found, or -1 if a block could not be read.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, bool fIgnoreBirthday, bool LockOnFinish, bool resetSaplingWallet)
 {
@@ -5338,31 +5724,40 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
         //Ignore function for cold storage offline mode
         return false;
     }
-    LOCK2(cs_main, cs_wallet);
     //Notify GUI of rescan
     NotifyRescanStarted();
 
     int ret = 0;
     int64_t nNow = GetTime();
+    int64_t nStartMicros = GetTimeMicros();
+    int nBlocksScanned = 0;
     const CChainParams& chainParams = Params();
 
     CBlockIndex* pindex = pindexStart;
 
-    //Reset the wallet location to the rescan start. This will force the rescan to start over
-    //if the wallet is killed part way through
-    currentBlock = chainActive.GetLocator(pindex);
-    chainHeight = pindex->nHeight;
-    SetBestChain(currentBlock, chainHeight);
-
     std::set<uint256> txList;
     std::set<uint256> txListOriginal;
 
     //Collect Sapling Addresses to notify GUI after rescan
     std::set<SaplingPaymentAddress> addressesFound;
 
+    double dProgressStart = 0.0;
+    double dProgressTip = 0.0;
+
     {
-        //Lock cs_keystore to prevent wallet from locking during rescan
-        LOCK(cs_KeyStore);
+        LOCK2(cs_main, cs_wallet);
+
+        //Callers pick the start block before they take the locks, it may have been disconnected since
+        if (!chainActive.Contains(pindex)) {
+            const CBlockIndex* pfork = chainActive.FindFork(pindex);
+            pindex = pfork ? chainActive[pfork->nHeight] : chainActive.Genesis();
+        }
+
+        //Reset the wallet location to the rescan start. This will force the rescan to start over
+        //if the wallet is killed part way through
+        currentBlock = chainActive.GetLocator(pindex);
+        chainHeight = pindex->nHeight;
+        SetBestChain(currentBlock, chainHeight);
 
         //Get List of current list of txids
         for (map<uint256, ArchiveTxPoint>::iterator it = pwalletMain->mapArcTxs.begin(); it != pwalletMain->mapArcTxs.end(); ++it)
@@ -5380,75 +5775,192 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
             pindex = chainActive.Next(pindex);
 
         uiInterface.ShowProgress(_("Rescanning..."), 0, false); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
+        dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
 
         // //Reset the sapling Wallet
         if (resetSaplingWallet) {
           SaplingWalletReset();
         }
 
-        while (pindex)
+        //Blocks connected while the rescan runs are added to the Sapling wallet by the rescan
+        fRescanning = true;
+        MetricsGauge("elosys.wallet.rescan.progress", 0.0);
+    }
+
+    bool fAborted = false;
+    CBlockIndex* pindexLastScanned = NULL;
+    {
+        CRescanPrefetcher prefetcher;
+        std::deque<CRescanBatch> vBatches;
+        CBlockIndex* pindexNext = pindex;
+        //Incoming viewing keys to trial decrypt with, taken again when keys are added
+        CRescanIvks vIvk;
+
+        //True if the wallet's incoming viewing keys differ from the snapshot, cs_wallet must be held
+        auto IvksChanged = [this](const CRescanIvks &vIvkSnapshot) {
+            return !vIvkSnapshot || vIvkSnapshot->size() != setSaplingIncomingViewingKeys.size() ||
+                !std::equal(setSaplingIncomingViewingKeys.begin(), setSaplingIncomingViewingKeys.end(), vIvkSnapshot->begin());
+        };
+
+        //Hand the next batch of block indexes on the active chain to the prefetcher
+        auto QueueBatch = [&]() {
+            LOCK2(cs_main, cs_wallet);
+            if (IvksChanged(vIvk))
+                vIvk = std::make_shared<const std::vector<SaplingIncomingViewingKey>>(
+                    setSaplingIncomingViewingKeys.begin(), setSaplingIncomingViewingKeys.end());
+            CRescanBatch batch;
+            while (pindexNext && batch.size() < RESCAN_BATCH_SIZE) {
+                batch.emplace_back(std::make_shared<CRescanBlock>(pindexNext, vIvk));
+                pindexNext = chainActive.Next(pindexNext);
+            }
+            if (!batch.empty()) {
+                prefetcher.Push(batch);
+                vBatches.push_back(batch);
+            }
+        };
+
+        while (pindexNext && vBatches.size() < RESCAN_BATCHES_AHEAD)
+            QueueBatch();
+
+        while (!vBatches.empty())
         {
             //exit loop if trying to shutdown
             if (ShutdownRequested()) {
                 break;
             }
 
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-            {
-                scanperc = (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100);
-                uiInterface.ShowProgress(_(("Rescanning - Currently on block " + std::to_string(pindex->nHeight) + "...").c_str()), std::max(1, std::min(99, scanperc)), false);
-            }
+            CRescanBatch batch = vBatches.front();
+            vBatches.pop_front();
+            QueueBatch();
 
-            bool blockInvolvesMe = false;
-            CBlock block;
-            ReadBlockFromDisk(block, pindex,1);
+            //Wait for the batch to be read and decrypted without holding any locks
+            for (const auto &item : batch) {
+                item->ready.wait();
+            }
 
-            std::vector<CTransaction> vOurs;
-            AddToWalletIfInvolvingMe(block.vtx, vOurs, &block, pindex->nHeight, fUpdate, addressesFound, true);
+            LOCK2(cs_main, cs_wallet);
+            //Lock cs_keystore to prevent wallet from locking during rescan
+            LOCK(cs_KeyStore);
 
-            for (int i = 0; i < vOurs.size(); i++) {
-                blockInvolvesMe = true;
-                txList.insert(vOurs[i].GetHash());
-                ret++;
+            //Keys added since the batch was queued never saw its blocks, nor
+            //those of the batches behind it, decrypt them again from here
+            if (IvksChanged(batch.front()->vIvk)) {
+                LogPrintf("Rescan: viewing keys were added, decrypting again from block %d\n", batch.front()->pindex->nHeight);
+                prefetcher.Clear();
+                vBatches.clear();
+                pindexNext = batch.front()->pindex;
+                batch.clear();
             }
 
-            IncrementSaplingWallet(pindex);
+            for (const auto &item : batch)
+            {
+                pindex = item->pindex;
+
+                //The chain reorganized since this batch was queued, continue from the fork
+                if (!chainActive.Contains(pindex)) {
+                    LogPrintf("Rescan: block %d %s is no longer on the active chain, continuing from the fork\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                    prefetcher.Clear();
+                    vBatches.clear();
+                    const CBlockIndex* pfork = chainActive.FindFork(pindex);
+                    pindexNext = pfork ? chainActive.Next(pfork) : chainActive.Genesis();
+                    //Blocks above the fork were already appended to the Sapling wallet
+                    uint32_t uResultHeight{0};
+                    if (pfork && saplingWallet.GetLastCheckpointHeight() > pfork->nHeight &&
+                        (!saplingWallet.Rewind(pfork->nHeight, uResultHeight) || uResultHeight != pfork->nHeight)) {
+                        LogPrintf("Rescan: cannot rewind the Sapling wallet to block %d, rebuilding it\n", pfork->nHeight);
+                        saplingWalletValidated = false;
+                    }
+                    break;
+                }
+
+                //The prefetcher could not read the block, an empty block would hide its transactions
+                if (item->fReadFailed) {
+                    if (!ReadBlockFromDisk(item->block, pindex, 1, false)) {
+                        LogPrintf("Rescan: ERROR: cannot read block %d %s, aborting the rescan\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                        fAborted = true;
+                        break;
+                    }
+                    DecryptSaplingBlock(item->block, pindex->nHeight, *item->vIvk, item->saplingNoteData);
+                }
 
-            SproutMerkleTree sproutTree;
-            SaplingMerkleTree saplingTree;
-            SaplingMerkleFrontier saplingFrontierTree;
-            // This should never fail: we should always be able to get the tree
-            // state on the path to the tip of our chain
-            assert(pcoinsTip->GetSproutAnchorAt(pindex->hashSproutAnchor, sproutTree));
-            if (pindex->pprev) {
-                if (NetworkUpgradeActive(pindex->pprev->nHeight, Params().GetConsensus(), Consensus::UPGRADE_SAPLING)) {
-                    assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
-                    assert(pcoinsTip->GetSaplingFrontierAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingFrontierTree));
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                {
+                    scanperc = (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100);
+                    uiInterface.ShowProgress(_(("Rescanning - Currently on block " + std::to_string(pindex->nHeight) + "...").c_str()), std::max(1, std::min(99, scanperc)), false);
+                    MetricsGauge("elosys.wallet.rescan.progress", std::max(0, std::min(100, scanperc)) / 100.0);
+                }
+
+                std::vector<CTransaction> vOurs;
+                AddToWalletIfInvolvingMe(item->block.vtx, vOurs, &item->block, pindex->nHeight, fUpdate, addressesFound, true, &item->saplingNoteData);
+
+                for (int i = 0; i < vOurs.size(); i++) {
+                    txList.insert(vOurs[i].GetHash());
+                    ret++;
+                }
+
+                IncrementSaplingWallet(pindex);
+
+                //Delete Transactions
+                if (pindex->nHeight % fDeleteInterval == 0)
+                    while(DeleteWalletTransactions(pindex, true)) {}
+
+                pindexLastScanned = pindex;
+                nBlocksScanned++;
+                MetricsIncrementCounter("elosys.wallet.rescan.blocks");
+                MetricsGauge("elosys.wallet.rescan.height", pindex->nHeight);
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f, %.1f blocks/s\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex),
+                        nBlocksScanned * 1000000.0 / std::max((int64_t)1, GetTimeMicros() - nStartMicros));
                 }
             }
 
-            //Delete Transactions
-            if (pindex->nHeight % fDeleteInterval == 0)
-                while(DeleteWalletTransactions(pindex, true)) {}
+            if (fAborted)
+                break;
 
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+            //Pick up blocks connected since the last batch was queued
+            if (vBatches.empty()) {
+                if (!pindexNext && chainActive.Contains(pindex))
+                    pindexNext = chainActive.Next(pindex);
+                while (pindexNext && vBatches.size() < RESCAN_BATCHES_AHEAD)
+                    QueueBatch();
+
+                //Reached the tip with cs_main held, ChainTip takes over from here
+                if (vBatches.empty())
+                    fRescanning = false;
             }
-            pindex = chainActive.Next(pindex);
         }
+    }
 
-        uiInterface.ShowProgress(_("Rescanning..."), 100, false); // hide progress dialog in GUI
+    {
+        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_KeyStore);
 
-        // // Update the Sapling Wallet Merkle tree
-        //IncrementSaplingWallet(chainActive.Tip());
+        //Also reset when the rescan was interrupted by a shutdown
+        fRescanning = false;
 
-        //Write all transactions ant block loacator to the wallet
-        currentBlock = chainActive.GetLocator();
-        chainHeight = chainActive.Tip()->nHeight;
-        SetBestChain(currentBlock, chainHeight);
+        uiInterface.ShowProgress(_("Rescanning..."), 100, false); // hide progress dialog in GUI
+        MetricsGauge("elosys.wallet.rescan.progress", 1.0);
+
+        double dSeconds = (GetTimeMicros() - nStartMicros) / 1000000.0;
+        LogPrintf("Rescan scanned %d blocks in %.2fs (%.1f blocks/s), found %d transactions\n", nBlocksScanned, dSeconds,
+            dSeconds > 0 ? nBlocksScanned / dSeconds : 0.0, ret);
+
+        //Resume from the last scanned block on the next start
+        if (fAborted) {
+            CBlockIndex* pindexResume = pindexLastScanned ? pindexLastScanned : pindexStart;
+            currentBlock = chainActive.GetLocator(pindexResume);
+            chainHeight = pindexResume->nHeight;
+            SetBestChain(currentBlock, chainHeight);
+            LogPrintf("Rescan aborted at block %d\n", pindexResume->nHeight);
+            ret = -1;
+        } else {
+            //Write all transactions ant block loacator to the wallet
+            currentBlock = chainActive.GetLocator();
+            chainHeight = chainActive.Tip()->nHeight;
+            SetBestChain(currentBlock, chainHeight);
+        }
 
         //Delete transactions
         while(DeleteWalletTransactions(chainActive.Tip(), true)) {}
@@ -5835,94 +6347,238 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime)
  */
 
 
-CAmount CWallet::GetBalance() const
+/**
+ * Full scan of mapWallet and the Sapling note cache, used to rebuild the
+ * balance ledger and by -checkwalletbalances to verify it.
+ */
+CWalletBalances CWallet::ComputeBalances() const
 {
-    CAmount nTotal = 0;
+    CWalletBalances balances;
+    LOCK2(cs_main, cs_wallet);
+
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+        const CWalletTx* pcoin = &(*it).second;
+        bool fTrusted = pcoin->IsTrusted();
+        bool fUnconfirmed = !CheckFinalTx(*pcoin) || (!fTrusted && pcoin->GetDepthInMainChain() == 0);
+        if (fTrusted) {
+            balances.nTrusted += pcoin->GetAvailableCredit();
+            balances.nWatchOnlyTrusted += pcoin->GetAvailableWatchOnlyCredit();
         }
+        if (fUnconfirmed) {
+            balances.nUnconfirmed += pcoin->GetAvailableCredit();
+            balances.nWatchOnlyUnconfirmed += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        balances.nImmature += pcoin->GetImmatureCredit();
+        balances.nWatchOnlyImmature += pcoin->GetImmatureWatchOnlyCredit();
     }
 
-    return nTotal;
+    std::vector<CSproutNotePlaintextEntry> sproutEntries;
+    std::vector<SaplingNoteEntry> saplingEntries;
+    std::set<PaymentAddress> filterAddresses;
+    GetFilteredNotes(sproutEntries, saplingEntries, filterAddresses, 0, INT_MAX, true, true, false);
+    for (const SaplingNoteEntry& entry : saplingEntries) {
+        if (entry.confirmations > 0)
+            balances.nSaplingTrusted += entry.note.value();
+        else
+            balances.nSaplingUnconfirmed += entry.note.value();
+    }
+
+    saplingEntries.clear();
+    GetFilteredNotes(sproutEntries, saplingEntries, filterAddresses, 0, INT_MAX, true, false, false);
+    for (const SaplingNoteEntry& entry : saplingEntries) {
+        if (entry.confirmations > 0)
+            balances.nSaplingWatchOnlyTrusted += entry.note.value();
+        else
+            balances.nSaplingWatchOnlyUnconfirmed += entry.note.value();
+    }
+    balances.nSaplingWatchOnlyTrusted -= balances.nSaplingTrusted;
+    balances.nSaplingWatchOnlyUnconfirmed -= balances.nSaplingUnconfirmed;
+
+    return balances;
 }
 
-CAmount CWallet::GetUnconfirmedBalance() const
+/**
+ * Amounts a single transaction adds to the ledger, following the same rules
+ * as ComputeBalances.
+ */
+CWalletBalances CWallet::ComputeTxBalances(const CWalletTx& wtx) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!CheckFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    CWalletBalances balances;
+
+    bool fFinal = CheckFinalTx(wtx);
+    int nDepth = wtx.GetDepthInMainChain();
+    bool fTrusted = wtx.IsTrusted();
+    if (fTrusted) {
+        balances.nTrusted += wtx.GetAvailableCredit();
+        balances.nWatchOnlyTrusted += wtx.GetAvailableWatchOnlyCredit();
+    }
+    if (!fFinal || (!fTrusted && nDepth == 0)) {
+        balances.nUnconfirmed += wtx.GetAvailableCredit();
+        balances.nWatchOnlyUnconfirmed += wtx.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature += wtx.GetImmatureCredit();
+    balances.nWatchOnlyImmature += wtx.GetImmatureWatchOnlyCredit();
+
+    if (!fFinal || wtx.GetBlocksToMaturity() > 0 || nDepth < 0)
+        return balances;
+
+    uint256 hash = wtx.GetHash();
+    for (auto it = mapSaplingNoteCache.lower_bound(SaplingOutPoint(hash, 0));
+         it != mapSaplingNoteCache.end() && it->first.hash == hash; ++it) {
+        auto nit = wtx.mapSaplingNoteData.find(it->first);
+        if (nit == wtx.mapSaplingNoteData.end())
+            continue;
+        const SaplingNoteData& nd = nit->second;
+        if (nd.nullifier && IsSaplingSpent(*nd.nullifier))
+            continue;
+
+        libzcash::SaplingExtendedFullViewingKey extfvk;
+        bool fSpendable = GetSaplingFullViewingKey(nd.ivk, extfvk) && HaveSaplingSpendingKey(extfvk);
+        CAmount nValue = it->second.note.value();
+        if (fSpendable) {
+            if (nDepth > 0)
+                balances.nSaplingTrusted += nValue;
+            else
+                balances.nSaplingUnconfirmed += nValue;
+        } else {
+            if (nDepth > 0)
+                balances.nSaplingWatchOnlyTrusted += nValue;
+            else
+                balances.nSaplingWatchOnlyUnconfirmed += nValue;
         }
     }
-    return nTotal;
+
+    return balances;
 }
 
-CAmount CWallet::GetImmatureBalance() const
+/** Replace the ledger amounts of one transaction, or drop them if it left the wallet */
+void CWallet::UpdateTxBalances(const uint256& hash) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
+    AssertLockHeld(cs_wallet);
+
+    auto it = mapTxBalances.find(hash);
+    if (it != mapTxBalances.end()) {
+        cachedBalances -= it->second;
+        mapTxBalances.erase(it);
     }
-    return nTotal;
+    setTxBalancesPending.erase(hash);
+
+    auto wit = mapWallet.find(hash);
+    if (wit == mapWallet.end())
+        return;
+    const CWalletTx& wtx = wit->second;
+
+    CWalletBalances balances = ComputeTxBalances(wtx);
+    if (!balances.IsNull()) {
+        cachedBalances += balances;
+        mapTxBalances.emplace(hash, balances);
+    }
+    // Amounts that change without a wallet event
+    if (wtx.GetDepthInMainChain() <= 0 || wtx.GetBlocksToMaturity() > 0 || !CheckFinalTx(wtx))
+        setTxBalancesPending.insert(hash);
 }
 
-CAmount CWallet::GetWatchOnlyBalance() const
+/**
+ * Queue a transaction and the wallet transactions it spends from for a ledger
+ * update, the spentness of their outputs follows the state of the spender.
+ */
+void CWallet::MarkBalancesStale(const CTransaction& tx) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
+    AssertLockHeld(cs_wallet);
+    if (!fBalancesCached)
+        return;
+
+    setTxBalancesStale.insert(tx.GetHash());
+    for (const CTxIn& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash))
+            setTxBalancesStale.insert(txin.prevout.hash);
+    }
+    for (const SpendDescription& spend : tx.vShieldedSpend) {
+        auto it = mapSaplingNullifiersToNotes.find(spend.nullifier);
+        if (it != mapSaplingNullifiersToNotes.end())
+            setTxBalancesStale.insert(it->second.hash);
+    }
+}
+
+CWalletBalances CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+
+    if (!fBalancesCached) {
+        cachedBalances = CWalletBalances();
+        mapTxBalances.clear();
+        setTxBalancesStale.clear();
+        setTxBalancesPending.clear();
+        for (const std::pair<const uint256, CWalletTx>& item : mapWallet)
+            UpdateTxBalances(item.first);
+        fBalancesCached = true;
+        return cachedBalances;
+    }
+
+    for (const uint256& hash : setTxBalancesPending) {
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end())
+            MarkBalancesStale(it->second);
+        else
+            setTxBalancesStale.insert(hash);
+    }
+    for (const uint256& hash : setTxBalancesStale)
+        UpdateTxBalances(hash);
+    setTxBalancesStale.clear();
+
+    if (fCheckWalletBalances) {
+        CWalletBalances scanned = ComputeBalances();
+        if (scanned != cachedBalances) {
+            LogPrintf("%s: balance ledger out of sync, trusted %s != %s, unconfirmed %s != %s, immature %s != %s, sapling %s != %s, rebuilding it\n", __func__,
+                FormatMoney(cachedBalances.nTrusted), FormatMoney(scanned.nTrusted),
+                FormatMoney(cachedBalances.nUnconfirmed), FormatMoney(scanned.nUnconfirmed),
+                FormatMoney(cachedBalances.nImmature), FormatMoney(scanned.nImmature),
+                FormatMoney(cachedBalances.nSaplingTrusted), FormatMoney(scanned.nSaplingTrusted));
+            fBalancesCached = false;
+            return GetBalances();
         }
     }
 
-    return nTotal;
+    return cachedBalances;
+}
+
+void CWallet::MarkBalancesDirty() const
+{
+    LOCK(cs_wallet);
+    fBalancesCached = false;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nTrusted;
+}
+
+CAmount CWallet::GetUnconfirmedBalance() const
+{
+    return GetBalances().nUnconfirmed;
+}
+
+CAmount CWallet::GetImmatureBalance() const
+{
+    return GetBalances().nImmature;
+}
+
+CAmount CWallet::GetWatchOnlyBalance() const
+{
+    return GetBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!CheckFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyImmature;
 }
 
 CAmount CWallet::GetAvailableBalance(const CCoinControl *coinControl) const
@@ -7587,6 +8243,8 @@ void CWallet::UpdatedTransaction(const uint256 &hashTx)
         // Only notify UI if this transaction is in this wallet
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end()) {
+            // Mempool eviction changes whether the transaction counts as trusted
+            MarkBalancesStale(mi->second);
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
             NotifyBalanceChanged();
         }
@@ -7982,6 +8640,8 @@ void CWallet::getZAddressBalances(std::map<libzcash::PaymentAddress, CAmount> &b
 
 
 bool CWallet::SaplingWalletGetMerklePathOfNote(const uint256 txid, int outidx, libzcash::MerklePath &merklePath) {
+    if (fBuilingWitnessCache)
+        return false;
     return saplingWallet.GetMerklePathOfNote(txid, outidx, merklePath);
 }
 
@@ -7990,6 +8650,10 @@ bool CWallet::SaplingWalletGetPathRootWithCMU(libzcash::MerklePath &merklePath,
 }
 
 void CWallet::SaplingWalletReset() {
+   //Drops a rebuild started before the reset, the caller owns the Sapling wallet now
+   nSaplingWalletGeneration++;
+   nSaplingRebuildHeight = -1;
+   fBuilingWitnessCache = false;
    saplingWallet.Reset();
    CWalletDB(strWalletFile).WriteSaplingWitnesses(saplingWallet);
 }
@@ -8004,7 +8668,7 @@ void CWallet::GetFilteredNotes(
     std::string address,
     int minDepth,
     bool ignoreSpent,
-    bool requireSpendingKey)
+    bool requireSpendingKey) const
 {
     std::set<PaymentAddress> filterAddresses;
 
@@ -8028,129 +8692,93 @@ void CWallet::GetFilteredNotes(
     int maxDepth,
     bool ignoreSpent,
     bool requireSpendingKey,
-    bool ignoreLocked)
+    bool ignoreLocked) const
 {
     LOCK2(cs_main, cs_wallet);
 
-    for (auto & p : mapWallet) {
-        CWalletTx wtx = p.second;
-
-        // Filter the transactions before checking for notes
-        if (!CheckFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0)
-            continue;
+    // Transaction level filters are shared by every note of a transaction,
+    // evaluate them once per call. A depth of -1 marks a filtered transaction.
+    std::map<uint256, int> mapTxDepth;
+    auto getTxDepth = [&](const CWalletTx& wtx) -> int {
+        auto it = mapTxDepth.find(wtx.GetHash());
+        if (it != mapTxDepth.end())
+            return it->second;
+
+        int nDepth = -1;
+        if (CheckFinalTx(wtx) && wtx.GetBlocksToMaturity() <= 0) {
+            int nTxDepth = wtx.GetDepthInMainChain();
+            int nFilterDepth = nTxDepth;
+            if (minDepth > 1) {
+                nFilterDepth = komodo_dpowconfs(tx_height(wtx.GetHash()), nTxDepth);
+            }
+            if (nFilterDepth >= minDepth && nFilterDepth <= maxDepth)
+                nDepth = nTxDepth;
+        }
+        mapTxDepth.emplace(wtx.GetHash(), nDepth);
+        return nDepth;
+    };
+
+    std::map<libzcash::SaplingIncomingViewingKey, bool> mapHaveSpendingKey;
+    auto haveSpendingKey = [&](const libzcash::SaplingIncomingViewingKey& ivk) -> bool {
+        auto it = mapHaveSpendingKey.find(ivk);
+        if (it != mapHaveSpendingKey.end())
+            return it->second;
 
-        if (minDepth > 1) {
-            int nHeight    = tx_height(wtx.GetHash());
-            int nDepth     = wtx.GetDepthInMainChain();
-            int dpowconfs  = komodo_dpowconfs(nHeight,nDepth);
-            if ( dpowconfs < minDepth || dpowconfs > maxDepth) {
-                continue;
-            }
-        } else {
-            if ( wtx.GetDepthInMainChain() < minDepth ||
-                wtx.GetDepthInMainChain() > maxDepth) {
-                continue;
-            }
-        }
+        libzcash::SaplingExtendedFullViewingKey extfvk;
+        bool fHave = GetSaplingFullViewingKey(ivk, extfvk) && HaveSaplingSpendingKey(extfvk);
+        mapHaveSpendingKey.emplace(ivk, fHave);
+        return fHave;
+    };
+
+    auto addSaplingNote = [&](const SaplingOutPoint& op, const SaplingNoteCacheEntry& entry) {
+        auto wit = mapWallet.find(op.hash);
+        if (wit == mapWallet.end())
+            return;
+        const CWalletTx& wtx = wit->second;
 
-        // for (auto & pair : wtx.mapSproutNoteData) {
-        //     JSOutPoint jsop = pair.first;
-        //     SproutNoteData nd = pair.second;
-        //     SproutPaymentAddress pa = nd.address;
-        //
-        //     // skip notes which belong to a different payment address in the wallet
-        //     if (!(filterAddresses.empty() || filterAddresses.count(pa))) {
-        //         continue;
-        //     }
-        //
-        //     // skip note which has been spent
-        //     if (ignoreSpent && nd.nullifier && IsSproutSpent(*nd.nullifier)) {
-        //         continue;
-        //     }
-        //
-        //     // skip notes which cannot be spent
-        //     if (requireSpendingKey && !HaveSproutSpendingKey(pa)) {
-        //         continue;
-        //     }
-        //
-        //     // skip locked notes
-        //     if (ignoreLocked && IsLockedNote(jsop)) {
-        //         continue;
-        //     }
-        //
-        //     int i = jsop.js; // Index into CTransaction.vjoinsplit
-        //     int j = jsop.n; // Index into JSDescription.ciphertexts
-        //
-        //     // Get cached decryptor
-        //     ZCNoteDecryption decryptor;
-        //     if (!GetNoteDecryptor(pa, decryptor)) {
-        //         // Note decryptors are created when the wallet is loaded, so it should always exist
-        //         throw std::runtime_error(strprintf("Could not find note decryptor for payment address %s", EncodePaymentAddress(pa)));
-        //     }
-        //
-        //     // determine amount of funds in the note
-        //     auto hSig = wtx.vjoinsplit[i].h_sig(*pzcashParams, wtx.joinSplitPubKey);
-        //     try {
-        //         SproutNotePlaintext plaintext = SproutNotePlaintext::decrypt(
-        //                 decryptor,
-        //                 wtx.vjoinsplit[i].ciphertexts[j],
-        //                 wtx.vjoinsplit[i].ephemeralKey,
-        //                 hSig,
-        //                 (unsigned char) j);
-        //
-        //         sproutEntries.push_back(CSproutNotePlaintextEntry{jsop, pa, plaintext, wtx.GetDepthInMainChain()});
-        //
-        //     } catch (const note_decryption_failed &err) {
-        //         // Couldn't decrypt with this spending key
-        //         throw std::runtime_error(strprintf("Could not decrypt note for payment address %s", EncodePaymentAddress(pa)));
-        //     } catch (const std::exception &exc) {
-        //         // Unexpected failure
-        //         throw std::runtime_error(strprintf("Error while decrypting note for payment address %s: %s", EncodePaymentAddress(pa), exc.what()));
-        //     }
-        // }
+        auto nit = wtx.mapSaplingNoteData.find(op);
+        if (nit == wtx.mapSaplingNoteData.end())
+            return;
+        const SaplingNoteData& nd = nit->second;
 
-        for (auto & pair : wtx.mapSaplingNoteData) {
-            SaplingOutPoint op = pair.first;
-            SaplingNoteData nd = pair.second;
+        int nDepth = getTxDepth(wtx);
+        if (nDepth < 0)
+            return;
 
-            auto optDeserialized = SaplingNotePlaintext::attempt_sapling_enc_decryption_deserialization(wtx.vShieldedOutput[op.n].encCiphertext, nd.ivk, wtx.vShieldedOutput[op.n].ephemeralKey);
+        if (ignoreSpent && nd.nullifier && IsSaplingSpent(*nd.nullifier))
+            return;
 
-            // The transaction would not have entered the wallet unless
-            // its plaintext had been successfully decrypted previously.
-            assert(optDeserialized != boost::none);
+        // skip notes which cannot be spent
+        if (requireSpendingKey && !haveSpendingKey(nd.ivk))
+            return;
 
-            auto notePt = optDeserialized.get();
-            auto maybe_pa = nd.ivk.address(notePt.d);
-            assert(static_cast<bool>(maybe_pa));
-            auto pa = maybe_pa.get();
+        // skip locked notes
+        if (ignoreLocked && IsLockedNote(op))
+            return;
 
-            // skip notes which belong to a different payment address in the wallet
-            if (!(filterAddresses.empty() || filterAddresses.count(pa))) {
-                continue;
-            }
+        saplingEntries.push_back(SaplingNoteEntry {
+            op, entry.address, entry.note, entry.memo, nDepth });
+    };
 
-            if (ignoreSpent && nd.nullifier && IsSaplingSpent(*nd.nullifier)) {
+    if (filterAddresses.empty()) {
+        for (const auto& item : mapSaplingNoteCache) {
+            addSaplingNote(item.first, item.second);
+        }
+    } else {
+        // Only visit the notes of the requested addresses, in outpoint order
+        std::set<SaplingOutPoint> setOutPoints;
+        for (const PaymentAddress& address : filterAddresses) {
+            const libzcash::SaplingPaymentAddress* pSaplingAddress = boost::get<libzcash::SaplingPaymentAddress>(&address);
+            if (pSaplingAddress == nullptr)
                 continue;
-            }
-
-            // skip notes which cannot be spent
-            if (requireSpendingKey) {
-                libzcash::SaplingExtendedFullViewingKey extfvk;
-                if (!(GetSaplingFullViewingKey(nd.ivk, extfvk) &&
-                    HaveSaplingSpendingKey(extfvk))) {
-                    continue;
-                }
-            }
-
-            // skip locked notes
-            // TODO: Add locking for Sapling notes -> done
-             if (ignoreLocked && IsLockedNote(op)) {
-                 continue;
-             }
-
-            auto note = notePt.note(nd.ivk).get();
-            saplingEntries.push_back(SaplingNoteEntry {
-                op, pa, note, notePt.memo(), wtx.GetDepthInMainChain() });
+            auto ait = mapSaplingNotesByAddress.find(*pSaplingAddress);
+            if (ait != mapSaplingNotesByAddress.end())
+                setOutPoints.insert(ait->second.begin(), ait->second.end());
+        }
+        for (const SaplingOutPoint& op : setOutPoints) {
+            auto it = mapSaplingNoteCache.find(op);
+            if (it != mapSaplingNoteCache.end())
+                addSaplingNote(it->first, it->second);
         }
     }
 }
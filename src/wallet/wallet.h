@@ -69,6 +69,7 @@ extern bool fPayAtLeastCustomFee;
 extern bool fWalletRbf;
 extern bool fTxDeleteEnabled;
 extern bool fTxConflictDeleteEnabled;
+extern bool fCheckWalletBalances;
 extern int fDeleteInterval;
 extern unsigned int fDeleteTransactionsAfterNBlocks;
 extern unsigned int fKeepLastNTransactions;
@@ -418,6 +419,18 @@ struct SaplingNoteEntry
     int confirmations;
 };
 
+/** Decrypted plaintext of a wallet Sapling note, kept in memory so queries don't re-decrypt it. */
+struct SaplingNoteCacheEntry
+{
+    libzcash::SaplingPaymentAddress address;
+    libzcash::SaplingNote note;
+    std::array<unsigned char, ZC_MEMO_SIZE> memo;
+
+    SaplingNoteCacheEntry(const libzcash::SaplingPaymentAddress& addressIn, const libzcash::SaplingNote& noteIn,
+                          const std::array<unsigned char, ZC_MEMO_SIZE>& memoIn) :
+        address(addressIn), note(noteIn), memo(memoIn) {}
+};
+
 /** A transaction with a merkle branch linking it to the block chain. */
 class CMerkleTx : public CTransaction
 {
@@ -824,6 +837,71 @@ private:
 };
 
 
+/**
+ * Wallet balances by confirmation class and pool. Transparent amounts follow
+ * GetBalance/GetUnconfirmedBalance/GetImmatureBalance, Sapling amounts are the
+ * unspent notes with at least one (trusted) or zero (unconfirmed) confirmations.
+ * Notes without a spending key are reported as watch-only.
+ */
+struct CWalletBalances
+{
+    CAmount nTrusted = 0;
+    CAmount nUnconfirmed = 0;
+    CAmount nImmature = 0;
+    CAmount nWatchOnlyTrusted = 0;
+    CAmount nWatchOnlyUnconfirmed = 0;
+    CAmount nWatchOnlyImmature = 0;
+    CAmount nSaplingTrusted = 0;
+    CAmount nSaplingUnconfirmed = 0;
+    CAmount nSaplingWatchOnlyTrusted = 0;
+    CAmount nSaplingWatchOnlyUnconfirmed = 0;
+
+    friend bool operator==(const CWalletBalances& a, const CWalletBalances& b) {
+        return a.nTrusted == b.nTrusted && a.nUnconfirmed == b.nUnconfirmed && a.nImmature == b.nImmature &&
+               a.nWatchOnlyTrusted == b.nWatchOnlyTrusted && a.nWatchOnlyUnconfirmed == b.nWatchOnlyUnconfirmed &&
+               a.nWatchOnlyImmature == b.nWatchOnlyImmature &&
+               a.nSaplingTrusted == b.nSaplingTrusted && a.nSaplingUnconfirmed == b.nSaplingUnconfirmed &&
+               a.nSaplingWatchOnlyTrusted == b.nSaplingWatchOnlyTrusted &&
+               a.nSaplingWatchOnlyUnconfirmed == b.nSaplingWatchOnlyUnconfirmed;
+    }
+
+    friend bool operator!=(const CWalletBalances& a, const CWalletBalances& b) {
+        return !(a == b);
+    }
+
+    CWalletBalances& operator+=(const CWalletBalances& b) {
+        nTrusted += b.nTrusted;
+        nUnconfirmed += b.nUnconfirmed;
+        nImmature += b.nImmature;
+        nWatchOnlyTrusted += b.nWatchOnlyTrusted;
+        nWatchOnlyUnconfirmed += b.nWatchOnlyUnconfirmed;
+        nWatchOnlyImmature += b.nWatchOnlyImmature;
+        nSaplingTrusted += b.nSaplingTrusted;
+        nSaplingUnconfirmed += b.nSaplingUnconfirmed;
+        nSaplingWatchOnlyTrusted += b.nSaplingWatchOnlyTrusted;
+        nSaplingWatchOnlyUnconfirmed += b.nSaplingWatchOnlyUnconfirmed;
+        return *this;
+    }
+
+    CWalletBalances& operator-=(const CWalletBalances& b) {
+        nTrusted -= b.nTrusted;
+        nUnconfirmed -= b.nUnconfirmed;
+        nImmature -= b.nImmature;
+        nWatchOnlyTrusted -= b.nWatchOnlyTrusted;
+        nWatchOnlyUnconfirmed -= b.nWatchOnlyUnconfirmed;
+        nWatchOnlyImmature -= b.nWatchOnlyImmature;
+        nSaplingTrusted -= b.nSaplingTrusted;
+        nSaplingUnconfirmed -= b.nSaplingUnconfirmed;
+        nSaplingWatchOnlyTrusted -= b.nSaplingWatchOnlyTrusted;
+        nSaplingWatchOnlyUnconfirmed -= b.nSaplingWatchOnlyUnconfirmed;
+        return *this;
+    }
+
+    bool IsNull() const {
+        return *this == CWalletBalances();
+    }
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -944,6 +1022,18 @@ public:
     void IncrementSaplingWallet(const CBlockIndex* pindex);
     void DecrementSaplingWallet(const CBlockIndex* pindex);
 
+    /**
+     * Replay the note commitments of the active chain from nStartHeight into a new
+     * Sapling wallet, starting from the frontier of the chain below it, and swap it
+     * in once it reached pindexStop or the tip. The locks are only taken per block.
+     * Returns false if a reorg, a shutdown or a reset of the Sapling wallet since
+     * nGeneration interrupted the replay.
+     */
+    bool RebuildSaplingWallet(int nStartHeight, const CBlockIndex* pindexStop, int nGeneration);
+    /** Take a rebuild requested by IncrementSaplingWallet, used by the witness thread */
+    bool GetSaplingWalletRebuild(int& nStartHeight, int& nGeneration);
+    bool IsSaplingWalletGeneration(int nGeneration);
+
 
 protected:
 
@@ -1214,6 +1304,38 @@ protected:
      */
     SaplingWallet saplingWallet;
     bool saplingWalletValidated = false;
+    /* Set while ScanForWalletTransactions owns Sapling wallet updates, guarded by cs_wallet */
+    bool fRescanning = false;
+    /* Bumped by every reset of the Sapling wallet so that a rebuild started before
+     * it is dropped, guarded by cs_wallet */
+    int nSaplingWalletGeneration = 0;
+    /* Start height of a rebuild waiting for the witness thread or -1, guarded by cs_wallet */
+    int nSaplingRebuildHeight = -1;
+
+    /* Wallet transactions of a block and the indexes of their Sapling notes */
+    std::map<uint256, std::set<int> > GetSaplingBlockNotes(const CBlock& block);
+    void SetSaplingNotePositions(const std::map<uint256, std::set<int> >& mapNotes,
+                                 const std::map<SaplingOutPoint, uint64_t>& mapPositions);
+
+    /* Balance ledger served by GetBalances, guarded by cs_wallet. It is the sum
+     * of the per transaction amounts in mapTxBalances. Events that can move
+     * funds between confirmation classes (transaction added, spent, conflicted
+     * or erased, block connected or disconnected) queue the transactions they
+     * touch in setTxBalancesStale, and the next query replaces their amounts.
+     * Transactions whose amounts follow the tip or the mempool without an
+     * event (unconfirmed, conflicted, immature or non-final) are kept in
+     * setTxBalancesPending and refreshed on every query. Key imports and
+     * MarkDirty rebuild the whole ledger.
+     */
+    mutable CWalletBalances cachedBalances;
+    mutable bool fBalancesCached = false;
+    mutable std::map<uint256, CWalletBalances> mapTxBalances;
+    mutable std::set<uint256> setTxBalancesStale;
+    mutable std::set<uint256> setTxBalancesPending;
+    CWalletBalances ComputeBalances() const;
+    CWalletBalances ComputeTxBalances(const CWalletTx& wtx) const;
+    void UpdateTxBalances(const uint256& hash) const;
+    void MarkBalancesStale(const CTransaction& tx) const;
 
     /* the hd chain data model (chain counters) */
     CHDChain hdChain;
@@ -1338,6 +1460,16 @@ public:
 
     std::map<uint256, SaplingOutPoint> mapSaplingNullifiersToNotes;
 
+    /**
+     * Decrypted Sapling notes of mapWallet, and the same outpoints grouped by
+     * payment address. Filled as transactions enter the wallet and pruned when
+     * they are erased, so GetFilteredNotes never has to trial-decrypt again.
+     * Spent state is not cached: it depends on the depth of the spending
+     * transaction and is resolved through mapSaplingNullifiersToNotes.
+     */
+    std::map<SaplingOutPoint, SaplingNoteCacheEntry> mapSaplingNoteCache;
+    std::map<libzcash::SaplingPaymentAddress, std::set<SaplingOutPoint>> mapSaplingNotesByAddress;
+
     std::map<uint256, CWalletTx> mapWallet;
     bool fRunSetBestChain = false;
 
@@ -1611,12 +1743,14 @@ public:
     void UpdateSproutNullifierNoteMapWithTx(CWalletTx& wtx);
     void UpdateSaplingNullifierNoteMapWithTx(CWalletTx* wtx);
     void UpdateNullifierNoteMapForBlock(const CBlock* pblock);
+    void CacheSaplingNotes(const CWalletTx& wtx);
+    void UncacheSaplingNotes(const uint256& hash);
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb, int nHeight, bool fRescan = false);
     bool EraseFromWallet(const uint256 &hash);
     void SyncTransactions(const std::vector<CTransaction> &vtx, const CBlock* pblock, const int nHeight);
     void ForceRescanWallet();
     void RescanWallet();
-    void AddToWalletIfInvolvingMe(const std::vector<CTransaction> &vtx, std::vector<CTransaction> &vAddedTxes, const CBlock* pblock, const int nHeight, bool fUpdate, std::set<libzcash::SaplingPaymentAddress>& addressesFound, bool fRescan = false);
+    void AddToWalletIfInvolvingMe(const std::vector<CTransaction> &vtx, std::vector<CTransaction> &vAddedTxes, const CBlock* pblock, const int nHeight, bool fUpdate, std::set<libzcash::SaplingPaymentAddress>& addressesFound, bool fRescan = false, const mapSaplingNoteData_t* pSaplingNoteData = NULL);
     void WitnessNoteCommitment(
          std::vector<uint256> commitments,
          std::vector<boost::optional<SproutWitness>>& witnesses,
@@ -1630,6 +1764,8 @@ public:
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime);
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime);
+    CWalletBalances GetBalances() const;
+    void MarkBalancesDirty() const;
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -1823,7 +1959,7 @@ public:
                           std::string address,
                           int minDepth=1,
                           bool ignoreSpent=true,
-                          bool requireSpendingKey=true);
+                          bool requireSpendingKey=true) const;
 
     /* Find notes filtered by payment addresses, min depth, max depth, if they are spent,
        if a spending key is required, and if they are locked */
@@ -1834,9 +1970,12 @@ public:
                           int maxDepth=INT_MAX,
                           bool ignoreSpent=true,
                           bool requireSpendingKey=true,
-                          bool ignoreLocked=true);
+                          bool ignoreLocked=true) const;
 };
 
+/** Run the Sapling wallet rebuilds requested by IncrementSaplingWallet in the background */
+void ThreadRebuildSaplingWallet(CWallet* pwallet);
+
 /** A key allocated from the key pool. */
 class CReserveKey
 {
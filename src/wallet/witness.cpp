@@ -74,7 +74,7 @@ UniValue getsaplingwitness(const UniValue& params, bool fHelp,  const CPubKey& m
 
   //Cycle through block and transactions build sapling tree until the commitment needed is reached
   CBlock pblock;
-  ReadBlockFromDisk(pblock, pblockindex, false);
+  ReadBlockFromDisk(pblock, pblockindex, false, false);
   for (const CTransaction& tx : pblock.vtx) {
       auto hash = tx.GetHash();
 
@@ -273,7 +273,7 @@ UniValue getsaplingwitnessatheight(const UniValue& params, bool fHelp,  const CP
 
   //Cycle through block and transactions build sapling tree until the commitment needed is reached
   CBlock pblock;
-  ReadBlockFromDisk(pblock, pblockindex, false);
+  ReadBlockFromDisk(pblock, pblockindex, false, false);
   for (const CTransaction& tx : pblock.vtx) {
       auto hash = tx.GetHash();
 
@@ -309,7 +309,7 @@ UniValue getsaplingwitnessatheight(const UniValue& params, bool fHelp,  const CP
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex, false))
+    if(!ReadBlockFromDisk(block, pblockindex, false, false))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
 
@@ -349,7 +349,8 @@ UniValue getsaplingblocks(const UniValue& params, bool fHelp,  const CPubKey& my
             + HelpExampleRpc("getsaplingblocks", "12800 1")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    // Only chain data is read, the wallet is not needed
+    LOCK(cs_main);
 
    int64_t nHeight = params[0].get_int64();
    int64_t nBlocks = params[1].get_int64();
@@ -388,7 +389,7 @@ UniValue getsaplingblocks(const UniValue& params, bool fHelp,  const CPubKey& my
       if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
           throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-      if(!ReadBlockFromDisk(block, pblockindex, false))
+      if(!ReadBlockFromDisk(block, pblockindex, false, false))
           throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
       jsonblock.push_back(Pair("hash", block.GetHash().GetHex()));
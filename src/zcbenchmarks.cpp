@@ -1,6 +1,8 @@
 #include <cstdio>
 #include <future>
 #include <map>
+#include <numeric>
+#include <random>
 #include <thread>
 #include <unistd.h>
 #include <boost/filesystem.hpp>
@@ -10,6 +12,7 @@
 #include "init.h"
 #include "primitives/transaction.h"
 #include "base58.h"
+#include "blockfilereader.h"
 #include "crypto/equihash.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -17,11 +20,16 @@
 #include "consensus/validation.h"
 #include "main.h"
 #include "miner.h"
+#include "net.h"
+#include "netbase.h"
+#include "netpoller.h"
 #include "pow.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "script/sign.h"
 #include "sodium.h"
 #include "streams.h"
+#include "threadpool.h"
 #include "txdb.h"
 #include "utiltest.h"
 #include "wallet/wallet.h"
@@ -225,6 +233,74 @@ double benchmark_verify_equihash()
     return timer_stop(tv_start);
 }
 
+double benchmark_verify_equihash_parallel(size_t nHeaders, double& serialTime, double& legacyTime)
+{
+    const CChainParams& params = Params(CBaseChainParams::MAIN);
+    CBlockHeader genesis_header = params.GenesisBlock().GetBlockHeader();
+    std::vector<CBlockHeader> vHeaders(nHeaders, genesis_header);
+    unsigned int n = params.EquihashN();
+    unsigned int k = params.EquihashK();
+
+    // As every header used to be checked: fresh state and serialization per header
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (const CBlockHeader& header : vHeaders) {
+        crypto_generichash_blake2b_state state;
+        EhInitialiseState(n, k, state);
+        CEquihashInput I{header};
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << I;
+        ss << header.nNonce;
+        crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+        bool isValid;
+        EhIsValidSolution(n, k, state, header.nSolution, isValid);
+        assert(isValid);
+    }
+    legacyTime = timer_stop(tv_start);
+
+    // One at a time on this thread with the per-thread base state
+    timer_start(tv_start);
+    for (const CBlockHeader& header : vHeaders) {
+        assert(CheckEquihashSolutions(std::vector<CBlockHeader>(1, header), params, false) < 0);
+    }
+    serialTime = timer_stop(tv_start);
+
+    // The whole batch on the validation thread pool, as for a headers message
+    timer_start(tv_start);
+    assert(CheckEquihashSolutions(vHeaders, params, false) < 0);
+    return timer_stop(tv_start);
+}
+
+double benchmark_read_blocks(int nBlocks, bool fRandom, int nMappedFiles, bool fCheckHash)
+{
+    std::vector<const CBlockIndex*> vIndex;
+    {
+        LOCK(cs_main);
+        int nHeight = chainActive.Height();
+        if (nHeight < 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "No blocks to read");
+        // The same pseudo-random heights for every variant being compared
+        std::mt19937 rng(nHeight);
+        for (int i = 0; i < nBlocks; i++) {
+            int h = fRandom ? rng() % (nHeight + 1) : std::max(nHeight - nBlocks + 1, 0) + i % (nHeight + 1);
+            if (chainActive[h]->nStatus & BLOCK_HAVE_DATA)
+                vIndex.push_back(chainActive[h]);
+        }
+    }
+
+    CBlockFileReader reader(nMappedFiles);
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (const CBlockIndex* pindex : vIndex) {
+        CBlock block;
+        if (!reader.ReadBlock(pindex->GetBlockPos(), block))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        if (fCheckHash && block.GetHash() != pindex->GetBlockHash())
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block hash doesn't match index");
+    }
+    return timer_stop(tv_start);
+}
+
 double benchmark_large_tx(size_t nInputs)
 {
     // Create priv/pub key
@@ -574,15 +650,31 @@ double benchmark_create_sapling_output()
     return t;
 }
 
-// Verify Sapling spend from testnet
+// Sapling spend and output from testnet
 // txid: abbd823cbd3d4e3b52023599d81a96b74817e95ce5bb58354f979156bd22ecc8
 // position: 0
-double benchmark_verify_sapling_spend()
+static SpendDescription benchmark_sapling_spend(uint256 &dataToBeSigned)
 {
     SpendDescription spend;
     CDataStream ss(ParseHex("8c6cf86bbb83bf0d075e5bd9bb4b5cd56141577be69f032880b11e26aa32aa5ef09fd00899e4b469fb11f38e9d09dc0379f0b11c23b5fe541765f76695120a03f0261d32af5d2a2b1e5c9a04200cd87d574dc42349de9790012ce560406a8a876a1e54cfcdc0eb74998abec2a9778330eeb2a0ac0e41d0c9ed5824fbd0dbf7da930ab299966ce333fd7bc1321dada0817aac5444e02c754069e218746bf879d5f2a20a8b028324fb2c73171e63336686aa5ec2e6e9a08eb18b87c14758c572f4531ccf6b55d09f44beb8b47563be4eff7a52598d80959dd9c9fee5ac4783d8370cb7d55d460053d3e067b5f9fe75ff2722623fb1825fcba5e9593d4205b38d1f502ff03035463043bd393a5ee039ce75a5d54f21b395255df6627ef96751566326f7d4a77d828aa21b1827282829fcbc42aad59cdb521e1a3aaa08b99ea8fe7fff0a04da31a52260fc6daeccd79bb877bdd8506614282258e15b3fe74bf71a93f4be3b770119edf99a317b205eea7d5ab800362b97384273888106c77d633600"), SER_NETWORK, PROTOCOL_VERSION);
     ss >> spend;
-    uint256 dataToBeSigned = uint256S("0x2dbf83fe7b88a7cbd80fac0c719483906bb9a0c4fc69071e4780d5f2c76e592c");
+    dataToBeSigned = uint256S("0x2dbf83fe7b88a7cbd80fac0c719483906bb9a0c4fc69071e4780d5f2c76e592c");
+    return spend;
+}
+
+static OutputDescription benchmark_sapling_output()
+{
+    OutputDescription output;
+    CDataStream ss(ParseHex("edd742af18857e5ec2d71d346a7fe2ac97c137339bd5268eea86d32e0ff4f38f76213fa8cfed3347ac4e8572dd88aff395c0c10a59f8b3f49d2bc539ed6c726667e29d4763f914ddd0abf1cdfa84e44de87c233434c7e69b8b5b8f4623c8aa444163425bae5cef842972fed66046c1c6ce65c866ad894d02e6e6dcaae7a962d9f2ef95757a09c486928e61f0f7aed90ad0a542b0d3dc5fe140dfa7626b9315c77e03b055f19cbacd21a866e46f06c00e0c7792b2a590a611439b510a9aaffcf1073bad23e712a9268b36888e3727033eee2ab4d869f54a843f93b36ef489fb177bf74b41a9644e5d2a0a417c6ac1c8869bc9b83273d453f878ed6fd96b82a5939903f7b64ecaf68ea16e255a7fb7cc0b6d8b5608a1c6b0ed3024cc62c2f0f9c5cfc7b431ae6e9d40815557aa1d010523f9e1960de77b2274cb6710d229d475c87ae900183206ba90cb5bbc8ec0df98341b82726c705e0308ca5dc08db4db609993a1046dfb43dfd8c760be506c0bed799bb2205fc29dc2e654dce731034a23b0aaf6da0199248702ee0523c159f41f4cbfff6c35ace4dd9ae834e44e09c76a0cbdda1d3f6a2c75ad71212daf9575ab5f09ca148718e667f29ddf18c8a330a86ace18a86e89454653902aa393c84c6b694f27d0d42e24e7ac9fe34733de5ec15f5066081ce912c62c1a804a2bb4dedcef7cc80274f6bb9e89e2fce91dc50d6a73c8aefb9872f1cf3524a92626a0b8f39bbf7bf7d96ca2f770fc04d7f457021c536a506a187a93b2245471ddbfb254a71bc4a0d72c8d639a31c7b1920087ffca05c24214157e2e7b28184e91989ef0b14f9b34c3dc3cc0ac64226b9e337095870cb0885737992e120346e630a416a9b217679ce5a778fb15779c136bcecca5efe79012013d77d90b4e99dd22c8f35bc77121716e160d05bd30d288ee8886390ee436f85bdc9029df888a3a3326d9d4ddba5cb5318b3274928829d662e96fea1d601f7a306251ed8c6cc4e5a3a7a98c35a3650482a0eee08f3b4c2da9b22947c96138f1505c2f081f8972d429f3871f32bef4aaa51aa6945df8e9c9760531ac6f627d17c1518202818a91ca304fb4037875c666060597976144fcbbc48a776a2c61beb9515fa8f3ae6d3a041d320a38a8ac75cb47bb9c866ee497fc3cd13299970c4b369c1c2ceb4220af082fbecdd8114492a8e4d713b5a73396fd224b36c1185bd5e20d683e6c8db35346c47ae7401988255da7cfffdced5801067d4d296688ee8fe424b4a8a69309ce257eefb9345ebfda3f6de46bb11ec94133e1f72cd7ac54934d6cf17b3440800e70b80ebc7c7bfc6fb0fc2c"), SER_NETWORK, PROTOCOL_VERSION);
+    ss >> output;
+    return output;
+}
+
+// Verify Sapling spend from testnet
+double benchmark_verify_sapling_spend()
+{
+    uint256 dataToBeSigned;
+    SpendDescription spend = benchmark_sapling_spend(dataToBeSigned);
 
     auto ctx = librustzcash_sapling_verification_ctx_init();
 
@@ -609,13 +701,9 @@ double benchmark_verify_sapling_spend()
 }
 
 // Verify Sapling output from testnet
-// txid: abbd823cbd3d4e3b52023599d81a96b74817e95ce5bb58354f979156bd22ecc8
-// position: 0
 double benchmark_verify_sapling_output()
 {
-    OutputDescription output;
-    CDataStream ss(ParseHex("edd742af18857e5ec2d71d346a7fe2ac97c137339bd5268eea86d32e0ff4f38f76213fa8cfed3347ac4e8572dd88aff395c0c10a59f8b3f49d2bc539ed6c726667e29d4763f914ddd0abf1cdfa84e44de87c233434c7e69b8b5b8f4623c8aa444163425bae5cef842972fed66046c1c6ce65c866ad894d02e6e6dcaae7a962d9f2ef95757a09c486928e61f0f7aed90ad0a542b0d3dc5fe140dfa7626b9315c77e03b055f19cbacd21a866e46f06c00e0c7792b2a590a611439b510a9aaffcf1073bad23e712a9268b36888e3727033eee2ab4d869f54a843f93b36ef489fb177bf74b41a9644e5d2a0a417c6ac1c8869bc9b83273d453f878ed6fd96b82a5939903f7b64ecaf68ea16e255a7fb7cc0b6d8b5608a1c6b0ed3024cc62c2f0f9c5cfc7b431ae6e9d40815557aa1d010523f9e1960de77b2274cb6710d229d475c87ae900183206ba90cb5bbc8ec0df98341b82726c705e0308ca5dc08db4db609993a1046dfb43dfd8c760be506c0bed799bb2205fc29dc2e654dce731034a23b0aaf6da0199248702ee0523c159f41f4cbfff6c35ace4dd9ae834e44e09c76a0cbdda1d3f6a2c75ad71212daf9575ab5f09ca148718e667f29ddf18c8a330a86ace18a86e89454653902aa393c84c6b694f27d0d42e24e7ac9fe34733de5ec15f5066081ce912c62c1a804a2bb4dedcef7cc80274f6bb9e89e2fce91dc50d6a73c8aefb9872f1cf3524a92626a0b8f39bbf7bf7d96ca2f770fc04d7f457021c536a506a187a93b2245471ddbfb254a71bc4a0d72c8d639a31c7b1920087ffca05c24214157e2e7b28184e91989ef0b14f9b34c3dc3cc0ac64226b9e337095870cb0885737992e120346e630a416a9b217679ce5a778fb15779c136bcecca5efe79012013d77d90b4e99dd22c8f35bc77121716e160d05bd30d288ee8886390ee436f85bdc9029df888a3a3326d9d4ddba5cb5318b3274928829d662e96fea1d601f7a306251ed8c6cc4e5a3a7a98c35a3650482a0eee08f3b4c2da9b22947c96138f1505c2f081f8972d429f3871f32bef4aaa51aa6945df8e9c9760531ac6f627d17c1518202818a91ca304fb4037875c666060597976144fcbbc48a776a2c61beb9515fa8f3ae6d3a041d320a38a8ac75cb47bb9c866ee497fc3cd13299970c4b369c1c2ceb4220af082fbecdd8114492a8e4d713b5a73396fd224b36c1185bd5e20d683e6c8db35346c47ae7401988255da7cfffdced5801067d4d296688ee8fe424b4a8a69309ce257eefb9345ebfda3f6de46bb11ec94133e1f72cd7ac54934d6cf17b3440800e70b80ebc7c7bfc6fb0fc2c"), SER_NETWORK, PROTOCOL_VERSION);
-    ss >> output;
+    OutputDescription output = benchmark_sapling_output();
 
     auto ctx = librustzcash_sapling_verification_ctx_init();
 
@@ -637,3 +725,345 @@ double benchmark_verify_sapling_output()
     }
     return timer_stop(tv_start);
 }
+
+// Verify nProofs Sapling spends and nProofs Sapling outputs, either one
+// verification context per description (as the per-item block workers do) or
+// with a single batch verifier.
+double benchmark_verify_sapling_batch(size_t nProofs, bool fBatched)
+{
+    uint256 dataToBeSigned;
+    SpendDescription spend = benchmark_sapling_spend(dataToBeSigned);
+    OutputDescription output = benchmark_sapling_output();
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+
+    bool result = true;
+    if (fBatched) {
+        auto ctx = librustzcash_sapling_batch_verifier_init();
+        for (size_t i = 0; result && i < nProofs; i++) {
+            result = librustzcash_sapling_batch_verifier_queue_spend(
+                        ctx,
+                        spend.cv.begin(),
+                        spend.anchor.begin(),
+                        spend.nullifier.begin(),
+                        spend.rk.begin(),
+                        spend.zkproof.begin(),
+                        spend.spendAuthSig.begin(),
+                        dataToBeSigned.begin()
+                    ) && librustzcash_sapling_batch_verifier_queue_output(
+                        ctx,
+                        output.cv.begin(),
+                        output.cmu.begin(),
+                        output.ephemeralKey.begin(),
+                        output.zkproof.begin()
+                    );
+        }
+        if (result) {
+            result = librustzcash_sapling_batch_verifier_validate(ctx);
+        } else {
+            librustzcash_sapling_batch_verifier_free(ctx);
+        }
+    } else {
+        for (size_t i = 0; result && i < nProofs; i++) {
+            auto ctx = librustzcash_sapling_verification_ctx_init();
+            result = librustzcash_sapling_check_spend(
+                        ctx,
+                        spend.cv.begin(),
+                        spend.anchor.begin(),
+                        spend.nullifier.begin(),
+                        spend.rk.begin(),
+                        spend.zkproof.begin(),
+                        spend.spendAuthSig.begin(),
+                        dataToBeSigned.begin()
+                    );
+            librustzcash_sapling_verification_ctx_free(ctx);
+
+            if (result) {
+                ctx = librustzcash_sapling_verification_ctx_init();
+                result = librustzcash_sapling_check_output(
+                            ctx,
+                            output.cv.begin(),
+                            output.cmu.begin(),
+                            output.ephemeralKey.begin(),
+                            output.zkproof.begin()
+                        );
+                librustzcash_sapling_verification_ctx_free(ctx);
+            }
+        }
+    }
+
+    double t = timer_stop(tv_start);
+    if (!result) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Sapling proof verification should return true");
+    }
+    return t;
+}
+
+// Look up the same cached signature nLookups times from each of nThreads
+// threads, as the script check threads do when connecting a block whose
+// transactions were already accepted to the mempool.
+double benchmark_sigcache_lookups(int nThreads, int nLookups)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 sighash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    if (!key.Sign(sighash, vchSig)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Signing failed");
+    }
+
+    CTransaction tx;
+    PrecomputedTransactionData txdata(tx);
+    CachingTransactionSignatureChecker checker(&tx, 0, 0, true, txdata);
+
+    // Populate the cache
+    if (!checker.VerifySignature(vchSig, pubkey, sighash)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Signature should be valid");
+    }
+
+    std::atomic<bool> fAllValid(true);
+    std::vector<std::thread> threads;
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < nLookups; j++) {
+                if (!checker.VerifySignature(vchSig, pubkey, sighash)) {
+                    fAllValid = false;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    double t = timer_stop(tv_start);
+    if (!fAllValid) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Cached signature should be valid");
+    }
+    return t;
+}
+
+/**
+ * Dispatch nRounds rounds of maxProcessingThreads small tasks, the way block
+ * validation hands out its Sapling batches, either by creating a thread per
+ * task with std::async or through the shared validation pool.
+ */
+double benchmark_task_dispatch(int nRounds, bool fPool)
+{
+    int nTasks = std::max(maxProcessingThreads, 1);
+    std::atomic<uint64_t> nSum(0);
+    auto work = [&nSum](int n) {
+        uint64_t x = n;
+        for (int i = 0; i < 1000; i++) {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        nSum += x;
+        return true;
+    };
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+
+    for (int r = 0; r < nRounds; r++) {
+        std::vector<std::future<bool>> vFutures;
+        if (fPool) {
+            CTaskGroup group(GetValidationThreadPool());
+            for (int i = 0; i < nTasks; i++) {
+                vFutures.emplace_back(group.Submit([&work, i]() { return work(i); }));
+            }
+            group.Wait();
+        } else {
+            for (int i = 0; i < nTasks; i++) {
+                vFutures.emplace_back(std::async(std::launch::async, work, i));
+            }
+            for (auto& future : vFutures) {
+                future.wait();
+            }
+        }
+        for (auto& future : vFutures) {
+            future.get();
+        }
+    }
+
+    return timer_stop(tv_start);
+}
+
+#ifndef WIN32
+// Drive the TLS handshake of both ends of a socketpair from one thread
+static bool HandshakeSocketPair(SSL* sslLocal, SSL* sslRemote)
+{
+    bool fLocalDone = false, fRemoteDone = false;
+    for (int i = 0; i < 1000 && !(fLocalDone && fRemoteDone); i++) {
+        if (!fLocalDone) {
+            int ret = SSL_do_handshake(sslLocal);
+            int err = SSL_get_error(sslLocal, ret);
+            if (ret == 1)
+                fLocalDone = true;
+            else if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+                return false;
+        }
+        if (!fRemoteDone) {
+            int ret = SSL_do_handshake(sslRemote);
+            int err = SSL_get_error(sslRemote, ret);
+            if (ret == 1)
+                fRemoteDone = true;
+            else if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+                return false;
+        }
+    }
+    return fLocalDone && fRemoteDone;
+}
+#endif
+
+double benchmark_socket_poller(const std::string& strBackend, bool fTLS, int nPeers, int nSeconds,
+                               int& nServed, uint64_t& nMessages,
+                               double& cpuPercent, double& avgLatencyUs, double& p99LatencyUs)
+{
+#ifdef WIN32
+    throw std::runtime_error("The socketpoller benchmark needs socketpair()");
+#else
+    if (fTLS && (tls_ctx_server == NULL || tls_ctx_client == NULL))
+        throw std::runtime_error("The TLS socketpoller benchmark needs the TLS contexts of the node");
+    std::unique_ptr<CSocketPoller> poller = MakeSocketPoller(strBackend);
+    // Both ends of every pair, plus headroom for the node itself
+    RaiseFileDescriptorLimit(2 * nPeers + 150);
+
+    // One socketpair per synthetic peer, the poller watches the first end.
+    // With TLS the first end accepts and the second end connects, like an
+    // inbound peer does.
+    std::vector<SOCKET> vLocal, vRemote;
+    std::map<SOCKET, SSL*> mapLocalSSL;
+    std::vector<SSL*> vRemoteSSL;
+    for (int i = 0; i < nPeers; i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            break;
+        if (!poller->IsServiceable(fds[0])) {
+            close(fds[0]);
+            close(fds[1]);
+            continue;
+        }
+        SOCKET hLocal = fds[0], hRemote = fds[1];
+        SetSocketNonBlocking(hLocal, true);
+        SetSocketNonBlocking(hRemote, true);
+        if (fTLS) {
+            SSL* sslLocal = SSL_new(tls_ctx_server);
+            SSL* sslRemote = SSL_new(tls_ctx_client);
+            SSL_set_fd(sslLocal, hLocal);
+            SSL_set_fd(sslRemote, hRemote);
+            SSL_set_accept_state(sslLocal);
+            SSL_set_connect_state(sslRemote);
+            if (!HandshakeSocketPair(sslLocal, sslRemote)) {
+                SSL_free(sslLocal);
+                SSL_free(sslRemote);
+                close(fds[0]);
+                close(fds[1]);
+                break;
+            }
+            mapLocalSSL[hLocal] = sslLocal;
+            vRemoteSSL.push_back(sslRemote);
+        }
+        vLocal.push_back(fds[0]);
+        vRemote.push_back(fds[1]);
+        poller->AddSocket(fds[0]);
+    }
+    nServed = vLocal.size();
+
+    // The remote ends send timestamps to randomly picked peers, idle peers stay
+    // in the watched set like they do on a busy node
+    std::atomic<bool> fStop(false);
+    std::thread sender([&]() {
+        uint32_t nRand = 1;
+        while (!fStop && !vRemote.empty()) {
+            nRand = nRand * 1664525 + 1013904223;
+            int64_t nNow = GetTimeMicros();
+            size_t nPeer = nRand % vRemote.size();
+            if (fTLS) {
+                // A TLS write that would block cannot be dropped, it has to be
+                // repeated with the same data
+                while (SSL_write(vRemoteSSL[nPeer], (const char*)&nNow, sizeof(nNow)) <= 0 && !fStop)
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+            } else if (send(vRemote[nPeer], (const char*)&nNow, sizeof(nNow), MSG_NOSIGNAL) < 0) {
+                // The peer's buffer is full, drop the message
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+
+    std::vector<int64_t> vLatencies;
+    std::vector<CSocketEvent> vInterest, vEvents;
+    for (SOCKET hSocket : vLocal)
+        vInterest.push_back(CSocketEvent(hSocket, true, false));
+
+    struct timespec cpu_start, cpu_stop;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    struct timeval tv_start;
+    timer_start(tv_start);
+    int64_t nEnd = GetTimeMillis() + nSeconds * 1000;
+
+    while (GetTimeMillis() < nEnd) {
+        vEvents.clear();
+        poller->Wait(50, vInterest, vEvents);
+        for (const CSocketEvent& event : vEvents) {
+            if (!event.fRecv)
+                continue;
+            // Whole 8-byte messages only, every write is one
+            int64_t buf[64];
+            ssize_t nBytes;
+            if (fTLS) {
+                // Like TLSManager::threadSocketHandler: edge triggered pollers
+                // read until SSL_read wants more, select() reads once per event
+                SSL* ssl = mapLocalSSL[event.hSocket];
+                do {
+                    nBytes = SSL_read(ssl, (char*)buf, sizeof(buf));
+                    if (nBytes <= 0)
+                        break;
+                    int64_t nNow = GetTimeMicros();
+                    for (size_t i = 0; i < (size_t)nBytes / sizeof(int64_t); i++)
+                        vLatencies.push_back(nNow - buf[i]);
+                } while (poller->IsEdgeTriggered());
+                if (nBytes <= 0 && !poller->IsEdgeTriggered() && SSL_get_error(ssl, nBytes) == SSL_ERROR_WANT_READ)
+                    MilliSleep(1);
+                continue;
+            }
+            while ((nBytes = recv(event.hSocket, (char*)buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                int64_t nNow = GetTimeMicros();
+                for (size_t i = 0; i < (size_t)nBytes / sizeof(int64_t); i++)
+                    vLatencies.push_back(nNow - buf[i]);
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_stop);
+    double elapsed = timer_stop(tv_start);
+    fStop = true;
+    sender.join();
+    for (const std::pair<SOCKET, SSL*>& item : mapLocalSSL)
+        SSL_free(item.second);
+    for (SSL* ssl : vRemoteSSL)
+        SSL_free(ssl);
+    for (size_t i = 0; i < vLocal.size(); i++) {
+        poller->RemoveSocket(vLocal[i]);
+        close(vLocal[i]);
+        close(vRemote[i]);
+    }
+
+    double cpu = (cpu_stop.tv_sec - cpu_start.tv_sec) + (cpu_stop.tv_nsec - cpu_start.tv_nsec) / 1e9;
+    cpuPercent = 100.0 * cpu / elapsed;
+    nMessages = vLatencies.size();
+    avgLatencyUs = p99LatencyUs = 0;
+    if (!vLatencies.empty()) {
+        avgLatencyUs = std::accumulate(vLatencies.begin(), vLatencies.end(), 0.0) / vLatencies.size();
+        std::vector<int64_t>::iterator p99 = vLatencies.begin() + vLatencies.size() * 99 / 100;
+        std::nth_element(vLatencies.begin(), p99, vLatencies.end());
+        p99LatencyUs = *p99;
+    }
+    return elapsed;
+#endif
+}
@@ -12,7 +12,9 @@ extern double benchmark_solve_equihash();
 extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads);
 // extern double benchmark_verify_joinsplit(const JSDescription &joinsplit);
 extern double benchmark_verify_equihash();
+extern double benchmark_verify_equihash_parallel(size_t nHeaders, double& serialTime, double& legacyTime);
 extern double benchmark_large_tx(size_t nInputs);
+extern double benchmark_read_blocks(int nBlocks, bool fRandom, int nMappedFiles, bool fCheckHash);
 // extern double benchmark_try_decrypt_notes(size_t nAddrs);
 // extern double benchmark_increment_note_witnesses(size_t nTxs);
 extern double benchmark_connectblock_slow();
@@ -23,5 +25,11 @@ extern double benchmark_create_sapling_spend();
 extern double benchmark_create_sapling_output();
 extern double benchmark_verify_sapling_spend();
 extern double benchmark_verify_sapling_output();
+extern double benchmark_verify_sapling_batch(size_t nProofs, bool fBatched);
+extern double benchmark_sigcache_lookups(int nThreads, int nLookups);
+extern double benchmark_task_dispatch(int nRounds, bool fPool);
+extern double benchmark_socket_poller(const std::string& strBackend, bool fTLS, int nPeers, int nSeconds,
+                                      int& nServed, uint64_t& nMessages,
+                                      double& cpuPercent, double& avgLatencyUs, double& p99LatencyUs);
 
 #endif